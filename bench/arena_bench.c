@@ -0,0 +1,95 @@
+/* Benchmark for the graph arena
+ *
+ * Loads the same random graph into a graph using an arena and one using malloc,
+ *   and times loading and freeing each. Also times reloading an arena graph
+ *   after g_reset
+ *
+ * Call with arena_bench [relations]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/graph.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_RELATIONS 1000000
+#define NAME_SIZE 16
+
+// Milliseconds since some fixed point
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+// Load relations, each pair of names is greater then lesser
+static int load(Graph *graph, char (*names)[NAME_SIZE], int relations)
+{
+    for(int i = 0; i < relations; i++) {
+        int rc = g_apply_relation(graph, names[i * 2], names[i * 2 + 1]);
+        if(rc && rc != ERR_DUPLICATE) return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int relations = argc > 1 ? atoi(argv[1]) : DEFAULT_RELATIONS;
+    int values = relations / 4 + 2;
+
+    // random relations that always point from a lower number to a higher one,
+    //   so there are never any cycles
+    char (*names)[NAME_SIZE] = malloc(sizeof(*names) * (size_t)relations * 2);
+    if(!names) {
+        log_err("Out of memory.");
+        return EXIT_FAILURE;
+    }
+
+    srand(1);
+    for(int i = 0; i < relations; i++) {
+        int a = rand() % (values - 1);
+        int b = a + 1 + rand() % (values - a - 1);
+        snprintf(names[i * 2], NAME_SIZE, "v%i", a);
+        snprintf(names[i * 2 + 1], NAME_SIZE, "v%i", b);
+    }
+
+    Graph *pooled = new_graph();
+    Graph *unpooled = new_graph_malloc();
+    if(!pooled || !unpooled) {
+        log_err("Out of memory.");
+        return EXIT_FAILURE;
+    }
+
+    double start = now();
+    int err = load(unpooled, names, relations);
+    double malloc_loaded = now();
+    g_free(unpooled);
+    double malloc_freed = now();
+
+    err |= load(pooled, names, relations);
+    double arena_loaded = now();
+    g_reset(pooled);
+    double arena_reset = now();
+    err |= load(pooled, names, relations);
+    double arena_reloaded = now();
+    g_free(pooled);
+    double arena_freed = now();
+
+    free(names);
+
+    if(err) {
+        log_err("Failed to load relations");
+        return EXIT_FAILURE;
+    }
+
+    printf("arena %i relations: malloc load %.3f ms, free %.3f ms\n",
+            relations, malloc_loaded - start, malloc_freed - malloc_loaded);
+    printf("arena %i relations: arena load %.3f ms, free %.3f ms, reset %.3f ms, reload %.3f ms\n",
+            relations, arena_loaded - malloc_freed, arena_freed - arena_reloaded,
+            arena_reset - arena_loaded, arena_reloaded - arena_reset);
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+/* Benchmark for bulk loading relations
+ *
+ * Generates a random DAG, with relations between random pairs of values pointing
+ *   from the lower numbered value to the higher, given in random order. Loads it
+ *   with g_apply_relations_batch, then loads a slice of it one relation at a time
+ *   with g_apply_relation for comparison
+ *
+ * Call with batch_bench [relations] [incremental relations]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/graph.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_RELATIONS 5000000
+#define DEFAULT_INCREMENTAL 200000
+// Average number of relations per value
+#define RELATIONS_PER_VALUE 5
+#define NAME_SIZE 16
+
+// Milliseconds since some fixed point
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+int main(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_RELATIONS;
+    int incremental = argc > 2 ? atoi(argv[2]) : DEFAULT_INCREMENTAL;
+    int values = count / RELATIONS_PER_VALUE + 2;
+    if(incremental > count) incremental = count;
+
+    char *names = malloc((size_t)values * NAME_SIZE);
+    char **greater = malloc(sizeof(char *) * (size_t)count);
+    char **lesser = malloc(sizeof(char *) * (size_t)count);
+    Graph *graph = new_graph();
+    if(!names || !greater || !lesser || !graph) {
+        log_err("Out of memory.");
+        return EXIT_FAILURE;
+    }
+
+    for(int i = 0; i < values; i++) snprintf(names + i * NAME_SIZE, NAME_SIZE, "v%i", i);
+
+    srand(1);
+    for(int i = 0; i < count; i++) {
+        int a = rand() % values;
+        int b = rand() % values;
+        if(a == b) b = (a + 1) % values;
+
+        greater[i] = names + (a < b ? a : b) * NAME_SIZE;
+        lesser[i] = names + (a < b ? b : a) * NAME_SIZE;
+    }
+
+    double start = now();
+    if(g_apply_relations_batch(graph, greater, lesser, count)) {
+        log_err("Failed to apply batch");
+        return EXIT_FAILURE;
+    }
+    double batched = now();
+
+    printf("batch %i relations (%i values): %.3f ms\n", count, graph->length, batched - start);
+
+    g_reset(graph);
+
+    start = now();
+    for(int i = 0; i < incremental; i++) {
+        int rc = g_apply_relation(graph, greater[i], lesser[i]);
+        if(rc && rc != ERR_DUPLICATE) {
+            log_err("Failed to apply %s > %s", greater[i], lesser[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    double applied = now();
+
+    g_reset(graph);
+
+    double batch_start = now();
+    if(g_apply_relations_batch(graph, greater, lesser, incremental)) {
+        log_err("Failed to apply batch");
+        return EXIT_FAILURE;
+    }
+    double batch_end = now();
+
+    printf("batch %i relations: incremental %.3f ms, batch %.3f ms\n",
+            incremental, applied - start, batch_end - batch_start);
+
+    g_free(graph);
+    free(names);
+    free(greater);
+    free(lesser);
+    return 0;
+}
@@ -0,0 +1,124 @@
+/* Benchmark for updating a graph in place
+ *
+ * Loads a random DAG as in batch_bench, then replaces relations one at a time:
+ *   each step removes an existing relation and applies a new random one pointing
+ *   the same way as the rest, so the graph stays about the same size. Every so
+ *   often a whole value is removed instead. Half the graph is frozen to start
+ *   with, so removals hit both frozen rows and relation vectors. Rebuilding the
+ *   graph with the batch loader is given for comparison, as that was the only way
+ *   to drop a relation before
+ *
+ * Call with churn_bench [relations] [changes]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/graph.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_RELATIONS 1000000
+#define DEFAULT_CHANGES 200000
+// Average number of relations per value
+#define RELATIONS_PER_VALUE 5
+#define NAME_SIZE 16
+// One change in this many removes a whole value
+#define VALUE_REMOVALS 64
+
+// Milliseconds since some fixed point
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+int main(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_RELATIONS;
+    int changes = argc > 2 ? atoi(argv[2]) : DEFAULT_CHANGES;
+    int values = count / RELATIONS_PER_VALUE + 2;
+
+    char *names = malloc((size_t)values * NAME_SIZE);
+    char **greater = malloc(sizeof(char *) * (size_t)count);
+    char **lesser = malloc(sizeof(char *) * (size_t)count);
+    Graph *graph = new_graph();
+    if(!names || !greater || !lesser || !graph) {
+        log_err("Out of memory.");
+        return EXIT_FAILURE;
+    }
+
+    for(int i = 0; i < values; i++) snprintf(names + i * NAME_SIZE, NAME_SIZE, "v%i", i);
+
+    srand(1);
+    for(int i = 0; i < count; i++) {
+        int a = rand() % values;
+        int b = rand() % values;
+        if(a == b) b = (a + 1) % values;
+
+        greater[i] = names + (a < b ? a : b) * NAME_SIZE;
+        lesser[i] = names + (a < b ? b : a) * NAME_SIZE;
+    }
+
+    int half = count / 2;
+    if(g_apply_relations_batch(graph, greater, lesser, half) || g_freeze(graph)
+            || g_apply_relations_batch(graph, greater + half, lesser + half, count - half)) {
+        log_err("Failed to apply batch");
+        return EXIT_FAILURE;
+    }
+
+    // relations replace each other in a ring, so each removal takes out one that's there
+    // new relations point the same way as the rest, so there are never cycles
+    int removed = 0;
+    int missing = 0;
+    double removing = 0;
+    double applying = 0;
+    for(int i = 0; i < changes; i++) {
+        int slot = i % count;
+
+        double start = now();
+        if(i % VALUE_REMOVALS == 0) {
+            if(g_remove_value(graph, lesser[slot]) == 0) removed++;
+        } else if(g_remove_relation(graph, greater[slot], lesser[slot])) {
+            missing++;
+        }
+        double middle = now();
+
+        int a = rand() % values;
+        int b = rand() % values;
+        if(a == b) b = (a + 1) % values;
+        greater[slot] = names + (a < b ? a : b) * NAME_SIZE;
+        lesser[slot] = names + (a < b ? b : a) * NAME_SIZE;
+
+        int rc = g_apply_relation(graph, greater[slot], lesser[slot]);
+        if(rc && rc != ERR_DUPLICATE) {
+            log_err("Failed to apply %s > %s", greater[slot], lesser[slot]);
+            return EXIT_FAILURE;
+        }
+        double end = now();
+
+        removing += middle - start;
+        applying += end - middle;
+    }
+
+    printf("churn %i relations: %i changes, remove %.3f ms (%.3f us each), apply %.3f ms (%.3f us each)\n",
+            count, changes, removing, removing * 1000.0 / changes, applying, applying * 1000.0 / changes);
+    printf("churn %i values removed, %i relations already gone with their values\n", removed, missing);
+
+    g_reset(graph);
+
+    double start = now();
+    if(g_apply_relations_batch(graph, greater, lesser, count)) {
+        log_err("Failed to rebuild");
+        return EXIT_FAILURE;
+    }
+    double rebuilt = now();
+
+    printf("churn %i relations: rebuild %.3f ms\n", count, rebuilt - start);
+
+    g_free(graph);
+    free(names);
+    free(greater);
+    free(lesser);
+    return 0;
+}
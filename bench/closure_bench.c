@@ -0,0 +1,149 @@
+/* Benchmark for transitive closure
+ *
+ * Builds a DAG where each relation goes from a value to one up to a few hundred
+ *   after it, then times building its closure in both directions with plain ORs,
+ *   with AVX2, and with AVX2 across threads, and answering pair, count and set
+ *   queries with it
+ *
+ * Call with closure_bench [values] [threads]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/graph.h"
+#include "../src/closure.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_VALUES 50000
+#define RELATIONS_PER_VALUE 3
+#define SPAN 400
+#define PAIRS 1000000
+// Values whose whole sets are counted and listed
+#define SETS 10000
+#define NAME_SIZE 16
+// Builds of each kind, the fastest is reported as the first ones fault in fresh pages
+#define BUILDS 3
+
+// Milliseconds since some fixed point
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+// Time building a closure, checking it matches the first one built if given
+static Closure *build(Graph *graph, int flags, int threads, const char *name, Closure *first)
+{
+    Closure *closure = NULL;
+    double best = 0;
+
+    for(int i = 0; i < BUILDS; i++) {
+        if(closure) cl_free(closure);
+
+        double start = now();
+        closure = g_closure(graph, flags, threads);
+        double built = now();
+        if(!closure) {
+            log_err("Failed to build closure");
+            return NULL;
+        }
+        if(!i || built - start < best) best = built - start;
+    }
+
+    if(first && memcmp(first->below, closure->below, sizeof(uint64_t) * closure->count * closure->words)) {
+        log_err("%s closure differs", name);
+        cl_free(closure);
+        return NULL;
+    }
+
+    printf("closure %s, %i threads: %.3f ms\n", name, threads, best);
+    return closure;
+}
+
+int main(int argc, char *argv[])
+{
+    int values = argc > 1 ? atoi(argv[1]) : DEFAULT_VALUES;
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+
+    int count = values * RELATIONS_PER_VALUE;
+    char *names = malloc((size_t)values * NAME_SIZE);
+    char **greater = malloc(sizeof(char *) * (size_t)count);
+    char **lesser = malloc(sizeof(char *) * (size_t)count);
+    Value **pairs = malloc(sizeof(Value *) * PAIRS * 2);
+    Value **set = malloc(sizeof(Value *) * (size_t)values);
+    Graph *graph = new_graph();
+    if(!names || !greater || !lesser || !pairs || !set || !graph) {
+        log_err("Out of memory.");
+        return EXIT_FAILURE;
+    }
+
+    for(int i = 0; i < values; i++) snprintf(names + i * NAME_SIZE, NAME_SIZE, "v%i", i);
+
+    srand(1);
+    for(int i = 0; i < count; i++) {
+        int a = rand() % values;
+        int b = a + 1 + rand() % SPAN;
+        if(b >= values) b = values - 1 - rand() % SPAN;
+        if(a == b) b = (a + 1) % values;
+
+        greater[i] = names + (a < b ? a : b) * NAME_SIZE;
+        lesser[i] = names + (a < b ? b : a) * NAME_SIZE;
+    }
+
+    if(g_apply_relations_batch(graph, greater, lesser, count)) {
+        log_err("Failed to apply batch");
+        return EXIT_FAILURE;
+    }
+    printf("closure %i values, %i relations\n", graph->length, count - (int)graph->duplicates);
+
+    Closure *closure = build(graph, CLOSURE_ABOVE | CLOSURE_SCALAR, 1, "scalar", NULL);
+    if(!closure) return EXIT_FAILURE;
+
+    Closure *other = build(graph, CLOSURE_ABOVE, 1, "vector", closure);
+    if(!other) return EXIT_FAILURE;
+    if(!other->vector) printf("closure vector: no AVX2, same as scalar\n");
+    cl_free(other);
+
+    other = build(graph, CLOSURE_ABOVE, threads, "vector", closure);
+    if(!other) return EXIT_FAILURE;
+    cl_free(other);
+
+    // a few names never got a relation, so aren't in the graph
+    for(int i = 0; i < PAIRS * 2; i++) {
+        do pairs[i] = g_lookup(graph, names + (rand() % values) * NAME_SIZE);
+        while(!pairs[i]);
+    }
+
+    int above = 0;
+    double start = now();
+    for(int i = 0; i < PAIRS; i++) above += cl_above(closure, pairs[i * 2], pairs[i * 2 + 1]);
+    double queried = now();
+    printf("closure %i pairs %.3f ms (%.0f per second), %i above\n",
+            PAIRS, queried - start, PAIRS / ((queried - start) / 1000.0), above);
+
+    unsigned long total = 0;
+    start = now();
+    for(int i = 0; i < SETS; i++) total += cl_count(closure, pairs[i], DIR_LOWER);
+    queried = now();
+    printf("closure %i counts below %.3f ms (%.2f us each), %lu values\n",
+            SETS, queried - start, (queried - start) * 1000.0 / SETS, total);
+
+    total = 0;
+    start = now();
+    for(int i = 0; i < SETS; i++) total += cl_values(closure, pairs[i], DIR_HIGHER, set);
+    queried = now();
+    printf("closure %i sets above %.3f ms (%.2f us each), %lu values\n",
+            SETS, queried - start, (queried - start) * 1000.0 / SETS, total);
+
+    cl_free(closure);
+    g_free(graph);
+    free(names);
+    free(greater);
+    free(lesser);
+    free(pairs);
+    free(set);
+    return 0;
+}
@@ -0,0 +1,113 @@
+/* Benchmark for critical path scheduling
+ *
+ * Loads a random DAG with g_apply_relations_batch, relations always pointing from
+ *   the lower numbered value to a higher one at most SPAN on, with random
+ *   weights. Times a schedule from scratch, then a run of changes each followed
+ *   by g_critical_path, recomputing incrementally and then in full for the
+ *   first of the same changes. Changes are new weights for random values, most
+ *   of them small enough to leave the length alone
+ *
+ * Call with critical_bench [values]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/critical.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_VALUES 200000
+#define RELATIONS_PER_VALUE 4
+#define SPAN 1000
+#define MAX_WEIGHT 100
+#define CHANGES 2000
+// Changes timed scheduling from scratch, which takes much longer each
+#define FULL_CHANGES 50
+#define NAME_SIZE 16
+
+// Milliseconds since some fixed point
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+// Make count changes, scheduling after each, from scratch if full is set
+static int run_changes(Graph *graph, char *names, int values, int count, int full)
+{
+    unsigned long recomputed = 0;
+
+    srand(2);
+    double start = now();
+    for(int i = 0; i < count; i++) {
+        char *name = names + (rand() % values) * NAME_SIZE;
+        g_set_weight(graph, name, rand() % MAX_WEIGHT);
+
+        if(full) graph->schedule->full = 1;
+        Schedule *schedule = g_critical_path(graph);
+        check(schedule, "Failed to schedule");
+        recomputed += schedule->recomputed;
+    }
+    double elapsed = now() - start;
+
+    printf("critical %s: %i changes in %.3f ms, %.3f us each, %.1f start times recomputed each\n",
+            full ? "full" : "incremental", count, elapsed, elapsed * 1000.0 / count,
+            (double)recomputed / count);
+    return 0;
+
+error:
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int values = argc > 1 ? atoi(argv[1]) : DEFAULT_VALUES;
+    int count = values * RELATIONS_PER_VALUE;
+    char *names = malloc((size_t)values * NAME_SIZE);
+    char **greater = malloc(sizeof(char *) * (size_t)count);
+    char **lesser = malloc(sizeof(char *) * (size_t)count);
+    Graph *graph = new_graph();
+    if(!names || !greater || !lesser || !graph) {
+        log_err("Out of memory.");
+        return EXIT_FAILURE;
+    }
+
+    for(int i = 0; i < values; i++) snprintf(names + i * NAME_SIZE, NAME_SIZE, "v%i", i);
+
+    srand(1);
+    for(int i = 0; i < count; i++) {
+        int a = rand() % values;
+        int b = a + 1 + rand() % SPAN;
+        if(b >= values) b = values - 1 - rand() % SPAN;
+        if(a == b) b = (a + 1) % values;
+
+        greater[i] = names + (a < b ? a : b) * NAME_SIZE;
+        lesser[i] = names + (a < b ? b : a) * NAME_SIZE;
+    }
+
+    if(g_apply_relations_batch(graph, greater, lesser, count)) {
+        log_err("Failed to load graph");
+        return EXIT_FAILURE;
+    }
+    for(int i = 0; i < values; i++) g_set_weight(graph, names + i * NAME_SIZE, rand() % MAX_WEIGHT);
+
+    double start = now();
+    Schedule *schedule = g_critical_path(graph);
+    double elapsed = now() - start;
+    if(!schedule) {
+        log_err("Failed to schedule");
+        return EXIT_FAILURE;
+    }
+    printf("critical %i values, %i relations: scheduled in %.3f ms, length %lli, chain of %i\n",
+            graph->length, count, elapsed, (long long)schedule->length, schedule->chain_length);
+
+    if(run_changes(graph, names, values, CHANGES, 0)) return EXIT_FAILURE;
+    if(run_changes(graph, names, values, FULL_CHANGES, 1)) return EXIT_FAILURE;
+
+    g_free(graph);
+    free(names);
+    free(greater);
+    free(lesser);
+    return 0;
+}
@@ -0,0 +1,81 @@
+/* Scaling benchmark for the parallel loader
+ *
+ * Writes a file of random relations to /tmp, with relations always pointing from
+ *   the lower numbered value to the higher so there are no cycles, then loads it
+ *   with in_load using 1, 2, 4... threads up to the limit, printing each stage
+ *
+ * Call with ingest_bench [megabytes] [max threads]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "../src/ingest.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_MEGABYTES 128
+// Number of distinct values in the file
+#define VALUES 1000000
+
+// Write random relations until the file is at least size bytes
+static int generate(FILE *file, size_t size)
+{
+    size_t written = 0;
+
+    srand(1);
+    while(written < size) {
+        int a = rand() % VALUES;
+        int b = rand() % VALUES;
+        if(a == b) continue;
+
+        int n = fprintf(file, "value_%i > value_%i\n", a < b ? a : b, a < b ? b : a);
+        if(n < 0) return 1;
+        written += (size_t)n;
+    }
+
+    return fflush(file);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t megabytes = argc > 1 ? (size_t)atoi(argv[1]) : DEFAULT_MEGABYTES;
+    int max_threads = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    char path[] = "/tmp/ingest_benchXXXXXX";
+
+    int fd = mkstemp(path);
+    FILE *file = fd == -1 ? NULL : fdopen(fd, "w");
+    if(!file) {
+        log_err("Could not make a file to read");
+        return EXIT_FAILURE;
+    }
+
+    if(generate(file, megabytes << 20)) {
+        log_err("Could not write %s", path);
+        fclose(file);
+        unlink(path);
+        return EXIT_FAILURE;
+    }
+    fclose(file);
+
+    if(max_threads < 1) max_threads = 1;
+    for(int threads = 1; threads <= max_threads; threads *= 2) {
+        Graph *graph = new_graph();
+        Ingest stats;
+
+        if(!graph || in_load(graph, path, threads, &stats)) {
+            log_err("Failed to load %s with %i threads", path, threads);
+            unlink(path);
+            return EXIT_FAILURE;
+        }
+
+        double parse = (double)megabytes * 1000.0 / stats.parse;
+        printf("ingest %zu MB (%i relations, %i values), %i threads: parse %.3f ms (%.1f MB/s), shard %.3f ms, "
+                "intern %.3f ms, translate %.3f ms, apply %.3f ms\n", megabytes, stats.relations, graph->length,
+                threads, stats.parse, parse, stats.shard, stats.intern, stats.translate, stats.apply);
+
+        g_free(graph);
+    }
+
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,93 @@
+/* Regression benchmark for relationship resolution over diamond lattices
+ *
+ * Builds two lattices two values wide, where each value is greater than both values
+ *   on the next level, so there are 2^depth paths from top to bottom. Searches that
+ *   don't skip values they've already visited take exponential time on these.
+ *
+ * Times building the lattices, a relation that has to move a whole lattice, and a
+ *   cyclic relation that has to search a whole lattice before being rejected
+ *
+ * Call with lattice_bench [depth]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/graph.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_DEPTH 40
+
+// Milliseconds since some fixed point
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+// Add a lattice with values named <prefix><level>_<0|1>
+static int lattice(Graph *graph, char prefix, int depth)
+{
+    char greater[32];
+    char lesser[32];
+
+    for(int level = 0; level < depth; level++) {
+        for(int i = 0; i < 4; i++) {
+            snprintf(greater, sizeof(greater), "%c%i_%i", prefix, level, i / 2);
+            snprintf(lesser, sizeof(lesser), "%c%i_%i", prefix, level + 1, i % 2);
+            if(g_apply_relation(graph, greater, lesser)) return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int depth = argc > 1 ? atoi(argv[1]) : DEFAULT_DEPTH;
+    char top[32];
+    char bottom[32];
+
+    for(int d = 10; d <= depth; d += 10) {
+        Graph *graph = new_graph();
+        if(!graph) {
+            log_err("Out of memory.");
+            return EXIT_FAILURE;
+        }
+
+        double start = now();
+        if(lattice(graph, 'a', d) || lattice(graph, 'b', d)) {
+            log_err("Failed to build lattice of depth %i", d);
+            g_free(graph);
+            return EXIT_FAILURE;
+        }
+        double built = now();
+
+        // b is entirely after a, so the whole of one lattice has to move
+        snprintf(top, sizeof(top), "a0_0");
+        snprintf(bottom, sizeof(bottom), "b%i_0", d);
+        if(g_apply_relation(graph, bottom, top)) {
+            log_err("Failed to move lattice of depth %i", d);
+            g_free(graph);
+            return EXIT_FAILURE;
+        }
+        double moved = now();
+
+        // the bottom of a lattice can't be above its top
+        snprintf(bottom, sizeof(bottom), "a%i_1", d);
+        if(g_apply_relation(graph, bottom, top) != ERR_RELATIONAL_CONFLICT) {
+            log_err("Cycle not found in lattice of depth %i", d);
+            g_free(graph);
+            return EXIT_FAILURE;
+        }
+        double rejected = now();
+
+        printf("lattice depth %i (%i values): build %.3f ms, move %.3f ms, reject cycle %.3f ms\n",
+                d, graph->length, built - start, moved - built, rejected - moved);
+
+        g_free(graph);
+    }
+
+    return 0;
+}
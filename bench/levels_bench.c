@@ -0,0 +1,83 @@
+/* Scaling benchmark for the level-synchronous sort
+ *
+ * Loads a random DAG with g_apply_relations_batch, with relations always pointing
+ *   from the lower numbered value to the higher, then sorts it into levels with
+ *   1, 2, 4... threads up to the limit
+ *
+ * Call with levels_bench [relations] [max threads]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/levels.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_RELATIONS 2000000
+// Average number of relations per value
+#define RELATIONS_PER_VALUE 5
+#define NAME_SIZE 16
+
+// Milliseconds since some fixed point
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+int main(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_RELATIONS;
+    int max_threads = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int values = count / RELATIONS_PER_VALUE + 2;
+
+    char *names = malloc((size_t)values * NAME_SIZE);
+    char **greater = malloc(sizeof(char *) * (size_t)count);
+    char **lesser = malloc(sizeof(char *) * (size_t)count);
+    Graph *graph = new_graph();
+    if(!names || !greater || !lesser || !graph) {
+        log_err("Out of memory.");
+        return EXIT_FAILURE;
+    }
+
+    for(int i = 0; i < values; i++) snprintf(names + i * NAME_SIZE, NAME_SIZE, "v%i", i);
+
+    srand(1);
+    for(int i = 0; i < count; i++) {
+        int a = rand() % values;
+        int b = rand() % values;
+        if(a == b) b = (a + 1) % values;
+
+        greater[i] = names + (a < b ? a : b) * NAME_SIZE;
+        lesser[i] = names + (a < b ? b : a) * NAME_SIZE;
+    }
+
+    if(g_apply_relations_batch(graph, greater, lesser, count) || g_freeze(graph)) {
+        log_err("Failed to load graph");
+        return EXIT_FAILURE;
+    }
+
+    if(max_threads < 1) max_threads = 1;
+    for(int threads = 1; threads <= max_threads; threads *= 2) {
+        double start = now();
+        Levels *levels = g_levels(graph, threads);
+        double end = now();
+
+        if(!levels) {
+            log_err("Failed to sort with %i threads", threads);
+            return EXIT_FAILURE;
+        }
+
+        printf("levels %i relations (%i values, %i levels), %i threads: %.3f ms\n",
+                count, graph->length, levels->count, threads, end - start);
+        lv_free(levels);
+    }
+
+    g_free(graph);
+    free(names);
+    free(greater);
+    free(lesser);
+    return 0;
+}
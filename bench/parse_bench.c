@@ -0,0 +1,137 @@
+/* Throughput benchmark for reading relation files
+ *
+ * Writes a file of random relations to /tmp, then reads it back with the old
+ *   fgets and sscanf loop, with the parser on its own, and with the parser
+ *   interning every value into a pool as a graph would
+ *
+ * Call with parse_bench [megabytes]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/parser.h"
+#include "../src/pool.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_MEGABYTES 256
+// Number of distinct values in the file
+#define VALUES 1000000
+#define BUFFER_SIZE 255
+
+// Milliseconds since some fixed point
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+// Write random relations until the file is at least size bytes
+static int generate(FILE *file, size_t size)
+{
+    size_t written = 0;
+
+    srand(1);
+    while(written < size) {
+        int n = fprintf(file, "value_%i %c value_%i\n", rand() % VALUES, rand() % 2 ? '>' : '<', rand() % VALUES);
+        if(n < 0) return 1;
+        written += (size_t)n;
+    }
+
+    return fflush(file);
+}
+
+// Read the file the way read_file used to
+static int read_sscanf(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if(!file) return -1;
+
+    char buf[BUFFER_SIZE];
+    char buf_1[BUFFER_SIZE];
+    char buf_2[BUFFER_SIZE];
+    char relate;
+    int count = 0;
+
+    while(fgets(buf, BUFFER_SIZE, file)) {
+        if(sscanf(buf, "%s %c %s\n", buf_1, &relate, buf_2) == 3) count++;
+    }
+
+    fclose(file);
+    return count;
+}
+
+// Read the file with the parser, interning values into pool if given
+static int read_parser(const char *path, Pool *pool)
+{
+    Parser *parser = new_parser(path);
+    if(!parser) return -1;
+
+    Relation relation;
+    int count = 0;
+    int rc;
+
+    while((rc = pr_next(parser, &relation)) != PARSE_END) {
+        if(rc != PARSE_RELATION) continue;
+
+        if(pool) {
+            p_intern(pool, relation.greater.str, relation.greater.length);
+            p_intern(pool, relation.lesser.str, relation.lesser.length);
+        }
+        count++;
+    }
+
+    pr_free(parser);
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t megabytes = argc > 1 ? (size_t)atoi(argv[1]) : DEFAULT_MEGABYTES;
+    char path[] = "/tmp/parse_benchXXXXXX";
+
+    int fd = mkstemp(path);
+    FILE *file = fd == -1 ? NULL : fdopen(fd, "w");
+    if(!file) {
+        log_err("Could not make a file to read");
+        return EXIT_FAILURE;
+    }
+
+    if(generate(file, megabytes << 20)) {
+        log_err("Could not write %s", path);
+        fclose(file);
+        unlink(path);
+        return EXIT_FAILURE;
+    }
+    fclose(file);
+
+    Pool *pool = new_pool();
+    if(!pool) {
+        log_err("Out of memory.");
+        unlink(path);
+        return EXIT_FAILURE;
+    }
+
+    double start = now();
+    int scanned = read_sscanf(path);
+    double scanf_end = now();
+    int parsed = read_parser(path, NULL);
+    double parse_end = now();
+    int interned = read_parser(path, pool);
+    double intern_end = now();
+
+    if(scanned != parsed || parsed != interned) {
+        log_err("Relation counts differ: %i sscanf, %i parsed, %i interned", scanned, parsed, interned);
+    }
+
+    double size = (double)megabytes;
+    printf("parse %zu MB (%i relations): sscanf %.1f MB/s, parser %.1f MB/s, parser + intern %.1f MB/s\n",
+            megabytes, parsed, size * 1000.0 / (scanf_end - start), size * 1000.0 / (parse_end - scanf_end),
+            size * 1000.0 / (intern_end - parse_end));
+
+    p_free(pool);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,206 @@
+/* Benchmark for reading while the graph is being changed
+ *
+ * One thread applies relations in batches while reader threads look up random
+ *   values and walk their relations, and each read's latency is recorded.
+ *   Run twice: once with everything behind one mutex, so a read waits for the
+ *   batch being applied, and once with readers on snapshots from pb_publish,
+ *   published after every batch
+ *
+ * Reads are timed from just before taking the lock or entering, so time spent
+ *   waiting counts
+ *
+ * Call with publish_bench [values]
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/graph.h"
+#include "../src/publish.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_VALUES 200000
+#define RELATIONS_PER_VALUE 2
+#define SPAN 100
+#define BATCH 20000
+#define READERS 2
+#define MAX_READS 1000000
+#define NAME_SIZE 16
+
+// Nanoseconds since some fixed point
+static unsigned long long now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (unsigned long long)time.tv_sec * 1000000000ULL + (unsigned long long)time.tv_nsec;
+}
+
+typedef struct bench {
+    Graph *graph;
+    Publisher *publisher;
+    pthread_mutex_t lock;
+    int published;
+    char *names;
+    int values;
+    atomic_int done;
+} Bench;
+
+typedef struct reader {
+    Bench *bench;
+    int slot;
+    unsigned long long *latencies;
+    int reads;
+    unsigned long found;
+} Reader;
+
+// Find a random value and count its relations, on the graph under the lock
+static void read_locked(Reader *reader, char *name)
+{
+    pthread_mutex_lock(&reader->bench->lock);
+    Value *value = g_lookup(reader->bench->graph, name);
+    if(value) reader->found += (unsigned long)g_degree(reader->bench->graph, value, DIR_LOWER);
+    pthread_mutex_unlock(&reader->bench->lock);
+}
+
+// The same on the current snapshot
+static void read_published(Reader *reader, char *name)
+{
+    Version *version = pb_enter(reader->bench->publisher, reader->slot);
+    if(version) {
+        uint32_t id = sn_find(version->snapshot, name, strlen(name));
+        if(id != SNAPSHOT_NONE) reader->found += sn_degree(version->snapshot, id, DIR_LOWER);
+    }
+    pb_leave(reader->bench->publisher, reader->slot);
+}
+
+static void *run_reader(void *data)
+{
+    Reader *reader = data;
+    Bench *bench = reader->bench;
+    unsigned int seed = (unsigned int)reader->slot + 1;
+
+    while(!atomic_load(&bench->done) && reader->reads < MAX_READS) {
+        char *name = bench->names + (rand_r(&seed) % bench->values) * NAME_SIZE;
+
+        unsigned long long start = now();
+        if(bench->published) read_published(reader, name);
+        else read_locked(reader, name);
+        reader->latencies[reader->reads++] = now() - start;
+    }
+
+    return NULL;
+}
+
+static int compare(const void *a, const void *b)
+{
+    unsigned long long first = *(const unsigned long long *)a;
+    unsigned long long second = *(const unsigned long long *)b;
+    return (first > second) - (first < second);
+}
+
+// Apply every relation while the readers run, then report their latencies
+static int run(Bench *bench, char **greater, char **lesser, int count)
+{
+    Reader readers[READERS];
+    pthread_t threads[READERS];
+    int started = 0;
+    double applied = 0;
+    int rc = 1;
+
+    bench->graph = new_graph();
+    bench->publisher = new_publisher(READERS);
+    check_mem(bench->graph && bench->publisher);
+    atomic_store(&bench->done, 0);
+
+    for(; started < READERS; started++) {
+        Reader *reader = &readers[started];
+        reader->bench = bench;
+        reader->slot = started;
+        reader->reads = 0;
+        reader->found = 0;
+        reader->latencies = malloc(sizeof(unsigned long long) * MAX_READS);
+        check_mem(reader->latencies);
+        check(pthread_create(&threads[started], NULL, run_reader, reader) == 0, "Couldn't start a reader");
+    }
+
+    unsigned long long start = now();
+    for(int i = 0; i < count; i += BATCH) {
+        int end = i + BATCH < count ? i + BATCH : count;
+
+        if(!bench->published) pthread_mutex_lock(&bench->lock);
+        for(int j = i; j < end; j++) g_apply_relation(bench->graph, greater[j], lesser[j]);
+        if(!bench->published) pthread_mutex_unlock(&bench->lock);
+
+        if(bench->published) check(pb_publish(bench->publisher, bench->graph) == 0, "Failed to publish");
+    }
+    applied = (double)(now() - start) / 1000000.0;
+    rc = 0;
+
+error:
+    atomic_store(&bench->done, 1);
+    for(int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+
+    // every reader's latencies together
+    int total = 0;
+    for(int i = 0; i < started; i++) total += readers[i].reads;
+    unsigned long long *all = malloc(sizeof(unsigned long long) * (size_t)(total ? total : 1));
+    if(!rc && all && total) {
+        int n = 0;
+        for(int i = 0; i < started; i++) {
+            memcpy(all + n, readers[i].latencies, sizeof(unsigned long long) * (size_t)readers[i].reads);
+            n += readers[i].reads;
+        }
+        qsort(all, (size_t)total, sizeof(unsigned long long), compare);
+
+        printf("publish %s: applied %i relations in %.3f ms, %i reads, p50 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns\n",
+                bench->published ? "snapshots" : "mutex", count, applied, total, all[total / 2],
+                all[(int)((double)total * 0.99)], all[(int)((double)total * 0.999)], all[total - 1]);
+    }
+
+    free(all);
+    for(int i = 0; i < started; i++) free(readers[i].latencies);
+    if(bench->publisher) pb_free(bench->publisher);
+    if(bench->graph) g_free(bench->graph);
+    return rc;
+}
+
+int main(int argc, char *argv[])
+{
+    int values = argc > 1 ? atoi(argv[1]) : DEFAULT_VALUES;
+    int count = values * RELATIONS_PER_VALUE;
+    Bench bench;
+    bench.names = malloc((size_t)values * NAME_SIZE);
+    bench.values = values;
+    char **greater = malloc(sizeof(char *) * (size_t)count);
+    char **lesser = malloc(sizeof(char *) * (size_t)count);
+    if(!bench.names || !greater || !lesser || pthread_mutex_init(&bench.lock, NULL)) {
+        log_err("Out of memory.");
+        return EXIT_FAILURE;
+    }
+
+    for(int i = 0; i < values; i++) snprintf(bench.names + i * NAME_SIZE, NAME_SIZE, "value%i", i);
+
+    srand(1);
+    for(int i = 0; i < count; i++) {
+        int a = rand() % values;
+        int b = a + 1 + rand() % SPAN;
+        if(b >= values) b = values - 1 - rand() % SPAN;
+        if(a == b) b = (a + 1) % values;
+
+        greater[i] = bench.names + (a < b ? a : b) * NAME_SIZE;
+        lesser[i] = bench.names + (a < b ? b : a) * NAME_SIZE;
+    }
+
+    for(bench.published = 0; bench.published <= 1; bench.published++) {
+        if(run(&bench, greater, lesser, count)) return EXIT_FAILURE;
+    }
+
+    pthread_mutex_destroy(&bench.lock);
+    free(greater);
+    free(lesser);
+    free(bench.names);
+    return 0;
+}
@@ -0,0 +1,163 @@
+/* Benchmark for reachability queries
+ *
+ * Builds a DAG of a million values in one of two shapes, then times building a
+ *   reachability index and answering random "is a above b" queries with it,
+ *   against a plain depth first search for a slice of the same queries
+ *
+ *   local: Each relation goes from a value to one up to a few hundred after it, like
+ *     dependencies between neighbouring parts of a project
+ *   uniform: Each relation goes between two random values, lower numbered first
+ *
+ * Call with reach_bench [values] [queries] [traversals]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/graph.h"
+#include "../src/reach.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_VALUES 1000000
+#define DEFAULT_QUERIES 1000000
+// Milliseconds spent answering the same queries by searching, which can take a
+//   long time each
+#define SEARCH_BUDGET 5000.0
+#define RELATIONS_PER_VALUE 3
+#define LOCAL_SPAN 400
+#define NAME_SIZE 16
+
+// Milliseconds since some fixed point
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+// Depth first search down from one value for another, without an index
+static int search(Graph *graph, Value *from, Value *to, unsigned int *seen, unsigned int stamp, Value **stack)
+{
+    int depth = 0;
+    stack[depth++] = from;
+
+    while(depth) {
+        Value *value = stack[--depth];
+        int degree = g_degree(graph, value, DIR_LOWER);
+
+        for(int i = 0; i < degree; i++) {
+            Value *lower = g_relation(graph, value, DIR_LOWER, i);
+            if(lower == to) return 1;
+            if(seen[lower->index] == stamp) continue;
+
+            seen[lower->index] = stamp;
+            stack[depth++] = lower;
+        }
+    }
+
+    return 0;
+}
+
+static int run(const char *shape, int local, int values, int queries, int traversals)
+{
+    int count = values * RELATIONS_PER_VALUE;
+    char *names = malloc((size_t)values * NAME_SIZE);
+    char **greater = malloc(sizeof(char *) * (size_t)count);
+    char **lesser = malloc(sizeof(char *) * (size_t)count);
+    Value **pairs = malloc(sizeof(Value *) * (size_t)queries * 2);
+    Graph *graph = new_graph();
+    if(!names || !greater || !lesser || !pairs || !graph) {
+        log_err("Out of memory.");
+        return 1;
+    }
+
+    for(int i = 0; i < values; i++) snprintf(names + i * NAME_SIZE, NAME_SIZE, "v%i", i);
+
+    srand(1);
+    for(int i = 0; i < count; i++) {
+        int a = rand() % values;
+        int b = local ? a + 1 + rand() % LOCAL_SPAN : rand() % values;
+        if(local && b >= values) b = values - 1 - rand() % LOCAL_SPAN;
+        if(a == b) b = (a + 1) % values;
+
+        greater[i] = names + (a < b ? a : b) * NAME_SIZE;
+        lesser[i] = names + (a < b ? b : a) * NAME_SIZE;
+    }
+
+    if(g_apply_relations_batch(graph, greater, lesser, count)) {
+        log_err("Failed to apply batch");
+        return 1;
+    }
+
+    double build_start = now();
+    Reach *reach = g_reach(graph, traversals);
+    double built = now();
+    if(!reach) {
+        log_err("Failed to build index");
+        return 1;
+    }
+
+    // a few names never got a relation, so aren't in the graph
+    for(int i = 0; i < queries * 2; i++) {
+        do pairs[i] = g_lookup(graph, names + (rand() % values) * NAME_SIZE);
+        while(!pairs[i]);
+    }
+
+    int above = 0;
+    double start = now();
+    for(int i = 0; i < queries; i++) above += ri_above(reach, pairs[i * 2], pairs[i * 2 + 1]);
+    double queried = now();
+
+    printf("reach %s %i values, %i relations: index %.3f ms, %i queries %.3f ms (%.0f per second), %i above, %.2f%% searched\n",
+            shape, graph->length, count - (int)graph->duplicates, built - build_start, queries, queried - start,
+            queries / ((queried - start) / 1000.0), above, 100.0 * (double)reach->searches / queries);
+
+    // the same queries by searching the graph, as far as there's time for
+    unsigned int *seen = calloc((size_t)graph->values_size, sizeof(unsigned int));
+    Value **stack = malloc(sizeof(Value *) * (size_t)graph->values_size);
+    if(!seen || !stack) {
+        log_err("Out of memory.");
+        return 1;
+    }
+
+    int searches = 0;
+    start = now();
+    double searched = start;
+    for(; searches < queries && searched - start < SEARCH_BUDGET; searches++) {
+        Value *higher = pairs[searches * 2];
+        Value *lower = pairs[searches * 2 + 1];
+
+        int found = search(graph, higher, lower, seen, (unsigned int)searches + 1, stack);
+        if(found != ri_above(reach, higher, lower)) {
+            log_err("Index and search disagree on %s above %s", higher->value, lower->value);
+            return 1;
+        }
+        searched = now();
+    }
+
+    printf("reach %s %i searches %.3f ms (%.0f per second)\n",
+            shape, searches, searched - start, searches / ((searched - start) / 1000.0));
+
+    free(seen);
+    free(stack);
+    ri_free(reach);
+    g_free(graph);
+    free(names);
+    free(greater);
+    free(lesser);
+    free(pairs);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int values = argc > 1 ? atoi(argv[1]) : DEFAULT_VALUES;
+    int queries = argc > 2 ? atoi(argv[2]) : DEFAULT_QUERIES;
+    int traversals = argc > 3 ? atoi(argv[3]) : 0;
+
+    if(run("local", 1, values, queries, traversals)) return EXIT_FAILURE;
+    if(run("uniform", 0, values, queries, traversals)) return EXIT_FAILURE;
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+/* Benchmark for transitive reduction
+ *
+ * Builds a DAG where each relation goes from a value to one a little after it,
+ *   which gives plenty of relations implied by others, as in real dependency
+ *   files. Times reducing it, and walking it before and after by sorting it into
+ *   levels and by visiting everything below some of its values
+ *
+ * Call with reduce_bench [values] [relations per value] [span]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/graph.h"
+#include "../src/levels.h"
+#include "../src/reduce.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_VALUES 500000
+#define DEFAULT_RELATIONS_PER_VALUE 6
+#define DEFAULT_SPAN 50
+// Values to walk everything below
+#define WALKS 20
+#define NAME_SIZE 16
+
+// Milliseconds since some fixed point
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+// Count every relation in a graph
+static long relations(Graph *graph)
+{
+    long count = 0;
+    for(Value *value = graph->start; value; value = value->next) count += g_degree(graph, value, DIR_LOWER);
+
+    return count;
+}
+
+// Time sorting into levels, then walking everything below a few values, which
+//   is what searches while resolving relations do
+static int walk(Graph *graph, double *sort, double *below)
+{
+    double start = now();
+    Levels *levels = g_levels(graph, 1);
+    *sort = now() - start;
+    if(!levels) return 1;
+
+    unsigned int *seen = calloc((size_t)graph->values_size, sizeof(unsigned int));
+    Value **stack = malloc(sizeof(Value *) * (size_t)graph->length);
+    if(!seen || !stack) return 1;
+
+    start = now();
+    for(int i = 0; i < WALKS; i++) {
+        int depth = 0;
+        stack[depth++] = levels->order[(long)levels->length * i / WALKS];
+
+        while(depth) {
+            Value *value = stack[--depth];
+            int degree = g_degree(graph, value, DIR_LOWER);
+            for(int j = 0; j < degree; j++) {
+                Value *lower = g_relation(graph, value, DIR_LOWER, j);
+                if(seen[lower->index] == (unsigned int)i + 1) continue;
+
+                seen[lower->index] = (unsigned int)i + 1;
+                stack[depth++] = lower;
+            }
+        }
+    }
+    *below = now() - start;
+
+    free(seen);
+    free(stack);
+    lv_free(levels);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int values = argc > 1 ? atoi(argv[1]) : DEFAULT_VALUES;
+    int per_value = argc > 2 ? atoi(argv[2]) : DEFAULT_RELATIONS_PER_VALUE;
+    int span = argc > 3 ? atoi(argv[3]) : DEFAULT_SPAN;
+    int count = values * per_value;
+
+    char *names = malloc((size_t)values * NAME_SIZE);
+    char **greater = malloc(sizeof(char *) * (size_t)count);
+    char **lesser = malloc(sizeof(char *) * (size_t)count);
+    Graph *graph = new_graph();
+    if(!names || !greater || !lesser || !graph) {
+        log_err("Out of memory.");
+        return EXIT_FAILURE;
+    }
+
+    for(int i = 0; i < values; i++) snprintf(names + i * NAME_SIZE, NAME_SIZE, "v%i", i);
+
+    srand(1);
+    for(int i = 0; i < count; i++) {
+        int a = rand() % values;
+        int b = a + 1 + rand() % span;
+        if(b >= values) b = values - 1;
+        if(a == b) a = b - 1;
+
+        greater[i] = names + a * NAME_SIZE;
+        lesser[i] = names + b * NAME_SIZE;
+    }
+
+    if(g_apply_relations_batch(graph, greater, lesser, count) || g_freeze(graph)) {
+        log_err("Failed to apply batch");
+        return EXIT_FAILURE;
+    }
+
+    long before = relations(graph);
+    double sort_before = 0;
+    double below_before = 0;
+    if(walk(graph, &sort_before, &below_before)) {
+        log_err("Failed to sort");
+        return EXIT_FAILURE;
+    }
+
+    unsigned long removed = 0;
+    double start = now();
+    if(g_transitive_reduce(graph, &removed)) {
+        log_err("Failed to reduce");
+        return EXIT_FAILURE;
+    }
+    double reduced = now();
+
+    double sort_after = 0;
+    double below_after = 0;
+    if(walk(graph, &sort_after, &below_after)) {
+        log_err("Failed to sort");
+        return EXIT_FAILURE;
+    }
+
+    printf("reduce %i values, %li relations: removed %lu (%.1f%%) in %.3f ms\n",
+            graph->length, before, removed, 100.0 * (double)removed / (double)before, reduced - start);
+    printf("reduce levels %.3f ms before, %.3f ms after; %i walks %.3f ms before, %.3f ms after\n",
+            sort_before, sort_after, WALKS, below_before, below_after);
+
+    g_free(graph);
+    free(names);
+    free(greater);
+    free(lesser);
+    return 0;
+}
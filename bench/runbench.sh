@@ -0,0 +1,21 @@
+#!/usr/bin/env bash
+
+echo -e "\e[0;33m--------------------------------"
+echo -e "|      Running benchmarks      |"
+echo -e "--------------------------------\e[0;0m"
+
+for i in bench/*_bench
+do
+    if test -f $i
+    then
+        if ! ./$i
+        then
+            echo "ERROR: in benchmark $i"
+            exit 1
+        fi
+    fi
+done
+
+echo -e "\e[0;33m--------------------------------"
+echo -e "|  Finished running benchmarks |"
+echo -e "--------------------------------\e[0;0m"
@@ -0,0 +1,121 @@
+/* Benchmark for saving and loading snapshots
+ *
+ * Generates a random DAG as in batch_bench and loads it with the batch loader, then
+ *   times saving it, opening the snapshot with and without checking its checksum,
+ *   looking every name up in the mapping, and loading it back into a graph.
+ *   Loading the same relations again with the batch loader is given for comparison
+ *
+ * Call with snapshot_bench [relations] [path]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/graph.h"
+#include "../src/snapshot.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_RELATIONS 2000000
+#define DEFAULT_PATH "/tmp/snapshot_bench.snap"
+// Average number of relations per value
+#define RELATIONS_PER_VALUE 5
+#define NAME_SIZE 16
+
+// Milliseconds since some fixed point
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+int main(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_RELATIONS;
+    const char *path = argc > 2 ? argv[2] : DEFAULT_PATH;
+    int values = count / RELATIONS_PER_VALUE + 2;
+
+    char *names = malloc((size_t)values * NAME_SIZE);
+    char **greater = malloc(sizeof(char *) * (size_t)count);
+    char **lesser = malloc(sizeof(char *) * (size_t)count);
+    Graph *graph = new_graph();
+    if(!names || !greater || !lesser || !graph) {
+        log_err("Out of memory.");
+        return EXIT_FAILURE;
+    }
+
+    for(int i = 0; i < values; i++) snprintf(names + i * NAME_SIZE, NAME_SIZE, "v%i", i);
+
+    srand(1);
+    for(int i = 0; i < count; i++) {
+        int a = rand() % values;
+        int b = rand() % values;
+        if(a == b) b = (a + 1) % values;
+
+        greater[i] = names + (a < b ? a : b) * NAME_SIZE;
+        lesser[i] = names + (a < b ? b : a) * NAME_SIZE;
+    }
+
+    double start = now();
+    if(g_apply_relations_batch(graph, greater, lesser, count)) {
+        log_err("Failed to apply batch");
+        return EXIT_FAILURE;
+    }
+    double built = now();
+
+    if(g_save(graph, path)) {
+        log_err("Failed to save %s", path);
+        return EXIT_FAILURE;
+    }
+    double saved = now();
+    g_free(graph);
+
+    double open_start = now();
+    Snapshot *snapshot = sn_open(path, 0);
+    double opened = now();
+    if(!snapshot) {
+        log_err("Failed to open %s", path);
+        return EXIT_FAILURE;
+    }
+
+    // every name, in a different order to the one they're stored in
+    int found = 0;
+    for(int i = 0; i < values; i++) {
+        const char *name = names + i * NAME_SIZE;
+        if(sn_find(snapshot, name, strlen(name)) != SNAPSHOT_NONE) found++;
+    }
+    double searched = now();
+
+    size_t size = snapshot->size;
+    sn_close(snapshot);
+
+    double verify_start = now();
+    snapshot = sn_open(path, 1);
+    double verified = now();
+    if(!snapshot) {
+        log_err("Checksum of %s doesn't match", path);
+        return EXIT_FAILURE;
+    }
+    sn_close(snapshot);
+
+    double load_start = now();
+    graph = g_load(path);
+    double loaded = now();
+    if(!graph) {
+        log_err("Failed to load %s", path);
+        return EXIT_FAILURE;
+    }
+
+    printf("snapshot %i relations (%i values, %zu bytes): batch %.3f ms, save %.3f ms\n",
+            count, graph->length, size, built - start, saved - built);
+    printf("snapshot open %.3f ms, find %i names %.3f ms, open verified %.3f ms, load %.3f ms\n",
+            opened - open_start, found, searched - opened, verified - verify_start, loaded - load_start);
+
+    g_free(graph);
+    remove(path);
+    free(names);
+    free(greater);
+    free(lesser);
+    return 0;
+}
@@ -0,0 +1,302 @@
+/* Scaling benchmark suite
+ *
+ * Generates graphs of several shapes at sizes from a thousand values up, and for
+ *   each one times applying its relations one at a time with g_apply_relation,
+ *   finding every value with g_find, getting the order with g_sorted and freeing
+ *   it all with g_free. Every order is checked against the relations before
+ *   anything's printed
+ *
+ *   random: Two relations per value between random pairs, lower numbered first,
+ *     applied in random order
+ *   chain: One long chain, applied from the top down
+ *   fanout: One value above every other and one below, so two very wide levels
+ *   lattice: Diamond lattice two values wide, with 2^depth paths from top to bottom
+ *   backedge: Two chains, the second after the first in the order, then a relation
+ *     from each value of the second to the matching value of the first, from
+ *     the bottom up. Every one goes against the order so far, and the first has
+ *     a whole chain on both sides. Searching both sides at once and moving the
+ *     smaller one is what keeps this linear
+ *
+ * Sizes go up by ten each time. A shape stops growing once applying its relations
+ *   takes long enough that the next size would run past SUITE_BUDGET, so the
+ *   shapes that scale badly still show how badly without taking all day
+ *
+ * Prints one row per shape and size, as CSV or JSON, with times in milliseconds
+ *   and per-item times in nanoseconds, for comparing between runs
+ *
+ * Call with suite_bench [--json] [--max <values>] [--shape <name>]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/graph.h"
+#include "../src/hash.h"
+#include "../src/dbg.h"
+
+#define MIN_VALUES 1000
+#define DEFAULT_MAX 1000000
+// Milliseconds the next size's apply is allowed to be expected to take
+#define SUITE_BUDGET 30000.0
+#define NAME_SIZE 16
+
+// Relations for one graph, each pair of numbers is greater then lesser
+//
+// values: Number of values, named v0 up
+// pairs: Numbers of the values in each relation
+// length: Number of relations
+typedef struct relations {
+    int values;
+    int *pairs;
+    int length;
+} Relations;
+
+// Fill in relations for n values of a shape
+typedef int (*generator)(Relations *relations, int n);
+
+// Milliseconds since some fixed point
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+// Make room for count relations between values values
+static int start(Relations *relations, int values, int count)
+{
+    relations->values = values;
+    relations->length = 0;
+    relations->pairs = malloc(sizeof(int) * 2 * (size_t)count);
+    return relations->pairs == NULL;
+}
+
+static void add(Relations *relations, int greater, int lesser)
+{
+    relations->pairs[relations->length * 2] = greater;
+    relations->pairs[relations->length * 2 + 1] = lesser;
+    relations->length++;
+}
+
+static int random_dag(Relations *relations, int n)
+{
+    if(start(relations, n, n * 2)) return 1;
+
+    for(int i = 0; i < n * 2; i++) {
+        int a = rand() % (n - 1);
+        int b = a + 1 + rand() % (n - a - 1);
+        add(relations, a, b);
+    }
+
+    // shuffle, so the order's built up from all over rather than top down
+    for(int i = relations->length - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int a = relations->pairs[i * 2];
+        int b = relations->pairs[i * 2 + 1];
+        relations->pairs[i * 2] = relations->pairs[j * 2];
+        relations->pairs[i * 2 + 1] = relations->pairs[j * 2 + 1];
+        relations->pairs[j * 2] = a;
+        relations->pairs[j * 2 + 1] = b;
+    }
+
+    return 0;
+}
+
+static int chain(Relations *relations, int n)
+{
+    if(start(relations, n, n - 1)) return 1;
+
+    for(int i = 0; i + 1 < n; i++) add(relations, i, i + 1);
+    return 0;
+}
+
+static int fanout(Relations *relations, int n)
+{
+    if(start(relations, n, (n - 2) * 2)) return 1;
+
+    // v0 is above everything, v1 below
+    for(int i = 2; i < n; i++) {
+        add(relations, 0, i);
+        add(relations, i, 1);
+    }
+    return 0;
+}
+
+static int lattice(Relations *relations, int n)
+{
+    int depth = n / 2 - 1;
+    if(start(relations, n, depth * 4)) return 1;
+
+    // level l is values 2l and 2l + 1
+    for(int level = 0; level < depth; level++) {
+        for(int i = 0; i < 4; i++) add(relations, level * 2 + i / 2, (level + 1) * 2 + i % 2);
+    }
+    return 0;
+}
+
+static int backedge(Relations *relations, int n)
+{
+    int half = n / 2;
+    if(start(relations, n, half * 3)) return 1;
+
+    // first chain is 0 to half - 1, second is half up
+    for(int i = 0; i + 1 < half; i++) add(relations, i, i + 1);
+    for(int i = 0; i + 1 < half; i++) add(relations, half + i, half + i + 1);
+    for(int i = half - 1; i >= 0; i--) add(relations, half + i, i);
+    return 0;
+}
+
+// Times for one graph
+typedef struct result {
+    double apply;
+    double find;
+    double sorted;
+    double free;
+} Result;
+
+// Build, query and free one graph, checking its order along the way
+static int run(Relations *relations, char (*names)[NAME_SIZE], Result *result)
+{
+    int *order = NULL;
+    unsigned long *ids = malloc(sizeof(unsigned long) * (size_t)relations->values);
+    Graph *graph = new_graph();
+    check_mem(ids && graph);
+
+    double time = now();
+    for(int i = 0; i < relations->length; i++) {
+        int rc = g_apply_relation(graph, names[relations->pairs[i * 2]], names[relations->pairs[i * 2 + 1]]);
+        check(!rc || rc == ERR_DUPLICATE, "Failed to apply %s > %s", names[relations->pairs[i * 2]],
+                names[relations->pairs[i * 2 + 1]]);
+    }
+    result->apply = now() - time;
+
+    // ids are worked out first, so only the lookups are timed
+    for(int i = 0; i < relations->values; i++) ids[i] = hash(names[i]);
+
+    int found = 0;
+    time = now();
+    for(int i = 0; i < relations->values; i++) found += g_find(graph, ids[i], NULL) != NULL;
+    result->find = now() - time;
+    check(found == graph->length, "Found %i of %i values", found, graph->length);
+
+    int size = 0;
+    time = now();
+    char **sorted = g_sorted(graph, &size);
+    result->sorted = now() - time;
+    check_mem(sorted);
+
+    // position of each value in the order, then every relation has to go down it
+    order = malloc(sizeof(int) * (size_t)relations->values);
+    check_mem(order);
+    for(int i = 0; i < size; i++) order[atoi(sorted[i] + 1)] = i;
+    free(sorted);
+    for(int i = 0; i < relations->length; i++) {
+        check(order[relations->pairs[i * 2]] < order[relations->pairs[i * 2 + 1]], "%s isn't before %s",
+                names[relations->pairs[i * 2]], names[relations->pairs[i * 2 + 1]]);
+    }
+
+    time = now();
+    g_free(graph);
+    result->free = now() - time;
+
+    free(order);
+    free(ids);
+    return 0;
+
+error:
+    if(graph) g_free(graph);
+    free(order);
+    free(ids);
+    return 1;
+}
+
+// Shapes in the order they're run
+static const char *shape_names[] = { "random", "chain", "fanout", "lattice", "backedge" };
+static generator shape_generators[] = { random_dag, chain, fanout, lattice, backedge };
+#define SHAPES ((int)(sizeof(shape_names) / sizeof(shape_names[0])))
+
+int main(int argc, char *argv[])
+{
+    int json = 0;
+    int max = DEFAULT_MAX;
+    const char *only = NULL;
+
+    for(int arg = 1; arg < argc; arg++) {
+        if(strcmp(argv[arg], "--json") == 0) {
+            json = 1;
+        } else if(strcmp(argv[arg], "--max") == 0 && arg + 1 < argc) {
+            max = atoi(argv[++arg]);
+        } else if(strcmp(argv[arg], "--shape") == 0 && arg + 1 < argc) {
+            only = argv[++arg];
+        } else {
+            fprintf(stderr, "Usage: suite_bench [--json] [--max <values>] [--shape <name>]\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    int known = !only;
+    for(int s = 0; s < SHAPES && !known; s++) known = strcmp(only, shape_names[s]) == 0;
+    if(!known) {
+        fprintf(stderr, "Unknown shape %s\n", only);
+        return EXIT_FAILURE;
+    }
+
+    char (*names)[NAME_SIZE] = malloc(sizeof(*names) * (size_t)(max > MIN_VALUES ? max : MIN_VALUES));
+    if(!names) {
+        log_err("Out of memory.");
+        return EXIT_FAILURE;
+    }
+    for(int i = 0; i < max; i++) snprintf(names[i], NAME_SIZE, "v%i", i);
+
+    if(json) printf("[\n");
+    else printf("shape,values,relations,apply_ms,apply_ns_per_relation,find_ms,find_ns_per_value,sorted_ms,free_ms\n");
+
+    int rows = 0;
+    for(int s = 0; s < SHAPES; s++) {
+        if(only && strcmp(only, shape_names[s]) != 0) continue;
+
+        for(int n = MIN_VALUES; n <= max; n *= 10) {
+            Relations relations;
+            Result result;
+
+            srand(1);
+            if(shape_generators[s](&relations, n)) {
+                log_err("Out of memory.");
+                return EXIT_FAILURE;
+            }
+
+            if(run(&relations, names, &result)) {
+                log_err("%s with %i values failed", shape_names[s], n);
+                return EXIT_FAILURE;
+            }
+
+            double per_relation = relations.length ? result.apply * 1000000.0 / relations.length : 0;
+            double per_value = result.find * 1000000.0 / n;
+            if(json) {
+                printf("%s  {\"shape\": \"%s\", \"values\": %i, \"relations\": %i, \"apply_ms\": %.3f, "
+                        "\"apply_ns_per_relation\": %.1f, \"find_ms\": %.3f, \"find_ns_per_value\": %.1f, "
+                        "\"sorted_ms\": %.3f, \"free_ms\": %.3f}", rows ? ",\n" : "", shape_names[s], n,
+                        relations.length, result.apply, per_relation, result.find, per_value, result.sorted, result.free);
+            } else {
+                printf("%s,%i,%i,%.3f,%.1f,%.3f,%.1f,%.3f,%.3f\n", shape_names[s], n, relations.length, result.apply,
+                        per_relation, result.find, per_value, result.sorted, result.free);
+            }
+            fflush(stdout);
+            rows++;
+            free(relations.pairs);
+
+            // assume at least linear growth
+            if(n <= max / 10 && result.apply * 10 > SUITE_BUDGET) {
+                fprintf(stderr, "suite %s stopped at %i values, %i would take over %.0f s\n", shape_names[s], n,
+                        n * 10, SUITE_BUDGET / 1000.0);
+                break;
+            }
+        }
+    }
+
+    if(json) printf("\n]\n");
+
+    free(names);
+    return 0;
+}
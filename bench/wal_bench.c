@@ -0,0 +1,179 @@
+/* Benchmark for the write-ahead log
+ *
+ * Times logging relations with a few group commit sizes, then recovering a
+ *   graph from a log of a million or so relations with wl_open, against
+ *   applying the same relations one at a time as replaying edge by edge would.
+ *   Also prints the size of the log per relation
+ *
+ * Committing every relation is one fdatasync each, so only the first
+ *   SYNC_EACH relations are timed that way
+ *
+ * Then recovers logs with churn, relations and removals alternating, at a few
+ *   sizes. Replay sorts once however many removals there are, so the time per
+ *   record should stay about the same as the log grows
+ *
+ * Call with wal_bench [values]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/graph.h"
+#include "../src/wal.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_VALUES 500000
+#define RELATIONS_PER_VALUE 2
+#define SPAN 100
+#define SYNC_EACH 500
+// Relations logged before churn starts removing them
+#define CHURN_AFTER 1000
+#define NAME_SIZE 16
+#define LOG_PATH "/tmp/wal_bench.log"
+
+// Milliseconds since some fixed point
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+// Log count relations to a new log, committing every group
+static int run_log(char **greater, char **lesser, int count, int group)
+{
+    unlink(LOG_PATH);
+    Wal *wal = wl_open(LOG_PATH, NULL, group);
+    check(wal, "Couldn't open %s", LOG_PATH);
+
+    double start = now();
+    for(int i = 0; i < count; i++) {
+        int rc = wl_apply(wal, greater[i], lesser[i]);
+        check(!rc || rc == ERR_DUPLICATE, "Failed to apply %s > %s", greater[i], lesser[i]);
+    }
+    check(wl_commit(wal) == 0, "Failed to commit");
+    double logged = now() - start;
+
+    struct stat info;
+    stat(LOG_PATH, &info);
+    printf("wal group %i: %i relations logged in %.3f ms, %.2f us each, %lu commits, %.1f bytes per relation\n",
+            group, count, logged, logged * 1000.0 / count, wal->commits, (double)info.st_size / count);
+
+    Graph *graph = wal->graph;
+    wl_close(wal);
+    g_free(graph);
+    return 0;
+
+error:
+    return 1;
+}
+
+// Log count relations, each after the first few followed by removing one from
+//   earlier, then time recovering the graph from the log
+static int run_churn(char **greater, char **lesser, int count)
+{
+    unlink(LOG_PATH);
+    Wal *wal = wl_open(LOG_PATH, NULL, 4096);
+    check(wal, "Couldn't open %s", LOG_PATH);
+
+    int removals = 0;
+    for(int i = 0; i < count; i++) {
+        int rc = wl_apply(wal, greater[i], lesser[i]);
+        check(!rc || rc == ERR_DUPLICATE, "Failed to apply %s > %s", greater[i], lesser[i]);
+
+        if(i < CHURN_AFTER) continue;
+        rc = wl_remove(wal, greater[i / 2], lesser[i / 2]);
+        check(!rc || rc == ERR_NOT_FOUND, "Failed to remove %s > %s", greater[i / 2], lesser[i / 2]);
+        if(!rc) removals++;
+    }
+    check(wl_commit(wal) == 0, "Failed to commit");
+    int length = wal->graph->length;
+    Graph *graph = wal->graph;
+    wl_close(wal);
+    g_free(graph);
+
+    double start = now();
+    wal = wl_open(LOG_PATH, NULL, 0);
+    double recovered = now() - start;
+    check(wal && wal->graph->length == length, "Failed to recover");
+
+    printf("wal churn recovery of %i relations and %i removals: %.3f ms, %.3f us per record\n",
+            count, removals, recovered, recovered * 1000.0 / (count + removals));
+
+    graph = wal->graph;
+    wl_close(wal);
+    g_free(graph);
+    return 0;
+
+error:
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int values = argc > 1 ? atoi(argv[1]) : DEFAULT_VALUES;
+    int count = values * RELATIONS_PER_VALUE;
+    char *names = malloc((size_t)values * NAME_SIZE);
+    char **greater = malloc(sizeof(char *) * (size_t)count);
+    char **lesser = malloc(sizeof(char *) * (size_t)count);
+    if(!names || !greater || !lesser) {
+        log_err("Out of memory.");
+        return EXIT_FAILURE;
+    }
+
+    for(int i = 0; i < values; i++) snprintf(names + i * NAME_SIZE, NAME_SIZE, "value%i", i);
+
+    srand(1);
+    for(int i = 0; i < count; i++) {
+        int a = rand() % values;
+        int b = a + 1 + rand() % SPAN;
+        if(b >= values) b = values - 1 - rand() % SPAN;
+        if(a == b) b = (a + 1) % values;
+
+        greater[i] = names + (a < b ? a : b) * NAME_SIZE;
+        lesser[i] = names + (a < b ? b : a) * NAME_SIZE;
+    }
+
+    if(run_log(greater, lesser, count < SYNC_EACH ? count : SYNC_EACH, 1)) return EXIT_FAILURE;
+    if(run_log(greater, lesser, count, 64)) return EXIT_FAILURE;
+    if(run_log(greater, lesser, count, 4096)) return EXIT_FAILURE;
+
+    // the last log has every relation in it
+    double start = now();
+    Wal *wal = wl_open(LOG_PATH, NULL, 0);
+    double recovered = now() - start;
+    if(!wal) {
+        log_err("Failed to recover");
+        return EXIT_FAILURE;
+    }
+    int length = wal->graph->length;
+    Graph *graph = wal->graph;
+    wl_close(wal);
+    g_free(graph);
+
+    start = now();
+    graph = new_graph();
+    for(int i = 0; i < count && graph; i++) g_apply_relation(graph, greater[i], lesser[i]);
+    double one_by_one = now() - start;
+    if(!graph || graph->length != length) {
+        log_err("Recovered %i values, expected %i", length, graph ? graph->length : 0);
+        return EXIT_FAILURE;
+    }
+    g_free(graph);
+
+    printf("wal recovery of %i relations: wl_open %.3f ms, one at a time %.3f ms (%.1fx)\n",
+            count, recovered, one_by_one, one_by_one / recovered);
+
+    for(int size = count / 4; size <= count; size *= 2) {
+        if(run_churn(greater, lesser, size)) return EXIT_FAILURE;
+    }
+
+    unlink(LOG_PATH);
+    free(greater);
+    free(lesser);
+    free(names);
+    return 0;
+}
@@ -0,0 +1,110 @@
+/* Benchmark for writing out the sorted order
+ *
+ * Builds a graph of a few million values, then times printing its order to
+ *   /dev/null the old way, with g_sorted and a printf per value, against
+ *   streaming it with g_write_sorted
+ *
+ * Call with writer_bench [values]
+ */
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/graph.h"
+#include "../src/writer.h"
+#include "../src/dbg.h"
+
+#define DEFAULT_VALUES 4000000
+#define RELATIONS_PER_VALUE 2
+#define SPAN 100
+#define NAME_SIZE 16
+
+// Milliseconds since some fixed point
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+int main(int argc, char *argv[])
+{
+    int values = argc > 1 ? atoi(argv[1]) : DEFAULT_VALUES;
+    int count = values * RELATIONS_PER_VALUE;
+    char *names = malloc((size_t)values * NAME_SIZE);
+    char **greater = malloc(sizeof(char *) * (size_t)count);
+    char **lesser = malloc(sizeof(char *) * (size_t)count);
+    Graph *graph = new_graph();
+    FILE *out = fopen("/dev/null", "w");
+    int fd = open("/dev/null", O_WRONLY);
+    if(!names || !greater || !lesser || !graph || !out || fd == -1) {
+        log_err("Out of memory, or couldn't open /dev/null.");
+        return EXIT_FAILURE;
+    }
+
+    for(int i = 0; i < values; i++) snprintf(names + i * NAME_SIZE, NAME_SIZE, "value%i", i);
+
+    srand(1);
+    for(int i = 0; i < count; i++) {
+        int a = rand() % values;
+        int b = a + 1 + rand() % SPAN;
+        if(b >= values) b = values - 1 - rand() % SPAN;
+        if(a == b) b = (a + 1) % values;
+
+        greater[i] = names + (a < b ? a : b) * NAME_SIZE;
+        lesser[i] = names + (a < b ? b : a) * NAME_SIZE;
+    }
+
+    if(g_apply_relations_batch(graph, greater, lesser, count)) {
+        log_err("Failed to apply batch");
+        return EXIT_FAILURE;
+    }
+    free(greater);
+    free(lesser);
+
+    // what read_file used to do
+    double start = now();
+    int size = 0;
+    char **sorted = g_sorted(graph, &size);
+    if(!sorted) {
+        log_err("Out of memory.");
+        return EXIT_FAILURE;
+    }
+    fprintf(out, "Done. Sorted list:\n");
+    for(int i = 0; i < size; i++) fprintf(out, "%s, ", sorted[i]);
+    fprintf(out, "\n");
+    fflush(out);
+    free(sorted);
+    double printed = now();
+
+    start = printed - start;
+    printf("writer %i values: g_sorted and printf %.3f ms, %.1f MB array\n",
+            size, start, (double)sizeof(char *) * size / 1000000.0);
+
+    double write_start = now();
+    Writer *writer = new_writer(fd, 0);
+    if(!writer) {
+        log_err("Out of memory.");
+        return EXIT_FAILURE;
+    }
+    int err = wr_string(writer, "Done. Sorted list:\n");
+    if(!err) err = g_write_sorted(graph, writer, ", ");
+    if(!err) err = wr_string(writer, "\n");
+    if(wr_free(writer) || err) {
+        log_err("Failed to write");
+        return EXIT_FAILURE;
+    }
+    double written = now();
+
+    printf("writer %i values: g_write_sorted %.3f ms (%.1fx), %.1f MB buffer\n",
+            graph->length, written - write_start, start / (written - write_start), WRITER_SIZE / 1000000.0);
+
+    fclose(out);
+    close(fd);
+    g_free(graph);
+    free(names);
+    return 0;
+}
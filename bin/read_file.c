@@ -2,91 +2,205 @@
  *
  * Simple program to read a file of values into a graph and sort them
  *
- * Call with read_file <file>
+ * Call with read_file [--batch] [--threads <n>] [--snapshot] [--save <snapshot>] [--stats] <file>
+ *
+ * --batch: Read every relation first and sort once at the end, much faster for
+ *   large files. A cycle anywhere rejects the whole file
+ * --threads: Load with n threads, or one per CPU if n is 0, then sort once at
+ *   the end as --batch. Prints how long each stage took
+ * --snapshot: The file is a snapshot written with --save rather than relations
+ * --save: Write the graph to a snapshot once it's loaded, which loads far faster
+ *   than the relations it came from
+ * --stats: Print the graph's operation counters once it's loaded, to stderr.
+ *   Only counted if the library was built with GRAPH_STATS
  */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "../src/graph.h"
+#include "../src/ingest.h"
+#include "../src/parser.h"
+#include "../src/writer.h"
 #include "../src/dbg.h"
 
-#define BUFFER_SIZE 255
+#define BATCH_INITIAL_SIZE 1024
 
-int main(int argc, char *argv[])
+// Relations collected for a batch, pointing into the parser's mapping
+typedef struct batch {
+    View *greater;
+    View *lesser;
+    int length;
+    int size;
+} Batch;
+
+// Keep a relation to apply with the rest of the batch
+static int add_batch(Batch *batch, Relation *relation)
 {
+    if(batch->length == batch->size) {
+        int size = batch->size ? batch->size * 2 : BATCH_INITIAL_SIZE;
+        View *greater = realloc(batch->greater, sizeof(View) * (size_t)size);
+        if(!greater) return 1;
+        batch->greater = greater;
 
-    if(argc != 2) {
-        fprintf(stderr, "Usage: read_file <file>\n");
-        return EXIT_FAILURE;
+        View *lesser = realloc(batch->lesser, sizeof(View) * (size_t)size);
+        if(!lesser) return 1;
+        batch->lesser = lesser;
+
+        batch->size = size;
     }
 
-    FILE *file = fopen(argv[1], "r");
-    if(!file) {
-        fprintf(stderr, "Could not open file: %s\n", argv[1]);
-        return EXIT_FAILURE;
+    batch->greater[batch->length] = relation->greater;
+    batch->lesser[batch->length] = relation->lesser;
+    batch->length++;
+    return 0;
+}
+
+// Load a file with the parallel loader and print how long each stage took
+static int load_threaded(Graph *graph, char *path, int threads)
+{
+    Ingest stats;
+    int err = in_load(graph, path, threads, &stats);
+
+    if(err == -1) {
+        fprintf(stderr, "Could not open file: %s\n", path);
+        return 1;
+    } else if(err) {
+        log_err("Could not sort %s", path);
+        return 1;
     }
 
-    Graph *graph = new_graph();
-    if(!graph) {
+    fprintf(stderr, "Loaded %i relations (%i invalid lines, %lu duplicates) with %i threads: parse %.3f ms, shard %.3f ms, "
+            "intern %.3f ms, translate %.3f ms, apply %.3f ms\n", stats.relations, stats.invalid, stats.duplicates,
+            stats.threads, stats.parse, stats.shard, stats.intern, stats.translate, stats.apply);
+    return 0;
+}
+
+// Print the sorted graph, straight from the graph to stdout in large writes
+static int print_sorted(Graph *graph)
+{
+    Writer *writer = new_writer(STDOUT_FILENO, 0);
+    if(!writer) {
         log_err("Out of memory.");
-        fclose(file);
-        return EXIT_FAILURE;
+        return 1;
     }
 
-    char *buf = malloc(BUFFER_SIZE); 
-    char *buf_1 = malloc(BUFFER_SIZE);
-    char *buf_2 = malloc(BUFFER_SIZE);
-    char relate;
+    // anything stdio is holding goes first
+    fflush(stdout);
 
-    if(!buf || !buf_1 || !buf_2) {
-        log_err("Out of memory.");
-        fclose(file);
-        free(buf);
-        free(buf_1);
-        free(buf_2);
-        return EXIT_FAILURE;
+    int err = wr_string(writer, "Done. Sorted list:\n");
+    if(!err) err = g_write_sorted(graph, writer, ", ");
+    if(!err) err = wr_string(writer, "\n");
+
+    return wr_free(writer) || err;
+}
+
+// Load a text file of relations, one at a time or as a batch
+static int load_text(Graph *graph, char *path, int batched)
+{
+    Parser *parser = new_parser(path);
+    if(!parser) {
+        fprintf(stderr, "Could not open file: %s\n", path);
+        return 1;
     }
 
-    while(fgets(buf, BUFFER_SIZE, file)) {
-        int err = sscanf(buf, "%s %c %s\n", buf_1, &relate, buf_2);
+    Batch batch = { NULL, NULL, 0, 0 };
+    Relation relation;
+    int rc;
 
-        if(err == EOF) {
-            log_err("Error reading line: %s\n", buf);
-            fclose(file);
-            free(buf);
-            free(buf_1);
-            free(buf_2);
-            return EXIT_FAILURE;
+    while((rc = pr_next(parser, &relation)) != PARSE_END) {
+        if(rc == PARSE_INVALID) {
+            log_warn("Line %i is not a valid relation: %.*s", parser->line, (int)parser->bad.length, parser->bad.str);
+        } else if(!batched) {
+            g_apply_relation_n(graph, relation.greater, relation.lesser);
+        } else if(add_batch(&batch, &relation)) {
+            log_err("Out of memory.");
+            free(batch.greater);
+            free(batch.lesser);
+            pr_free(parser);
+            return 1;
         }
+    }
+
+    int err = 0;
+    if(batched) {
+        err = g_apply_relations_batch_n(graph, batch.greater, batch.lesser, batch.length);
+        if(err) log_err("Could not sort %s", path);
+
+        free(batch.greater);
+        free(batch.lesser);
+    }
+
+    if(!err && graph->duplicates) log_warn("Skipped %lu duplicate relations", graph->duplicates);
+
+    // values are interned by the graph, so the file isn't needed any more
+    pr_free(parser);
+    return err != 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int batched = 0;
+    int snapshot = 0;
+    int stats = 0;
+    int threads = -1;
+    char *save = NULL;
+    int arg = 1;
 
-        switch(relate) {
-            case '<':
-                g_apply_relation(graph, buf_2, buf_1);
-                break;
-            case '>':
-                g_apply_relation(graph, buf_1, buf_2);
-                break;
-            default:
-                log_warn("'%c' is not a valid comparison in %s\n", relate, buf);
-                break;
+    for(; arg < argc - 1; arg++) {
+        if(strcmp(argv[arg], "--batch") == 0) {
+            batched = 1;
+        } else if(strcmp(argv[arg], "--snapshot") == 0) {
+            snapshot = 1;
+        } else if(strcmp(argv[arg], "--stats") == 0) {
+            stats = 1;
+        } else if(strcmp(argv[arg], "--threads") == 0 && arg + 2 < argc) {
+            threads = atoi(argv[++arg]);
+        } else if(strcmp(argv[arg], "--save") == 0 && arg + 2 < argc) {
+            save = argv[++arg];
+        } else {
+            break;
         }
     }
 
-    free(buf);
-    free(buf_1);
-    free(buf_2);
+    if(arg != argc - 1 || threads < -1) {
+        fprintf(stderr, "Usage: read_file [--batch] [--threads <n>] [--snapshot] [--save <snapshot>] [--stats] <file>\n");
+        return EXIT_FAILURE;
+    }
 
-    int size = 0;
-    char **sorted = g_sorted(graph, &size);
+    char *path = argv[arg];
+    Graph *graph = NULL;
+    int err = 0;
 
-    printf("Done. Sorted list:\n");
-    for(int i = 0; i < size; i++) {
-        printf("%s, ", sorted[i]);
+    if(snapshot) {
+        graph = g_load(path);
+        if(!graph) {
+            fprintf(stderr, "Could not load snapshot: %s\n", path);
+            return EXIT_FAILURE;
+        }
+    } else {
+        graph = new_graph();
+        if(!graph) {
+            log_err("Out of memory.");
+            return EXIT_FAILURE;
+        }
+
+        err = threads != -1 ? load_threaded(graph, path, threads) : load_text(graph, path, batched);
     }
-    printf("\n");
 
-    free(sorted);
-    fclose(file);
+    if(!err && stats) {
+        Stats counted = g_stats(graph);
+        st_print(&counted, stderr);
+    }
+
+    if(!err && save && g_save(graph, save)) {
+        log_err("Could not save snapshot %s", save);
+        err = 1;
+    }
+
+    if(!err) err = print_sorted(graph);
+
     g_free(graph);
-    return 0;
+    return err ? EXIT_FAILURE : 0;
 }
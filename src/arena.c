@@ -0,0 +1,168 @@
+/* Arena allocator
+ *
+ * Bump allocation from 1MB blocks, with power-of-two free lists on top for
+ *   memory that gets handed back
+ */
+
+#include <malloc.h>
+#include <string.h>
+
+#include "arena.h"
+#include "stats.h"
+#include "dbg.h"
+
+// Size of each normal block
+#define ARENA_BLOCK_SIZE ((size_t)1 << 20)
+// Alignment of everything handed out
+#define ARENA_ALIGN ((size_t)16)
+// Anything bigger than this gets a block to itself, so it doesn't waste the rest of the current one
+#define ARENA_LARGE (ARENA_BLOCK_SIZE / 4)
+
+// Make a new arena
+Arena *new_arena(void)
+{
+    Arena *arena = calloc(1, sizeof(Arena));
+    if(!arena) return NULL;
+
+    return arena;
+}
+
+// Allocate a block with size bytes usable
+static Block *a_block(size_t size)
+{
+    Block *block = malloc(sizeof(Block) + size);
+    if(!block) return NULL;
+
+    block->size = size;
+    block->next = NULL;
+    return block;
+}
+
+// Bump allocate from the current block, starting a new block when it runs out
+void *a_alloc(Arena *arena, size_t size)
+{
+    if(!arena) return malloc(size);
+
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    STAT_ADD(*arena, allocations, 1);
+    STAT_ADD(*arena, bytes, size);
+
+    if(size > ARENA_LARGE) {
+        // large allocation: own block, kept behind the current one so that can still be used
+        Block *block = a_block(size);
+        if(!block) return NULL;
+        STAT_ADD(*arena, reserved, size);
+
+        if(arena->blocks) {
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        } else {
+            arena->blocks = block;
+        }
+        return block->data;
+    }
+
+    if(size > arena->left) {
+        // rest of the current block is wasted, at most a quarter of it
+        Block *block = a_block(ARENA_BLOCK_SIZE);
+        if(!block) return NULL;
+        STAT_ADD(*arena, reserved, ARENA_BLOCK_SIZE);
+
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->next = block->data;
+        arena->left = block->size;
+    }
+
+    void *ptr = arena->next;
+    arena->next += size;
+    arena->left -= size;
+    return ptr;
+}
+
+// Get the size class for an allocation, the smallest power of two that fits it
+// Always at least a pointer, so freed memory can hold the free list link
+static int a_class(size_t size)
+{
+    int class = 3;
+    while(((size_t)1 << class) < size) class++;
+
+    return class;
+}
+
+// Allocate from a size class, reusing freed memory first
+void *a_slab_alloc(Arena *arena, size_t size)
+{
+    if(!arena) return malloc(size);
+
+    int class = a_class(size);
+    check(class < ARENA_CLASSES, "Slab allocation of %zu bytes too large", size);
+
+    void *ptr = arena->slabs[class];
+    if(ptr) {
+        arena->slabs[class] = *(void **)ptr;
+        STAT_ADD(*arena, allocations, 1);
+        STAT_ADD(*arena, bytes, (size_t)1 << class);
+        return ptr;
+    }
+
+    return a_alloc(arena, (size_t)1 << class);
+
+error:
+    return NULL;
+}
+
+// Push memory onto its size class's free list
+void a_slab_free(Arena *arena, void *ptr, size_t size)
+{
+    if(!ptr) return;
+
+    if(!arena) {
+        free(ptr);
+        return;
+    }
+
+    int class = a_class(size);
+    *(void **)ptr = arena->slabs[class];
+    arena->slabs[class] = ptr;
+}
+
+// Free everything but one normal block
+void a_reset(Arena *arena)
+{
+    Block *keep = NULL;
+    Block *block = arena->blocks;
+
+    while(block) {
+        Block *next = block->next;
+        if(!keep && block->size == ARENA_BLOCK_SIZE) {
+            keep = block;
+            keep->next = NULL;
+        } else {
+            free(block);
+        }
+        block = next;
+    }
+
+    arena->blocks = keep;
+    arena->next = keep ? keep->data : NULL;
+    arena->left = keep ? keep->size : 0;
+    memset(arena->slabs, 0, sizeof(arena->slabs));
+    arena->allocations = 0;
+    arena->bytes = 0;
+    arena->reserved = keep ? (unsigned long)keep->size : 0;
+}
+
+// Free every block and the arena
+void a_free(Arena *arena)
+{
+    Block *block = arena->blocks;
+
+    while(block) {
+        Block *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    free(arena);
+}
@@ -0,0 +1,107 @@
+/* Arena allocator
+ *
+ * Hands out memory from large blocks so lots of small, long-lived allocations
+ *   (values, relation vectors) don't each go through malloc, and can all be
+ *   freed at once
+ *
+ * Memory from a_alloc is only freed with the whole arena. Memory from a_slab_alloc
+ *   comes in power-of-two size classes and can be handed back with a_slab_free
+ *   for reuse, which suits arrays that grow by doubling
+ *
+ * Every function also accepts a NULL arena, in which case it falls back to
+ *   plain malloc and free
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Number of slab size classes, class n holds allocations of 2^n bytes
+#define ARENA_CLASSES 48
+
+/* struct: Block
+ *
+ * Block of memory allocated by an arena. Avoid using directly
+ *
+ * next: Next block in the arena
+ * size: Usable size of data
+ * data: Memory handed out
+ */
+typedef struct block Block;
+
+typedef struct block {
+    Block *next;
+    size_t size;
+    char data[];
+} Block;
+
+/* struct: Arena
+ *
+ * Create with new_arena and operate with a_* functions
+ *
+ * blocks: Blocks allocated, most recent first
+ * next: Next free byte in the current block
+ * left: Bytes left in the current block
+ * slabs: Free list for each slab size class
+ * allocations: Allocations handed out, only counted with GRAPH_STATS (see stats.h)
+ * bytes: Bytes handed out, as above
+ * reserved: Bytes of blocks allocated, as above
+ */
+typedef struct arena {
+    Block *blocks;
+    char *next;
+    size_t left;
+    void *slabs[ARENA_CLASSES];
+    unsigned long allocations;
+    unsigned long bytes;
+    unsigned long reserved;
+} Arena;
+
+/* function: new_arena()
+ *
+ * Create a new, empty arena; no blocks are allocated until first use
+ *
+ * Returns the arena or NULL if out of memory
+ */
+Arena *new_arena(void);
+
+/* function: a_alloc(Arena *arena, size_t size)
+ *
+ * Allocate size bytes from an arena, aligned for any type
+ *
+ * Returns the memory or NULL if out of memory
+ */
+void *a_alloc(Arena *arena, size_t size);
+
+/* function: a_slab_alloc(Arena *arena, size_t size)
+ *
+ * Allocate at least size bytes from an arena's slabs, reusing memory given back
+ *   with a_slab_free where possible
+ *
+ * Returns the memory or NULL if out of memory
+ */
+void *a_slab_alloc(Arena *arena, size_t size);
+
+/* function: a_slab_free(Arena *arena, void *ptr, size_t size)
+ *
+ * Give memory from a_slab_alloc back for reuse. size has to be the size it was
+ *   allocated with. Does nothing if ptr is NULL
+ */
+void a_slab_free(Arena *arena, void *ptr, size_t size);
+
+/* function: a_reset(Arena *arena)
+ *
+ * Forget everything allocated from an arena, keeping one block to reuse
+ *
+ * Any memory from the arena is invalid afterwards
+ */
+void a_reset(Arena *arena);
+
+/* function: a_free(Arena *arena)
+ *
+ * Free an arena and everything allocated from it
+ */
+void a_free(Arena *arena);
+
+#endif
@@ -0,0 +1,367 @@
+/* Transitive closure
+ *
+ * The relations are copied into rows of positions first, so building only reads
+ *   arrays. AVX2 isn't assumed at compile time, the OR used is picked once the
+ *   CPU's been checked. Rows are mapped straight from the kernel, in huge pages
+ *   where it allows, as faulting them in is otherwise most of the time
+ */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CLOSURE_AVX2
+#endif
+
+#include "closure.h"
+#include "dbg.h"
+
+// Words in a cache line, rows and column splits are multiples of this so threads
+//   never write to the same line
+#define CLOSURE_LINE 8
+
+// OR count words of from into to
+typedef void (*cl_or)(uint64_t *to, const uint64_t *from, uint32_t count);
+
+// Shared between every thread
+//
+// closure: Closure being filled in
+// or: OR to use
+// threads: Number of threads
+// start: Start of each position's lower relations in lower, count + 1 entries
+// lower: Positions of lower values
+// higher_start: Start of each position's higher relations in higher, if building above
+// higher: Positions of higher values
+typedef struct state {
+    Closure *closure;
+    cl_or or;
+    int threads;
+    uint32_t *start;
+    uint32_t *lower;
+    uint32_t *higher_start;
+    uint32_t *higher;
+} State;
+
+// One thread's part, a range of columns in each direction
+//
+// state: Everything shared
+// index: Which thread this is
+// started: Whether it got its own thread
+typedef struct worker {
+    State *state;
+    int index;
+    int started;
+} Worker;
+
+static void cl_or_scalar(uint64_t *to, const uint64_t *from, uint32_t count)
+{
+    for(uint32_t i = 0; i < count; i++) to[i] |= from[i];
+}
+
+#ifdef CLOSURE_AVX2
+__attribute__((target("avx2")))
+static void cl_or_avx2(uint64_t *to, const uint64_t *from, uint32_t count)
+{
+    // rows start on cache lines, so this lines every load and store up with them
+    uint32_t i = 0;
+    for(; i < count && ((uintptr_t)(to + i) & 31); i++) to[i] |= from[i];
+
+    for(; i + 4 <= count; i += 4) {
+        __m256i a;
+        __m256i b;
+        memcpy(&a, to + i, sizeof(a));
+        memcpy(&b, from + i, sizeof(b));
+        a = _mm256_or_si256(a, b);
+        memcpy(to + i, &a, sizeof(a));
+    }
+
+    for(; i < count; i++) to[i] |= from[i];
+}
+#endif
+
+// Smallest x with x * x >= n
+static uint64_t cl_root(uint64_t n)
+{
+    uint64_t low = 0;
+    uint64_t high = n < 2 ? n : n / 2 + 1;
+
+    while(low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if(middle * middle >= n) high = middle;
+        else low = middle + 1;
+    }
+
+    return low;
+}
+
+// First column word of a thread's part of the rows below, rounded to a cache line
+// Work on each word grows with the number of rows before it, so the total up to
+//   word w grows with w squared
+static uint32_t cl_split(uint32_t words, int part, int parts)
+{
+    uint64_t split = cl_root((uint64_t)words * words * (unsigned int)part / (unsigned int)parts);
+    split = (split + CLOSURE_LINE - 1) / CLOSURE_LINE * CLOSURE_LINE;
+    return split < words ? (uint32_t)split : words;
+}
+
+// Fill this thread's columns of every row below, from the bottom of the order up
+static void cl_below(Worker *worker)
+{
+    State *state = worker->state;
+    Closure *closure = state->closure;
+    uint32_t first = cl_split(closure->words, worker->index, state->threads);
+    uint32_t last = cl_split(closure->words, worker->index + 1, state->threads);
+    if(first == last) return;
+
+    for(uint32_t p = closure->count; p-- > 0;) {
+        uint64_t *row = closure->below + (size_t)p * closure->words;
+
+        for(uint32_t i = state->start[p]; i < state->start[p + 1]; i++) {
+            uint32_t lower = state->lower[i];
+            uint32_t word = lower / 64;
+            // everything below lower comes after it
+            if(word >= last) continue;
+
+            uint32_t from = word > first ? word : first;
+            state->or(row + from, closure->below + (size_t)lower * closure->words + from, last - from);
+            if(word >= first) row[word] |= UINT64_C(1) << (lower % 64);
+        }
+    }
+}
+
+// Fill this thread's columns of every row above, from the top of the order down
+// The work's the mirror image of below, so are the splits
+static void cl_above_rows(Worker *worker)
+{
+    State *state = worker->state;
+    Closure *closure = state->closure;
+    uint32_t words = closure->words;
+    uint32_t first = words - cl_split(words, state->threads - worker->index, state->threads);
+    uint32_t last = words - cl_split(words, state->threads - worker->index - 1, state->threads);
+    if(first == last) return;
+
+    for(uint32_t p = 0; p < closure->count; p++) {
+        uint64_t *row = closure->above + (size_t)p * words;
+
+        for(uint32_t i = state->higher_start[p]; i < state->higher_start[p + 1]; i++) {
+            uint32_t higher = state->higher[i];
+            uint32_t word = higher / 64;
+            // everything above higher comes before it
+            if(word < first) continue;
+
+            uint32_t to = word < last ? word + 1 : last;
+            state->or(row + first, closure->above + (size_t)higher * words + first, to - first);
+            if(word < last) row[word] |= UINT64_C(1) << (higher % 64);
+        }
+    }
+}
+
+static void *cl_run(void *data)
+{
+    Worker *worker = data;
+
+    cl_below(worker);
+    if(worker->state->closure->above) cl_above_rows(worker);
+    return NULL;
+}
+
+// Copy one direction of the relations into rows by position
+// Returns 1 if out of memory
+static int cl_rows(Graph *graph, Closure *closure, int direction, uint32_t **start, uint32_t **related)
+{
+    *start = malloc(sizeof(uint32_t) * ((size_t)closure->count + 1));
+    if(!*start) return 1;
+
+    uint32_t total = 0;
+    for(uint32_t p = 0; p < closure->count; p++) {
+        (*start)[p] = total;
+        total += (uint32_t)g_degree(graph, closure->order[p], direction);
+    }
+    (*start)[closure->count] = total;
+
+    *related = malloc(sizeof(uint32_t) * (total ? total : 1));
+    if(!*related) return 1;
+
+    for(uint32_t p = 0; p < closure->count; p++) {
+        int degree = g_degree(graph, closure->order[p], direction);
+        for(int i = 0; i < degree; i++) {
+            Value *value = g_relation(graph, closure->order[p], direction, i);
+            (*related)[(*start)[p] + (uint32_t)i] = closure->position[value->index];
+        }
+    }
+
+    return 0;
+}
+
+// Size in bytes of one direction's rows
+static size_t cl_size(Closure *closure)
+{
+    size_t size = sizeof(uint64_t) * (size_t)closure->count * closure->words;
+    return size ? size : sizeof(uint64_t);
+}
+
+// Map zeroed rows, one per value
+// Pages come from the kernel already zeroed and only when first touched, so the
+//   half of each row that's never set costs nothing
+static uint64_t *cl_matrix(Closure *closure)
+{
+    void *rows = mmap(NULL, cl_size(closure), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(rows == MAP_FAILED) return NULL;
+
+    // every build walks all of them, so fewer, bigger pages mean far fewer faults
+    //   and TLB misses
+    madvise(rows, cl_size(closure), MADV_HUGEPAGE);
+    return rows;
+}
+
+Closure *g_closure(Graph *graph, int flags, int threads)
+{
+    if(threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(threads <= 0) threads = 1;
+
+    State state = { NULL, cl_or_scalar, threads, NULL, NULL, NULL, NULL };
+    Worker *workers = NULL;
+    pthread_t *ids = NULL;
+    Closure *closure = calloc(1, sizeof(Closure));
+    check_mem(closure);
+
+    closure->length = graph->pool->length;
+    closure->count = (uint32_t)graph->length;
+    closure->words = (closure->count + 64 * CLOSURE_LINE - 1) / (64 * CLOSURE_LINE) * CLOSURE_LINE;
+    closure->position = malloc(sizeof(uint32_t) * (closure->length ? closure->length : 1));
+    closure->order = malloc(sizeof(Value *) * (closure->count ? closure->count : 1));
+    check_mem(closure->position && closure->order);
+
+    memset(closure->position, 0xff, sizeof(uint32_t) * closure->length);
+    uint32_t p = 0;
+    for(Value *value = graph->start; value; value = value->next, p++) {
+        closure->order[p] = value;
+        closure->position[value->index] = p;
+    }
+
+    closure->below = cl_matrix(closure);
+    check_mem(closure->below);
+    check_mem(!cl_rows(graph, closure, DIR_LOWER, &state.start, &state.lower));
+    if(flags & CLOSURE_ABOVE) {
+        closure->above = cl_matrix(closure);
+        check_mem(closure->above);
+        check_mem(!cl_rows(graph, closure, DIR_HIGHER, &state.higher_start, &state.higher));
+    }
+
+#ifdef CLOSURE_AVX2
+    if(!(flags & CLOSURE_SCALAR) && __builtin_cpu_supports("avx2")) {
+        state.or = cl_or_avx2;
+        closure->vector = 1;
+    }
+#endif
+
+    state.closure = closure;
+    workers = malloc(sizeof(Worker) * (size_t)threads);
+    ids = malloc(sizeof(pthread_t) * (size_t)threads);
+    check_mem(workers && ids);
+
+    for(int i = 0; i < threads; i++) {
+        workers[i].state = &state;
+        workers[i].index = i;
+        workers[i].started = 0;
+    }
+
+    // parts that don't get a thread are done on this one, so the columns are
+    //   split the same however many start
+    for(int i = 1; i < threads; i++) workers[i].started = !pthread_create(&ids[i], NULL, cl_run, &workers[i]);
+
+    cl_run(&workers[0]);
+    for(int i = 1; i < threads; i++) {
+        if(workers[i].started) pthread_join(ids[i], NULL);
+        else cl_run(&workers[i]);
+    }
+
+    free(workers);
+    free(ids);
+    free(state.start);
+    free(state.lower);
+    free(state.higher_start);
+    free(state.higher);
+    return closure;
+
+error:
+    free(workers);
+    free(ids);
+    free(state.start);
+    free(state.lower);
+    free(state.higher_start);
+    free(state.higher);
+    if(closure) cl_free(closure);
+    return NULL;
+}
+
+// Position of a value, or UINT32_MAX if it's newer than the closure
+static uint32_t cl_position(Closure *closure, Value *value)
+{
+    return value->index < closure->length ? closure->position[value->index] : UINT32_MAX;
+}
+
+int cl_above(Closure *closure, Value *higher, Value *lower)
+{
+    uint32_t a = cl_position(closure, higher);
+    uint32_t b = cl_position(closure, lower);
+    if(a == UINT32_MAX || b == UINT32_MAX || b <= a) return 0;
+
+    return (closure->below[(size_t)a * closure->words + b / 64] >> (b % 64)) & 1;
+}
+
+uint32_t cl_count(Closure *closure, Value *value, int direction)
+{
+    uint32_t p = cl_position(closure, value);
+    if(p == UINT32_MAX) return 0;
+
+    uint32_t count = 0;
+    if(direction == DIR_LOWER || closure->above) {
+        uint64_t *row = (direction == DIR_LOWER ? closure->below : closure->above) + (size_t)p * closure->words;
+        for(uint32_t w = 0; w < closure->words; w++) count += (uint32_t)__builtin_popcountll(row[w]);
+        return count;
+    }
+
+    // without rows above, it's a column of the rows below
+    for(uint32_t i = 0; i < p; i++) {
+        count += (closure->below[(size_t)i * closure->words + p / 64] >> (p % 64)) & 1;
+    }
+    return count;
+}
+
+uint32_t cl_values(Closure *closure, Value *value, int direction, Value **values)
+{
+    uint32_t p = cl_position(closure, value);
+    if(p == UINT32_MAX) return 0;
+
+    uint32_t count = 0;
+    if(direction == DIR_LOWER || closure->above) {
+        uint64_t *row = (direction == DIR_LOWER ? closure->below : closure->above) + (size_t)p * closure->words;
+        for(uint32_t w = 0; w < closure->words; w++) {
+            // take each set bit off the bottom
+            for(uint64_t bits = row[w]; bits; bits &= bits - 1) {
+                values[count++] = closure->order[w * 64 + (uint32_t)__builtin_ctzll(bits)];
+            }
+        }
+        return count;
+    }
+
+    for(uint32_t i = 0; i < p; i++) {
+        if((closure->below[(size_t)i * closure->words + p / 64] >> (p % 64)) & 1) values[count++] = closure->order[i];
+    }
+    return count;
+}
+
+void cl_free(Closure *closure)
+{
+    free(closure->position);
+    free(closure->order);
+    if(closure->below) munmap(closure->below, cl_size(closure));
+    if(closure->above) munmap(closure->above, cl_size(closure));
+    free(closure);
+}
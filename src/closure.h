@@ -0,0 +1,106 @@
+/* Transitive closure
+ *
+ * Every value's full set of values below it, and optionally above it, as rows of
+ *   bits. Meant for graphs up to around 100k values, where sets are wanted
+ *   whole rather than one pair at a time: each set costs a bit per value, so
+ *   100k values take 1.25GB per direction
+ *
+ * Bits and rows are both by position in the graph's order, so a value's row
+ *   below only has bits after its own and its row above only bits before it.
+ *   Rows below are built from the bottom of the order up, each one the OR of the
+ *   rows of the values directly below it, and rows above the same way from the
+ *   top down. Only the part of each row that can have bits set is ORed, which
+ *   halves the work, and the ORs use AVX2 where the CPU has it
+ *
+ * Threads split the columns rather than the rows, so each one works through
+ *   every row in order without waiting for anything. Later columns have more
+ *   rows to fill below, earlier ones above, so the splits are weighted to even
+ *   out the work
+ *
+ * The closure describes the graph as it was when built; rebuild after changing it
+ */
+
+#ifndef CLOSURE_H
+#define CLOSURE_H
+
+#include <stdint.h>
+
+#include "graph.h"
+
+// Flags for g_closure
+// Build the sets above each value as well as below
+#define CLOSURE_ABOVE 1
+// Don't use vector instructions even if the CPU has them
+#define CLOSURE_SCALAR 2
+
+/* struct: Closure
+ *
+ * Result of g_closure, query with cl_above, cl_count and cl_values and free with
+ *   cl_free. Queries don't change it, so any number of threads can share one
+ *
+ * length: Number of ids covered, values added since aren't
+ * count: Number of values, and rows in each direction
+ * words: Number of 64-bit words in each row, a multiple of 8 so rows start on
+ *   cache lines
+ * position: Position of each id in the graph's order, or UINT32_MAX for ids
+ *   without a value
+ * order: Values in the graph's order
+ * below: Row for each position with bit j set if it's above position j
+ * above: Row for each position with bit j set if it's below position j, or NULL
+ *   if not built
+ * vector: 1 if rows were ORed with AVX2, 0 if not
+ */
+typedef struct closure {
+    uint32_t length;
+    uint32_t count;
+    uint32_t words;
+    uint32_t *position;
+    Value **order;
+    uint64_t *below;
+    uint64_t *above;
+    int vector;
+} Closure;
+
+/* function: g_closure(Graph *graph, int flags, int threads)
+ *
+ * Build the transitive closure of a graph using threads threads, or one per
+ *   online CPU if threads is 0 or less. flags is 0 or any of CLOSURE_ABOVE and
+ *   CLOSURE_SCALAR. The graph mustn't change while this runs
+ *
+ * Returns the closure, or NULL if out of memory
+ */
+Closure *g_closure(Graph *graph, int flags, int threads);
+
+/* function: cl_above(Closure *closure, Value *higher, Value *lower)
+ *
+ * Check whether higher is above lower through any chain of relations
+ *
+ * Returns 1 if it is, 0 if not or either value is newer than the closure
+ */
+int cl_above(Closure *closure, Value *higher, Value *lower);
+
+/* function: cl_count(Closure *closure, Value *value, int direction)
+ *
+ * Count the values below (DIR_LOWER) or above (DIR_HIGHER) a value. Counting
+ *   above without CLOSURE_ABOVE checks one bit in every row instead
+ *
+ * Returns the count, 0 if the value is newer than the closure
+ */
+uint32_t cl_count(Closure *closure, Value *value, int direction);
+
+/* function: cl_values(Closure *closure, Value *value, int direction, Value **values)
+ *
+ * Fill values with every value below (DIR_LOWER) or above (DIR_HIGHER) a value,
+ *   in the graph's order. values needs room for cl_count of them
+ *
+ * Returns the number of values filled in
+ */
+uint32_t cl_values(Closure *closure, Value *value, int direction, Value **values);
+
+/* function: cl_free(Closure *closure)
+ *
+ * Free a closure from g_closure
+ */
+void cl_free(Closure *closure);
+
+#endif
@@ -0,0 +1,407 @@
+/* Critical path
+ *
+ * A full schedule walks the graph's list forward for earliest starts and back for
+ *   latest starts. After that, only the values marked since the last schedule are
+ *   recomputed: each pass takes them off a heap in label order, soonest first
+ *   going forward and latest first going back, and queues the values either side
+ *   of one whose time moved. Everything a value depends on comes before it in
+ *   the heap's order, so each value is recomputed once with final inputs
+ */
+
+#include <malloc.h>
+#include <string.h>
+
+#include "critical.h"
+#include "dbg.h"
+
+// Flags for each id in Schedule.marks
+#define MARK_FORWARD 1
+#define MARK_BACKWARD 2
+#define MARK_QUEUED 4
+
+// Ids an id list starts with room for
+#define IDS_INITIAL_SIZE 64
+
+// Append an id to a list, growing it as needed
+// Returns 1 if out of memory
+static int cp_push(unsigned int **ids, int *length, int *size, unsigned int id)
+{
+    if(*length == *size) {
+        int grown = *size ? *size * 2 : IDS_INITIAL_SIZE;
+        unsigned int *items = realloc(*ids, sizeof(unsigned int) * (size_t)grown);
+        if(!items) return 1;
+
+        *ids = items;
+        *size = grown;
+    }
+
+    (*ids)[(*length)++] = id;
+    return 0;
+}
+
+// Make sure the arrays have room for size ids, doubling so touching new ids one at
+//   a time stays cheap. New ids start at 0 and unmarked
+// Returns 1 if out of memory, leaving the schedule usable at its old size
+static int cp_cover(Schedule *schedule, int size)
+{
+    if(size <= schedule->size) return 0;
+
+    int grown = schedule->size ? schedule->size : IDS_INITIAL_SIZE;
+    while(grown < size) grown *= 2;
+
+    int64_t **arrays[] = { &schedule->earliest, &schedule->finish, &schedule->latest };
+    for(size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+        int64_t *array = realloc(*arrays[i], sizeof(int64_t) * (size_t)grown);
+        if(!array) return 1;
+
+        memset(array + schedule->size, 0, sizeof(int64_t) * (size_t)(grown - schedule->size));
+        *arrays[i] = array;
+    }
+
+    unsigned char *marks = realloc(schedule->marks, (size_t)grown);
+    if(!marks) return 1;
+
+    memset(marks + schedule->size, 0, (size_t)(grown - schedule->size));
+    schedule->marks = marks;
+    schedule->size = grown;
+    return 0;
+}
+
+void cp_touch(Schedule *schedule, unsigned int id, int direction)
+{
+    // everything's recomputed anyway
+    if(schedule->full) return;
+
+    if(cp_cover(schedule, (int)id + 1)) goto error;
+
+    unsigned char *mark = &schedule->marks[id];
+    if(direction != DIR_LOWER && !(*mark & MARK_FORWARD)) {
+        if(cp_push(&schedule->forward, &schedule->forward_length, &schedule->forward_size, id)) goto error;
+        *mark |= MARK_FORWARD;
+    }
+    if(direction != DIR_HIGHER && !(*mark & MARK_BACKWARD)) {
+        if(cp_push(&schedule->backward, &schedule->backward_length, &schedule->backward_size, id)) goto error;
+        *mark |= MARK_BACKWARD;
+    }
+    return;
+
+error:
+    // can't keep track, so start again from scratch next time
+    schedule->full = 1;
+}
+
+void cp_forget(Schedule *schedule, Value *value)
+{
+    if(value->index < (unsigned int)schedule->size && schedule->finish[value->index] == schedule->length) {
+        schedule->rescan = 1;
+    }
+}
+
+// Lag between greater finishing and lesser starting
+static int64_t cp_lag(Graph *graph, Value *greater, Value *lesser)
+{
+    return graph->edges ? e_weight(graph->edges, greater->index, lesser->index) : 0;
+}
+
+// Earliest a value can start, from the finish of everything higher
+static int64_t cp_earliest(Graph *graph, Schedule *schedule, Value *value)
+{
+    int64_t start = 0;
+
+    int degree = g_degree(graph, value, DIR_HIGHER);
+    for(int i = 0; i < degree; i++) {
+        Value *higher = g_relation(graph, value, DIR_HIGHER, i);
+        int64_t ready = schedule->finish[higher->index] + cp_lag(graph, higher, value);
+        if(ready > start) start = ready;
+    }
+
+    return start;
+}
+
+// Latest a value can start, from the latest start of everything lower
+static int64_t cp_latest(Graph *graph, Schedule *schedule, Value *value)
+{
+    int64_t end = schedule->length;
+
+    int degree = g_degree(graph, value, DIR_LOWER);
+    for(int i = 0; i < degree; i++) {
+        Value *lower = g_relation(graph, value, DIR_LOWER, i);
+        int64_t due = schedule->latest[lower->index] - cp_lag(graph, value, lower);
+        if(due < end) end = due;
+    }
+
+    return end - value->weight;
+}
+
+// Every latest start, last value first
+static void cp_backward_all(Graph *graph, Schedule *schedule)
+{
+    for(Value *value = graph->end; value; value = value->prev) {
+        schedule->latest[value->index] = cp_latest(graph, schedule, value);
+    }
+    schedule->recomputed += (unsigned long)graph->length;
+}
+
+// Schedule everything from scratch
+static void cp_full(Graph *graph, Schedule *schedule)
+{
+    schedule->length = 0;
+    schedule->last = POOL_NONE;
+
+    for(Value *value = graph->start; value; value = value->next) {
+        int64_t earliest = cp_earliest(graph, schedule, value);
+        schedule->earliest[value->index] = earliest;
+        schedule->finish[value->index] = earliest + value->weight;
+
+        if(schedule->last == POOL_NONE || schedule->finish[value->index] > schedule->length) {
+            schedule->length = schedule->finish[value->index];
+            schedule->last = value->index;
+        }
+    }
+    schedule->recomputed += (unsigned long)graph->length;
+
+    cp_backward_all(graph, schedule);
+}
+
+// Whether a comes out of the heap before b: soonest label first, or latest if
+//   reverse is set
+static int cp_heap_before(Value *a, Value *b, int reverse)
+{
+    return reverse ? a->label > b->label : a->label < b->label;
+}
+
+// Queue a value on a heap of values by label, unless it's already queued
+// Returns 1 if out of memory
+static int cp_heap_push(Schedule *schedule, Vector *heap, Value *value, int reverse)
+{
+    if(schedule->marks[value->index] & MARK_QUEUED) return 0;
+    if(v_push(heap, value)) return 1;
+    schedule->marks[value->index] |= MARK_QUEUED;
+
+    int i = heap->length - 1;
+    while(i > 0) {
+        int parent = (i - 1) / 2;
+        if(!cp_heap_before(heap->items[i], heap->items[parent], reverse)) break;
+
+        void *swap = heap->items[i];
+        heap->items[i] = heap->items[parent];
+        heap->items[parent] = swap;
+        i = parent;
+    }
+
+    return 0;
+}
+
+// Take the next value off a heap, or NULL once it's empty
+static Value *cp_heap_pop(Schedule *schedule, Vector *heap, int reverse)
+{
+    if(heap->length == 0) return NULL;
+
+    Value *top = heap->items[0];
+    heap->items[0] = heap->items[heap->length - 1];
+    v_pop(heap);
+    schedule->marks[top->index] &= (unsigned char)~MARK_QUEUED;
+
+    int i = 0;
+    for(;;) {
+        int first = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if(left < heap->length && cp_heap_before(heap->items[left], heap->items[first], reverse)) first = left;
+        if(right < heap->length && cp_heap_before(heap->items[right], heap->items[first], reverse)) first = right;
+        if(first == i) break;
+
+        void *swap = heap->items[i];
+        heap->items[i] = heap->items[first];
+        heap->items[first] = swap;
+        i = first;
+    }
+
+    return top;
+}
+
+// Recompute the marked values' times, and whatever they move, in one direction
+// Going forward it also finds the longest finish among the values it recomputes,
+//   and notes if one that finished at length finishes sooner now
+// Returns 1 if out of memory
+static int cp_pass(Graph *graph, Schedule *schedule, int reverse)
+{
+    unsigned int *ids = reverse ? schedule->backward : schedule->forward;
+    int length = reverse ? schedule->backward_length : schedule->forward_length;
+    int towards = reverse ? DIR_HIGHER : DIR_LOWER;
+    int rc = 1;
+
+    Vector *heap = new_vector();
+    if(!heap) return 1;
+
+    for(int i = 0; i < length; i++) {
+        Value *value = graph->values[ids[i]];
+        if(value && cp_heap_push(schedule, heap, value, reverse)) goto end;
+    }
+
+    Value *value = NULL;
+    while((value = cp_heap_pop(schedule, heap, reverse))) {
+        unsigned int id = value->index;
+        int moved = 0;
+        schedule->recomputed++;
+
+        if(reverse) {
+            int64_t latest = cp_latest(graph, schedule, value);
+            moved = latest != schedule->latest[id];
+            schedule->latest[id] = latest;
+        } else {
+            schedule->earliest[id] = cp_earliest(graph, schedule, value);
+            int64_t finish = schedule->earliest[id] + value->weight;
+            moved = finish != schedule->finish[id];
+
+            if(schedule->finish[id] == schedule->length && finish < schedule->length) schedule->rescan = 1;
+            if(finish > schedule->length) {
+                schedule->length = finish;
+                schedule->last = id;
+            }
+            schedule->finish[id] = finish;
+        }
+
+        if(!moved) continue;
+
+        int degree = g_degree(graph, value, towards);
+        for(int i = 0; i < degree; i++) {
+            if(cp_heap_push(schedule, heap, g_relation(graph, value, towards, i), reverse)) goto end;
+        }
+    }
+    rc = 0;
+
+end:
+    v_free(heap);
+    return rc;
+}
+
+// Recompute what's changed since the last schedule
+// Returns 1 if out of memory
+static int cp_update(Graph *graph, Schedule *schedule)
+{
+    int64_t length = schedule->length;
+    if(cp_pass(graph, schedule, 0)) return 1;
+
+    // what finished last might not any more, so look for what does now
+    if(schedule->rescan) {
+        schedule->length = 0;
+        schedule->last = POOL_NONE;
+        for(Value *value = graph->start; value; value = value->next) {
+            if(schedule->last == POOL_NONE || schedule->finish[value->index] > schedule->length) {
+                schedule->length = schedule->finish[value->index];
+                schedule->last = value->index;
+            }
+        }
+    }
+
+    // every latest start is measured back from the length
+    if(schedule->length != length) {
+        cp_backward_all(graph, schedule);
+        return 0;
+    }
+
+    return cp_pass(graph, schedule, 1);
+}
+
+// Trace the critical chain back from the value that finishes last, through the
+//   higher value holding each one up
+// Returns 1 if out of memory
+static int cp_chain(Graph *graph, Schedule *schedule)
+{
+    schedule->chain_length = 0;
+    Value *value = schedule->last == POOL_NONE ? NULL : graph->values[schedule->last];
+
+    while(value) {
+        if(schedule->chain_length == schedule->chain_size) {
+            int grown = schedule->chain_size ? schedule->chain_size * 2 : IDS_INITIAL_SIZE;
+            Value **chain = realloc(schedule->chain, sizeof(Value *) * (size_t)grown);
+            if(!chain) return 1;
+
+            schedule->chain = chain;
+            schedule->chain_size = grown;
+        }
+        schedule->chain[schedule->chain_length++] = value;
+
+        Value *held = value;
+        value = NULL;
+        int degree = g_degree(graph, held, DIR_HIGHER);
+        for(int i = 0; i < degree && !value; i++) {
+            Value *higher = g_relation(graph, held, DIR_HIGHER, i);
+            int64_t ready = schedule->finish[higher->index] + cp_lag(graph, higher, held);
+            if(ready == schedule->earliest[held->index]) value = higher;
+        }
+    }
+
+    // found last to first
+    for(int i = 0, j = schedule->chain_length - 1; i < j; i++, j--) {
+        Value *swap = schedule->chain[i];
+        schedule->chain[i] = schedule->chain[j];
+        schedule->chain[j] = swap;
+    }
+
+    return 0;
+}
+
+// Forget what was marked, ready for the next round of changes
+// Values queued are unmarked as they come off the heap, so unless a pass stopped
+//   part way only the marked ids need clearing
+static void cp_clear(Schedule *schedule, int all)
+{
+    if(all) {
+        if(schedule->marks) memset(schedule->marks, 0, (size_t)schedule->size);
+    } else {
+        for(int i = 0; i < schedule->forward_length; i++) schedule->marks[schedule->forward[i]] = 0;
+        for(int i = 0; i < schedule->backward_length; i++) schedule->marks[schedule->backward[i]] = 0;
+    }
+
+    schedule->forward_length = 0;
+    schedule->backward_length = 0;
+    schedule->full = 0;
+    schedule->rescan = 0;
+}
+
+Schedule *g_critical_path(Graph *graph)
+{
+    Schedule *schedule = graph->schedule;
+    if(!schedule) {
+        schedule = calloc(1, sizeof(Schedule));
+        if(!schedule) return NULL;
+
+        schedule->last = POOL_NONE;
+        schedule->full = 1;
+        graph->schedule = schedule;
+    }
+
+    schedule->recomputed = 0;
+    if(cp_cover(schedule, graph->values_size)) goto error;
+
+    // marking more than the graph holds costs more than going over it once
+    if(schedule->forward_length + schedule->backward_length > graph->length) schedule->full = 1;
+
+    if(schedule->full) cp_full(graph, schedule);
+    else if(cp_update(graph, schedule)) goto error;
+
+    if(cp_chain(graph, schedule)) goto error;
+
+    cp_clear(schedule, 0);
+    return schedule;
+
+error:
+    // half updated, so it all has to be done again
+    cp_clear(schedule, 1);
+    schedule->full = 1;
+    return NULL;
+}
+
+void cp_free(Schedule *schedule)
+{
+    free(schedule->earliest);
+    free(schedule->finish);
+    free(schedule->latest);
+    free(schedule->chain);
+    free(schedule->forward);
+    free(schedule->backward);
+    free(schedule->marks);
+    free(schedule);
+}
@@ -0,0 +1,118 @@
+/* Critical path
+ *
+ * Schedules a graph as jobs: every value is a job taking its weight, and can't
+ *   start until every value higher than it has finished, plus the weight of the
+ *   relation between them as a lag. The graph's order is already a topological
+ *   order, so one pass forward along it gives each value's earliest start, and
+ *   one pass back gives the latest it can start without making the whole
+ *   schedule any longer
+ *
+ *   earliest: 0 for values with nothing higher, otherwise the latest finish of
+ *     anything higher, earliest + weight, plus the relation's weight
+ *   length: The latest finish of any value
+ *   latest: length - weight for values with nothing lower, otherwise the
+ *     soonest latest start of anything lower, minus the relation's weight, minus
+ *     its own weight
+ *   slack: latest - earliest, how far a value can slip. Values with no slack
+ *     are critical, and the critical chain is a path of them from a value that
+ *     starts at 0 to one that finishes at length
+ *
+ * Once a graph has been scheduled it keeps track of what's changed: a relation
+ *   added or removed, or a weight set, marks the values either side of it. The
+ *   next g_critical_path only recomputes earliest starts downstream of the
+ *   marked values, and latest starts upstream of them, in label order with a
+ *   heap so each is recomputed at most once. If the length changes every latest
+ *   start moves, so the backward pass is done in full
+ *
+ * Weights are kept in memory only; g_save and the write-ahead log don't save them
+ */
+
+#ifndef CRITICAL_H
+#define CRITICAL_H
+
+#include <stdint.h>
+
+#include "graph.h"
+
+/* struct: Schedule
+ *
+ * Result of g_critical_path. Kept up to date by the graph, which frees it
+ *
+ * size: Number of ids the arrays have room for
+ * earliest: Earliest start of each value, indexed by Value.index
+ * finish: Earliest finish of each value, earliest + weight
+ * latest: Latest start of each value
+ * length: Latest finish of any value, 0 for an empty graph
+ * last: Id of a value that finishes at length, where the chain ends, or
+ *   POOL_NONE for an empty graph
+ * chain: Critical chain, from a value that starts at 0 to one that finishes at
+ *   length, each value with no slack and higher than the next
+ * chain_length: Number of values in chain
+ * chain_size: Number of values chain has room for
+ * forward: Ids whose earliest start needs recomputing since the last g_critical_path
+ * forward_length: Number of ids in forward
+ * forward_size: Number of ids forward has room for
+ * backward: Ids whose latest start needs recomputing, as for forward
+ * backward_length: Number of ids in backward
+ * backward_size: Number of ids backward has room for
+ * marks: Flags for each id, whether it's in forward or backward or queued
+ * full: Set when everything has to be recomputed, e.g. before the first time
+ *   or after running out of memory keeping track
+ * rescan: Set when a value that finished at length finishes sooner or goes,
+ *   so the length has to be found again
+ * recomputed: Number of start times recomputed by the last g_critical_path
+ */
+typedef struct schedule {
+    int size;
+    int64_t *earliest;
+    int64_t *finish;
+    int64_t *latest;
+    int64_t length;
+    unsigned int last;
+    Value **chain;
+    int chain_length;
+    int chain_size;
+    unsigned int *forward;
+    int forward_length;
+    int forward_size;
+    unsigned int *backward;
+    int backward_length;
+    int backward_size;
+    unsigned char *marks;
+    int full;
+    int rescan;
+    unsigned long recomputed;
+} Schedule;
+
+/* function: g_critical_path(Graph *graph)
+ *
+ * Schedule a graph's values by their weights and relations' weights (see
+ *   g_set_weight and g_set_relation_weight), recomputing only what changed since
+ *   the last call
+ *
+ * Returns the graph's schedule, valid until the graph next changes, or NULL if
+ *   out of memory
+ */
+Schedule *g_critical_path(Graph *graph);
+
+/* function: cp_touch(Schedule *schedule, unsigned int id, int direction)
+ *
+ * Note that the relations of a value in direction changed, or both directions
+ *   if direction is -1 (e.g. its weight changed). Called by the graph, avoid
+ *   using directly
+ */
+void cp_touch(Schedule *schedule, unsigned int id, int direction);
+
+/* function: cp_forget(Schedule *schedule, Value *value)
+ *
+ * Note that a value is being removed. Called by the graph, avoid using directly
+ */
+void cp_forget(Schedule *schedule, Value *value);
+
+/* function: cp_free(Schedule *schedule)
+ *
+ * Free a schedule. Called by the graph, avoid using directly
+ */
+void cp_free(Schedule *schedule);
+
+#endif
@@ -0,0 +1,187 @@
+/* Edge set
+ *
+ * Open-addressing table of packed id pairs, with backward shift deletion
+ *
+ * Weights live at the same slot as their key in a parallel table, and move
+ *   whenever the key does
+ */
+
+#include <malloc.h>
+#include <string.h>
+
+#include "edges.h"
+
+// Starting number of slots in the table, must be a power of two
+#define EDGES_INITIAL_SIZE 64
+
+Edges *new_edges(void)
+{
+    Edges *edges = calloc(1, sizeof(Edges));
+    if(!edges) return NULL;
+
+    edges->table = calloc(EDGES_INITIAL_SIZE, sizeof(uint64_t));
+    if(!edges->table) {
+        free(edges);
+        return NULL;
+    }
+
+    edges->table_size = EDGES_INITIAL_SIZE;
+    return edges;
+}
+
+// Pack a pair into a key; ids are never POOL_NONE so adding 1 can't wrap to 0,
+//   which marks an empty slot
+static uint64_t e_key(unsigned int from, unsigned int to)
+{
+    return ((uint64_t)from << 32 | to) + 1;
+}
+
+// Mix a key so pairs with nearby ids spread across the table
+// Finaliser from splitmix64
+static uint64_t e_hash(uint64_t key)
+{
+    key = (key ^ (key >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    key = (key ^ (key >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return key ^ (key >> 31);
+}
+
+// Find the slot for a key, stopping at the key or the first empty slot
+static uint64_t e_slot(Edges *edges, uint64_t key)
+{
+    uint64_t mask = edges->table_size - 1;
+    uint64_t i = e_hash(key) & mask;
+
+    while(edges->table[i] && edges->table[i] != key) i = (i + 1) & mask;
+
+    return i;
+}
+
+// Move every key and its weight into a table of a new size
+static int e_resize(Edges *edges, uint64_t size)
+{
+    uint64_t *table = calloc(size, sizeof(uint64_t));
+    int64_t *weights = edges->weights ? calloc(size, sizeof(int64_t)) : NULL;
+    if(!table || (edges->weights && !weights)) {
+        free(table);
+        free(weights);
+        return 1;
+    }
+
+    uint64_t *old = edges->table;
+    uint64_t old_size = edges->table_size;
+    uint64_t mask = size - 1;
+    for(uint64_t j = 0; j < old_size; j++) {
+        if(!old[j]) continue;
+
+        uint64_t i = e_hash(old[j]) & mask;
+        while(table[i]) i = (i + 1) & mask;
+        table[i] = old[j];
+        if(weights) weights[i] = edges->weights[j];
+    }
+
+    free(old);
+    free(edges->weights);
+    edges->table = table;
+    edges->weights = weights;
+    edges->table_size = size;
+    return 0;
+}
+
+// Grow to keep the table at most half full
+int e_reserve(Edges *edges, uint64_t length)
+{
+    uint64_t size = edges->table_size;
+    while(length * 2 > size) size *= 2;
+
+    if(size == edges->table_size) return 0;
+    return e_resize(edges, size);
+}
+
+int e_add(Edges *edges, unsigned int from, unsigned int to)
+{
+    if(e_reserve(edges, edges->length + 1)) return -1;
+
+    uint64_t key = e_key(from, to);
+    uint64_t i = e_slot(edges, key);
+    if(edges->table[i]) return 1;
+
+    edges->table[i] = key;
+    if(edges->weights) edges->weights[i] = 0;
+    edges->length++;
+    return 0;
+}
+
+int e_has(Edges *edges, unsigned int from, unsigned int to)
+{
+    uint64_t key = e_key(from, to);
+    return edges->table[e_slot(edges, key)] == key;
+}
+
+// Remove a key, then pull back any later key in the same run that would no longer
+//   be reachable from its home slot across the gap
+int e_remove(Edges *edges, unsigned int from, unsigned int to)
+{
+    uint64_t mask = edges->table_size - 1;
+    uint64_t gap = e_slot(edges, e_key(from, to));
+    if(!edges->table[gap]) return 1;
+
+    edges->table[gap] = 0;
+    edges->length--;
+
+    for(uint64_t i = (gap + 1) & mask; edges->table[i]; i = (i + 1) & mask) {
+        uint64_t home = e_hash(edges->table[i]) & mask;
+
+        // distance from home to i is at least the distance from the gap to i, so the
+        //   gap lies between home and i and the key can move back into it
+        if(((i - home) & mask) >= ((i - gap) & mask)) {
+            edges->table[gap] = edges->table[i];
+            edges->table[i] = 0;
+            if(edges->weights) edges->weights[gap] = edges->weights[i];
+            gap = i;
+        }
+    }
+
+    return 0;
+}
+
+int e_set_weight(Edges *edges, unsigned int from, unsigned int to, int64_t weight)
+{
+    uint64_t key = e_key(from, to);
+    uint64_t i = e_slot(edges, key);
+    if(edges->table[i] != key) return 1;
+
+    if(!edges->weights) {
+        // nothing to keep until the first weight that isn't 0
+        if(!weight) return 0;
+
+        edges->weights = calloc(edges->table_size, sizeof(int64_t));
+        if(!edges->weights) return -1;
+    }
+
+    edges->weights[i] = weight;
+    return 0;
+}
+
+int64_t e_weight(Edges *edges, unsigned int from, unsigned int to)
+{
+    if(!edges->weights) return 0;
+
+    uint64_t key = e_key(from, to);
+    uint64_t i = e_slot(edges, key);
+    return edges->table[i] == key ? edges->weights[i] : 0;
+}
+
+void e_reset(Edges *edges)
+{
+    memset(edges->table, 0, sizeof(uint64_t) * edges->table_size);
+    free(edges->weights);
+    edges->weights = NULL;
+    edges->length = 0;
+}
+
+void e_free(Edges *edges)
+{
+    free(edges->table);
+    free(edges->weights);
+    free(edges);
+}
@@ -0,0 +1,102 @@
+/* Edge set
+ *
+ * Set of relations between values, each given as a pair of pool ids, so checking
+ *   whether a relation is already in a graph takes one table lookup rather than a
+ *   walk along a relation list
+ *
+ * Pairs are packed into one 64-bit key and kept in an open-addressing table with
+ *   linear probing. Removal shifts later entries back into the gap rather than
+ *   leaving tombstones, so lookups stay short however much the set churns
+ *
+ * Each pair can also carry a weight, kept in a second table alongside the keys
+ *   that's only allocated once a weight is set
+ */
+
+#ifndef EDGES_H
+#define EDGES_H
+
+#include <stdint.h>
+
+/* struct: Edges
+ *
+ * Create with new_edges and operate with e_* functions
+ *
+ * table: Open-addressing table, each slot holds a packed pair + 1 or 0 if empty
+ * table_size: Number of slots in table (always a power of two)
+ * length: Number of pairs in the set
+ * weights: Weight of the pair in each slot of table, or NULL while every weight is 0
+ */
+typedef struct edges {
+    uint64_t *table;
+    uint64_t table_size;
+    uint64_t length;
+    int64_t *weights;
+} Edges;
+
+/* function: new_edges()
+ *
+ * Create a new empty edge set
+ *
+ * Returns the set or NULL if out of memory
+ */
+Edges *new_edges(void);
+
+/* function: e_add(Edges *edges, unsigned int from, unsigned int to)
+ *
+ * Add the pair from, to. Neither can be POOL_NONE
+ *
+ * Returns 0 if added, 1 if it was already in the set or -1 if out of memory
+ */
+int e_add(Edges *edges, unsigned int from, unsigned int to);
+
+/* function: e_has(Edges *edges, unsigned int from, unsigned int to)
+ *
+ * Returns 1 if the pair from, to is in the set, 0 otherwise
+ */
+int e_has(Edges *edges, unsigned int from, unsigned int to);
+
+/* function: e_remove(Edges *edges, unsigned int from, unsigned int to)
+ *
+ * Take the pair from, to out of the set
+ *
+ * Returns 0 if removed or 1 if it wasn't in the set
+ */
+int e_remove(Edges *edges, unsigned int from, unsigned int to);
+
+/* function: e_set_weight(Edges *edges, unsigned int from, unsigned int to, int64_t weight)
+ *
+ * Set the weight of the pair from, to. Pairs start with weight 0, and go back to
+ *   it if removed and added again
+ *
+ * Returns 0 if set, 1 if the pair isn't in the set or -1 if out of memory
+ */
+int e_set_weight(Edges *edges, unsigned int from, unsigned int to, int64_t weight);
+
+/* function: e_weight(Edges *edges, unsigned int from, unsigned int to)
+ *
+ * Returns the weight of the pair from, to, or 0 if it isn't in the set
+ */
+int64_t e_weight(Edges *edges, unsigned int from, unsigned int to);
+
+/* function: e_reserve(Edges *edges, uint64_t length)
+ *
+ * Make room for length pairs in total without growing again, e.g. before a
+ *   bulk load
+ *
+ * Returns 0 on success or 1 if out of memory, leaving the set as it was
+ */
+int e_reserve(Edges *edges, uint64_t length);
+
+/* function: e_reset(Edges *edges)
+ *
+ * Empty the set, keeping its table allocated
+ */
+void e_reset(Edges *edges);
+
+/* function: e_free(Edges *edges)
+ *
+ * Free an edge set
+ */
+void e_free(Edges *edges);
+
+#endif
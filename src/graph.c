@@ -8,86 +8,390 @@
  */
 
 #include <malloc.h>
+#include <stdlib.h>
 
 #include "graph.h"
+#include "arena.h"
+#include "critical.h"
+#include "edges.h"
 #include "hash.h"
 #include "list.h"
+#include "pool.h"
+#include "snapshot.h"
 #include "dbg.h"
 
-// Make a new graph
-Graph *new_graph(void)
+// Starting number of slots in the values array
+#define VALUES_INITIAL_SIZE 16
+
+// Labels are kept within 62 bits so there's room to work on a range without overflowing
+// 0 and LABEL_MAX + 1 are never used, they act as the bounds either side of the graph
+#define LABEL_BITS 62
+#define LABEL_MAX ((UINT64_C(1) << LABEL_BITS) - 1)
+// Gap left when appending to either end, so pushes rarely need a relabel
+#define LABEL_GAP (UINT64_C(1) << 32)
+// Growth of the allowed number of values per relabel range each time the range doubles
+// Has to be between 1 and 2, lower means fewer relabels but less space for values
+#define LABEL_DENSITY 1.5
+
+// Make a new graph, with or without an arena
+static Graph *g_create(int pooled)
 {
     Graph *new = malloc(sizeof(Graph));
     if(!new) return NULL;
 
+    new->pool = new_pool();
+    new->arena = pooled ? new_arena() : NULL;
+    if(!new->pool || (pooled && !new->arena)) {
+        if(new->pool) p_free(new->pool);
+        free(new);
+        return NULL;
+    }
+
     new->length = 0;
     new->start = NULL;
     new->end = NULL;
+    new->epoch = 0;
+    new->values = NULL;
+    new->values_size = 0;
+    new->frozen = NULL;
+    new->spare = NULL;
+    new->edges = NULL;
+    new->duplicates = 0;
+    memset(&new->stats, 0, sizeof(Stats));
+    new->conflict = NULL;
+    new->schedule = NULL;
     return new;
 }
 
+Graph *new_graph(void)
+{
+    return g_create(1);
+}
+
+Graph *new_graph_malloc(void)
+{
+    return g_create(0);
+}
+
+// Set up a value with no relations that isn't in a graph yet
+static void g_init_value(Value *new)
+{
+    v_init(&new->higher);
+    v_init(&new->lower);
+
+    new->prev = NULL;
+    new->next = NULL;
+    new->label = 0;
+    new->visited = 0;
+    new->weight = 1;
+}
+
+// Make a value outside of any graph, with its own copy of the string
 Value *new_value(char item[])
 {
-    Value *new = malloc(sizeof(Value) + strlen(item) + 1); // yikes (add 1 for null byte)
+    size_t length = strlen(item);
+    Value *new = malloc(sizeof(Value) + length + 1); // yikes (add 1 for null byte)
     if(!new) return NULL;
 
-    new->higher = new_list();
-    new->lower = new_list();
+    g_init_value(new);
+
+    // string goes straight after the value until it's interned by a graph
+    new->value = (char *)(new + 1);
+    memcpy(new->value, item, length + 1);
 
     new->id = hash(item);
-    strcpy(new->value, item);
+    new->index = POOL_NONE;
+    new->pooled = 0;
 
-    new->prev = NULL;
-    new->next = NULL;
-    new->to_transfer = 0;
+    return new;
+}
+
+// Make sure the values array covers an id, growing it as needed
+static int g_cover(Graph *graph, unsigned int id)
+{
+    if(id < (unsigned int)graph->values_size) return 0;
+
+    int size = graph->values_size ? graph->values_size : VALUES_INITIAL_SIZE;
+    while((unsigned int)size <= id) size *= 2;
+
+    Value **values = realloc(graph->values, sizeof(Value *) * (size_t)size);
+    if(!values) return 1;
+
+    memset(values + graph->values_size, 0, sizeof(Value *) * (size_t)(size - graph->values_size));
+    graph->values = values;
+    graph->values_size = size;
+    return 0;
+}
+
+// Make a value for a string already interned in the graph's pool, from the graph's
+//   arena if there is one. The value refers to the pool's copy of the string
+static Value *g_id_value(Graph *graph, unsigned int id)
+{
+    if(g_cover(graph, id)) return NULL;
+
+    // removed values are reused first so churn doesn't keep growing the arena
+    Value *new = graph->spare;
+    if(new) graph->spare = new->next;
+    else new = a_alloc(graph->arena, sizeof(Value));
+    if(!new) return NULL;
+
+    g_init_value(new);
+
+    new->value = p_string(graph->pool, id);
+    new->id = (unsigned long)p_hash(graph->pool, id);
+    new->index = id;
+    new->pooled = graph->arena != NULL;
+
+    // a new value needs scheduling both ways, even before it has any relations
+    if(graph->schedule) cp_touch(graph->schedule, id, -1);
 
     return new;
 }
 
-// Predec because _tree_rec and _l_rec are codependent
-static int g_resolve_tree_rec(Value *leaf, Value *root);
+// Give back a value made by g_id_value once it's out of the graph, or never got in
+static void g_drop_value(Graph *graph, Value *value)
+{
+    if(value->pooled) {
+        value->next = graph->spare;
+        graph->spare = value;
+    } else {
+        free(value);
+    }
+}
+
+// Make a value for a graph, interning its string
+static Value *g_new_value(Graph *graph, View item)
+{
+    unsigned int id = p_intern(graph->pool, item.str, item.length);
+    if(id == POOL_NONE) return NULL;
+
+    return g_id_value(graph, id);
+}
+
+// Add a value to the values array
+// Values made by new_value have their string interned first, so the graph only
+//   ever uses the pool's copies
+// Returns 1 if out of memory or there's already a value with the same string
+static int g_add(Graph *graph, Value *value)
+{
+    if(value->index == POOL_NONE) {
+        unsigned int id = p_intern(graph->pool, value->value, strlen(value->value));
+        if(id == POOL_NONE) return 1;
+
+        value->index = id;
+        value->value = p_string(graph->pool, id);
+    }
+
+    if(g_cover(graph, value->index)) return 1;
+    if(graph->values[value->index]) return 1;
+
+    graph->values[value->index] = value;
+    if(graph->schedule) cp_touch(graph->schedule, value->index, -1);
+    return 0;
+}
+
+// Relabel the values around a new value that doesn't fit between its neighbours
+// Dietz-Sleator style tag-range relabeling: take the aligned range of labels around
+//   the new value, doubling it until it's sparse enough, then spread the labels
+//   in that range out evenly
+// Amortised O(log n) per insertion
+static void g_relabel(Value *value)
+{
+    // labels around the new value, it doesn't have one yet
+    uint64_t anchor = value->prev ? value->prev->label : value->next->label;
+    Value *first = value;
+    Value *last = value;
+    uint64_t count = 1;
+    double limit = 1;
+
+    for(int i = 1; i <= LABEL_BITS; i++) {
+        uint64_t width = UINT64_C(1) << i;
+        uint64_t base = anchor & ~(width - 1);
+        limit *= LABEL_DENSITY;
+
+        // grow the range to cover every value with a label inside it
+        while(first->prev && first->prev->label >= base) {
+            first = first->prev;
+            count++;
+        }
+        while(last->next && last->next->label <= base + width - 1) {
+            last = last->next;
+            count++;
+        }
+
+        if((double)count > limit) continue;
+
+        // sparse enough, spread the labels out
+        uint64_t spacing = width / (count + 1);
+        uint64_t label = base;
+        for(Value *current = first; current != last->next; current = current->next) {
+            label += spacing;
+            current->label = label;
+        }
+        return;
+    }
+
+    // Only reachable with more values than labels, which isn't going to happen
+    log_err("Ran out of labels relabeling %s", value->value);
+}
+
+// Give a newly linked value a label between its neighbours
+// Values at either end get a large gap so repeated pushes stay cheap
+static void g_label(Value *value)
+{
+    // exclusive bounds on the label
+    uint64_t low = value->prev ? value->prev->label : 0;
+    uint64_t high = value->next ? value->next->label : LABEL_MAX + 1;
+    uint64_t room = high - low;
+
+    if(room < 2) {
+        g_relabel(value);
+    } else if(!value->next && value->prev && room > LABEL_GAP) {
+        value->label = low + LABEL_GAP;
+    } else if(!value->prev && value->next && room > LABEL_GAP) {
+        value->label = high - LABEL_GAP;
+    } else {
+        value->label = low + room / 2;
+    }
+}
 
-// Wrapper function for _tree_rec to handle the higher/lower lists
-static int g_resolve_l_rec(Item *item, Value *root)
+// Returned by a search visitor to carry on without following that value's relations
+#define SEARCH_PRUNE -1
+// Returned by g_search_step once there's nothing left to search
+#define SEARCH_DONE -2
+
+// Offsets from the graph epoch stamped on values by each side of g_resolve_tree
+#define MARK_HIGHER 1
+#define MARK_LOWER 2
+
+// State for a depth-first search from a value, following either its higher or lower relations
+// Uses an explicit stack, so the depth of the graph isn't limited by the call stack
+// The visitor is called on each value reached: return 0 to follow its relations,
+//   SEARCH_PRUNE to skip them, or anything else to stop the search
+// The stack holds each value under the value it was reached from, and parent is
+//   that value for the one being visited, NULL for the start
+typedef struct search {
+    Graph *graph;
+    Vector *stack;
+    int higher;
+    g_visitor visit;
+    void *data;
+    Value *parent;
+} Search;
+
+// Set up a search from start
+// Returns 0 or ERR_OUT_OF_MEMORY
+static int g_search_start(Search *search, Graph *graph, Value *start, int higher, g_visitor visit, void *data)
 {
-    // run tree_rec for current item
-    int err = g_resolve_tree_rec((Value *)item->value, root);
-    if(err) return err;
+    search->graph = graph;
+    search->higher = higher;
+    search->visit = visit;
+    search->data = data;
 
-    // continue to next item
-    if(item->next) return g_resolve_l_rec(item->next, root);
+    search->parent = NULL;
+
+    search->stack = new_vector();
+    if(!search->stack) return ERR_OUT_OF_MEMORY;
+
+    if(v_push(search->stack, NULL)) return ERR_OUT_OF_MEMORY;
+    return v_push(search->stack, start) ? ERR_OUT_OF_MEMORY : 0;
+}
+
+// Visit the next value in a search
+// Split into single steps so two searches can be run side by side
+// Returns 0 if there's more to search, SEARCH_DONE if there isn't, or the value that stopped it
+static int g_search_step(Search *search)
+{
+    Value *value = v_pop(search->stack);
+    if(!value) return SEARCH_DONE;
+    search->parent = v_pop(search->stack);
+
+    int rc = search->visit(value, search->data);
+    if(rc == SEARCH_PRUNE) return 0;
+    if(rc) return rc;
+
+    int degree = g_degree(search->graph, value, search->higher);
+    for(int i = 0; i < degree; i++) {
+        if(v_push(search->stack, value)) return ERR_OUT_OF_MEMORY;
+        if(v_push(search->stack, g_relation(search->graph, value, search->higher, i))) return ERR_OUT_OF_MEMORY;
+    }
 
     return 0;
 }
 
-static int g_resolve_tree_rec(Value *leaf, Value *root)
+// Clean up after a search
+static void g_search_end(Search *search)
+{
+    if(search->stack) v_free(search->stack);
+}
+
+// One side of g_resolve_tree
+//
+// limit: Value on the other end of the new relation, bounds the search
+// higher: Whether this side searches higher values (so has to stay after limit) or
+//   lower values (so has to stay before limit)
+// mark: Stamp left on values found by this side
+// other: Stamp left on values found by the other side
+// found: Values found so far
+// parents: Value each one in found was reached from, kept so a cycle can be traced
+//   back without searching again
+// search: The search for this side, for the parent of the value being visited
+// hit: Value that showed the relation makes a cycle, and hit_parent where it was
+//   reached from
+typedef struct bound {
+    Value *limit;
+    int higher;
+    uint64_t mark;
+    uint64_t other;
+    Vector *found;
+    Vector *parents;
+    Search *search;
+    Value *hit;
+    Value *hit_parent;
+} Bound;
+
+// Visitor for each side of g_resolve_tree
+static int g_resolve_visit(Value *leaf, void *data)
 {
-    // stop and return an error if we find the root value
+    Bound *bound = data;
+
+    // stop and return an error if we find the other end of the relation
     // specifically this will occur if any value higher than the relation currently applying
     //   depends on being lower than the greater one
     // essentially making sure we're not accidentally making a cyclic graph
-    if(leaf->id == root->id) return ERR_RELATIONAL_CONFLICT;
+    if(leaf == bound->limit) goto conflict;
 
-    // set the transfer flag so we know to transfer it later
-    leaf->to_transfer = 1;
+    // skip anything already found or outside the affected region
+    // each value is visited at most once, so diamonds in the graph aren't searched once per path
+    if(leaf->visited == bound->mark) return SEARCH_PRUNE;
+    if(bound->higher ? g_before(leaf, bound->limit) : g_before(bound->limit, leaf)) return SEARCH_PRUNE;
 
-    // resolve the higher tree if it exists
-    if(leaf->higher->length != 0) return g_resolve_l_rec(leaf->higher->start, root);
+    // found by the other side: it's both above greater and below lesser, so also cyclic
+    if(leaf->visited == bound->other) goto conflict;
 
-    return 0;
+    // stamp it so we know it's been found
+    leaf->visited = bound->mark;
+    if(v_push(bound->found, leaf)) return ERR_OUT_OF_MEMORY;
+    return v_push(bound->parents, bound->search->parent) ? ERR_OUT_OF_MEMORY : 0;
+
+conflict:
+    bound->hit = leaf;
+    bound->hit_parent = bound->search->parent;
+    return ERR_RELATIONAL_CONFLICT;
 }
 
-static int g_resolve_tree(Value *trunk, Value *root)
+// Compare values by label for qsort
+static int g_label_compare(const void *first, const void *second)
 {
-    // Given a root, traverse its higher values and ensure there are no conflicts, while also setting transfer flags on each value that needs to be transferred
-    // just a wrapper around the recursive function
-    // left here because it's clearer and i might need to change it later
-    return g_resolve_tree_rec(trunk, root);
+    const Value *first_v = *(Value * const *)first;
+    const Value *second_v = *(Value * const *)second;
+
+    if(first_v->label < second_v->label) return -1;
+    return first_v->label > second_v->label;
 }
 
-// Shift an item (shift) before another value (pivot)
-// Called from a recursive function, doesn't do any fancy handling itself
-static void g_shift_before(Graph *graph, Value *pivot, Value *shift)
+// Unlink a value from the graph, leaving it in the values array
+static void g_unlink(Graph *graph, Value *shift)
 {
     // Break current links
     Value *prev = shift->prev;
@@ -101,134 +405,937 @@ static void g_shift_before(Graph *graph, Value *pivot, Value *shift)
     if(graph->start == shift) graph->start = next;
     if(graph->end == shift) graph->end = prev;
     graph->length -= 1;
+}
+
+// Link a value into the graph before another value and label it
+// Only handles the links, the values array is left to the caller
+static void g_link_before(Graph *graph, Value *after, Value *new)
+{
+    // Insert 1 [] 3 <-2, given 3
+
+    // Get 1
+    Value *prev = after->prev;
+
+    // Graph operations
+    if(graph->start == after) graph->start = new;
+    graph->length += 1;
+
+    // 1.next = 2
+    if(prev) prev->next = new;
+    // 3.prev = 2
+    after->prev = new;
+    // 2.next = 3
+    new->next = after;
+    // 2.prev = 1
+    new->prev = prev;
+
+    g_label(new);
+}
+
+// Link a value into the graph after another value and label it
+// Only handles the links, the values array is left to the caller
+static void g_link_after(Graph *graph, Value *before, Value *new)
+{
+    // Insert 1 [] 3 <- 2, given 1
+
+    // Get 3
+    Value *next = before->next;
+
+    // Graph operations
+    // Set end if at end
+    if(graph->end == before) graph->end = new;
+    // Increase length
+    graph->length += 1;
+
+    // 1.next = 2
+    before->next = new;
+    // 3.prev = 2
+    if(next) next->prev = new;
+    // 2.next = 3
+    new->next = next;
+    // 2.prev = 1
+    new->prev = before;
+
+    g_label(new);
+}
+
+// Shift an item (shift) before another value (pivot)
+static void g_shift_before(Graph *graph, Value *pivot, Value *shift)
+{
+    g_unlink(graph, shift);
+
+    // Relink, it's already in the values array so only the links need changing
+    g_link_before(graph, pivot, shift);
+}
+
+// Shift an item (shift) after another value (pivot)
+static void g_shift_after(Graph *graph, Value *pivot, Value *shift)
+{
+    g_unlink(graph, shift);
+    g_link_after(graph, pivot, shift);
+}
 
-    // Reinsert, we're just reusing the insertion function cos it's what we need
-    g_insert_before(graph, pivot, shift);
+// Most names in a logged cycle, and most cycles logged from a batch
+#define CYCLE_REPORT_LIMIT 16
+// Room for the names of one logged cycle
+#define CYCLE_TEXT_SIZE 512
+
+static void g_conflict_free(Conflict *conflict)
+{
+    if(!conflict) return;
+
+    free(conflict->names);
+    free(conflict->starts);
+    free(conflict);
 }
 
-// Recursive transfer function
+// Append str to text, as much of it as fits
+static void g_append(char *text, size_t size, size_t *used, const char *str)
+{
+    size_t length = strlen(str);
+    if(*used + length >= size) length = size - 1 - *used;
+
+    memcpy(text + *used, str, length);
+    *used += length;
+    text[*used] = '\0';
+}
+
+// Write a cycle's names into text with separator between them, closing it with the
+//   first again if closed is set. Names past CYCLE_REPORT_LIMIT or the room in
+//   text are left off and counted instead
+static void g_cycle_text(Conflict *conflict, int cycle, const char *separator, int closed, char *text, size_t size)
+{
+    int start = conflict->starts[cycle];
+    int end = conflict->starts[cycle + 1];
+    size_t used = 0;
+    text[0] = '\0';
+
+    int i = start;
+    for(; i < end && i - start < CYCLE_REPORT_LIMIT; i++) {
+        const char *before = i > start ? separator : "";
+        if(used + strlen(before) + strlen(conflict->names[i]) >= size) break;
+        g_append(text, size, &used, before);
+        g_append(text, size, &used, conflict->names[i]);
+    }
+
+    if(i < end) {
+        // the count's digits, written backwards from the end
+        char digits[16];
+        size_t first = sizeof(digits) - 1;
+        digits[first] = '\0';
+        int more = end - i;
+        do {
+            digits[--first] = (char)('0' + more % 10);
+            more /= 10;
+        } while(more);
+
+        g_append(text, size, &used, separator);
+        g_append(text, size, &used, "...and ");
+        g_append(text, size, &used, digits + first);
+        g_append(text, size, &used, " more");
+    } else if(closed) {
+        g_append(text, size, &used, separator);
+        g_append(text, size, &used, conflict->names[start]);
+    }
+}
+
+// Replace the graph's conflict with count cycles of names names in all, to be filled in
+// Returns the new conflict or NULL if out of memory
+static Conflict *g_conflict_new(Graph *graph, int names, int count)
+{
+    Conflict *conflict = malloc(sizeof(Conflict));
+    if(!conflict) return NULL;
+
+    conflict->names = malloc(sizeof(char *) * (size_t)(names ? names : 1));
+    conflict->starts = malloc(sizeof(int) * (size_t)(count + 1));
+    conflict->count = count;
+    if(!conflict->names || !conflict->starts) {
+        free(conflict->names);
+        free(conflict->starts);
+        free(conflict);
+        return NULL;
+    }
+
+    g_conflict_free(graph->conflict);
+    graph->conflict = conflict;
+    return conflict;
+}
+
+// Reject a relation from a value to itself, keeping the one name as its cycle
+// The name's interned so the conflict can hold it, even if the value isn't in
+//   the graph
+// Returns ERR_RELATIONAL_CONFLICT or ERR_OUT_OF_MEMORY
+static int g_self_conflict(Graph *graph, View item)
+{
+    unsigned int id = p_intern(graph->pool, item.str, item.length);
+    if(id == POOL_NONE) return ERR_OUT_OF_MEMORY;
+
+    Conflict *conflict = g_conflict_new(graph, 1, 1);
+    if(!conflict) return ERR_OUT_OF_MEMORY;
+    conflict->names[0] = p_string(graph->pool, id);
+    conflict->starts[0] = 0;
+    conflict->starts[1] = 1;
+
+    log_err("Conflict found! Cannot resolve %.*s > %.*s, a value can't be greater than itself",
+            (int)item.length, item.str, (int)item.length, item.str);
+    return ERR_RELATIONAL_CONFLICT;
+}
+
+// Trace the cycle g_resolve_tree ran into back through the parents each side kept
 //
-// Shifts any values with the transfer flag to above the pivot
-// Preserves orginal order, just moves them up relative to the pivot
-static void g_transfer_rec(Graph *graph, Value *value, Value *pivot, int post_pivot)
+// Going down from greater, the cycle is greater, lesser, then down the path the
+//   lower side took from lesser to where they met, then down the path the higher
+//   side took from there back up to greater. Either path is empty if a side
+//   reached the other end of the relation itself
+//
+// Returns 0 or ERR_OUT_OF_MEMORY
+static int g_resolve_cycle(Graph *graph, Bound *up, Bound *down)
 {
+    Value *greater = down->limit;
+    Value *lesser = up->limit;
+    Vector *path = new_vector();
+    Value **parent = calloc((size_t)(graph->values_size ? graph->values_size : 1), sizeof(Value *));
+    int rc = ERR_OUT_OF_MEMORY;
+    if(!path || !parent) goto end;
+
+    // where each value either side found was reached from, on this rare path only
+    Bound *sides[] = { up, down };
+    for(int side = 0; side < 2; side++) {
+        for(int i = 0; i < sides[side]->found->length; i++) {
+            Value *value = sides[side]->found->items[i];
+            parent[value->index] = sides[side]->parents->items[i];
+        }
+    }
 
-    // Get the next value so we don't lose it after shift
-    Value *next = value->next;
+    // where they met, and the last value each side came through to get there
+    Value *met = up->hit ? up->hit : down->hit;
+    Value *from_up = up->hit ? up->hit_parent : parent[met->index];
+    Value *from_down = down->hit ? down->hit_parent : parent[met->index];
+    if(met == lesser) from_down = NULL;
+    if(met == greater) from_up = NULL;
+
+    // the lower side's path, from where they met back to lesser, to be reversed
+    if(v_push(path, greater)) goto end;
+    for(Value *value = from_down; value; value = value == lesser ? NULL : parent[value->index]) {
+        if(v_push(path, value)) goto end;
+    }
+    for(int i = 1, j = path->length - 1; i < j; i++, j--) {
+        void *swap = path->items[i];
+        path->items[i] = path->items[j];
+        path->items[j] = swap;
+    }
 
-    // Middle case: hit pivot, skip value while setting post_pivot true
-    if(value == pivot) {
-        g_transfer_rec(graph, next, pivot, 1);
-        return;
+    if(met != greater && v_push(path, met)) goto end;
+    for(Value *value = from_up; value && value != greater; value = parent[value->index]) {
+        if(v_push(path, value)) goto end;
+    }
+
+    Conflict *conflict = g_conflict_new(graph, path->length, 1);
+    if(!conflict) goto end;
+    for(int i = 0; i < path->length; i++) conflict->names[i] = ((Value *)path->items[i])->value;
+    conflict->starts[0] = 0;
+    conflict->starts[1] = path->length;
+    rc = 0;
+
+end:
+    if(path) v_free(path);
+    free(parent);
+    return rc;
+}
+
+// Reorder the graph for a new relation greater > lesser, where greater is currently after lesser
+//
+// Bounded search for incremental topological ordering (Pearce-Kelly):
+//   only values between lesser and greater can be affected, so search up from greater
+//   for higher values still after lesser, and down from lesser for lower values still
+//   before greater. Reaching the other end of the relation means it's cyclic.
+// Either set can be moved past the other end of the relation in its current order
+//   to give a valid sort. The two searches run a step at a time side by side and
+//   whichever finishes first is the smaller set, so that one gets moved.
+//
+// Returns 0 on success, ERR_RELATIONAL_CONFLICT if cyclic or ERR_OUT_OF_MEMORY
+static int g_resolve_tree(Graph *graph, Value *greater, Value *lesser)
+{
+    // move the epoch on past both stamps, so nothing is marked as visited yet
+    uint64_t epoch = graph->epoch;
+    graph->epoch += MARK_LOWER;
+
+    Search up_s = { graph, NULL, DIR_HIGHER, NULL, NULL, NULL };
+    Search down_s = { graph, NULL, DIR_LOWER, NULL, NULL, NULL };
+    Bound up = { lesser, DIR_HIGHER, epoch + MARK_HIGHER, epoch + MARK_LOWER, new_vector(), new_vector(), &up_s, NULL, NULL };
+    Bound down = { greater, DIR_LOWER, epoch + MARK_LOWER, epoch + MARK_HIGHER, new_vector(), new_vector(), &down_s, NULL, NULL };
+    Bound *done = NULL;
+    unsigned long steps = 0;
+    int rc = ERR_OUT_OF_MEMORY;
+
+    if(!up.found || !down.found || !up.parents || !down.parents) goto end;
+    if(g_search_start(&up_s, graph, greater, DIR_HIGHER, g_resolve_visit, &up)) goto end;
+    if(g_search_start(&down_s, graph, lesser, DIR_LOWER, g_resolve_visit, &down)) goto end;
+
+    // each step pops one value off a side's stack
+    for(rc = 0; !rc;) {
+        rc = g_search_step(&up_s);
+        steps++;
+        if(rc == SEARCH_DONE) done = &up;
+        if(rc) break;
+
+        rc = g_search_step(&down_s);
+        steps++;
+        if(rc == SEARCH_DONE) done = &down;
+    }
+
+    if(rc == ERR_RELATIONAL_CONFLICT && g_resolve_cycle(graph, &up, &down)) rc = ERR_OUT_OF_MEMORY;
+
+    if(done) {
+        rc = 0;
+
+        STAT_ADD(graph->stats, shifted, done->found->length);
+
+        // keep the set in its current order
+        qsort(done->found->items, (size_t)done->found->length, sizeof(void *), g_label_compare);
+
+        if(done == &up) {
+            // higher values go just before lesser
+            for(int i = 0; i < done->found->length; i++) {
+                g_shift_before(graph, lesser, done->found->items[i]);
+            }
+        } else {
+            // lower values go just after greater
+            Value *pivot = greater;
+            for(int i = 0; i < done->found->length; i++) {
+                g_shift_after(graph, pivot, done->found->items[i]);
+                pivot = done->found->items[i];
+            }
+        }
     }
 
-    // Late case: After pivot and needs transfer
-    // Specifically to exclude locations already before the pivot, which won't need to be moved
-    if(post_pivot && value->to_transfer) {
-        g_shift_before(graph, pivot, value);
+end:
+    STAT_ADD(graph->stats, resolves, 1);
+    STAT_ADD(graph->stats, visited, steps);
+    STAT_MAX(graph->stats, visited_max, steps);
+
+    g_search_end(&up_s);
+    g_search_end(&down_s);
+    if(up.found) v_free(up.found);
+    if(down.found) v_free(down.found);
+    if(up.parents) v_free(up.parents);
+    if(down.parents) v_free(down.parents);
+    return rc;
+}
+
+// Get the graph's edge set, filling it from the relations already there the first
+//   time, e.g. after g_load
+// Returns NULL if out of memory
+static Edges *g_edges(Graph *graph)
+{
+    if(graph->edges) return graph->edges;
+
+    Edges *edges = new_edges();
+    if(!edges) return NULL;
+
+    uint64_t total = 0;
+    for(Value *value = graph->start; value; value = value->next) total += (uint64_t)g_degree(graph, value, DIR_LOWER);
+    if(e_reserve(edges, total)) goto error;
+
+    for(Value *value = graph->start; value; value = value->next) {
+        int degree = g_degree(graph, value, DIR_LOWER);
+        for(int i = 0; i < degree; i++) {
+            if(e_add(edges, value->index, g_relation(graph, value, DIR_LOWER, i)->index) < 0) goto error;
+        }
+    }
+
+    graph->edges = edges;
+    return edges;
+
+error:
+    e_free(edges);
+    return NULL;
+}
+
+// Let the schedule know greater > lesser was added, removed or changed, if the graph's
+//   been scheduled: lesser's earliest start and greater's latest start can move
+static void g_touch(Graph *graph, Value *greater, Value *lesser)
+{
+    if(!graph->schedule) return;
+
+    cp_touch(graph->schedule, lesser->index, DIR_HIGHER);
+    cp_touch(graph->schedule, greater->index, DIR_LOWER);
+}
+
+// Add a relation to the higher and lower vectors and the edge set
+// The edge set has to have been made with g_edges, and not have the relation yet
+static int g_relate(Graph *graph, Value *greater, Value *lesser)
+{
+    if(v_push_in(&greater->lower, lesser, graph->arena)) return ERR_OUT_OF_MEMORY;
+    if(v_push_in(&lesser->higher, greater, graph->arena)) {
+        v_pop(&greater->lower);
+        return ERR_OUT_OF_MEMORY;
+    }
+    if(e_add(graph->edges, greater->index, lesser->index) < 0) {
+        v_pop(&greater->lower);
+        v_pop(&lesser->higher);
+        return ERR_OUT_OF_MEMORY;
     }
 
-    // Early and all late cases: Reset to_transfer, continue
-    value->to_transfer = 0;
-    if(next) g_transfer_rec(graph, next, pivot, post_pivot);
+    g_touch(graph, greater, lesser);
+    return 0;
 }
 
-// Wrapper around the recursive transfer function
-static void g_transfer(Graph *graph, Value *pivot)
+// find a value by a string view
+static Value *g_lookup_view(Graph *graph, View item)
 {
-    // start with initial flag for post_pivot set to false
-    g_transfer_rec(graph, graph->start, pivot, 0);
+    STAT_ADD(graph->stats, finds, 1);
+
+    unsigned int id = p_find(graph->pool, item.str, item.length);
+    if(id == POOL_NONE || id >= (unsigned int)graph->values_size) return NULL;
+
+    return graph->values[id];
+}
+
+// Make a view of a whole null-terminated string
+static View g_view(char item[])
+{
+    View view = { item, strlen(item) };
+    return view;
+}
+
+int g_apply_relation(Graph *graph, char greater[], char lesser[])
+{
+    return g_apply_relation_n(graph, g_view(greater), g_view(lesser));
 }
 
 // Apply a new relation
 // Will create new items if not present
-int g_apply_relation(Graph *graph, char greater[], char lesser[])
+static int g_apply_view(Graph *graph, View greater, View lesser)
 {
     // Case 1: Both items present, no swap needed
     // Case 2: Both items present, swap needed but no conflicting relation
     // Case 3: Both items present, swap needed but conflicting relation
     // Case 4: One or both items not yet present
 
-    // Prep for finding items
-    int greater_i = -1;
-    int lesser_i = -1;
-    unsigned long greater_id = hash(greater);
-    unsigned long lesser_id = hash(lesser);
+    // a value can't be greater than itself, whether it's in the graph or not
+    if(greater.length == lesser.length && memcmp(greater.str, lesser.str, greater.length) == 0) {
+        return g_self_conflict(graph, greater);
+    }
+
+    Edges *edges = g_edges(graph);
+    if(!edges) return ERR_OUT_OF_MEMORY;
 
     // Find items, if they exist
-    Value *greater_v = g_find(graph, greater_id, &greater_i);
-    Value *lesser_v = g_find(graph, lesser_id, &lesser_i);
+    Value *greater_v = g_lookup_view(graph, greater);
+    Value *lesser_v = g_lookup_view(graph, lesser);
+    int greater_found = greater_v != NULL;
+    int lesser_found = lesser_v != NULL;
+
+    // Already related, so already in order too
+    if(greater_v && lesser_v && e_has(edges, greater_v->index, lesser_v->index)) {
+        graph->duplicates++;
+        return ERR_DUPLICATE;
+    }
 
-    if(greater_v && lesser_v && greater_i < lesser_i) {
+    if(greater_v && lesser_v && g_before(greater_v, lesser_v)) {
         // Case 1: Both present and no swap needed
-        // TODO: Make sure we don't insert duplicates
         // Just add relations to the lists of higher and lower values
-        l_push(greater_v->lower, lesser_v);
-        l_push(lesser_v->higher, greater_v);
-    } else if(greater_v && lesser_v && greater_i > lesser_i) {
+        return g_relate(graph, greater_v, lesser_v);
+    } else if(greater_v && lesser_v && g_before(lesser_v, greater_v)) {
         // Case 2 and 3
 
-        // Resolve the tree to find items that need to be transferred
-        int err = g_resolve_tree(greater_v, lesser_v);
+        // Resolve the tree, moving the affected values
+        int err = g_resolve_tree(graph, greater_v, lesser_v);
 
         // check for case 3
         if(err == ERR_RELATIONAL_CONFLICT) {
-            log_err("Conflict found! Cannot resolve %s > %s", greater, lesser);
+            char text[CYCLE_TEXT_SIZE];
+            g_cycle_text(graph->conflict, 0, " > ", 1, text, sizeof(text));
+            log_err("Conflict found! Cannot resolve %.*s > %.*s, it makes the cycle %s",
+                    (int)greater.length, greater.str, (int)lesser.length, lesser.str, text);
             return err;
         }
-
-        // resolve the graph transfers
-        g_transfer(graph, lesser_v);
+        if(err) return err;
 
         // add relattions
-        l_push(greater_v->lower, lesser_v);
-        l_push(lesser_v->higher, greater_v);
+        return g_relate(graph, greater_v, lesser_v);
     } else {
         // Case 4: need item
 
         // Make sure they both exist and create if not
-        if(!greater_v) greater_v = new_value(greater);
-        if(!lesser_v) lesser_v = new_value(lesser);
+        if(!greater_v) greater_v = g_new_value(graph, greater);
+        if(!lesser_v) lesser_v = g_new_value(graph, lesser);
+        if(!greater_v || !lesser_v) goto error;
 
-
-        // Add relations
-        l_push(greater_v->lower, lesser_v);
-        l_push(lesser_v->higher, greater_v);
-
-        if(greater_i == -1 && lesser_i == -1) {
+        // link the new ones in first, so the relation only ever joins values in the graph
+        if(!greater_found && !lesser_found) {
             // Neither exist, add them in order
-            g_push(graph, greater_v);
-            g_push(graph, lesser_v);
-        } else if(greater_i == -1) {
+            if(g_push(graph, greater_v)) goto error;
+            // in the graph now, whatever happens to lesser
+            greater_found = 1;
+            if(g_push(graph, lesser_v)) goto error;
+        } else if(!greater_found) {
             // Insert greater before lesser
-            g_insert_before(graph, lesser_v, greater_v);
-        } else if(lesser_i == -1) {
-            // Insert lesser after greater
-            g_insert_after(graph, greater_v, lesser_v);
+            if(g_insert_before(graph, lesser_v, greater_v)) goto error;
         } else {
-            // Error case - why do they both have an index if one of them wasn't defined?
-            // TODO: update return values for consistency
-            return -1;
+            // Insert lesser after greater
+            if(g_insert_after(graph, greater_v, lesser_v)) goto error;
         }
+
+        // Add relations
+        return g_relate(graph, greater_v, lesser_v);
     }
 
+error:
+    // give back whichever new values didn't make it into the graph
+    if(greater_v && !greater_found) g_drop_value(graph, greater_v);
+    if(lesser_v && !lesser_found) g_drop_value(graph, lesser_v);
+    return ERR_OUT_OF_MEMORY;
+}
+
+// time each relation when counting, otherwise there's nothing in the way
+int g_apply_relation_n(Graph *graph, View greater, View lesser)
+{
+#ifdef GRAPH_STATS
+    uint64_t start = st_now();
+    int rc = g_apply_view(graph, greater, lesser);
+    st_latency(&graph->stats, st_now() - start);
+    graph->stats.applies++;
+    return rc;
+#else
+    return g_apply_view(graph, greater, lesser);
+#endif
+}
+
+// Undo the first count relations of a batch, newest first so each pop takes off
+//   the relation that was pushed. Duplicates that were skipped are left alone
+static void g_batch_unrelate(Graph *graph, unsigned int *greater, unsigned int *lesser, char *kept, int count)
+{
+    for(int i = count - 1; i >= 0; i--) {
+        if(!kept[i]) continue;
+
+        v_pop(&graph->values[greater[i]]->lower);
+        v_pop(&graph->values[lesser[i]]->higher);
+        e_remove(graph->edges, greater[i], lesser[i]);
+    }
+}
+
+// Forget values a batch created, they never got linked into the graph
+static void g_batch_unadd(Graph *graph, Vector *added)
+{
+    for(int i = 0; i < added->length; i++) {
+        Value *value = added->items[i];
+
+        graph->values[value->index] = NULL;
+        v_clear_in(&value->higher, graph->arena);
+        v_clear_in(&value->lower, graph->arena);
+        g_drop_value(graph, value);
+    }
+}
+
+// Find the cycles among the values left over by an unfinished sort, keep them in
+//   graph->conflict and log them
+// Every value left is on a cycle or below one, so the cycles are the strongly
+//   connected components of what's left: Tarjan's algorithm finds them all in one
+//   pass over its relations, with explicit stacks like the other searches
+// left[id] is non-zero for values that weren't sorted, stack has room for all of them
+static int g_batch_report(Graph *graph, unsigned int *left, Value **stack)
+{
+    unsigned int length = graph->pool->length;
+    // order each value was reached in, from 1, and lowest order reachable from it
+    unsigned int *index = calloc(length, sizeof(unsigned int));
+    unsigned int *low = malloc(sizeof(unsigned int) * length);
+    // ids on the current path and how far through its lower relations each is
+    unsigned int *path = malloc(sizeof(unsigned int) * length);
+    int *edge = malloc(sizeof(int) * length);
+    char *on_stack = calloc(length, sizeof(char));
+    // where each component starts in names
+    int *starts = malloc(sizeof(int) * (length + 1));
+    Vector *names = new_vector();
+    int rc = ERR_OUT_OF_MEMORY;
+    if(!index || !low || !path || !edge || !on_stack || !starts || !names) goto end;
+
+    unsigned int reached = 0;
+    int top = 0;
+    int count = 0;
+    for(unsigned int root = 0; root < length; root++) {
+        if(!left[root] || index[root]) continue;
+
+        int depth = 0;
+        path[0] = root;
+        edge[0] = 0;
+        index[root] = low[root] = ++reached;
+        stack[top++] = graph->values[root];
+        on_stack[root] = 1;
+
+        while(depth >= 0) {
+            unsigned int id = path[depth];
+            Value *value = graph->values[id];
+
+            if(edge[depth] < g_degree(graph, value, DIR_LOWER)) {
+                unsigned int next = g_relation(graph, value, DIR_LOWER, edge[depth]++)->index;
+                if(!left[next]) continue;
+
+                if(!index[next]) {
+                    path[++depth] = next;
+                    edge[depth] = 0;
+                    index[next] = low[next] = ++reached;
+                    stack[top++] = graph->values[next];
+                    on_stack[next] = 1;
+                } else if(on_stack[next] && index[next] < low[id]) {
+                    low[id] = index[next];
+                }
+                continue;
+            }
+
+            // everything below it is done, so it heads a component if nothing
+            //   reached back above it
+            if(low[id] == index[id]) {
+                int first = names->length;
+                Value *popped;
+                do {
+                    popped = stack[--top];
+                    on_stack[popped->index] = 0;
+                    if(v_push(names, popped->value)) goto end;
+                } while(popped != value);
+
+                // a lone value is only a cycle if it's related to itself
+                int cyclic = names->length - first > 1;
+                for(int i = 0; !cyclic && i < g_degree(graph, value, DIR_LOWER); i++) {
+                    cyclic = g_relation(graph, value, DIR_LOWER, i) == value;
+                }
+
+                if(cyclic) starts[count++] = first;
+                else names->length = first;
+            }
+
+            depth--;
+            if(depth >= 0 && low[id] < low[path[depth]]) low[path[depth]] = low[id];
+        }
+    }
+
+    Conflict *conflict = g_conflict_new(graph, names->length, count);
+    if(!conflict) goto end;
+    for(int i = 0; i < names->length; i++) conflict->names[i] = names->items[i];
+    memcpy(conflict->starts, starts, sizeof(int) * (size_t)count);
+    conflict->starts[count] = names->length;
+
+    char text[CYCLE_TEXT_SIZE];
+    for(int i = 0; i < count && i < CYCLE_REPORT_LIMIT; i++) {
+        g_cycle_text(conflict, i, ", ", 0, text, sizeof(text));
+        log_err("Conflict found! Cycle through %s", text);
+    }
+    if(count > CYCLE_REPORT_LIMIT) log_err("...and %i more cycles", count - CYCLE_REPORT_LIMIT);
+    rc = ERR_RELATIONAL_CONFLICT;
+
+end:
+    free(index);
+    free(low);
+    free(path);
+    free(edge);
+    free(on_stack);
+    free(starts);
+    if(names) v_free(names);
+    return rc;
+}
+
+// Sort every value in the graph from scratch with Kahn's algorithm, then relink and
+//   relabel the graph in that order
+// Values already in the graph keep their relative order where the relations allow it,
+//   and added values go after them
+// Returns 0, ERR_RELATIONAL_CONFLICT with the graph untouched or ERR_OUT_OF_MEMORY
+static int g_batch_sort(Graph *graph, Vector *added)
+{
+    unsigned int length = graph->pool->length;
+    int total = graph->length + added->length;
+    int rc = ERR_OUT_OF_MEMORY;
+
+    // count of higher values not yet placed, for each id
+    unsigned int *left = calloc(length ? length : 1, sizeof(unsigned int));
+    // sorted values, doubling as the queue of values ready to place
+    Value **order = malloc(sizeof(Value *) * (size_t)(total ? total : 1));
+    if(!left || !order) goto end;
+
+    int tail = 0;
+    for(Value *value = graph->start; value; value = value->next) {
+        left[value->index] = (unsigned int)g_degree(graph, value, DIR_HIGHER);
+        if(!left[value->index]) order[tail++] = value;
+    }
+    for(int i = 0; i < added->length; i++) {
+        Value *value = added->items[i];
+        left[value->index] = (unsigned int)g_degree(graph, value, DIR_HIGHER);
+        if(!left[value->index]) order[tail++] = value;
+    }
+
+    for(int head = 0; head < tail; head++) {
+        Value *value = order[head];
+        int degree = g_degree(graph, value, DIR_LOWER);
+        for(int i = 0; i < degree; i++) {
+            Value *lower = g_relation(graph, value, DIR_LOWER, i);
+            if(--left[lower->index] == 0) order[tail++] = lower;
+        }
+    }
+
+    if(tail < total) {
+        rc = g_batch_report(graph, left, order);
+        goto end;
+    }
+
+    // relink in sorted order with labels spread evenly over the whole range
+    uint64_t spacing = LABEL_MAX / ((uint64_t)total + 1);
+    Value *prev = NULL;
+    for(int i = 0; i < total; i++) {
+        order[i]->prev = prev;
+        order[i]->next = NULL;
+        order[i]->label = spacing * (uint64_t)(i + 1);
+        if(prev) prev->next = order[i];
+        prev = order[i];
+    }
+
+    graph->start = total ? order[0] : NULL;
+    graph->end = prev;
+    graph->length = total;
+    rc = 0;
+
+end:
+    free(left);
+    free(order);
+    return rc;
+}
+
+int g_apply_relations_batch(Graph *graph, char *greater[], char *lesser[], int count)
+{
+    View *greater_v = malloc(sizeof(View) * (size_t)(count > 0 ? count : 1));
+    View *lesser_v = malloc(sizeof(View) * (size_t)(count > 0 ? count : 1));
+    int rc = ERR_OUT_OF_MEMORY;
+
+    if(greater_v && lesser_v) {
+        for(int i = 0; i < count; i++) {
+            greater_v[i] = g_view(greater[i]);
+            lesser_v[i] = g_view(lesser[i]);
+        }
+        rc = g_apply_relations_batch_n(graph, greater_v, lesser_v, count);
+    }
+
+    free(greater_v);
+    free(lesser_v);
+    return rc;
+}
+
+int g_apply_relations_batch_n(Graph *graph, View *greater, View *lesser, int count)
+{
+    unsigned int *greater_id = malloc(sizeof(unsigned int) * (size_t)(count > 0 ? count : 1));
+    unsigned int *lesser_id = malloc(sizeof(unsigned int) * (size_t)(count > 0 ? count : 1));
+    int rc = greater_id && lesser_id ? 0 : ERR_OUT_OF_MEMORY;
+
+    // strings interned here stay in the pool even if the batch fails, without values
+    for(int i = 0; i < count && !rc; i++) {
+        greater_id[i] = p_intern(graph->pool, greater[i].str, greater[i].length);
+        lesser_id[i] = p_intern(graph->pool, lesser[i].str, lesser[i].length);
+        if(greater_id[i] == POOL_NONE || lesser_id[i] == POOL_NONE) rc = ERR_OUT_OF_MEMORY;
+    }
+
+    if(!rc) rc = g_apply_relations_ids(graph, greater_id, lesser_id, count);
+
+    free(greater_id);
+    free(lesser_id);
+    return rc;
+}
+
+// Apply many relations at once
+// Relations are all added first and the graph sorted once at the end, rather than
+//   reordering for each one
+int g_apply_relations_ids(Graph *graph, unsigned int *greater, unsigned int *lesser, int count)
+{
+    Edges *edges = g_edges(graph);
+    Vector *added = new_vector();
+    char *kept = malloc((size_t)(count ? count : 1));
+    unsigned long duplicates = graph->duplicates;
+    if(!edges || !added || !kept || e_reserve(edges, edges->length + (uint64_t)count)) {
+        if(added) v_free(added);
+        free(kept);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    int rc = 0;
+    int i = 0;
+    for(; i < count; i++) {
+        unsigned int ids[2] = { greater[i], lesser[i] };
+        // a lesser of POOL_NONE only makes sure greater has a value
+        int sides = lesser[i] == POOL_NONE ? 1 : 2;
+
+        for(int j = 0; j < sides && !rc; j++) {
+            if(g_cover(graph, ids[j])) {
+                rc = ERR_OUT_OF_MEMORY;
+                break;
+            }
+            if(graph->values[ids[j]]) continue;
+
+            // once in added the value is cleaned up along with the rest on failure
+            Value *value = g_id_value(graph, ids[j]);
+            if(!value) {
+                rc = ERR_OUT_OF_MEMORY;
+            } else if(v_push(added, value)) {
+                g_drop_value(graph, value);
+                rc = ERR_OUT_OF_MEMORY;
+            } else {
+                graph->values[ids[j]] = value;
+            }
+        }
+
+        if(rc) break;
+        if(sides == 1) {
+            kept[i] = 0;
+            continue;
+        }
+
+        // skip relations already in the graph or earlier in the batch
+        kept[i] = !e_has(edges, ids[0], ids[1]);
+        if(!kept[i]) {
+            graph->duplicates++;
+            continue;
+        }
+
+        rc = g_relate(graph, graph->values[ids[0]], graph->values[ids[1]]);
+        if(rc) {
+            kept[i] = 0;
+            break;
+        }
+    }
+
+    if(!rc) rc = g_batch_sort(graph, added);
+
+    if(rc) {
+        // leave the graph as it was
+        g_batch_unrelate(graph, greater, lesser, kept, i);
+        g_batch_unadd(graph, added);
+        graph->duplicates = duplicates;
+    }
+
+    v_free(added);
+    free(kept);
+    return rc;
+}
+
+// Take one copy of related out of a value's relations in one direction
+// Added relations are checked first, newest first, then the frozen row. Either way
+//   the last relation is moved into the gap, so order within a row isn't kept
+// Returns 1 if related isn't there
+static int g_unrelate(Graph *graph, Value *value, int direction, Value *related)
+{
+    Vector *added = direction == DIR_HIGHER ? &value->higher : &value->lower;
+    for(int i = added->length - 1; i >= 0; i--) {
+        if(added->items[i] != related) continue;
+
+        added->items[i] = added->items[--added->length];
+        return 0;
+    }
+
+    Frozen *frozen = graph->frozen;
+    if(!frozen || value->index >= frozen->length) return 1;
+
+    unsigned int *start = direction == DIR_HIGHER ? frozen->higher_start : frozen->lower_start;
+    unsigned int *end = direction == DIR_HIGHER ? frozen->higher_end : frozen->lower_end;
+    unsigned int *row = direction == DIR_HIGHER ? frozen->higher : frozen->lower;
+    for(unsigned int i = start[value->index]; i < end[value->index]; i++) {
+        if(row[i] != related->index) continue;
+
+        row[i] = row[--end[value->index]];
+        return 0;
+    }
+
+    return 1;
+}
+
+int g_remove_relation(Graph *graph, char greater[], char lesser[])
+{
+    Value *greater_v = g_lookup(graph, greater);
+    Value *lesser_v = g_lookup(graph, lesser);
+    if(!greater_v || !lesser_v) return ERR_NOT_FOUND;
+
+    return g_remove_relation_v(graph, greater_v, lesser_v);
+}
+
+int g_remove_relation_v(Graph *graph, Value *greater_v, Value *lesser_v)
+{
+    // both sides are always added together, so if one is there so is the other
+    if(g_unrelate(graph, greater_v, DIR_LOWER, lesser_v)) return ERR_NOT_FOUND;
+    g_unrelate(graph, lesser_v, DIR_HIGHER, greater_v);
+    if(graph->edges) e_remove(graph->edges, greater_v->index, lesser_v->index);
+    g_touch(graph, greater_v, lesser_v);
+
     return 0;
 }
 
-// recursive function to get sorted list
-// this uses a head:tail format common to Haskell and other functional languages
-// so we assign the head (list[0]) then recurse over the rest (list[1:])
-// slightly hacky in c but it also works nicely so
-static char **g_sorted_rec(Value *value, char **list)
+// Remove a value, taking it out of each of its neighbours' relations
+// The order of everything else stays valid, so only the links around it change
+int g_remove_value(Graph *graph, char item[])
 {
-    // end of list case
-    if(!value) return list;
+    Value *value = g_lookup(graph, item);
+    if(!value) return ERR_NOT_FOUND;
+
+    for(int direction = DIR_LOWER; direction <= DIR_HIGHER; direction++) {
+        int degree = g_degree(graph, value, direction);
+        for(int i = 0; i < degree; i++) {
+            Value *related = g_relation(graph, value, direction, i);
+            g_unrelate(graph, related, direction == DIR_HIGHER ? DIR_LOWER : DIR_HIGHER, value);
+            if(direction == DIR_HIGHER) g_touch(graph, related, value);
+            else g_touch(graph, value, related);
+
+            if(!graph->edges) continue;
+            if(direction == DIR_HIGHER) e_remove(graph->edges, related->index, value->index);
+            else e_remove(graph->edges, value->index, related->index);
+        }
+    }
 
-    // assign the start of the current list
-    list[0] = value->value;
-    // continue with the tail of the list
-    g_sorted_rec(value->next, &list[1]);
-    return list;
+    // its own frozen rows just become empty
+    Frozen *frozen = graph->frozen;
+    if(frozen && value->index < frozen->length) {
+        frozen->higher_end[value->index] = frozen->higher_start[value->index];
+        frozen->lower_end[value->index] = frozen->lower_start[value->index];
+    }
+
+    if(graph->schedule) cp_forget(graph->schedule, value);
+    g_unlink(graph, value);
+    graph->values[value->index] = NULL;
+    v_clear_in(&value->higher, graph->arena);
+    v_clear_in(&value->lower, graph->arena);
+    g_drop_value(graph, value);
+
+    return 0;
+}
+
+int g_set_weight(Graph *graph, char item[], int64_t weight)
+{
+    Value *value = g_lookup(graph, item);
+    if(!value) return ERR_NOT_FOUND;
+
+    value->weight = weight;
+    if(graph->schedule) cp_touch(graph->schedule, value->index, -1);
+    return 0;
+}
+
+int g_set_relation_weight(Graph *graph, char greater[], char lesser[], int64_t weight)
+{
+    Value *greater_v = g_lookup(graph, greater);
+    Value *lesser_v = g_lookup(graph, lesser);
+    if(!greater_v || !lesser_v) return ERR_NOT_FOUND;
+
+    Edges *edges = g_edges(graph);
+    if(!edges) return ERR_OUT_OF_MEMORY;
+
+    int rc = e_set_weight(edges, greater_v->index, lesser_v->index, weight);
+    if(rc) return rc < 0 ? ERR_OUT_OF_MEMORY : ERR_NOT_FOUND;
+
+    g_touch(graph, greater_v, lesser_v);
+    return 0;
+}
+
+// visitor to fill the sorted list
+// data is a cursor into the list, moved along one for each value
+static int g_sorted_visit(Value *value, void *data)
+{
+    char ***cursor = data;
+
+    **cursor = value->value;
+    *cursor += 1;
+    return 0;
 }
 
 // get the sorted graph as an array of strings
@@ -241,166 +1348,500 @@ char **g_sorted(Graph *graph, int *size)
     // dynamically allocate an array of sufficient size
     char **list = malloc(sizeof(char *) * (unsigned long)graph->length);
 
-    // set the size appropriately and start recursion
+    if(!list) return NULL;
+
+    // set the size appropriately and fill the list
     *size = graph->length;
-    return g_sorted_rec(graph->start, list);
+    char **cursor = list;
+    g_each(graph, g_sorted_visit, &cursor);
+    return list;
 }
 
-// find a value in the graph (internal recursion)
-static Value *g_find_rec(Value *value, unsigned long search, int *index)
+// find a value
+// goes through the pool's table, only walks the graph if the index is wanted
+Value *g_find(Graph *graph, unsigned long search, int *index)
 {
-    // Case 1: End of list and value not found, return null
-    // Index will be reset by g_find
-    if(!value) return NULL;
+    STAT_ADD(graph->stats, finds, 1);
 
-    if(index) *index += 1;
+    unsigned int id = p_find_hash(graph->pool, search);
+    Value *found = id == POOL_NONE || id >= (unsigned int)graph->values_size ? NULL : graph->values[id];
 
-    // Case 2: IDs equal and found, return value
-    // index should be correct from recursion
-    if(value->id == search) {
-        return value;
+    // ignore the index if we haven't got one
+    if(index) {
+        *index = -1;
+        if(found) {
+            for(Value *value = found; value; value = value->prev) *index += 1;
+        }
     }
 
-    // Case 3: Not yet found, continue searching
-    return g_find_rec(value->next, search, index);
+    return found;
 }
 
-// find a value
-Value *g_find(Graph *graph, unsigned long search, int *index)
+// find a value by string, making sure the string matches on a collision
+Value *g_lookup(Graph *graph, char item[])
 {
-    // ignore the index if we haven't got one
-    if(index) *index = 0;
-    Value *found = g_find_rec(graph->start, search, index);
+    return g_lookup_view(graph, g_view(item));
+}
 
-    // return if found
-    if(found) return found;
+// compare labels to check order
+int g_before(Value *first, Value *second)
+{
+    return first->label < second->label;
+}
+
+// count relations, frozen ones first
+int g_degree(Graph *graph, Value *value, int direction)
+{
+    Vector *added = direction == DIR_HIGHER ? &value->higher : &value->lower;
+    Frozen *frozen = graph->frozen;
 
-    // else not found
-    if(index) *index = -1;
+    if(!frozen || value->index >= frozen->length) return added->length;
+
+    unsigned int *start = direction == DIR_HIGHER ? frozen->higher_start : frozen->lower_start;
+    unsigned int *end = direction == DIR_HIGHER ? frozen->higher_end : frozen->lower_end;
+    return (int)(end[value->index] - start[value->index]) + added->length;
+}
+
+// get a relation, frozen ones first
+Value *g_relation(Graph *graph, Value *value, int direction, int i)
+{
+    Vector *added = direction == DIR_HIGHER ? &value->higher : &value->lower;
+    Frozen *frozen = graph->frozen;
+
+    if(frozen && value->index < frozen->length) {
+        unsigned int *start = direction == DIR_HIGHER ? frozen->higher_start : frozen->lower_start;
+        unsigned int *end = direction == DIR_HIGHER ? frozen->higher_end : frozen->lower_end;
+        unsigned int *related = direction == DIR_HIGHER ? frozen->higher : frozen->lower;
+        unsigned int row = start[value->index];
+        int count = (int)(end[value->index] - row);
+
+        if(i < count) return graph->values[related[row + (unsigned int)i]];
+        i -= count;
+    }
+
+    return added->items[i];
+}
+
+// free the arrays in frozen relations
+static void g_frozen_free(Frozen *frozen)
+{
+    if(!frozen) return;
+
+    free(frozen->higher_start);
+    free(frozen->higher_end);
+    free(frozen->higher);
+    free(frozen->lower_start);
+    free(frozen->lower_end);
+    free(frozen->lower);
+    free(frozen);
+}
+
+// make the end of each row, with every row full up to the start of the next
+static unsigned int *g_row_ends(unsigned int *start, unsigned int length)
+{
+    unsigned int *end = malloc(sizeof(unsigned int) * (length ? length : 1));
+    if(!end) return NULL;
+
+    if(length) memcpy(end, start + 1, sizeof(unsigned int) * length);
+    return end;
+}
+
+// pack relations from one direction into compressed rows
+// start, end and related are allocated here
+static int g_freeze_rows(Graph *graph, int direction, unsigned int **start, unsigned int **end, unsigned int **related)
+{
+    unsigned int length = graph->pool->length;
+    unsigned int total = 0;
+
+    *start = malloc(sizeof(unsigned int) * (length + 1));
+    if(!*start) return ERR_OUT_OF_MEMORY;
+
+    for(unsigned int i = 0; i < length; i++) {
+        (*start)[i] = total;
+        if(graph->values[i]) total += (unsigned int)g_degree(graph, graph->values[i], direction);
+    }
+    (*start)[length] = total;
+
+    *end = g_row_ends(*start, length);
+    if(!*end) return ERR_OUT_OF_MEMORY;
+
+    // always allocate something so an empty graph still has an array
+    *related = malloc(sizeof(unsigned int) * (total ? total : 1));
+    if(!*related) return ERR_OUT_OF_MEMORY;
+
+    for(unsigned int i = 0; i < length; i++) {
+        Value *value = graph->values[i];
+        int degree = value ? g_degree(graph, value, direction) : 0;
+        for(int j = 0; j < degree; j++) {
+            (*related)[(*start)[i] + (unsigned int)j] = g_relation(graph, value, direction, j)->index;
+        }
+    }
+
+    return 0;
+}
+
+// pack every relation into compressed rows
+int g_freeze(Graph *graph)
+{
+    Frozen *frozen = calloc(1, sizeof(Frozen));
+    if(!frozen) return ERR_OUT_OF_MEMORY;
+
+    // every id gets a row, even ones without a value
+    if(g_cover(graph, graph->pool->length)) {
+        free(frozen);
+        return ERR_OUT_OF_MEMORY;
+    }
+    frozen->length = graph->pool->length;
+    if(g_freeze_rows(graph, DIR_HIGHER, &frozen->higher_start, &frozen->higher_end, &frozen->higher)
+            || g_freeze_rows(graph, DIR_LOWER, &frozen->lower_start, &frozen->lower_end, &frozen->lower)) {
+        g_frozen_free(frozen);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    // everything is in the new rows now, so the old ones and the vectors can go
+    g_frozen_free(graph->frozen);
+    graph->frozen = frozen;
+
+    for(unsigned int i = 0; i < frozen->length; i++) {
+        if(!graph->values[i]) continue;
+
+        v_clear_in(&graph->values[i]->higher, graph->arena);
+        v_clear_in(&graph->values[i]->lower, graph->arena);
+    }
+
+    return 0;
+}
+
+// write a snapshot, numbering values in sorted order
+// lay a graph out as a snapshot at path, or in memory if path is NULL, but
+//   leave committing it to the caller
+static int g_snapshot_at(Graph *graph, const char *path, Snapshot **out)
+{
+    uint32_t length = (uint32_t)graph->length;
+    uint64_t relations = 0;
+    uint64_t names_size = 0;
+    int rc = ERR_OUT_OF_MEMORY;
+
+    // snapshot id of each value by its pool id
+    unsigned int *ids = malloc(sizeof(unsigned int) * (graph->pool->length ? graph->pool->length : 1));
+    if(!ids) return ERR_OUT_OF_MEMORY;
+
+    uint32_t id = 0;
+    for(Value *value = graph->start; value; value = value->next) {
+        ids[value->index] = id++;
+        relations += (uint64_t)g_degree(graph, value, DIR_LOWER);
+        names_size += strlen(value->value) + 1;
+    }
+
+    rc = path ? ERR_IO : ERR_OUT_OF_MEMORY;
+    check(relations <= UINT32_MAX, "Too many relations to snapshot: %llu", (unsigned long long)relations);
+    Snapshot *snapshot = sn_create(path, length, (uint32_t)relations, names_size);
+    if(!snapshot) goto error;
+
+    uint64_t name = 0;
+    uint32_t higher = 0;
+    uint32_t lower = 0;
+    id = 0;
+    for(Value *value = graph->start; value; value = value->next, id++) {
+        size_t size = strlen(value->value) + 1;
+        snapshot->name_starts[id] = name;
+        memcpy(snapshot->names + name, value->value, size);
+        name += size;
+        snapshot->hashes[id] = p_hash(graph->pool, value->index);
+
+        snapshot->higher_start[id] = higher;
+        int degree = g_degree(graph, value, DIR_HIGHER);
+        for(int i = 0; i < degree; i++) snapshot->higher[higher++] = ids[g_relation(graph, value, DIR_HIGHER, i)->index];
+
+        snapshot->lower_start[id] = lower;
+        degree = g_degree(graph, value, DIR_LOWER);
+        for(int i = 0; i < degree; i++) snapshot->lower[lower++] = ids[g_relation(graph, value, DIR_LOWER, i)->index];
+    }
+    snapshot->name_starts[length] = name;
+    snapshot->higher_start[length] = higher;
+    snapshot->lower_start[length] = lower;
+
+    *out = snapshot;
+    rc = 0;
+
+error:
+    free(ids);
+    return rc;
+}
+
+int g_save(Graph *graph, const char *path)
+{
+    Snapshot *snapshot = NULL;
+    int rc = g_snapshot_at(graph, path, &snapshot);
+    if(rc) return rc;
+
+    rc = sn_commit(snapshot) ? ERR_IO : 0;
+    sn_close(snapshot);
+    return rc;
+}
+
+// the same layout as g_save, so readers use the sn_* functions either way
+Snapshot *g_snapshot(Graph *graph)
+{
+    Snapshot *snapshot = NULL;
+    if(g_snapshot_at(graph, NULL, &snapshot)) return NULL;
+
+    sn_commit(snapshot);
+    return snapshot;
+}
+
+// copy one direction of a snapshot's relations into frozen rows
+// returns 1 if out of memory or a relation points outside the snapshot
+static int g_load_rows(Snapshot *snapshot, uint32_t *start, uint32_t *related, unsigned int **start_out, unsigned int **end_out, unsigned int **related_out)
+{
+    uint32_t length = snapshot->length;
+
+    *start_out = malloc(sizeof(unsigned int) * (length + 1));
+    *related_out = malloc(sizeof(unsigned int) * (snapshot->relations ? snapshot->relations : 1));
+    if(!*start_out || !*related_out) return 1;
+
+    for(uint32_t i = 0; i <= length; i++) {
+        if(start[i] > snapshot->relations || (i && start[i] < start[i - 1])) return 1;
+        (*start_out)[i] = start[i];
+    }
+    for(uint32_t i = 0; i < snapshot->relations; i++) {
+        if(related[i] >= length) return 1;
+        (*related_out)[i] = related[i];
+    }
+
+    *end_out = g_row_ends(*start_out, length);
+    return *end_out == NULL;
+}
+
+// read a snapshot into a new graph, in the order it was saved
+Graph *g_load(const char *path)
+{
+    Snapshot *snapshot = sn_open(path, 1);
+    if(!snapshot) return NULL;
+
+    Graph *graph = new_graph();
+    Frozen *frozen = calloc(1, sizeof(Frozen));
+    uint32_t length = snapshot->length;
+    check_mem(graph && frozen);
+    graph->frozen = frozen;
+    check_mem(!g_cover(graph, length));
+
+    // ids were given out in sorted order, so labels can just count up
+    uint64_t spacing = LABEL_MAX / ((uint64_t)length + 1);
+    for(uint32_t id = 0; id < length; id++) {
+        uint64_t start = snapshot->name_starts[id];
+        uint64_t end = snapshot->name_starts[id + 1];
+        check(start < end && end <= snapshot->header->names_size, "Bad name in %s", path);
+
+        // every name is new to the pool, so it gets the same id as in the snapshot
+        unsigned int index = p_intern_hashed(graph->pool, snapshot->names + start, end - start - 1, snapshot->hashes[id]);
+        check(index == id, "Duplicate name in %s", path);
+
+        Value *value = g_id_value(graph, index);
+        check_mem(value);
+        graph->values[index] = value;
+
+        value->prev = graph->end;
+        if(graph->end) graph->end->next = value;
+        else graph->start = value;
+        graph->end = value;
+        graph->length++;
+        value->label = spacing * (id + UINT64_C(1));
+    }
+
+    frozen->length = length;
+    check(!g_load_rows(snapshot, snapshot->higher_start, snapshot->higher, &frozen->higher_start, &frozen->higher_end, &frozen->higher)
+            && !g_load_rows(snapshot, snapshot->lower_start, snapshot->lower, &frozen->lower_start, &frozen->lower_end, &frozen->lower),
+            "Bad relations in %s", path);
+
+    sn_close(snapshot);
+    return graph;
+
+error:
+    if(graph) g_free(graph);
+    else free(frozen);
+    sn_close(snapshot);
     return NULL;
 }
 
 // push an item onto the end
 // same implementation as l_push
-void g_push(Graph *graph, Value *value)
+int g_push(Graph *graph, Value *value)
 {
+    if(g_add(graph, value)) return 1;
+
     Value *before = graph->end;
 
     if(!graph->start) graph->start = value;
     if(before) before->next = value;
     value->prev = before;
+    value->next = NULL;
     graph->end = value;
     graph->length += 1;
+
+    g_label(value);
+
+    return 0;
 }
 
 int g_insert_before(Graph *graph, Value *after, Value *new)
 {
-    // Insert 1 [] 3 <-2, given 3
+    if(g_add(graph, new)) return 1;
 
-    // Get 1
-    Value *prev = after->prev;
+    g_link_before(graph, after, new);
 
-    // Graph operations
-    if(graph->start == after) graph->start = new;
-    graph->length += 1;
+    return 0;
+}
 
-    // 1.next = 2
-    if(prev) prev->next = new;
-    // 3.prev = 2
-    after->prev = new;
-    // 2.next = 3
-    new->next = after;
-    // 2.prev = 1
-    new->prev = prev;
+int g_insert_after(Graph *graph, Value *before, Value *new)
+{
+    if(g_add(graph, new)) return 1;
+
+    g_link_after(graph, before, new);
 
     return 0;
 }
 
-int g_insert_after(Graph *graph, Value *before, Value *new)
+// walk a graph
+int g_each(Graph *graph, g_visitor visit, void *data)
 {
-    // Insert 1 [] 3 <- 2, given 1
+    Value *value = graph->start;
 
-    // Get 3
-    Value *next = before->next;
+    while(value) {
+        // get the next value first in case the visitor moves or frees this one
+        Value *next = value->next;
 
-    // Graph operations
-    // Set end if at end
-    if(graph->end == before) graph->end = new;
-    // Increase length
-    graph->length += 1;
+        int rc = visit(value, data);
+        if(rc) return rc;
 
-    // 1.next = 2
-    before->next = new;
-    // 3.prev = 2
-    if(next) next->prev = new;
-    // 2.next = 3
-    new->next = next;
-    // 2.prev = 1
-    new->prev = before;
+        value = next;
+    }
 
     return 0;
 }
 
-// recursive print for the higher and lower lists
-static void g_print_l_rec(Item *item)
+// start a cursor at the first value
+Iter g_iter_begin(Graph *graph)
 {
-    // end cases
-    if(!item) return;
-    if(!item->value) return;
+    Iter iter = { graph->start };
+    return iter;
+}
 
-    printf("%li, ", (unsigned long int)((Value *)item->value)->id);
+// move a cursor on
+// like g_each the next value's taken first, so the one given can be moved or freed
+Value *g_iter_next(Iter *iter)
+{
+    Value *value = iter->next;
+    if(value) iter->next = value->next;
+    return value;
+}
 
-    g_print_l_rec(item->next);
+Conflict *g_conflict(Graph *graph)
+{
+    return graph->conflict;
 }
 
-// recursive wrapper for printing the lists
-static void g_print_l(List *list)
+// copy the counters, adding what the arenas counted
+Stats g_stats(Graph *graph)
+{
+    Stats stats = graph->stats;
+
+#ifdef GRAPH_STATS
+    stats.enabled = 1;
+    Arena *arenas[] = { graph->arena, graph->pool->arena };
+    for(size_t i = 0; i < sizeof(arenas) / sizeof(arenas[0]); i++) {
+        if(!arenas[i]) continue;
+
+        stats.allocations += arenas[i]->allocations;
+        stats.bytes += arenas[i]->bytes;
+        stats.reserved += arenas[i]->reserved;
+    }
+#endif
+
+    return stats;
+}
+
+// print the higher or lower relations of a value
+static void g_print_l(Graph *graph, Value *value, int direction)
 {
     printf("[");
-    g_print_l_rec(list->start);
+    int degree = g_degree(graph, value, direction);
+    for(int i = 0; i < degree; i++) {
+        printf("%li, ", (unsigned long int)g_relation(graph, value, direction, i)->id);
+    }
     printf("]\n");
 }
 
-// recursive print for the graph
-static void g_print_rec(Value *value)
+// print a value in the graph
+static int g_print_visit(Value *value, void *data)
 {
-    if(!value) return;
+    Graph *graph = data;
 
-    if(value->to_transfer) {
-        // add a * if it's been marked for transfer
-        printf("[%li]: %s (*)\n", value->id, value->value);
-    } else {
-        printf("[%li]: %s\n", value->id, value->value);
-    }
+    printf("[%li]: %s\n", value->id, value->value);
     // higher and lower lists
-    printf("  higher: "); g_print_l(value->higher);
-    printf("  lower: "); g_print_l(value->lower);
+    printf("  higher: "); g_print_l(graph, value, DIR_HIGHER);
+    printf("  lower: "); g_print_l(graph, value, DIR_LOWER);
 
-    g_print_rec(value->next);
+    return 0;
 }
 
 void g_print(Graph *graph)
 {
     printf("Length %i\n", graph->length);
-    g_print_rec(graph->start);
+    g_each(graph, g_print_visit, graph);
 }
 
-// Recursively free items in a list
-static void g_free_rec(Value *value)
+// Free a value and its relations
+// Anything from the arena is left to be freed all at once
+static int g_free_visit(Value *value, void *data)
 {
-    if(value->next) g_free_rec(value->next);
+    Graph *graph = data;
 
-    if(value->higher) l_free(value->higher);
-    if(value->lower) l_free(value->lower);
+    if(!graph->arena) {
+        v_clear(&value->higher);
+        v_clear(&value->lower);
+    }
 
-    free(value);
+    if(!value->pooled) free(value);
+    return 0;
+}
+
+// Empty a graph, keeping its memory for reuse
+void g_reset(Graph *graph)
+{
+    g_each(graph, g_free_visit, graph);
+    if(graph->arena) a_reset(graph->arena);
+
+    g_frozen_free(graph->frozen);
+    graph->frozen = NULL;
+    graph->spare = NULL;
+    if(graph->edges) e_reset(graph->edges);
+    graph->duplicates = 0;
+    memset(&graph->stats, 0, sizeof(Stats));
+    g_conflict_free(graph->conflict);
+    graph->conflict = NULL;
+    if(graph->schedule) cp_free(graph->schedule);
+    graph->schedule = NULL;
+    p_reset(graph->pool);
+    memset(graph->values, 0, sizeof(Value *) * (size_t)graph->values_size);
+
+    graph->start = NULL;
+    graph->end = NULL;
+    graph->length = 0;
 }
 
 // Free a graph
 // Will also destroy any items
 void g_free(Graph *graph)
 {
-    if(graph->start) g_free_rec(graph->start);
-
+    g_each(graph, g_free_visit, graph);
+
+    if(graph->arena) a_free(graph->arena);
+    g_frozen_free(graph->frozen);
+    if(graph->edges) e_free(graph->edges);
+    g_conflict_free(graph->conflict);
+    if(graph->schedule) cp_free(graph->schedule);
+    free(graph->values);
+    p_free(graph->pool);
     free(graph);
 }
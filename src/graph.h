@@ -2,48 +2,137 @@
  *
  * Basic DAG structure
  *
- * TODO: Make sure things can't be pushed twice
  * TODO: Improve error handling
- * TODO: Add automatic tests for graphs
  */
 
 #ifndef GRAPH_H
 #define GRAPH_H
 
+#include <stdint.h>
+
+#include "arena.h"
+#include "edges.h"
 #include "list.h"
+#include "pool.h"
+#include "snapshot.h"
+#include "stats.h"
 
 /* Errors
  *
  * ERR_RELATIONAL_CONFLICT: Error during relationship resolution; cyclic dependency
+ * ERR_OUT_OF_MEMORY: Allocation failed part way through an operation
+ * ERR_IO: Reading or writing a file failed
+ * ERR_NOT_FOUND: The value or relation isn't in the graph
+ * ERR_DUPLICATE: The relation is already in the graph, so nothing was changed
  */
 enum g_error {
     ERR_RELATIONAL_CONFLICT = 1,
+    ERR_OUT_OF_MEMORY = 2,
+    ERR_IO = 3,
+    ERR_NOT_FOUND = 4,
+    ERR_DUPLICATE = 5,
+};
+
+/* Directions for relations
+ *
+ * DIR_LOWER: Values lower than this one
+ * DIR_HIGHER: Values higher than this one
+ */
+enum g_direction {
+    DIR_LOWER = 0,
+    DIR_HIGHER = 1,
 };
 
 /* struct: Value
  *
  * Value in a graph. Avoid using directly
  *
- * higher: List of pointers to higher values (direct relations)
- * lower: List of pointers to lower values
+ * higher: Vector of pointers to higher values (direct relations) added since the
+ *   graph was last frozen. Use g_degree and g_relation rather than reading directly
+ * lower: Vector of pointers to lower values, as above
  * prev: Previous value in graph
  * next: Next value in graph
  * id: Hashed value for id
- * to_transfer: Bool used during relationship resolution
- * value: String value
+ * index: Dense id of the value's string in the graph's pool, and its position in the
+ *   graph's values array. POOL_NONE until added to a graph
+ * pooled: Set if allocated from the graph's arena rather than by new_value
+ * label: Order-maintenance label; labels always increase along the graph, so
+ *   comparing two labels gives their order. Kept up to date by the g_* insertion functions
+ * visited: Epoch stamp of the last search during relationship resolution that reached
+ *   this value
+ * weight: How long the value takes as a job in g_critical_path, 1 unless set with
+ *   g_set_weight
+ * value: String value; once in a graph this is the pool's interned copy
  */
 typedef struct value Value;
 
 typedef struct value {
-    List *higher; // List[Value]
-    List *lower;  // List[Value]
+    Vector higher; // Vector[Value]
+    Vector lower;  // Vector[Value]
     Value *prev;
     Value *next;
     unsigned long id;
-    int to_transfer;
-    char value[];
+    unsigned int index;
+    int pooled;
+    uint64_t label;
+    uint64_t visited;
+    int64_t weight;
+    char *value;
 } Value;
 
+/* struct: Frozen
+ *
+ * Relations stored in compressed sparse row format, built by g_freeze
+ *
+ * Relations of the value with index i are higher[higher_start[i]] to
+ *   higher[higher_end[i] - 1], given as indices into the graph's values
+ *   array. Same for lower. Four bytes per relation each way.
+ *
+ * Rows start out full, up to the start of the next row. Removing a relation moves
+ *   the last one in its row into its place and shortens the row, leaving a gap
+ *   until the next g_freeze
+ *
+ * length: Number of values covered, values added since have no rows
+ * higher_start: Start of each value's higher relations, length + 1 entries
+ * higher_end: End of each value's higher relations, length entries
+ * higher: Indices of higher values
+ * lower_start: Start of each value's lower relations, length + 1 entries
+ * lower_end: End of each value's lower relations, length entries
+ * lower: Indices of lower values
+ */
+typedef struct frozen {
+    unsigned int length;
+    unsigned int *higher_start;
+    unsigned int *higher_end;
+    unsigned int *higher;
+    unsigned int *lower_start;
+    unsigned int *lower_end;
+    unsigned int *lower;
+} Frozen;
+
+/* struct: Conflict
+ *
+ * Cycles that got relations rejected with ERR_RELATIONAL_CONFLICT, see g_conflict
+ *
+ * From g_apply_relation there's one cycle, in order: each value is greater than
+ *   the next and the last is greater than the first. The first two are the
+ *   rejected relation's greater and lesser, so the rest is the path already in
+ *   the graph that goes back from lesser to greater
+ *
+ * From a batch there's one entry per strongly connected component: every value
+ *   in it is on a cycle through the others, in no particular order
+ *
+ * names: Names of the values in each cycle, one cycle after another. They're the
+ *   graph's interned strings, so stay valid even if the values are removed
+ * starts: Where each cycle starts in names, count + 1 entries
+ * count: Number of cycles
+ */
+typedef struct conflict {
+    char **names;
+    int *starts;
+    int count;
+} Conflict;
+
 /* struct: Graph
  *
  * Representation of a DAG
@@ -53,21 +142,84 @@ typedef struct value {
  * start: Start value
  * end: End value
  * length: Length of graph
+ * pool: Interned strings of values, giving each string a dense id
+ * epoch: Stamp for the current search; moving it on forgets every earlier visit
+ *   without touching the values
+ * values: Every value in the graph, indexed by Value.index; NULL for ids without a value
+ * values_size: Number of slots in values
+ * frozen: Relations as of the last g_freeze, or NULL if never frozen
+ * arena: Arena values and their relation vectors are allocated from, or NULL to use malloc
+ * spare: Values from the arena that were removed, linked through next, reused
+ *   before allocating more
+ * edges: Every relation in the graph as a pair of ids, so duplicates can be
+ *   found in one lookup. NULL until first needed, e.g. after g_load
+ * duplicates: Number of relations dropped because they were already in the
+ *   graph, since it was made or last reset
+ * stats: Operation counters, only counted with GRAPH_STATS. Use g_stats rather
+ *   than reading directly, it adds the arenas' counts
+ * conflict: Cycles found by the last rejected relation or batch, NULL if none
+ *   yet. Use g_conflict
+ * schedule: Schedule from g_critical_path, kept up to date as the graph changes,
+ *   or NULL if it's never been scheduled
  */
 typedef struct graph {
     Value *start;
     Value *end;
     int length;
+    Pool *pool;
+    uint64_t epoch;
+    Value **values;
+    int values_size;
+    Frozen *frozen;
+    Arena *arena;
+    Value *spare;
+    Edges *edges;
+    unsigned long duplicates;
+    Stats stats;
+    Conflict *conflict;
+    struct schedule *schedule;
 } Graph;
 
+/* function: g_visitor
+ *
+ * Callback used by g_each, called with each value in a graph and the data
+ *   pointer given to g_each
+ *
+ * The visitor is free to move or free the value it's given
+ *
+ * Return 0 to continue, or non-zero to stop early
+ */
+typedef int (*g_visitor)(Value *value, void *data);
+
+/* struct: Iter
+ *
+ * Cursor over a graph's values in sorted order, start with g_iter_begin and move
+ *   with g_iter_next
+ *
+ * next: Value g_iter_next gives next, NULL once every value's been given
+ */
+typedef struct iter {
+    Value *next;
+} Iter;
+
 /* function: new_graph()
  *
  * Create a new empty graph
  *
+ * Values and relations added by the graph are allocated from an arena owned by the
+ *   graph, and freed all at once by g_free
+ *
  * Check if not null before using
  */
 Graph *new_graph(void);
 
+/* function: new_graph_malloc()
+ *
+ * Same as new_graph, but allocates every value and relation vector separately
+ *   with malloc. Slower to build and free; mainly useful for comparison
+ */
+Graph *new_graph_malloc(void);
+
 /* function: new_value(char item[])
  *
  * Creates a new value with value item
@@ -86,16 +238,119 @@ Value *new_value(char item[]);
  *
  * This is the primary function for updating a graph
  *
- * Returns 0 on success or 1 on error
+ * A relation that's already in the graph is dropped and counted in
+ *   graph->duplicates, so relation lists never hold the same value twice
+ *
+ * A relation that would make a cycle is rejected with ERR_RELATIONAL_CONFLICT,
+ *   and the cycle is logged and kept for g_conflict
+ *
+ * Returns 0 on success, ERR_DUPLICATE if the relation was already there, or a
+ *   g_error on error
  */
 int g_apply_relation(Graph *graph, char greater[], char lesser[]);
 
+/* function: g_apply_relation_n(Graph *graph, View greater, View lesser)
+ *
+ * Same as g_apply_relation, with the strings given as views so they don't need to
+ *   be null-terminated or copied first, e.g. tokens straight from a parser
+ */
+int g_apply_relation_n(Graph *graph, View greater, View lesser);
+
+/* function: g_apply_relations_batch(Graph *graph, char *greater[], char *lesser[], int count)
+ *
+ * Apply count relations at once, where greater[i] > lesser[i]
+ *
+ * All the relations are added first and then the whole graph is sorted once with
+ *   Kahn's algorithm, O(V + E) in total rather than reordering after every
+ *   relation, so this is much faster for bulk loads. Values already in the graph
+ *   keep their order where the new relations allow it
+ *
+ * If the relations make a cycle, none of the batch is applied. Every strongly
+ *   connected component is found with Tarjan's algorithm in one pass over the
+ *   values left unsorted, and logged and kept for g_conflict. Values are
+ *   created as with g_apply_relation
+ *
+ * Relations already in the graph or repeated within the batch are skipped and
+ *   counted in graph->duplicates, and don't count as an error
+ *
+ * Returns 0 on success or a g_error on error
+ */
+int g_apply_relations_batch(Graph *graph, char *greater[], char *lesser[], int count);
+
+/* function: g_apply_relations_batch_n(Graph *graph, View *greater, View *lesser, int count)
+ *
+ * Same as g_apply_relations_batch, with the strings given as views
+ */
+int g_apply_relations_batch_n(Graph *graph, View *greater, View *lesser, int count);
+
+/* function: g_apply_relations_ids(Graph *graph, unsigned int *greater, unsigned int *lesser, int count)
+ *
+ * Same as g_apply_relations_batch, with values given by the ids of strings already
+ *   interned in graph->pool, e.g. by a loader that interns on its own
+ *
+ * Values are created for any ids that don't have one yet. A lesser id of
+ *   POOL_NONE adds no relation, only the greater value if it's not there
+ */
+int g_apply_relations_ids(Graph *graph, unsigned int *greater, unsigned int *lesser, int count);
+
+/* function: g_remove_relation(Graph *graph, char greater[], char lesser[])
+ *
+ * Remove a relation greater > lesser from the graph
+ *
+ * Dropping a relation can't make the current order invalid, so nothing is moved.
+ *   Takes time in the degree of the two values. Both values stay in the graph even
+ *   if they have no relations left; use g_remove_value to drop them
+ *
+ * Returns 0 on success or ERR_NOT_FOUND if the relation isn't in the graph
+ */
+int g_remove_relation(Graph *graph, char greater[], char lesser[]);
+
+/* function: g_remove_relation_v(Graph *graph, Value *greater, Value *lesser)
+ *
+ * Same as g_remove_relation, given values already in the graph rather than strings
+ */
+int g_remove_relation_v(Graph *graph, Value *greater, Value *lesser);
+
+/* function: g_remove_value(Graph *graph, char item[])
+ *
+ * Remove a value and all of its relations from the graph
+ *
+ * Values it was related to stay in the graph, in the same order. Takes time in
+ *   the degree of the value and its neighbours
+ *
+ * Any pointers to the value are invalid afterwards
+ *
+ * Returns 0 on success or ERR_NOT_FOUND if the value isn't in the graph
+ */
+int g_remove_value(Graph *graph, char item[]);
+
+/* function: g_set_weight(Graph *graph, char item[], int64_t weight)
+ *
+ * Set how long a value takes as a job, for g_critical_path
+ *
+ * Returns 0 on success or ERR_NOT_FOUND if the value isn't in the graph
+ */
+int g_set_weight(Graph *graph, char item[], int64_t weight);
+
+/* function: g_set_relation_weight(Graph *graph, char greater[], char lesser[], int64_t weight)
+ *
+ * Set the lag between greater finishing and lesser starting, for g_critical_path.
+ *   Relations start with no lag, and lose it if removed
+ *
+ * Returns 0 on success, ERR_NOT_FOUND if the relation isn't in the graph or
+ *   ERR_OUT_OF_MEMORY
+ */
+int g_set_relation_weight(Graph *graph, char greater[], char lesser[], int64_t weight);
+
 /* function: g_sorted(Graph *graph, int *size)
  *
  * Get the sorted graph as an array of strings
  * Returns a pointer to the start of the array
  * Sets size to the number of strings
  *
+ * To go through the order without an array the size of the graph, use g_iter_begin,
+ *   or g_write_sorted in writer.h to print it
+ *
  * Returns NULL on an empty list
  */
 char **g_sorted(Graph *graph, int *size);
@@ -104,21 +359,107 @@ char **g_sorted(Graph *graph, int *size);
  *
  * Find a value by id in a graph
  *
- * Returns the value; i will be set to its index in the graph
- * Note there is not a function to lookup by index, use for comparisons
- * i can be set as NULL if not needed
+ * Returns the value; i will be set to its index in the graph, or -1 if not found
+ * Note there is not a function to lookup by index
+ * Finding the index walks the graph, so set i as NULL if not needed and use
+ *   g_before for comparisons
  *
- * Array should be freed with free() after use
+ * Lookup goes through the graph's string pool, so doesn't walk the graph.
+ * If two strings hash to the same id the first one added is returned; use
+ *   g_lookup to match on the string as well
  */
 Value *g_find(Graph *graph, unsigned long id, int *i);
 
+/* function: g_lookup(Graph *graph, char item[])
+ *
+ * Find a value by its string in a graph
+ *
+ * Same as g_find, but confirms the string on an id collision so two different
+ *   strings with the same hash are never mixed up
+ *
+ * Returns the value or NULL if not present
+ */
+Value *g_lookup(Graph *graph, char item[]);
+
+/* function: g_degree(Graph *graph, Value *value, int direction)
+ *
+ * Get the number of direct relations of a value in one direction (DIR_HIGHER or
+ *   DIR_LOWER), whether frozen or not
+ */
+int g_degree(Graph *graph, Value *value, int direction);
+
+/* function: g_relation(Graph *graph, Value *value, int direction, int i)
+ *
+ * Get the ith direct relation of a value in one direction, where i is less
+ *   than g_degree. Frozen relations come first, then any added since
+ */
+Value *g_relation(Graph *graph, Value *value, int direction, int i);
+
+/* function: g_freeze(Graph *graph)
+ *
+ * Pack every relation into compressed sparse row arrays (see Frozen) and free the
+ *   per-value vectors, so walks over relations read contiguous memory and each
+ *   relation takes 8 bytes rather than two pointers plus vector slack
+ *
+ * The graph can still be updated after freezing; new relations go into the
+ *   per-value vectors again until the next g_freeze
+ *
+ * Returns 0 on success or ERR_OUT_OF_MEMORY, leaving the graph as it was
+ */
+int g_freeze(Graph *graph);
+
+/* function: g_save(Graph *graph, const char *path)
+ *
+ * Write a graph to a snapshot file (see snapshot.h), with its names, relations and
+ *   current order. The file is replaced only once it's completely written
+ *
+ * Returns 0 on success, ERR_OUT_OF_MEMORY, or ERR_IO if the file can't be written
+ */
+int g_save(Graph *graph, const char *path);
+
+/* function: g_snapshot(Graph *graph)
+ *
+ * Copy a graph's names, relations and current order into a snapshot in memory,
+ *   laid out as g_save would write it. Nothing in it points back at the graph,
+ *   so it can be read on other threads while the graph keeps changing
+ *
+ * Read it with the sn_* functions and free it with sn_close
+ *
+ * Returns the snapshot, or NULL if out of memory
+ */
+Snapshot *g_snapshot(Graph *graph);
+
+/* function: g_load(const char *path)
+ *
+ * Read a graph back from a snapshot written by g_save, after checking its checksum
+ *
+ * The order is taken from the snapshot rather than sorted again, and relations
+ *   are loaded already frozen, so this is close to the cost of reading the file
+ *
+ * Returns the graph, or NULL if the file isn't a valid snapshot or out of memory
+ */
+Graph *g_load(const char *path);
+
+/* function: g_before(Value *first, Value *second)
+ *
+ * Check whether one value comes before another in the same graph
+ *
+ * Compares labels, so doesn't need to walk the graph
+ *
+ * Returns 1 if first is before second, 0 otherwise
+ */
+int g_before(Value *first, Value *second);
+
 /* function: g_push(Graph *graph, Value *value)
  *
  * Push a value onto the end of a graph
  *
  * Typically only used internally
+ *
+ * Returns non-zero if out of memory, or a value with the same string is
+ *   already in the graph
  */
-void g_push(Graph *graph, Value *value);
+int g_push(Graph *graph, Value *value);
 
 /* function: g_insert_before(Graph *graph, Value *before, Value *value)
  *
@@ -126,7 +467,8 @@ void g_push(Graph *graph, Value *value);
  *
  * Typically only used internally
  *
- * Returns non-zero on error (currently no error cases)
+ * Returns non-zero if out of memory, or a value with the same string is
+ *   already in the graph
  */
 int g_insert_before(Graph *graph, Value *before, Value *value);
 
@@ -136,10 +478,57 @@ int g_insert_before(Graph *graph, Value *before, Value *value);
  *
  * Typically only used internally
  *
- * Returns non-zero on error (currently no error cases)
+ * Returns non-zero if out of memory, or a value with the same string is
+ *   already in the graph
  */
 int g_insert_after(Graph *graph, Value *after, Value *value);
 
+/* function: g_each(Graph *graph, g_visitor visit, void *data)
+ *
+ * Call visit on each value in a graph, in sorted order
+ *
+ * Loops rather than recursing, so works on graphs of any size
+ *
+ * Returns 0 if the whole graph was visited, or the first non-zero value from visit
+ */
+int g_each(Graph *graph, g_visitor visit, void *data);
+
+/* function: g_iter_begin(Graph *graph)
+ *
+ * Get a cursor at the start of a graph's order
+ *
+ * The value last given can be moved or removed, as with g_each. The cursor holds
+ *   the value after it, so that one mustn't be removed while iterating
+ */
+Iter g_iter_begin(Graph *graph);
+
+/* function: g_iter_next(Iter *iter)
+ *
+ * Move a cursor on one value
+ *
+ * Returns the value, or NULL at the end of the graph
+ */
+Value *g_iter_next(Iter *iter);
+
+/* function: g_conflict(Graph *graph)
+ *
+ * Get the cycles behind the last ERR_RELATIONAL_CONFLICT from g_apply_relation or
+ *   a batch, found by the same search that hit them. Later successful changes
+ *   leave it as it was; it's replaced by the next conflict and cleared by g_reset
+ *
+ * Returns the cycles, or NULL if nothing's been rejected
+ */
+Conflict *g_conflict(Graph *graph);
+
+/* function: g_stats(Graph *graph)
+ *
+ * Get a graph's operation counters since it was made or last reset. Everything's
+ *   0 unless the library was built with GRAPH_STATS, see stats.h
+ *
+ * Returns a copy of the counters
+ */
+Stats g_stats(Graph *graph);
+
 /* function: g_print(Graph *graph)
  *
  * Print a graph, including length, values, and the higher and lower relations for each value
@@ -148,6 +537,14 @@ int g_insert_after(Graph *graph, Value *after, Value *value);
  */
 void g_print(Graph *graph);
 
+/* function: g_reset(Graph *graph)
+ *
+ * Empty a graph so it can be reused, keeping its arena and tables allocated
+ *
+ * Any values from the graph are invalid afterwards
+ */
+void g_reset(Graph *graph);
+
 /* function: g_free(Graph *graph)
  *
  * Free a graph
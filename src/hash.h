@@ -1,15 +1,28 @@
-// Quick string hashing function
-// Uses djb2, http://www.cse.yorku.ca/~oz/hash.html
+// Quick string hashing functions
+// 64-bit hash in the style of wyhash, https://github.com/wangyi-fudan/wyhash
 
 #ifndef HASH_H
 #define HASH_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 /* function: hash(char *str)
  *
- * Hash a string using djb2
+ * Hash a null-terminated string
  *
  * Returns hash
  */
 unsigned long hash(char *str);
 
+/* function: hash_n(const char *str, size_t length)
+ *
+ * Hash length bytes of a string, which doesn't have to be null-terminated
+ *
+ * Gives the same hash as hash() for the same string
+ *
+ * Returns hash
+ */
+uint64_t hash_n(const char *str, size_t length);
+
 #endif
@@ -0,0 +1,371 @@
+/* Parallel relation file loader
+ *
+ * Each stage starts a thread per worker and waits for them all, so stages never
+ *   overlap and nothing needs locking: every thread only writes to its own
+ *   worker, shard, or range of the output arrays
+ */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ingest.h"
+#include "parser.h"
+#include "pool.h"
+#include "dbg.h"
+
+// Starting number of relations each worker has room for
+#define INGEST_INITIAL_SIZE 1024
+
+typedef struct state State;
+
+// One thread's share of the work
+//
+// state: Everything shared between the threads
+// index: Which worker this is, also the shard it handles
+// start: Chunk of the file to parse
+// size: Size of the chunk in bytes
+// pool: Names in the chunk, with ids local to this worker
+// greater: Relations in the chunk by local id
+// lesser
+// length: Number of relations
+// capacity: Number of relations greater and lesser have room for
+// shard_id: Id of each local name within its shard's pool
+// offset: Position of this worker's relations in the combined arrays
+// invalid: Number of lines that weren't relations
+// rc: 0, or ERR_OUT_OF_MEMORY if anything failed
+typedef struct worker {
+    State *state;
+    int index;
+    const char *start;
+    size_t size;
+    Pool *pool;
+    unsigned int *greater;
+    unsigned int *lesser;
+    int length;
+    int capacity;
+    unsigned int *shard_id;
+    int offset;
+    int invalid;
+    int rc;
+} Worker;
+
+// Names with hashes in one shard, merged from every worker
+//
+// pool: Distinct names in the shard
+// global: Id in the graph's pool for each name in the shard
+typedef struct shard {
+    Pool *pool;
+    unsigned int *global;
+} Shard;
+
+// Shared between every thread
+//
+// graph: Graph being loaded
+// threads: Number of workers and shards
+// workers: Each worker
+// shards: Each shard
+// greater: Every relation by the graph's ids, in file order
+// lesser
+struct state {
+    Graph *graph;
+    int threads;
+    Worker *workers;
+    Shard *shards;
+    unsigned int *greater;
+    unsigned int *lesser;
+};
+
+// Milliseconds since some fixed point
+static double in_now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000.0 + (double)time.tv_nsec / 1000000.0;
+}
+
+// Shard a name belongs to
+// Uses the high bits, pools use the low bits for their tables
+static int in_shard(uint64_t hash, int threads)
+{
+    return (int)((hash >> 32) % (uint64_t)threads);
+}
+
+// Run a stage with a thread for each worker and wait for them all
+// Returns the first error from a worker
+static int in_run(State *state, void *(*stage)(void *))
+{
+    pthread_t *threads = malloc(sizeof(pthread_t) * (size_t)state->threads);
+    if(!threads) return ERR_OUT_OF_MEMORY;
+
+    int started = 0;
+    for(; started < state->threads; started++) {
+        if(pthread_create(&threads[started], NULL, stage, &state->workers[started])) break;
+    }
+
+    // anything that couldn't get a thread runs on this one
+    for(int i = started; i < state->threads; i++) stage(&state->workers[i]);
+    for(int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    free(threads);
+
+    for(int i = 0; i < state->threads; i++) {
+        if(state->workers[i].rc) return state->workers[i].rc;
+    }
+    return 0;
+}
+
+// Keep a relation between local ids
+static int in_push(Worker *worker, unsigned int greater, unsigned int lesser)
+{
+    if(worker->length == worker->capacity) {
+        int capacity = worker->capacity ? worker->capacity * 2 : INGEST_INITIAL_SIZE;
+
+        unsigned int *greater_a = realloc(worker->greater, sizeof(unsigned int) * (size_t)capacity);
+        if(!greater_a) return 1;
+        worker->greater = greater_a;
+
+        unsigned int *lesser_a = realloc(worker->lesser, sizeof(unsigned int) * (size_t)capacity);
+        if(!lesser_a) return 1;
+        worker->lesser = lesser_a;
+
+        worker->capacity = capacity;
+    }
+
+    worker->greater[worker->length] = greater;
+    worker->lesser[worker->length] = lesser;
+    worker->length++;
+    return 0;
+}
+
+// Parse a chunk, interning names locally
+static void *in_parse(void *data)
+{
+    Worker *worker = data;
+    Parser *parser = new_parser_buffer(worker->start, worker->size);
+    worker->pool = new_pool();
+    if(!parser || !worker->pool) goto error;
+
+    Relation relation;
+    int rc;
+    while((rc = pr_next(parser, &relation)) != PARSE_END) {
+        if(rc == PARSE_INVALID) {
+            log_warn("Not a valid relation: %.*s", (int)parser->bad.length, parser->bad.str);
+            worker->invalid++;
+            continue;
+        }
+
+        unsigned int greater = p_intern(worker->pool, relation.greater.str, relation.greater.length);
+        unsigned int lesser = p_intern(worker->pool, relation.lesser.str, relation.lesser.length);
+        if(greater == POOL_NONE || lesser == POOL_NONE) goto error;
+        if(in_push(worker, greater, lesser)) goto error;
+    }
+
+    pr_free(parser);
+    return NULL;
+
+error:
+    if(parser) pr_free(parser);
+    worker->rc = ERR_OUT_OF_MEMORY;
+    return NULL;
+}
+
+// Merge the names in this worker's shard from every worker
+static void *in_merge(void *data)
+{
+    Worker *worker = data;
+    State *state = worker->state;
+    Shard *shard = &state->shards[worker->index];
+
+    shard->pool = new_pool();
+    if(!shard->pool) goto error;
+
+    for(int w = 0; w < state->threads; w++) {
+        Pool *pool = state->workers[w].pool;
+        unsigned int *shard_id = state->workers[w].shard_id;
+
+        for(unsigned int id = 0; id < pool->length; id++) {
+            uint64_t hash = p_hash(pool, id);
+            if(in_shard(hash, state->threads) != worker->index) continue;
+
+            // every local id is in exactly one shard, so only this thread writes it
+            char *name = p_string(pool, id);
+            shard_id[id] = p_intern_hashed(shard->pool, name, strlen(name), hash);
+            if(shard_id[id] == POOL_NONE) goto error;
+        }
+    }
+
+    return NULL;
+
+error:
+    worker->rc = ERR_OUT_OF_MEMORY;
+    return NULL;
+}
+
+// Rewrite this worker's relations to the graph's ids, into the combined arrays
+static void *in_translate(void *data)
+{
+    Worker *worker = data;
+    State *state = worker->state;
+    Pool *pool = worker->pool;
+
+    // swap each local id for its global one, then use that for every relation
+    for(unsigned int id = 0; id < pool->length; id++) {
+        Shard *shard = &state->shards[in_shard(p_hash(pool, id), state->threads)];
+        worker->shard_id[id] = shard->global[worker->shard_id[id]];
+    }
+
+    for(int i = 0; i < worker->length; i++) {
+        state->greater[worker->offset + i] = worker->shard_id[worker->greater[i]];
+        state->lesser[worker->offset + i] = worker->shard_id[worker->lesser[i]];
+    }
+
+    return NULL;
+}
+
+// Split the file into a chunk per worker, each ending just after a newline
+static void in_split(State *state, const char *data, size_t size)
+{
+    size_t start = 0;
+
+    // nothing to split, every chunk stays empty
+    if(!size) return;
+
+    for(int i = 0; i < state->threads; i++) {
+        size_t end = size / (size_t)state->threads * (size_t)(i + 1);
+        if(end < start) end = start;
+        if(i == state->threads - 1) end = size;
+        while(end > start && end < size && data[end - 1] != '\n') end++;
+
+        state->workers[i].start = data + start;
+        state->workers[i].size = end - start;
+        start = end;
+    }
+}
+
+// Intern every distinct name in the graph's pool, one shard after another
+static int in_intern(State *state)
+{
+    Pool *graph_pool = state->graph->pool;
+
+    for(int s = 0; s < state->threads; s++) {
+        Shard *shard = &state->shards[s];
+        shard->global = malloc(sizeof(unsigned int) * (shard->pool->length ? shard->pool->length : 1));
+        if(!shard->global) return ERR_OUT_OF_MEMORY;
+
+        for(unsigned int id = 0; id < shard->pool->length; id++) {
+            char *name = p_string(shard->pool, id);
+            shard->global[id] = p_intern_hashed(graph_pool, name, strlen(name), p_hash(shard->pool, id));
+            if(shard->global[id] == POOL_NONE) return ERR_OUT_OF_MEMORY;
+        }
+    }
+
+    return 0;
+}
+
+// Give each worker somewhere to put the shard id of each of its names, and its
+//   offset in the combined relation arrays
+// Returns the total number of relations, or -1 if out of memory
+static int in_prepare(State *state)
+{
+    int total = 0;
+
+    for(int i = 0; i < state->threads; i++) {
+        Worker *worker = &state->workers[i];
+        worker->shard_id = malloc(sizeof(unsigned int) * (worker->pool->length ? worker->pool->length : 1));
+        if(!worker->shard_id) return -1;
+
+        worker->offset = total;
+        total += worker->length;
+    }
+
+    return total;
+}
+
+// Free everything but the graph
+static void in_free(State *state)
+{
+    for(int i = 0; i < state->threads; i++) {
+        Worker *worker = &state->workers[i];
+        if(worker->pool) p_free(worker->pool);
+        free(worker->greater);
+        free(worker->lesser);
+        free(worker->shard_id);
+
+        Shard *shard = &state->shards[i];
+        if(shard->pool) p_free(shard->pool);
+        free(shard->global);
+    }
+
+    free(state->workers);
+    free(state->shards);
+    free(state->greater);
+    free(state->lesser);
+}
+
+int in_load(Graph *graph, const char *path, int threads, Ingest *stats)
+{
+    if(threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(threads <= 0) threads = 1;
+
+    Parser *file = new_parser(path);
+    if(!file) return -1;
+
+    Ingest times = { threads, 0, 0, 0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+    State state = { graph, threads, NULL, NULL, NULL, NULL };
+    int rc = ERR_OUT_OF_MEMORY;
+
+    state.workers = calloc((size_t)threads, sizeof(Worker));
+    state.shards = calloc((size_t)threads, sizeof(Shard));
+    if(!state.workers || !state.shards) goto end;
+
+    for(int i = 0; i < threads; i++) {
+        state.workers[i].state = &state;
+        state.workers[i].index = i;
+    }
+    in_split(&state, file->data, file->size);
+
+    double start = in_now();
+    if((rc = in_run(&state, in_parse))) goto end;
+    double parsed = in_now();
+
+    int total = in_prepare(&state);
+    rc = ERR_OUT_OF_MEMORY;
+    if(total < 0) goto end;
+    if((rc = in_run(&state, in_merge))) goto end;
+    double sharded = in_now();
+
+    if((rc = in_intern(&state))) goto end;
+    double interned = in_now();
+
+    rc = ERR_OUT_OF_MEMORY;
+    state.greater = malloc(sizeof(unsigned int) * (size_t)(total ? total : 1));
+    state.lesser = malloc(sizeof(unsigned int) * (size_t)(total ? total : 1));
+    if(!state.greater || !state.lesser) goto end;
+    if((rc = in_run(&state, in_translate))) goto end;
+    double translated = in_now();
+
+    unsigned long duplicates = graph->duplicates;
+    rc = g_apply_relations_ids(graph, state.greater, state.lesser, total);
+    double applied = in_now();
+
+    times.duplicates = graph->duplicates - duplicates;
+    times.relations = total;
+    for(int i = 0; i < threads; i++) times.invalid += state.workers[i].invalid;
+    times.parse = parsed - start;
+    times.shard = sharded - parsed;
+    times.intern = interned - sharded;
+    times.translate = translated - interned;
+    times.apply = applied - translated;
+
+end:
+    if(stats) *stats = times;
+    if(state.workers && state.shards) in_free(&state);
+    else {
+        free(state.workers);
+        free(state.shards);
+    }
+    pr_free(file);
+    return rc;
+}
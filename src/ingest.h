@@ -0,0 +1,63 @@
+/* Parallel relation file loader
+ *
+ * Loads a whole relation file (see parser.h) into a graph using several threads:
+ *
+ *   parse: The file is split into one chunk per thread at line boundaries, and each
+ *     thread parses its chunk, interning names into its own pool and collecting
+ *     relations between its own ids
+ *   shard: Names are split into shards by hash, one shard per thread, and each
+ *     thread merges its shard's names from every chunk, so each distinct name
+ *     is handled by exactly one thread
+ *   intern: Each distinct name is interned in the graph's pool, one thread
+ *   translate: Each thread rewrites its relations to the graph's ids
+ *   apply: Relations are added to the graph and it's sorted once, as
+ *     g_apply_relations_batch, one thread
+ *
+ * Parsing and deduplicating names is nearly all of the work, and both scale with
+ *   the number of threads
+ */
+
+#ifndef INGEST_H
+#define INGEST_H
+
+#include "graph.h"
+
+/* struct: Ingest
+ *
+ * Results of in_load
+ *
+ * threads: Number of threads used
+ * relations: Number of relations read
+ * invalid: Number of lines that weren't relations, which are skipped
+ * duplicates: Number of relations that were already in the graph or repeated in
+ *   the file, which are skipped
+ * parse: Milliseconds spent on each stage, as described above
+ * shard
+ * intern
+ * translate
+ * apply
+ */
+typedef struct ingest {
+    int threads;
+    int relations;
+    int invalid;
+    unsigned long duplicates;
+    double parse;
+    double shard;
+    double intern;
+    double translate;
+    double apply;
+} Ingest;
+
+/* function: in_load(Graph *graph, const char *path, int threads, Ingest *stats)
+ *
+ * Load every relation in a file into a graph with threads threads, or one per
+ *   online CPU if threads is 0 or less. stats is filled in if it's not NULL
+ *
+ * As with g_apply_relations_batch, a cycle rejects the whole file
+ *
+ * Returns 0 on success, a g_error, or -1 if the file can't be read
+ */
+int in_load(Graph *graph, const char *path, int threads, Ingest *stats);
+
+#endif
@@ -0,0 +1,257 @@
+/* Level-synchronous topological sort
+ *
+ * Every thread works through the current frontier in small chunks claimed from a
+ *   shared cursor, so threads that finish early take work from the rest. Placing
+ *   a value decrements the count of unplaced higher values of everything below
+ *   it atomically, and whichever thread takes a count to zero puts that value in
+ *   the next frontier. Threads meet at a barrier between frontiers.
+ */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "levels.h"
+#include "dbg.h"
+
+// Values claimed from the frontier at a time
+#define LEVELS_CHUNK 64
+// Values found for the next frontier that a thread keeps before adding them all at once
+#define LEVELS_BUFFER 256
+
+// Shared between every thread
+//
+// graph: Graph being sorted
+// levels: Result being filled in
+// threads: Number of threads
+// left: Number of higher values not yet placed, for each id
+// head: Start of the current frontier in levels->order
+// end: End of the current frontier
+// cursor: Next value in the current frontier not claimed by a thread
+// tail: End of the next frontier so far
+// barrier: Where threads meet between frontiers
+// lock: Guards ready
+// go: Signalled once ready is set
+// ready: Set once every thread that's going to run has started
+typedef struct state {
+    Graph *graph;
+    Levels *levels;
+    int threads;
+    atomic_uint *left;
+    int head;
+    int end;
+    atomic_int cursor;
+    atomic_int tail;
+    pthread_barrier_t barrier;
+    pthread_mutex_t lock;
+    pthread_cond_t go;
+    int ready;
+} State;
+
+// One thread's part in the sort
+//
+// state: Everything shared
+// index: Which thread this is
+// buffer: Values found for the next frontier, not yet added
+// length: Number of values in buffer
+typedef struct worker {
+    State *state;
+    int index;
+    Value *buffer[LEVELS_BUFFER];
+    int length;
+} Worker;
+
+// Add the buffered values to the next frontier, reserving room for them all at once
+static void lv_flush(Worker *worker)
+{
+    if(!worker->length) return;
+
+    int start = atomic_fetch_add(&worker->state->tail, worker->length);
+    memcpy(worker->state->levels->order + start, worker->buffer, sizeof(Value *) * (size_t)worker->length);
+    worker->length = 0;
+}
+
+// Put a value in the next frontier
+static void lv_push(Worker *worker, Value *value)
+{
+    if(worker->length == LEVELS_BUFFER) lv_flush(worker);
+    worker->buffer[worker->length++] = value;
+}
+
+// Count higher values for this thread's share of the ids, and find level 0
+static void lv_start(Worker *worker)
+{
+    State *state = worker->state;
+    Graph *graph = state->graph;
+    unsigned int length = graph->pool->length;
+    unsigned int first = (unsigned int)((uint64_t)length * (unsigned int)worker->index / (unsigned int)state->threads);
+    unsigned int last = (unsigned int)((uint64_t)length * (unsigned int)(worker->index + 1) / (unsigned int)state->threads);
+
+    for(unsigned int id = first; id < last; id++) {
+        // ids interned without ever getting a value may be past the end of values
+        Value *value = id < (unsigned int)graph->values_size ? graph->values[id] : NULL;
+        if(!value) {
+            state->levels->level[id] = -1;
+            continue;
+        }
+
+        unsigned int degree = (unsigned int)g_degree(graph, value, DIR_HIGHER);
+        atomic_init(&state->left[id], degree);
+        state->levels->level[id] = 0;
+        if(!degree) lv_push(worker, value);
+    }
+
+    lv_flush(worker);
+}
+
+// Place every value in a range of the current frontier
+static void lv_place(Worker *worker, int start, int end, int level)
+{
+    State *state = worker->state;
+    Graph *graph = state->graph;
+
+    for(int i = start; i < end; i++) {
+        Value *value = state->levels->order[i];
+        int degree = g_degree(graph, value, DIR_LOWER);
+
+        for(int j = 0; j < degree; j++) {
+            Value *lower = g_relation(graph, value, DIR_LOWER, j);
+
+            // the last higher value to be placed puts it in the next level
+            if(atomic_fetch_sub(&state->left[lower->index], 1) == 1) {
+                state->levels->level[lower->index] = level + 1;
+                lv_push(worker, lower);
+            }
+        }
+    }
+}
+
+// Work through every frontier alongside the other threads
+static void *lv_run(void *data)
+{
+    Worker *worker = data;
+    State *state = worker->state;
+    Levels *levels = state->levels;
+
+    // wait to find out how many threads there are
+    pthread_mutex_lock(&state->lock);
+    while(!state->ready) pthread_cond_wait(&state->go, &state->lock);
+    pthread_mutex_unlock(&state->lock);
+
+    lv_start(worker);
+
+    for(;;) {
+        // one thread moves on to the frontier just found while the rest wait
+        if(pthread_barrier_wait(&state->barrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+            state->head = state->end;
+            state->end = atomic_load(&state->tail);
+            atomic_store(&state->cursor, state->head);
+            if(state->end > state->head) levels->starts[levels->count++] = state->head;
+        }
+        pthread_barrier_wait(&state->barrier);
+
+        if(state->head == state->end) break;
+
+        int level = levels->count - 1;
+        int start;
+        while((start = atomic_fetch_add(&state->cursor, LEVELS_CHUNK)) < state->end) {
+            int end = start + LEVELS_CHUNK < state->end ? start + LEVELS_CHUNK : state->end;
+            lv_place(worker, start, end, level);
+        }
+        lv_flush(worker);
+    }
+
+    return NULL;
+}
+
+// Allocate levels for a graph
+static Levels *lv_create(Graph *graph)
+{
+    Levels *levels = calloc(1, sizeof(Levels));
+    if(!levels) return NULL;
+
+    levels->length = graph->length;
+    levels->size = (int)graph->pool->length;
+    levels->order = malloc(sizeof(Value *) * (size_t)(levels->length ? levels->length : 1));
+    // there can't be more levels than values
+    levels->starts = malloc(sizeof(int) * (size_t)(levels->length + 1));
+    levels->level = malloc(sizeof(int) * (size_t)(levels->size ? levels->size : 1));
+
+    if(!levels->order || !levels->starts || !levels->level) {
+        lv_free(levels);
+        return NULL;
+    }
+
+    return levels;
+}
+
+Levels *g_levels(Graph *graph, int threads)
+{
+    if(threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(threads <= 0) threads = 1;
+
+    Levels *levels = lv_create(graph);
+    State state = { .graph = graph, .levels = levels, .threads = threads, .ready = 0 };
+    Worker *workers = calloc((size_t)threads, sizeof(Worker));
+    pthread_t *ids = malloc(sizeof(pthread_t) * (size_t)threads);
+    state.left = malloc(sizeof(atomic_uint) * (size_t)(graph->pool->length ? graph->pool->length : 1));
+
+    if(!levels || !workers || !ids || !state.left) goto error;
+
+    atomic_init(&state.cursor, 0);
+    atomic_init(&state.tail, 0);
+    pthread_mutex_init(&state.lock, NULL);
+    pthread_cond_init(&state.go, NULL);
+
+    for(int i = 0; i < threads; i++) {
+        workers[i].state = &state;
+        workers[i].index = i;
+    }
+
+    // this thread is the first worker, the rest wait until they know how many of
+    //   them actually started
+    int started = 1;
+    for(; started < threads; started++) {
+        if(pthread_create(&ids[started], NULL, lv_run, &workers[started])) break;
+    }
+
+    state.threads = started;
+    pthread_barrier_init(&state.barrier, NULL, (unsigned int)started);
+    pthread_mutex_lock(&state.lock);
+    state.ready = 1;
+    pthread_cond_broadcast(&state.go);
+    pthread_mutex_unlock(&state.lock);
+
+    lv_run(&workers[0]);
+    for(int i = 1; i < started; i++) pthread_join(ids[i], NULL);
+    pthread_barrier_destroy(&state.barrier);
+    pthread_mutex_destroy(&state.lock);
+    pthread_cond_destroy(&state.go);
+
+    levels->starts[levels->count] = state.end;
+    if(state.end < levels->length) {
+        log_err("Relations have a cycle, only %i of %i values sorted", state.end, levels->length);
+        goto error;
+    }
+
+    free(workers);
+    free(ids);
+    free(state.left);
+    return levels;
+
+error:
+    if(levels) lv_free(levels);
+    free(workers);
+    free(ids);
+    free(state.left);
+    return NULL;
+}
+
+void lv_free(Levels *levels)
+{
+    free(levels->order);
+    free(levels->starts);
+    free(levels->level);
+    free(levels);
+}
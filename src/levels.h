@@ -0,0 +1,54 @@
+/* Level-synchronous topological sort
+ *
+ * Sorts a whole graph from scratch with Kahn's algorithm, one frontier at a time:
+ *   level 0 is every value with nothing higher, and level n + 1 is every value
+ *   whose higher values are all in levels up to n. Every value in a frontier
+ *   can be handled at once, so each one is split between several threads
+ *
+ * Levels are the longest chain of relations above each value, so values on the
+ *   same level never depend on each other and can be scheduled together
+ */
+
+#ifndef LEVELS_H
+#define LEVELS_H
+
+#include "graph.h"
+
+/* struct: Levels
+ *
+ * Result of g_levels, free with lv_free
+ *
+ * length: Number of values
+ * order: Every value in a valid order, grouped by level. Order within a level
+ *   depends on the threads
+ * count: Number of levels
+ * starts: Start of each level in order, count + 1 entries
+ * size: Number of entries in level
+ * level: Level of each value indexed by Value.index, or -1 for ids without a value
+ */
+typedef struct levels {
+    int length;
+    Value **order;
+    int count;
+    int *starts;
+    int size;
+    int *level;
+} Levels;
+
+/* function: g_levels(Graph *graph, int threads)
+ *
+ * Sort a graph into levels using threads threads, or one per online CPU if
+ *   threads is 0 or less. The graph itself isn't changed, and mustn't be while
+ *   this runs
+ *
+ * Returns the levels, or NULL if out of memory or the relations have a cycle
+ */
+Levels *g_levels(Graph *graph, int threads);
+
+/* function: lv_free(Levels *levels)
+ *
+ * Free levels from g_levels
+ */
+void lv_free(Levels *levels);
+
+#endif
@@ -9,11 +9,11 @@
  * It could be improved further but is outside the scope of this project - I've only implemented what I'm
  *   likely to need during use
  *
- * Recursion is used for iterative list operations because it's tidier than mucking around with pointer
- *   reassignment in a loop and also I like it
+ * List operations loop rather than recurse, so list length is never limited by the stack size
  */
 
 #include <malloc.h>
+#include <string.h>
 
 #include "list.h"
 #include "dbg.h"
@@ -73,45 +73,127 @@ void *l_pop(List *list)
     return value;
 }
 
-// Recursive list index
-static void *l_index_rec(Item *current, int n)
-{
-    if(n == 0) return current->value;
-
-    if(current->next) {
-        return l_index_rec(current->next, n - 1);
-    } else {
-        return NULL;
-    }
-}
-
 // Get nth value of a list
 // Returns null if does not exist
 // Could maybe be optimised by searching from back if more than half,
 //   but outside the scope of this project
 void *l_index(List *list, int n)
 {
-    if(n >= list->length) return NULL;
+    if(n < 0 || n >= list->length) return NULL;
     if(n == list->length - 1) return list->end->value; // shortcut to last item
 
-    return l_index_rec(list->start, n);
+    Item *item = list->start;
+    for(; n > 0; n--) item = item->next;
+
+    return item->value;
 }
 
-// Recursively free items in a list
-static void l_free_rec(Item *item)
+// Call a visitor on each value, stopping early if it asks
+int l_each(List *list, l_visitor visit, void *data)
 {
-    if(item->next) l_free_rec(item->next);
+    for(Item *item = list->start; item; item = item->next) {
+        int rc = visit(item->value, data);
+        if(rc) return rc;
+    }
 
-    free(item);
+    return 0;
 }
 
 // Free a list
 // Will also destroy any items
 void l_free(List *list)
 {
-    if(list->start) l_free_rec(list->start);
+    Item *item = list->start;
+    while(item) {
+        Item *next = item->next;
+        free(item);
+        item = next;
+    }
 
     free(list);
 }
 
+// Starting capacity for a vector
+#define VECTOR_INITIAL_SIZE 8
 
+// Make a new vector, nothing is allocated for items until the first push
+Vector *new_vector(void)
+{
+    Vector *vector = malloc(sizeof(Vector));
+    if(!vector) return NULL;
+
+    v_init(vector);
+    return vector;
+}
+
+// Set up an empty vector in place
+void v_init(Vector *vector)
+{
+    vector->items = NULL;
+    vector->length = 0;
+    vector->capacity = 0;
+}
+
+// Push onto the end, doubling the capacity when full
+int v_push(Vector *vector, void *item)
+{
+    if(vector->length == vector->capacity) {
+        int capacity = vector->capacity ? vector->capacity * 2 : VECTOR_INITIAL_SIZE;
+        void **items = realloc(vector->items, sizeof(void *) * (size_t)capacity);
+        if(!items) return 1;
+
+        vector->items = items;
+        vector->capacity = capacity;
+    }
+
+    vector->items[vector->length++] = item;
+    return 0;
+}
+
+// Push onto the end, doubling the capacity from the arena when full
+int v_push_in(Vector *vector, void *item, Arena *arena)
+{
+    if(vector->length == vector->capacity) {
+        int capacity = vector->capacity ? vector->capacity * 2 : VECTOR_INITIAL_SIZE;
+        void **items = a_slab_alloc(arena, sizeof(void *) * (size_t)capacity);
+        if(!items) return 1;
+
+        if(vector->length) memcpy(items, vector->items, sizeof(void *) * (size_t)vector->length);
+        a_slab_free(arena, vector->items, sizeof(void *) * (size_t)vector->capacity);
+
+        vector->items = items;
+        vector->capacity = capacity;
+    }
+
+    vector->items[vector->length++] = item;
+    return 0;
+}
+
+// Pop off the end
+void *v_pop(Vector *vector)
+{
+    if(vector->length == 0) return NULL;
+
+    return vector->items[--vector->length];
+}
+
+// Free the array and start again empty
+void v_clear(Vector *vector)
+{
+    free(vector->items);
+    v_init(vector);
+}
+
+// Give the array back to the arena and start again empty
+void v_clear_in(Vector *vector, Arena *arena)
+{
+    a_slab_free(arena, vector->items, sizeof(void *) * (size_t)vector->capacity);
+    v_init(vector);
+}
+
+// Free a vector and its array
+void v_free(Vector *vector)
+{
+    free(vector->items);
+    free(vector);
+}
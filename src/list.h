@@ -6,6 +6,8 @@
 #ifndef LIST_H
 #define LIST_H
 
+#include "arena.h"
+
 /* struct: Item
  *
  * Item in a linked list. Note that this is typically not exposed by list operation functions,
@@ -44,6 +46,34 @@ typedef struct list {
     int length;
 } List;
 
+/* struct: Vector
+ *
+ * Growable array of pointers, used as a stack for iterative traversals and for
+ *   relations while a graph is being built
+ *
+ * Create with new_vector (or v_init for one inside another struct) and operate
+ *   with v_* functions
+ *
+ * Format:
+ *   void **items: Array of pointers
+ *   int length: Number of items in use
+ *   int capacity: Number of items allocated
+ */
+typedef struct vector {
+    void **items;
+    int length;
+    int capacity;
+} Vector;
+
+/* function: l_visitor
+ *
+ * Callback used by l_each, called with each value in a list and the data
+ *   pointer given to l_each
+ *
+ * Return 0 to continue, or non-zero to stop early
+ */
+typedef int (*l_visitor)(void *value, void *data);
+
 /* function: List* new_list()
  *
  * Creates a new, empty linked list
@@ -84,6 +114,18 @@ void *l_pop(List *list);
  */
 void *l_index(List *list, int n);
 
+/* function: int l_each(List *list, l_visitor visit, void *data)
+ *
+ * Call visit on each value in a list, in order
+ *
+ * list: list to walk
+ * visit: callback for each value
+ * data: passed through to visit
+ *
+ * Returns 0 if the whole list was visited, or the first non-zero value from visit
+ */
+int l_each(List *list, l_visitor visit, void *data);
+
 /* function: void l_free(List *list)
  *
  * Clear and free a list; use during cleanup
@@ -92,4 +134,65 @@ void *l_index(List *list, int n);
  */
 void l_free(List *list);
 
+/* function: Vector *new_vector()
+ *
+ * Creates a new, empty vector
+ *
+ * Returns a pointer to the vector or NULL if error occured
+ */
+Vector *new_vector(void);
+
+/* function: void v_init(Vector *vector)
+ *
+ * Initialise an empty vector in place, for vectors embedded in another struct
+ *
+ * Nothing is allocated until the first push
+ */
+void v_init(Vector *vector);
+
+/* function: int v_push(Vector *vector, void *item)
+ *
+ * Push an item onto the end of a vector, growing it if needed
+ *
+ * Returns 0 on success, 1 if out of memory growing the vector
+ */
+int v_push(Vector *vector, void *item);
+
+/* function: int v_push_in(Vector *vector, void *item, Arena *arena)
+ *
+ * Same as v_push, but the array is allocated from an arena's slabs
+ *
+ * A vector has to stick to either v_push or v_push_in with the same arena, and be
+ *   cleared with v_clear_in
+ */
+int v_push_in(Vector *vector, void *item, Arena *arena);
+
+/* function: void *v_pop(Vector *vector)
+ *
+ * Pop an item off the end of a vector
+ *
+ * Returns the item removed, or NULL if the vector is empty
+ */
+void *v_pop(Vector *vector);
+
+/* function: void v_clear(Vector *vector)
+ *
+ * Free the array behind a vector and make it empty, without freeing the vector
+ *   itself. Use for vectors set up with v_init
+ */
+void v_clear(Vector *vector);
+
+/* function: void v_clear_in(Vector *vector, Arena *arena)
+ *
+ * Same as v_clear, for vectors grown with v_push_in. The array goes back to the
+ *   arena for reuse
+ */
+void v_clear_in(Vector *vector, Arena *arena);
+
+/* function: void v_free(Vector *vector)
+ *
+ * Free a vector; doesn't touch the items pointed to
+ */
+void v_free(Vector *vector);
+
 #endif
@@ -0,0 +1,181 @@
+/* Relation file parser
+ *
+ * Hand-written scanner over a memory-mapped file. Finding the end of each line is
+ *   most of the work, so that uses SSE2 where it's available
+ */
+
+#include <fcntl.h>
+#include <malloc.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "parser.h"
+#include "dbg.h"
+
+// Make a parser over data
+static Parser *pr_create(const char *data, size_t size, void *mapping)
+{
+    Parser *parser = malloc(sizeof(Parser));
+    if(!parser) return NULL;
+
+    parser->data = data;
+    parser->size = size;
+    parser->pos = 0;
+    parser->line = 0;
+    parser->bad.str = NULL;
+    parser->bad.length = 0;
+    parser->mapping = mapping;
+    return parser;
+}
+
+Parser *new_parser(const char *path)
+{
+    struct stat info;
+    void *mapping = NULL;
+    size_t size = 0;
+
+    int fd = open(path, O_RDONLY);
+    check(fd != -1, "Could not open %s", path);
+    check(fstat(fd, &info) == 0, "Could not stat %s", path);
+
+    // empty files can't be mapped, but there's nothing to map anyway
+    size = (size_t)info.st_size;
+    if(size) {
+        mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        check(mapping != MAP_FAILED, "Could not map %s", path);
+
+        // read front to back once, so let the kernel read ahead
+        madvise(mapping, size, MADV_SEQUENTIAL);
+    }
+
+    // the mapping keeps the file, so the descriptor isn't needed
+    close(fd);
+    fd = -1;
+
+    Parser *parser = pr_create(mapping, size, mapping);
+    check_mem(parser);
+    return parser;
+
+error:
+    if(fd != -1) close(fd);
+    if(mapping && mapping != MAP_FAILED) munmap(mapping, size);
+    return NULL;
+}
+
+Parser *new_parser_buffer(const char *data, size_t size)
+{
+    return pr_create(data, size, NULL);
+}
+
+// Find the next newline from start, or end if there isn't one
+static const char *pr_newline(const char *start, const char *end)
+{
+#ifdef __SSE2__
+    // compare 16 bytes at a time, the mask has a bit set for each newline
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    while(end - start >= 16) {
+        __m128i chunk;
+        memcpy(&chunk, start, 16);
+
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        if(mask) return start + __builtin_ctz((unsigned int)mask);
+
+        start += 16;
+    }
+#endif
+
+    const char *found = memchr(start, '\n', (size_t)(end - start));
+    return found ? found : end;
+}
+
+// Check for the whitespace sscanf would skip
+static int pr_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Skip whitespace from start
+static const char *pr_skip(const char *start, const char *end)
+{
+    while(start < end && pr_space(*start)) start++;
+    return start;
+}
+
+// Read a value from start, which has to be at its first character
+// Values stop at whitespace or a comparison, so a>b needs no spaces
+// Returns the end of the value
+static const char *pr_token(const char *start, const char *end, View *token)
+{
+    const char *cursor = start;
+    while(cursor < end && !pr_space(*cursor) && *cursor != '<' && *cursor != '>') cursor++;
+
+    token->str = start;
+    token->length = (size_t)(cursor - start);
+    return cursor;
+}
+
+// Read a relation from a single line
+// Returns PARSE_RELATION, PARSE_INVALID, or PARSE_END if the line is blank
+static int pr_line(const char *start, const char *end, Relation *relation)
+{
+    View first;
+    View second;
+
+    start = pr_skip(start, end);
+    if(start == end) return PARSE_END;
+
+    start = pr_skip(pr_token(start, end, &first), end);
+    if(start == end) return PARSE_INVALID;
+
+    char relate = *start;
+    if(relate != '<' && relate != '>') return PARSE_INVALID;
+
+    start = pr_skip(start + 1, end);
+    if(start == end) return PARSE_INVALID;
+
+    start = pr_skip(pr_token(start, end, &second), end);
+    if(start != end || !first.length || !second.length) return PARSE_INVALID;
+
+    relation->greater = relate == '>' ? first : second;
+    relation->lesser = relate == '>' ? second : first;
+    return PARSE_RELATION;
+}
+
+int pr_next(Parser *parser, Relation *relation)
+{
+    const char *end = parser->data + parser->size;
+
+    while(parser->pos < parser->size) {
+        const char *start = parser->data + parser->pos;
+        const char *newline = pr_newline(start, end);
+
+        // carry on after the newline, if there is one
+        parser->pos = (size_t)(newline - parser->data);
+        if(newline < end) parser->pos++;
+        parser->line++;
+
+        int rc = pr_line(start, newline, relation);
+        if(rc == PARSE_END) continue;
+
+        if(rc == PARSE_INVALID) {
+            parser->bad.str = start;
+            parser->bad.length = (size_t)(newline - start);
+        }
+        return rc;
+    }
+
+    return PARSE_END;
+}
+
+void pr_free(Parser *parser)
+{
+    if(parser->mapping) munmap(parser->mapping, parser->size);
+    free(parser);
+}
@@ -0,0 +1,95 @@
+/* Relation file parser
+ *
+ * Reads files of relations, one per line, in the form
+ *
+ *   <one> > <two>    or    <one> < <two>
+ *
+ * where the values are any runs of characters other than whitespace, < and >.
+ *   Spaces around the comparison are optional, blank lines are skipped and there's
+ *   no limit on line length
+ *
+ * The file is mapped into memory and scanned in place, so the values handed back
+ *   are views into the mapping rather than copies. They stay valid until the
+ *   parser is freed, and can go straight to g_apply_relation_n or into a pool
+ */
+
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>
+
+#include "pool.h"
+
+/* Results from pr_next
+ *
+ * PARSE_END: No lines left
+ * PARSE_RELATION: Found a relation
+ * PARSE_INVALID: Line isn't a relation; it's given in Parser.bad
+ */
+enum pr_result {
+    PARSE_END = 0,
+    PARSE_RELATION = 1,
+    PARSE_INVALID = 2,
+};
+
+/* struct: Relation
+ *
+ * Relation read from a file, where greater > lesser whichever way round it was written
+ */
+typedef struct relation {
+    View greater;
+    View lesser;
+} Relation;
+
+/* struct: Parser
+ *
+ * Create with new_parser or new_parser_buffer and operate with pr_* functions
+ *
+ * data: Contents being parsed
+ * size: Size of data in bytes
+ * pos: Offset of the next line in data
+ * line: Number of the line last read, counting from 1
+ * bad: Last line that wasn't a relation, without its newline
+ * mapping: Mapping of the file data comes from, or NULL if it wasn't mapped
+ */
+typedef struct parser {
+    const char *data;
+    size_t size;
+    size_t pos;
+    int line;
+    View bad;
+    void *mapping;
+} Parser;
+
+/* function: new_parser(const char *path)
+ *
+ * Map a file into memory to parse
+ *
+ * Returns the parser or NULL if the file can't be opened or mapped
+ */
+Parser *new_parser(const char *path);
+
+/* function: new_parser_buffer(const char *data, size_t size)
+ *
+ * Parse size bytes of data already in memory, which has to outlive the parser.
+ *   data doesn't have to be null-terminated
+ *
+ * Returns the parser or NULL if out of memory
+ */
+Parser *new_parser_buffer(const char *data, size_t size);
+
+/* function: pr_next(Parser *parser, Relation *relation)
+ *
+ * Read the next relation, skipping blank lines
+ *
+ * Returns a pr_result; relation is only set for PARSE_RELATION
+ */
+int pr_next(Parser *parser, Relation *relation);
+
+/* function: pr_free(Parser *parser)
+ *
+ * Free a parser, unmapping its file. Any views from it are invalid afterwards
+ */
+void pr_free(Parser *parser);
+
+#endif
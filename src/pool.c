@@ -0,0 +1,195 @@
+/* Interned string pool
+ *
+ * Strings are packed end to end into blocks from an arena, so they're never moved
+ *   and pointers to them stay valid as the pool grows
+ */
+
+#include <malloc.h>
+#include <string.h>
+
+#include "pool.h"
+#include "hash.h"
+#include "dbg.h"
+
+// Size of each block strings are packed into
+#define POOL_BLOCK_SIZE ((size_t)64 << 10)
+// Starting number of slots in the table, must be a power of two
+#define POOL_INITIAL_SIZE 64
+
+Pool *new_pool(void)
+{
+    Pool *pool = calloc(1, sizeof(Pool));
+    if(!pool) return NULL;
+
+    pool->arena = new_arena();
+    pool->table = calloc(POOL_INITIAL_SIZE, sizeof(unsigned int));
+    if(!pool->arena || !pool->table) goto error;
+
+    pool->table_size = POOL_INITIAL_SIZE;
+    return pool;
+
+error:
+    if(pool->arena) a_free(pool->arena);
+    free(pool->table);
+    free(pool);
+    return NULL;
+}
+
+// Find the table slot for a string
+// Linear probing from the hash; stops at the matching id or the first empty slot
+// If str is NULL any string with the hash matches
+static unsigned int *p_slot(Pool *pool, const char *str, size_t length, uint64_t hash)
+{
+    unsigned int mask = pool->table_size - 1;
+    unsigned int i = (unsigned int)hash & mask;
+
+    while(pool->table[i]) {
+        unsigned int id = pool->table[i] - 1;
+        if(pool->hashes[id] == hash) {
+            if(!str) break;
+
+            const char *found = pool->strings[id];
+            if(memcmp(found, str, length) == 0 && found[length] == '\0') break;
+        }
+        i = (i + 1) & mask;
+    }
+
+    return &pool->table[i];
+}
+
+// Double the size of the table, reusing the stored hashes
+static int p_grow_table(Pool *pool)
+{
+    unsigned int size = pool->table_size * 2;
+    unsigned int *table = calloc(size, sizeof(unsigned int));
+    if(!table) return 1;
+
+    free(pool->table);
+    pool->table = table;
+    pool->table_size = size;
+
+    unsigned int mask = size - 1;
+    for(unsigned int id = 0; id < pool->length; id++) {
+        unsigned int i = (unsigned int)pool->hashes[id] & mask;
+        while(table[i]) i = (i + 1) & mask;
+        table[i] = id + 1;
+    }
+
+    return 0;
+}
+
+// Grow the per-id arrays
+static int p_grow_ids(Pool *pool)
+{
+    unsigned int size = pool->size ? pool->size * 2 : POOL_INITIAL_SIZE;
+
+    char **strings = realloc(pool->strings, sizeof(char *) * size);
+    if(!strings) return 1;
+    pool->strings = strings;
+
+    uint64_t *hashes = realloc(pool->hashes, sizeof(uint64_t) * size);
+    if(!hashes) return 1;
+    pool->hashes = hashes;
+
+    pool->size = size;
+    return 0;
+}
+
+// Copy a string into the current block, starting a new one if it doesn't fit
+static char *p_copy(Pool *pool, const char *str, size_t length)
+{
+    char *copy = NULL;
+
+    if(length + 1 > POOL_BLOCK_SIZE / 4) {
+        // long strings get their own allocation
+        copy = a_alloc(pool->arena, length + 1);
+        if(!copy) return NULL;
+    } else {
+        if(length + 1 > pool->left) {
+            pool->block = a_alloc(pool->arena, POOL_BLOCK_SIZE);
+            if(!pool->block) return NULL;
+            pool->left = POOL_BLOCK_SIZE;
+        }
+
+        copy = pool->block;
+        pool->block += length + 1;
+        pool->left -= length + 1;
+    }
+
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+unsigned int p_intern_hashed(Pool *pool, const char *str, size_t length, uint64_t hash)
+{
+    unsigned int *slot = p_slot(pool, str, length, hash);
+    if(*slot) return *slot - 1;
+
+    // ids run out one short of POOL_NONE
+    check(pool->length < POOL_NONE - 1, "Pool is full");
+
+    // new string; grow first, which invalidates the slot
+    if(pool->length == pool->size && p_grow_ids(pool)) return POOL_NONE;
+    if((pool->length + 1) * 2 > pool->table_size) {
+        if(p_grow_table(pool)) return POOL_NONE;
+        slot = p_slot(pool, str, length, hash);
+    }
+
+    char *copy = p_copy(pool, str, length);
+    if(!copy) return POOL_NONE;
+
+    unsigned int id = pool->length++;
+    pool->strings[id] = copy;
+    pool->hashes[id] = hash;
+    *slot = id + 1;
+    return id;
+
+error:
+    return POOL_NONE;
+}
+
+unsigned int p_intern(Pool *pool, const char *str, size_t length)
+{
+    return p_intern_hashed(pool, str, length, hash_n(str, length));
+}
+
+unsigned int p_find(Pool *pool, const char *str, size_t length)
+{
+    unsigned int slot = *p_slot(pool, str, length, hash_n(str, length));
+    return slot ? slot - 1 : POOL_NONE;
+}
+
+unsigned int p_find_hash(Pool *pool, uint64_t hash)
+{
+    unsigned int slot = *p_slot(pool, NULL, 0, hash);
+    return slot ? slot - 1 : POOL_NONE;
+}
+
+char *p_string(Pool *pool, unsigned int id)
+{
+    return pool->strings[id];
+}
+
+uint64_t p_hash(Pool *pool, unsigned int id)
+{
+    return pool->hashes[id];
+}
+
+void p_reset(Pool *pool)
+{
+    a_reset(pool->arena);
+    pool->block = NULL;
+    pool->left = 0;
+    pool->length = 0;
+    memset(pool->table, 0, sizeof(unsigned int) * pool->table_size);
+}
+
+void p_free(Pool *pool)
+{
+    a_free(pool->arena);
+    free(pool->strings);
+    free(pool->hashes);
+    free(pool->table);
+    free(pool);
+}
@@ -0,0 +1,125 @@
+/* Interned string pool
+ *
+ * Stores each distinct string once, packed into large blocks, and gives it a
+ *   dense id counting up from 0. Ids can be used to index flat arrays of
+ *   per-string data
+ *
+ * Strings are found through an open-addressing table of ids keyed by a 64-bit
+ *   hash; the string is always compared as well, so two strings with the same
+ *   hash are never merged
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+// Returned in place of an id when a string isn't found or can't be added
+#define POOL_NONE ((unsigned int)-1)
+
+/* struct: View
+ *
+ * String given by a start and length rather than a null terminator, such as a
+ *   token inside a larger buffer
+ *
+ * str: First character
+ * length: Number of characters
+ */
+typedef struct view {
+    const char *str;
+    size_t length;
+} View;
+
+/* struct: Pool
+ *
+ * Create with new_pool and operate with p_* functions
+ *
+ * arena: Memory for the strings
+ * block: Block strings are currently being packed into
+ * left: Bytes left in block
+ * strings: String for each id
+ * hashes: Hash of each string
+ * length: Number of strings
+ * size: Number of ids strings and hashes have room for
+ * table: Open-addressing table, each slot holds an id + 1 or 0 if empty
+ * table_size: Number of slots in table (always a power of two)
+ */
+typedef struct pool {
+    Arena *arena;
+    char *block;
+    size_t left;
+    char **strings;
+    uint64_t *hashes;
+    unsigned int length;
+    unsigned int size;
+    unsigned int *table;
+    unsigned int table_size;
+} Pool;
+
+/* function: new_pool()
+ *
+ * Create a new empty pool
+ *
+ * Returns the pool or NULL if out of memory
+ */
+Pool *new_pool(void);
+
+/* function: p_intern(Pool *pool, const char *str, size_t length)
+ *
+ * Get the id for length bytes of str, adding a copy to the pool if it's not
+ *   already there. str doesn't have to be null-terminated
+ *
+ * Returns the id, or POOL_NONE if out of memory
+ */
+unsigned int p_intern(Pool *pool, const char *str, size_t length);
+
+/* function: p_intern_hashed(Pool *pool, const char *str, size_t length, uint64_t hash)
+ *
+ * Same as p_intern, with the hash from hash_n already worked out
+ */
+unsigned int p_intern_hashed(Pool *pool, const char *str, size_t length, uint64_t hash);
+
+/* function: p_find(Pool *pool, const char *str, size_t length)
+ *
+ * Get the id for length bytes of str without adding it
+ *
+ * Returns the id, or POOL_NONE if not in the pool
+ */
+unsigned int p_find(Pool *pool, const char *str, size_t length);
+
+/* function: p_find_hash(Pool *pool, uint64_t hash)
+ *
+ * Get the id of the first string added with a given hash, without checking the string
+ *
+ * Returns the id, or POOL_NONE if no string has that hash
+ */
+unsigned int p_find_hash(Pool *pool, uint64_t hash);
+
+/* function: p_string(Pool *pool, unsigned int id)
+ *
+ * Get the null-terminated string for an id. Stays valid until the pool is reset or freed
+ */
+char *p_string(Pool *pool, unsigned int id);
+
+/* function: p_hash(Pool *pool, unsigned int id)
+ *
+ * Get the hash of the string for an id
+ */
+uint64_t p_hash(Pool *pool, unsigned int id);
+
+/* function: p_reset(Pool *pool)
+ *
+ * Empty a pool, keeping memory for reuse. Ids start from 0 again
+ */
+void p_reset(Pool *pool);
+
+/* function: p_free(Pool *pool)
+ *
+ * Free a pool and all its strings
+ */
+void p_free(Pool *pool);
+
+#endif
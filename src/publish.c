@@ -0,0 +1,119 @@
+/* Snapshot publishing for concurrent readers
+ *
+ * Every atomic here is sequentially consistent, which is what makes the epochs
+ *   work: a reader stores its epoch before loading current, and the publisher
+ *   swaps current before reading the slots. So either the publisher sees the
+ *   reader's epoch and keeps the old version, or the reader loads after the
+ *   swap and never had the old version at all
+ */
+
+#include <malloc.h>
+
+#include "publish.h"
+#include "dbg.h"
+
+Publisher *new_publisher(int readers)
+{
+    Publisher *publisher = malloc(sizeof(Publisher));
+    if(!publisher) return NULL;
+
+    publisher->slots = malloc(sizeof(atomic_ulong) * (size_t)(readers > 0 ? readers : 1));
+    if(!publisher->slots) {
+        free(publisher);
+        return NULL;
+    }
+
+    atomic_init(&publisher->current, NULL);
+    atomic_init(&publisher->epoch, 0);
+    for(int i = 0; i < readers; i++) atomic_init(&publisher->slots[i], PUBLISH_IDLE);
+    publisher->readers = readers;
+    publisher->retired = NULL;
+    publisher->published = 0;
+    return publisher;
+}
+
+static void pb_free_version(Version *version)
+{
+    sn_close(version->snapshot);
+    free(version);
+}
+
+int pb_publish(Publisher *publisher, Graph *graph)
+{
+    Version *version = malloc(sizeof(Version));
+    if(!version) return ERR_OUT_OF_MEMORY;
+
+    version->snapshot = g_snapshot(graph);
+    if(!version->snapshot) {
+        free(version);
+        return ERR_OUT_OF_MEMORY;
+    }
+    version->number = ++publisher->published;
+    version->retired = 0;
+    version->next = NULL;
+
+    // readers in this epoch or earlier might have the old one
+    Version *old = atomic_exchange(&publisher->current, version);
+    unsigned long epoch = atomic_fetch_add(&publisher->epoch, 1);
+
+    if(old) {
+        old->retired = epoch;
+        old->next = publisher->retired;
+        publisher->retired = old;
+    }
+
+    pb_reclaim(publisher);
+    return 0;
+}
+
+Version *pb_enter(Publisher *publisher, int reader)
+{
+    atomic_store(&publisher->slots[reader], atomic_load(&publisher->epoch));
+    return atomic_load(&publisher->current);
+}
+
+void pb_leave(Publisher *publisher, int reader)
+{
+    atomic_store(&publisher->slots[reader], PUBLISH_IDLE);
+}
+
+int pb_reclaim(Publisher *publisher)
+{
+    // oldest epoch any reader is still in
+    unsigned long oldest = PUBLISH_IDLE;
+    for(int i = 0; i < publisher->readers; i++) {
+        unsigned long epoch = atomic_load(&publisher->slots[i]);
+        if(epoch < oldest) oldest = epoch;
+    }
+
+    int waiting = 0;
+    Version **link = &publisher->retired;
+    while(*link) {
+        Version *version = *link;
+
+        if(version->retired < oldest) {
+            *link = version->next;
+            pb_free_version(version);
+        } else {
+            link = &version->next;
+            waiting++;
+        }
+    }
+
+    return waiting;
+}
+
+void pb_free(Publisher *publisher)
+{
+    Version *current = atomic_load(&publisher->current);
+    if(current) pb_free_version(current);
+
+    while(publisher->retired) {
+        Version *next = publisher->retired->next;
+        pb_free_version(publisher->retired);
+        publisher->retired = next;
+    }
+
+    free(publisher->slots);
+    free(publisher);
+}
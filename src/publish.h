@@ -0,0 +1,120 @@
+/* Snapshot publishing for concurrent readers
+ *
+ * The graph itself is only safe to use from one thread. To read it from others,
+ *   the thread that changes it publishes a snapshot of it now and then with
+ *   pb_publish, and readers get whichever snapshot is current with pb_enter.
+ *   A snapshot never changes once published, so readers see one consistent
+ *   version of the order and relations for as long as they hold it
+ *
+ * Neither side ever waits for the other. Entering and leaving are an atomic
+ *   store each, and publishing swaps a pointer; the old snapshot is retired and
+ *   only freed once every reader that could have it has left. Each reader
+ *   announces the epoch it entered in, and a snapshot retired in epoch e is
+ *   freed when no reader is still in an epoch at or before e
+ *
+ * Publishing copies the whole graph (see g_snapshot), so it's for publishing
+ *   every so often, after a batch of changes, rather than after every relation.
+ *   A reader that stays entered holds back every snapshot retired since, so
+ *   leave between requests
+ *
+ * Readers each have their own slot, numbered from 0 to one less than the number
+ *   given to new_publisher. A slot must only be used by one thread at a time
+ */
+
+#ifndef PUBLISH_H
+#define PUBLISH_H
+
+#include <stdatomic.h>
+
+#include "graph.h"
+#include "snapshot.h"
+
+/* struct: Version
+ *
+ * One published snapshot
+ *
+ * snapshot: The snapshot, read with the sn_* functions. Ids are in sorted order
+ * number: Counts up from 1 with each pb_publish
+ * retired: Epoch it stopped being current in, once it has
+ * next: Next retired version waiting to be freed
+ */
+typedef struct version {
+    Snapshot *snapshot;
+    unsigned long number;
+    unsigned long retired;
+    struct version *next;
+} Version;
+
+/* struct: Publisher
+ *
+ * Current snapshot of a graph and the readers using it. Create with
+ *   new_publisher and operate with pb_* functions
+ *
+ * current: Version readers get from pb_enter
+ * epoch: Goes up by one with each pb_publish
+ * slots: Epoch each reader entered in, or PUBLISH_IDLE if it isn't entered
+ * readers: Number of slots
+ * retired: Versions replaced but maybe still being read, newest first
+ * published: Number of versions published
+ */
+typedef struct publisher {
+    _Atomic(Version *) current;
+    atomic_ulong epoch;
+    atomic_ulong *slots;
+    int readers;
+    Version *retired;
+    unsigned long published;
+} Publisher;
+
+// Slot of a reader that isn't entered
+#define PUBLISH_IDLE ((unsigned long)-1)
+
+/* function: new_publisher(int readers)
+ *
+ * Create a publisher with slots for readers readers. Nothing is published
+ *   until pb_publish, and pb_enter gives NULL until then
+ *
+ * Returns the publisher or NULL if out of memory
+ */
+Publisher *new_publisher(int readers);
+
+/* function: pb_publish(Publisher *publisher, Graph *graph)
+ *
+ * Snapshot a graph and make it current. Call from the thread that changes the
+ *   graph. Also frees any retired versions no reader can still have
+ *
+ * Returns 0 on success or ERR_OUT_OF_MEMORY, leaving the current version as it was
+ */
+int pb_publish(Publisher *publisher, Graph *graph);
+
+/* function: pb_enter(Publisher *publisher, int reader)
+ *
+ * Get the current version for a reader. It stays valid until pb_leave with the
+ *   same reader, however many times the graph is published meanwhile
+ *
+ * Returns the version, or NULL if nothing's been published yet
+ */
+Version *pb_enter(Publisher *publisher, int reader);
+
+/* function: pb_leave(Publisher *publisher, int reader)
+ *
+ * Finish with the version a reader got from pb_enter
+ */
+void pb_leave(Publisher *publisher, int reader);
+
+/* function: pb_reclaim(Publisher *publisher)
+ *
+ * Free retired versions no reader can still have. Call from the publishing
+ *   thread; pb_publish already does
+ *
+ * Returns the number of versions still waiting to be freed
+ */
+int pb_reclaim(Publisher *publisher);
+
+/* function: pb_free(Publisher *publisher)
+ *
+ * Free a publisher and every version. No reader can be entered
+ */
+void pb_free(Publisher *publisher);
+
+#endif
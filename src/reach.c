@@ -0,0 +1,385 @@
+/* Reachability index
+ *
+ * GRAIL labels, landmarks, and level and order filters, with a pruned search for
+ *   anything they can't decide, or a bit matrix for small graphs
+ */
+
+#include <malloc.h>
+#include <string.h>
+
+#include "reach.h"
+#include "levels.h"
+#include "dbg.h"
+
+// Fields of each traversal's labels
+#define LABEL_POST 0
+#define LABEL_LOW 1
+#define LABEL_TREE 2
+#define LABEL_FIELDS 3
+
+// Step of a traversal: the value, how many of its lower values have been tried,
+//   and which one to start from, so each traversal takes them in a different order
+typedef struct frame {
+    uint32_t id;
+    uint32_t next;
+    uint32_t first;
+} Frame;
+
+// xorshift64, only needs to shuffle traversals so a fixed seed is fine
+static uint64_t ri_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Labels of one id for one traversal
+static uint32_t *ri_label(Reach *reach, uint32_t id, int traversal)
+{
+    return reach->labels + ((size_t)id * (size_t)reach->traversals + (size_t)traversal) * LABEL_FIELDS;
+}
+
+// Value of an id, ids interned without ever getting a value may be past the end of values
+static Value *ri_value(Graph *graph, uint32_t id)
+{
+    return id < (uint32_t)graph->values_size ? graph->values[id] : NULL;
+}
+
+// Copy the graph's lower relations into rows by id
+static int ri_rows(Reach *reach, Graph *graph)
+{
+    uint32_t total = 0;
+
+    reach->start = malloc(sizeof(uint32_t) * (reach->length + 1));
+    if(!reach->start) return 1;
+
+    for(uint32_t id = 0; id < reach->length; id++) {
+        reach->start[id] = total;
+        Value *value = ri_value(graph, id);
+        if(value) total += (uint32_t)g_degree(graph, value, DIR_LOWER);
+    }
+    reach->start[reach->length] = total;
+
+    reach->lower = malloc(sizeof(uint32_t) * (total ? total : 1));
+    if(!reach->lower) return 1;
+
+    for(uint32_t id = 0; id < reach->length; id++) {
+        Value *value = ri_value(graph, id);
+        int degree = value ? g_degree(graph, value, DIR_LOWER) : 0;
+        for(int i = 0; i < degree; i++) {
+            reach->lower[reach->start[id] + (uint32_t)i] = g_relation(graph, value, DIR_LOWER, i)->index;
+        }
+    }
+
+    return 0;
+}
+
+// One randomised depth first traversal from every root, giving each value its
+//   post order number, the lowest number below it, and the start of its subtree
+// Everything is visited, as every value is below a root
+static void ri_traverse(Reach *reach, int traversal, uint32_t *roots, uint32_t root_count, Frame *frames, uint64_t *random)
+{
+    uint32_t counter = 0;
+    uint32_t stamp = (uint32_t)traversal + 1;
+
+    // shuffle the roots
+    for(uint32_t i = root_count; i > 1; i--) {
+        uint32_t j = (uint32_t)(ri_random(random) % i);
+        uint32_t root = roots[i - 1];
+        roots[i - 1] = roots[j];
+        roots[j] = root;
+    }
+
+    for(uint32_t r = 0; r < root_count; r++) {
+        uint32_t depth = 0;
+        uint32_t id = roots[r];
+        uint32_t *label = NULL;
+
+        // roots are never below anything, so can't have been visited already
+        reach->seen[id] = stamp;
+        label = ri_label(reach, id, traversal);
+        label[LABEL_LOW] = UINT32_MAX;
+        label[LABEL_TREE] = counter;
+        uint32_t degree = reach->start[id + 1] - reach->start[id];
+        frames[depth++] = (Frame){ id, 0, degree ? (uint32_t)(ri_random(random) % degree) : 0 };
+
+        while(depth) {
+            Frame *frame = &frames[depth - 1];
+            uint32_t *row = reach->lower + reach->start[frame->id];
+            degree = reach->start[frame->id + 1] - reach->start[frame->id];
+            label = ri_label(reach, frame->id, traversal);
+
+            if(frame->next < degree) {
+                uint32_t lower = row[(frame->first + frame->next) % degree];
+                frame->next++;
+
+                uint32_t *lower_label = ri_label(reach, lower, traversal);
+                if(reach->seen[lower] == stamp) {
+                    // no cycles, so anything seen already is finished
+                    if(lower_label[LABEL_LOW] < label[LABEL_LOW]) label[LABEL_LOW] = lower_label[LABEL_LOW];
+                    continue;
+                }
+
+                reach->seen[lower] = stamp;
+                lower_label[LABEL_LOW] = UINT32_MAX;
+                lower_label[LABEL_TREE] = counter;
+                uint32_t lower_degree = reach->start[lower + 1] - reach->start[lower];
+                frames[depth++] = (Frame){ lower, 0, lower_degree ? (uint32_t)(ri_random(random) % lower_degree) : 0 };
+                continue;
+            }
+
+            // finished, so number it and pass its lowest number up
+            label[LABEL_POST] = counter++;
+            if(label[LABEL_POST] < label[LABEL_LOW]) label[LABEL_LOW] = label[LABEL_POST];
+
+            depth--;
+            if(depth) {
+                uint32_t *higher_label = ri_label(reach, frames[depth - 1].id, traversal);
+                if(label[LABEL_LOW] < higher_label[LABEL_LOW]) higher_label[LABEL_LOW] = label[LABEL_LOW];
+            }
+        }
+    }
+}
+
+// Pick the landmarks, the values with the most paths through them going by the
+//   product of their degrees, and work out which are above and below each value
+// Masks are passed down the graph in order and up it in reverse, so each is one pass
+static void ri_landmarks(Reach *reach, Graph *graph)
+{
+    uint32_t landmarks[REACH_LANDMARKS];
+    uint64_t scores[REACH_LANDMARKS];
+    int count = 0;
+    int least = 0;
+
+    // keep the best so far, replacing the least of them each time
+    for(Value *value = graph->start; value; value = value->next) {
+        uint64_t score = (uint64_t)(g_degree(graph, value, DIR_HIGHER) + 1) * (uint64_t)(g_degree(graph, value, DIR_LOWER) + 1);
+
+        if(count < REACH_LANDMARKS) {
+            landmarks[count] = value->index;
+            scores[count++] = score;
+        } else if(score > scores[least]) {
+            landmarks[least] = value->index;
+            scores[least] = score;
+        } else {
+            continue;
+        }
+
+        for(int i = 0; i < count; i++) {
+            if(scores[i] < scores[least]) least = i;
+        }
+    }
+
+    memset(reach->above, 0, sizeof(uint64_t) * reach->length);
+    memset(reach->below, 0, sizeof(uint64_t) * reach->length);
+    for(int i = 0; i < count; i++) {
+        reach->above[landmarks[i]] |= UINT64_C(1) << i;
+        reach->below[landmarks[i]] |= UINT64_C(1) << i;
+    }
+
+    for(Value *value = graph->start; value; value = value->next) {
+        for(uint32_t i = reach->start[value->index]; i < reach->start[value->index + 1]; i++) {
+            reach->above[reach->lower[i]] |= reach->above[value->index];
+        }
+    }
+
+    for(Value *value = graph->end; value; value = value->prev) {
+        for(uint32_t i = reach->start[value->index]; i < reach->start[value->index + 1]; i++) {
+            reach->below[value->index] |= reach->below[reach->lower[i]];
+        }
+    }
+}
+
+// Fill the closure bit matrix, from the bottom of the graph up so each value's
+//   lower values already have their rows
+static int ri_closure(Reach *reach, Graph *graph)
+{
+    reach->words = (reach->length + 63) / 64;
+    reach->closure = calloc((size_t)reach->length * reach->words + 1, sizeof(uint64_t));
+    if(!reach->closure) return 1;
+
+    for(Value *value = graph->end; value; value = value->prev) {
+        uint64_t *row = reach->closure + (size_t)value->index * reach->words;
+
+        for(uint32_t i = reach->start[value->index]; i < reach->start[value->index + 1]; i++) {
+            uint32_t lower = reach->lower[i];
+            uint64_t *lower_row = reach->closure + (size_t)lower * reach->words;
+
+            for(uint32_t w = 0; w < reach->words; w++) row[w] |= lower_row[w];
+            row[lower / 64] |= UINT64_C(1) << (lower % 64);
+        }
+    }
+
+    return 0;
+}
+
+Reach *g_reach(Graph *graph, int traversals)
+{
+    Reach *reach = calloc(1, sizeof(Reach));
+    Levels *levels = g_levels(graph, 0);
+    uint32_t *roots = NULL;
+    Frame *frames = NULL;
+    check_mem(reach && levels);
+
+    reach->traversals = traversals > 0 ? traversals : REACH_TRAVERSALS;
+    reach->length = (unsigned int)levels->size;
+
+    // levels are kept, the rest of the sort isn't needed
+    reach->level = levels->level;
+    levels->level = NULL;
+
+    size_t length = reach->length ? reach->length : 1;
+    reach->position = malloc(sizeof(uint32_t) * length);
+    reach->labels = malloc(sizeof(uint32_t) * length * (size_t)reach->traversals * LABEL_FIELDS);
+    reach->seen = calloc(length, sizeof(uint32_t));
+    reach->stack = malloc(sizeof(uint32_t) * length);
+    reach->above = malloc(sizeof(uint64_t) * length);
+    reach->below = malloc(sizeof(uint64_t) * length);
+    frames = malloc(sizeof(Frame) * length);
+    check_mem(reach->position && reach->labels && reach->seen && reach->stack && reach->above && reach->below && frames);
+    check_mem(!ri_rows(reach, graph));
+
+    uint32_t position = 0;
+    for(Value *value = graph->start; value; value = value->next) reach->position[value->index] = position++;
+
+    // level 0 is everything with nothing above it
+    uint32_t root_count = levels->count ? (uint32_t)levels->starts[1] : 0;
+    roots = malloc(sizeof(uint32_t) * (root_count ? root_count : 1));
+    check_mem(roots);
+    for(uint32_t i = 0; i < root_count; i++) roots[i] = levels->order[i]->index;
+
+    uint64_t random = UINT64_C(0x9e3779b97f4a7c15);
+    for(int t = 0; t < reach->traversals; t++) ri_traverse(reach, t, roots, root_count, frames, &random);
+    reach->stamp = (uint32_t)reach->traversals;
+
+    ri_landmarks(reach, graph);
+
+    if(reach->length <= REACH_CLOSURE_LIMIT) check_mem(!ri_closure(reach, graph));
+
+    free(roots);
+    free(frames);
+    lv_free(levels);
+    return reach;
+
+error:
+    free(roots);
+    free(frames);
+    if(levels) lv_free(levels);
+    if(reach) ri_free(reach);
+    return NULL;
+}
+
+// Whether higher could be above lower, i.e. nothing rules it out
+static int ri_may(Reach *reach, uint32_t higher, uint32_t lower)
+{
+    if(reach->level[higher] >= reach->level[lower]) return 0;
+    if(reach->position[higher] >= reach->position[lower]) return 0;
+
+    // higher has to be above every landmark lower is, and below every one lower is below
+    if(reach->below[lower] & ~reach->below[higher]) return 0;
+    if(reach->above[higher] & ~reach->above[lower]) return 0;
+
+    for(int t = 0; t < reach->traversals; t++) {
+        uint32_t *higher_label = ri_label(reach, higher, t);
+        uint32_t *lower_label = ri_label(reach, lower, t);
+
+        if(lower_label[LABEL_LOW] < higher_label[LABEL_LOW] || lower_label[LABEL_POST] > higher_label[LABEL_POST]) return 0;
+    }
+
+    return 1;
+}
+
+// Whether there's a landmark between them, or lower is in higher's subtree in some
+//   traversal, so lower is definitely below
+// Only valid for different values
+static int ri_sure(Reach *reach, uint32_t higher, uint32_t lower)
+{
+    if(reach->below[higher] & reach->above[lower]) return 1;
+
+    for(int t = 0; t < reach->traversals; t++) {
+        uint32_t *higher_label = ri_label(reach, higher, t);
+        uint32_t post = ri_label(reach, lower, t)[LABEL_POST];
+
+        if(higher_label[LABEL_TREE] <= post && post <= higher_label[LABEL_POST]) return 1;
+    }
+
+    return 0;
+}
+
+// Depth first search down from higher, skipping anything that can't be above lower
+static int ri_search(Reach *reach, uint32_t higher, uint32_t lower)
+{
+    reach->searches++;
+
+    // stamps wrap eventually, so start the marks again from nothing
+    if(++reach->stamp == 0) {
+        memset(reach->seen, 0, sizeof(uint32_t) * reach->length);
+        reach->stamp = 1;
+    }
+
+    uint32_t depth = 0;
+    reach->stack[depth++] = higher;
+    reach->seen[higher] = reach->stamp;
+
+    while(depth) {
+        uint32_t id = reach->stack[--depth];
+        uint32_t base = depth;
+        uint32_t closest = depth;
+
+        for(uint32_t i = reach->start[id]; i < reach->start[id + 1]; i++) {
+            uint32_t next = reach->lower[i];
+            if(next == lower) return 1;
+            if(reach->seen[next] == reach->stamp) continue;
+
+            reach->seen[next] = reach->stamp;
+            if(!ri_may(reach, next, lower)) continue;
+            if(ri_sure(reach, next, lower)) return 1;
+
+            // keep whichever is closest to lower in the order on top, so the search
+            //   heads straight for it when there's a path
+            reach->stack[depth++] = next;
+            if(reach->position[next] > reach->position[reach->stack[closest]]) closest = depth - 1;
+        }
+
+        if(depth > base) {
+            uint32_t top = reach->stack[depth - 1];
+            reach->stack[depth - 1] = reach->stack[closest];
+            reach->stack[closest] = top;
+        }
+    }
+
+    return 0;
+}
+
+int ri_above(Reach *reach, Value *higher, Value *lower)
+{
+    uint32_t a = higher->index;
+    uint32_t b = lower->index;
+    if(a >= reach->length || b >= reach->length) return 0;
+    if(reach->level[a] < 0 || reach->level[b] < 0) return 0;
+
+    reach->queries++;
+
+    if(reach->closure) return (reach->closure[(size_t)a * reach->words + b / 64] >> (b % 64)) & 1;
+
+    if(!ri_may(reach, a, b)) return 0;
+    if(ri_sure(reach, a, b)) return 1;
+
+    return ri_search(reach, a, b);
+}
+
+void ri_free(Reach *reach)
+{
+    free(reach->level);
+    free(reach->position);
+    free(reach->labels);
+    free(reach->start);
+    free(reach->lower);
+    free(reach->closure);
+    free(reach->seen);
+    free(reach->stack);
+    free(reach->above);
+    free(reach->below);
+    free(reach);
+}
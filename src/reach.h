@@ -0,0 +1,116 @@
+/* Reachability index
+ *
+ * Answers whether one value is above another, through any chain of relations,
+ *   mostly without walking the graph
+ *
+ * Built once from a graph, in O(k(V + E)) for k traversals:
+ *
+ *   levels: Levels from g_levels. A value can only be above values on later levels
+ *   position: Position in the graph's order. A value can only be above values
+ *     after it, which catches different pairs to levels
+ *   intervals: GRAIL labels, https://doi.org/10.14778/1920841.1920879. Each of
+ *     k randomised depth first traversals down the graph numbers values in post
+ *     order, and gives each value the range from the lowest number below it to
+ *     its own. Anything below a value has its range inside the value's range, so
+ *     a range outside it in any traversal rules the pair out
+ *   subtrees: Values below a value in a traversal's spanning tree are numbered
+ *     in one block just before it, so one inside that block is definitely below
+ *   landmarks: A few well connected values, and for each value which of them are
+ *     above and below it. A landmark below one value and above another means
+ *     there's a path between them. Otherwise, a value can only be above another
+ *     if it's above all the same landmarks and below all the same landmarks
+ *
+ * Queries the filters can't answer fall back to a depth first search that skips
+ *   anything the filters rule out
+ *
+ * Small graphs get the whole transitive closure as a bit matrix instead, so every
+ *   query is one bit
+ *
+ * The index describes the graph as it was when built; rebuild after changing it
+ */
+
+#ifndef REACH_H
+#define REACH_H
+
+#include <stdint.h>
+
+#include "graph.h"
+
+// Traversals used when g_reach is given 0 or less
+#define REACH_TRAVERSALS 3
+// Graphs with up to this many ids get a bit matrix, 2MB at the limit
+#define REACH_CLOSURE_LIMIT 4096
+// Number of landmarks, one bit each in a word per value
+#define REACH_LANDMARKS 64
+
+/* struct: Reach
+ *
+ * Result of g_reach, query with ri_above and free with ri_free
+ *
+ * Queries use scratch space in the index, so it can't be queried from more than
+ *   one thread at a time
+ *
+ * length: Number of ids covered, values added since aren't
+ * traversals: Number of traversals
+ * level: Level of each id, or -1 for ids without a value
+ * position: Position of each id in the graph's order
+ * labels: For each id, traversals groups of three: post order number, lowest
+ *   number below, and start of its spanning subtree
+ * above: Mask of the landmarks each id is, or is below
+ * below: Mask of the landmarks each id is, or is above
+ * start: Start of each id's lower relations in lower, length + 1 entries
+ * lower: Ids of lower values
+ * closure: Bit matrix with bit j of row i set if i is above j, rows of words
+ *   words each, or NULL if the graph is too big
+ * words: Number of 64-bit words in each closure row
+ * seen: Search stamp of each id
+ * stamp: Current search stamp
+ * stack: Search stack, room for every id
+ * queries: Number of queries answered
+ * searches: Number of queries that needed a search
+ */
+typedef struct reach {
+    unsigned int length;
+    int traversals;
+    int *level;
+    uint32_t *position;
+    uint32_t *labels;
+    uint64_t *above;
+    uint64_t *below;
+    uint32_t *start;
+    uint32_t *lower;
+    uint64_t *closure;
+    uint32_t words;
+    uint32_t *seen;
+    uint32_t stamp;
+    uint32_t *stack;
+    unsigned long queries;
+    unsigned long searches;
+} Reach;
+
+/* function: g_reach(Graph *graph, int traversals)
+ *
+ * Build a reachability index for a graph with traversals randomised traversals,
+ *   or REACH_TRAVERSALS if 0 or less. More traversals rule out more pairs
+ *   without a search, for 12 bytes per value each. Takes 36 bytes per value plus
+ *   4 per relation on top
+ *
+ * Returns the index, or NULL if out of memory
+ */
+Reach *g_reach(Graph *graph, int traversals);
+
+/* function: ri_above(Reach *reach, Value *higher, Value *lower)
+ *
+ * Check whether higher is above lower through any chain of relations
+ *
+ * Returns 1 if it is, 0 if not or either value is newer than the index
+ */
+int ri_above(Reach *reach, Value *higher, Value *lower);
+
+/* function: ri_free(Reach *reach)
+ *
+ * Free an index from g_reach
+ */
+void ri_free(Reach *reach);
+
+#endif
@@ -0,0 +1,215 @@
+/* Transitive reduction
+ *
+ * Bit-parallel over blocks of 64 values in sorted order, visiting only what each
+ *   block reaches
+ *
+ * Everything works on positions in the order rather than values, with the relations
+ *   copied into rows by position, so the frontier moves through memory in order
+ */
+
+#include <malloc.h>
+#include <stdint.h>
+
+#include "reduce.h"
+#include "dbg.h"
+
+// Values per block, one bit each
+#define REDUCE_BLOCK 64
+
+// State shared by every block
+//
+// order: Values in sorted order
+// start: Start of each position's lower relations in lower, one more than order
+// lower: Positions of lower values
+// any: For each position, block values with a path to it
+// longer: For each position, block values with a path of two or more relations to it
+// heap: Frontier of positions still to visit, smallest first
+// heap_length: Number of positions in heap
+// visited: Positions visited by the current block, so only their masks need clearing
+// visited_length: Number of positions in visited
+// implied: Implied relations found in the current block, greater then lesser
+typedef struct reduce {
+    Value **order;
+    uint32_t *start;
+    uint32_t *lower;
+    uint64_t *any;
+    uint64_t *longer;
+    uint32_t *heap;
+    uint32_t heap_length;
+    uint32_t *visited;
+    uint32_t visited_length;
+    Vector implied;
+} Reduce;
+
+// Add a position to the frontier
+static void rd_push(Reduce *reduce, uint32_t position)
+{
+    uint32_t *heap = reduce->heap;
+    uint32_t i = reduce->heap_length++;
+
+    while(i && heap[(i - 1) / 2] > position) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = position;
+}
+
+// Take the smallest position off the frontier
+static uint32_t rd_pop(Reduce *reduce)
+{
+    uint32_t *heap = reduce->heap;
+    uint32_t top = heap[0];
+    uint32_t last = heap[--reduce->heap_length];
+    uint32_t length = reduce->heap_length;
+    uint32_t i = 0;
+
+    while(2 * i + 1 < length) {
+        uint32_t child = 2 * i + 1;
+        if(child + 1 < length && heap[child + 1] < heap[child]) child++;
+        if(heap[child] >= last) break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+    if(length) heap[i] = last;
+
+    return top;
+}
+
+// Find the implied relations of the block starting at first
+// Returns 1 if out of memory
+static int rd_block(Reduce *reduce, uint32_t first, uint32_t count)
+{
+    uint32_t last = first + count;
+
+    // nothing past the furthest relation of the block matters
+    uint32_t limit = first;
+    for(uint32_t i = reduce->start[first]; i < reduce->start[last]; i++) {
+        if(reduce->lower[i] > limit) limit = reduce->lower[i];
+    }
+
+    // block values start on the frontier whether anything reaches them or not
+    reduce->heap_length = 0;
+    reduce->visited_length = 0;
+    for(uint32_t p = first; p < last; p++) rd_push(reduce, p);
+
+    while(reduce->heap_length) {
+        uint32_t p = rd_pop(reduce);
+        uint64_t any = reduce->any[p];
+        uint64_t spread = any | (p < last ? UINT64_C(1) << (p - first) : 0);
+        reduce->visited[reduce->visited_length++] = p;
+
+        for(uint32_t i = reduce->start[p]; i < reduce->start[p + 1]; i++) {
+            uint32_t lower = reduce->lower[i];
+            if(lower > limit) continue;
+
+            // block values are already on the frontier, anything else is added the
+            //   first time it's reached
+            if(lower >= last && !reduce->any[lower]) rd_push(reduce, lower);
+            reduce->any[lower] |= spread;
+            reduce->longer[lower] |= any;
+        }
+    }
+
+    int rc = 0;
+    for(uint32_t p = first; p < last && !rc; p++) {
+        uint64_t bit = UINT64_C(1) << (p - first);
+
+        for(uint32_t i = reduce->start[p]; i < reduce->start[p + 1] && !rc; i++) {
+            if(!(reduce->longer[reduce->lower[i]] & bit)) continue;
+
+            rc = v_push(&reduce->implied, reduce->order[p]) || v_push(&reduce->implied, reduce->order[reduce->lower[i]]);
+        }
+    }
+
+    // everything reached was visited, so that's every mask that was set
+    for(uint32_t i = 0; i < reduce->visited_length; i++) {
+        reduce->any[reduce->visited[i]] = 0;
+        reduce->longer[reduce->visited[i]] = 0;
+    }
+
+    return rc;
+}
+
+// Copy the relations into rows by position
+// Returns 1 if out of memory
+static int rd_rows(Reduce *reduce, Graph *graph, uint32_t length, uint32_t *position)
+{
+    uint32_t total = 0;
+    for(uint32_t p = 0; p < length; p++) {
+        reduce->start[p] = total;
+        total += (uint32_t)g_degree(graph, reduce->order[p], DIR_LOWER);
+    }
+    reduce->start[length] = total;
+
+    reduce->lower = malloc(sizeof(uint32_t) * (total ? total : 1));
+    if(!reduce->lower) return 1;
+
+    for(uint32_t p = 0; p < length; p++) {
+        Value *value = reduce->order[p];
+        int degree = g_degree(graph, value, DIR_LOWER);
+        for(int i = 0; i < degree; i++) {
+            reduce->lower[reduce->start[p] + (uint32_t)i] = position[g_relation(graph, value, DIR_LOWER, i)->index];
+        }
+    }
+
+    return 0;
+}
+
+int g_transitive_reduce(Graph *graph, unsigned long *removed)
+{
+    uint32_t length = (uint32_t)graph->length;
+    size_t ids = graph->pool->length ? graph->pool->length : 1;
+    unsigned long count = 0;
+    int rc = ERR_OUT_OF_MEMORY;
+
+    size_t size = length ? length : 1;
+    uint32_t *position = malloc(sizeof(uint32_t) * ids);
+    Reduce reduce = { NULL, NULL, NULL, NULL, NULL, NULL, 0, NULL, 0, { NULL, 0, 0 } };
+    reduce.order = malloc(sizeof(Value *) * size);
+    reduce.start = malloc(sizeof(uint32_t) * (size + 1));
+    reduce.any = calloc(size, sizeof(uint64_t));
+    reduce.longer = calloc(size, sizeof(uint64_t));
+    reduce.heap = malloc(sizeof(uint32_t) * size);
+    reduce.visited = malloc(sizeof(uint32_t) * size);
+    check_mem(position && reduce.order && reduce.start && reduce.any && reduce.longer && reduce.heap && reduce.visited);
+
+    uint32_t p = 0;
+    for(Value *value = graph->start; value; value = value->next, p++) {
+        reduce.order[p] = value;
+        position[value->index] = p;
+    }
+
+    check_mem(!rd_rows(&reduce, graph, length, position));
+    free(position);
+    position = NULL;
+
+    // the rows keep implied relations after they're removed from the graph, which
+    //   only costs a little time as they don't change what's reachable
+    for(uint32_t first = 0; first < length; first += REDUCE_BLOCK) {
+        uint32_t block = length - first < REDUCE_BLOCK ? length - first : REDUCE_BLOCK;
+
+        check_mem(!rd_block(&reduce, first, block));
+
+        for(int i = 0; i < reduce.implied.length; i += 2) {
+            g_remove_relation_v(graph, reduce.implied.items[i], reduce.implied.items[i + 1]);
+        }
+        count += (unsigned long)reduce.implied.length / 2;
+        reduce.implied.length = 0;
+    }
+
+    rc = g_freeze(graph);
+
+error:
+    if(removed) *removed = count;
+    free(position);
+    free(reduce.order);
+    free(reduce.start);
+    free(reduce.lower);
+    free(reduce.any);
+    free(reduce.longer);
+    free(reduce.heap);
+    free(reduce.visited);
+    free(reduce.implied.items);
+    return rc;
+}
@@ -0,0 +1,32 @@
+/* Transitive reduction
+ *
+ * Removes every relation that's implied by a longer path, e.g. a > c when there's
+ *   also a > b and b > c. What's above what doesn't change, and neither does the
+ *   order, but there are fewer relations to store and walk
+ *
+ * Values are taken 64 at a time in sorted order. Each value in a block gets a bit,
+ *   and masks of which block values reach each value are passed down in order,
+ *   both for any path and for paths of at least two relations. A relation from a
+ *   block value to one whose second mask has its bit is implied. Only values the
+ *   block reaches are visited, through a frontier kept in order, and only as far
+ *   as the block's furthest relation. So it's O(V + E) per block when relations
+ *   are all short, and much less when little is reachable
+ */
+
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include "graph.h"
+
+/* function: g_transitive_reduce(Graph *graph, unsigned long *removed)
+ *
+ * Remove every relation implied by other relations, then freeze the graph so the
+ *   space they took is given back. removed is set to the number of relations
+ *   removed if it's not NULL
+ *
+ * Returns 0 on success or ERR_OUT_OF_MEMORY. If it runs out of memory part way
+ *   through, some implied relations may be left, but the graph is still valid
+ */
+int g_transitive_reduce(Graph *graph, unsigned long *removed);
+
+#endif
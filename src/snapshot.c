@@ -0,0 +1,304 @@
+/* Binary graph snapshots
+ *
+ * Written by mapping a file of the right size read-write and filling in the
+ *   sections in place, so a snapshot is never held in memory twice
+ */
+
+#include <fcntl.h>
+#include <malloc.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+#include "graph.h"
+#include "hash.h"
+#include "dbg.h"
+
+#define SNAPSHOT_MAGIC "DAGSNAP"
+#define SNAPSHOT_ENDIAN UINT32_C(0x01020304)
+// Suffix of the file written before it's moved into place
+#define SNAPSHOT_TEMP ".tmp"
+
+// Round up to a multiple of 8
+static uint64_t sn_align(uint64_t offset)
+{
+    return (offset + 7) & ~UINT64_C(7);
+}
+
+// Point the section arrays into the mapping
+static void sn_sections(Snapshot *snapshot)
+{
+    char *base = snapshot->mapping;
+    SnapshotHeader *header = snapshot->mapping;
+
+    snapshot->header = header;
+    snapshot->length = header->length;
+    snapshot->relations = header->relations;
+    snapshot->name_starts = (uint64_t *)(void *)(base + header->name_starts);
+    snapshot->hashes = (uint64_t *)(void *)(base + header->hashes);
+    snapshot->higher_start = (uint32_t *)(void *)(base + header->higher_start);
+    snapshot->higher = (uint32_t *)(void *)(base + header->higher);
+    snapshot->lower_start = (uint32_t *)(void *)(base + header->lower_start);
+    snapshot->lower = (uint32_t *)(void *)(base + header->lower);
+    snapshot->table = (uint32_t *)(void *)(base + header->table);
+    snapshot->names = base + header->names;
+}
+
+// Work out where each section goes for a header with its counts filled in
+static void sn_layout(SnapshotHeader *header)
+{
+    uint64_t offset = sn_align(sizeof(SnapshotHeader));
+    uint64_t length = header->length;
+    uint64_t relations = header->relations;
+
+    header->name_starts = offset;
+    offset = sn_align(offset + sizeof(uint64_t) * (length + 1));
+    header->hashes = offset;
+    offset = sn_align(offset + sizeof(uint64_t) * length);
+    header->higher_start = offset;
+    offset = sn_align(offset + sizeof(uint32_t) * (length + 1));
+    header->higher = offset;
+    offset = sn_align(offset + sizeof(uint32_t) * relations);
+    header->lower_start = offset;
+    offset = sn_align(offset + sizeof(uint32_t) * (length + 1));
+    header->lower = offset;
+    offset = sn_align(offset + sizeof(uint32_t) * relations);
+    header->table = offset;
+    offset = sn_align(offset + sizeof(uint32_t) * header->table_size);
+    header->names = offset;
+    header->size = offset + header->names_size;
+}
+
+// Checksum a whole snapshot, counting the checksum field as 0
+static uint64_t sn_checksum(Snapshot *snapshot)
+{
+    SnapshotHeader header = *snapshot->header;
+    header.checksum = 0;
+
+    uint64_t parts[2] = {
+        hash_n((const char *)&header, sizeof(header)),
+        hash_n((const char *)snapshot->mapping + sizeof(header), snapshot->size - sizeof(header)),
+    };
+    return hash_n((const char *)parts, sizeof(parts));
+}
+
+// Check a mapped header describes a snapshot that fits in size bytes
+static int sn_valid(SnapshotHeader *header, size_t size)
+{
+    if(size < sizeof(SnapshotHeader)) return 0;
+    if(memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) return 0;
+    if(header->endian != SNAPSHOT_ENDIAN || header->version != SNAPSHOT_VERSION) return 0;
+    if(header->size != size) return 0;
+
+    // the table has to have empty slots, or lookups of missing names never end
+    uint32_t table_size = header->table_size;
+    if(!table_size || (table_size & (table_size - 1)) || table_size <= header->length) return 0;
+
+    // laying it out again has to give the same sections, so they're all in bounds
+    SnapshotHeader expected = *header;
+    sn_layout(&expected);
+    return memcmp(&expected, header, sizeof(SnapshotHeader)) == 0;
+}
+
+Snapshot *sn_open(const char *path, int verify)
+{
+    Snapshot *snapshot = NULL;
+    struct stat info;
+    void *mapping = MAP_FAILED;
+
+    int fd = open(path, O_RDONLY);
+    check(fd != -1, "Could not open %s", path);
+    check(fstat(fd, &info) == 0, "Could not stat %s", path);
+    check((size_t)info.st_size >= sizeof(SnapshotHeader), "%s is too small to be a snapshot", path);
+
+    mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    check(mapping != MAP_FAILED, "Could not map %s", path);
+    close(fd);
+    fd = -1;
+
+    snapshot = calloc(1, sizeof(Snapshot));
+    check_mem(snapshot);
+    snapshot->mapping = mapping;
+    snapshot->size = (size_t)info.st_size;
+    snapshot->fd = -1;
+
+    check(sn_valid(mapping, snapshot->size), "%s is not a valid snapshot", path);
+    sn_sections(snapshot);
+    check(!verify || sn_checksum(snapshot) == snapshot->header->checksum, "Checksum of %s doesn't match", path);
+
+    return snapshot;
+
+error:
+    if(fd != -1) close(fd);
+    if(mapping != MAP_FAILED) munmap(mapping, (size_t)info.st_size);
+    free(snapshot);
+    return NULL;
+}
+
+Snapshot *sn_create(const char *path, uint32_t length, uint32_t relations, uint64_t names_size)
+{
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.endian = SNAPSHOT_ENDIAN;
+    header.length = length;
+    header.relations = relations;
+    header.names_size = names_size;
+
+    // at most half full, like pools
+    header.table_size = 16;
+    while(header.table_size < (uint64_t)length * 2) header.table_size *= 2;
+    sn_layout(&header);
+
+    int fd = -1;
+    void *mapping = MAP_FAILED;
+    Snapshot *snapshot = calloc(1, sizeof(Snapshot));
+    check_mem(snapshot);
+    snapshot->fd = -1;
+
+    // anonymous memory starts zeroed too, so the table's empty as in a fresh file
+    if(!path) {
+        mapping = mmap(NULL, header.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        check_mem(mapping != MAP_FAILED);
+        goto mapped;
+    }
+
+    size_t path_length = strlen(path);
+    snapshot->path = malloc(path_length + 1);
+    snapshot->temp = malloc(path_length + sizeof(SNAPSHOT_TEMP));
+    check_mem(snapshot->path && snapshot->temp);
+    memcpy(snapshot->path, path, path_length + 1);
+    memcpy(snapshot->temp, path, path_length);
+    memcpy(snapshot->temp + path_length, SNAPSHOT_TEMP, sizeof(SNAPSHOT_TEMP));
+
+    fd = open(snapshot->temp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    check(fd != -1, "Could not create %s", snapshot->temp);
+    check(ftruncate(fd, (off_t)header.size) == 0, "Could not size %s", snapshot->temp);
+
+    mapping = mmap(NULL, header.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    check(mapping != MAP_FAILED, "Could not map %s", snapshot->temp);
+    snapshot->fd = fd;
+
+mapped:
+    snapshot->mapping = mapping;
+    snapshot->size = header.size;
+    memcpy(mapping, &header, sizeof(header));
+    sn_sections(snapshot);
+    return snapshot;
+
+error:
+    if(fd != -1) {
+        close(fd);
+        unlink(snapshot->temp);
+    }
+    if(snapshot) {
+        free(snapshot->path);
+        free(snapshot->temp);
+        free(snapshot);
+    }
+    return NULL;
+}
+
+int sn_sync_dir(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    size_t length = slash ? (size_t)(slash - path) : 1;
+    if(slash == path) length = 1;
+
+    char *dir = malloc(length + 1);
+    if(!dir) return -1;
+    memcpy(dir, slash ? path : ".", length);
+    dir[length] = '\0';
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    free(dir);
+    if(fd == -1) return -1;
+
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+int sn_commit(Snapshot *snapshot)
+{
+    uint32_t mask = snapshot->header->table_size - 1;
+
+    // the file is fresh, so the table starts out zeroed
+    for(uint32_t id = 0; id < snapshot->length; id++) {
+        uint32_t i = (uint32_t)snapshot->hashes[id] & mask;
+        while(snapshot->table[i]) i = (i + 1) & mask;
+        snapshot->table[i] = id + 1;
+    }
+
+    // in memory, nowhere to write it
+    if(!snapshot->path) return 0;
+
+    snapshot->header->checksum = sn_checksum(snapshot);
+
+    // msync writes the pages, fsync the file's size too, both before the rename
+    //   so path is never a half written file
+    check(msync(snapshot->mapping, snapshot->size, MS_SYNC) == 0, "Could not write %s", snapshot->temp);
+    check(fsync(snapshot->fd) == 0, "Could not write %s", snapshot->temp);
+    check(rename(snapshot->temp, snapshot->path) == 0, "Could not move %s into place", snapshot->temp);
+    check(sn_sync_dir(snapshot->path) == 0, "Could not write the directory of %s", snapshot->path);
+
+    // written, nothing for sn_close to remove
+    close(snapshot->fd);
+    free(snapshot->path);
+    free(snapshot->temp);
+    snapshot->fd = -1;
+    snapshot->path = NULL;
+    snapshot->temp = NULL;
+    return 0;
+
+error:
+    return -1;
+}
+
+uint32_t sn_find(Snapshot *snapshot, const char *str, size_t length)
+{
+    uint64_t hash = hash_n(str, length);
+    uint32_t mask = snapshot->header->table_size - 1;
+
+    for(uint32_t i = (uint32_t)hash & mask; snapshot->table[i]; i = (i + 1) & mask) {
+        uint32_t id = snapshot->table[i] - 1;
+        if(snapshot->hashes[id] != hash) continue;
+
+        const char *name = sn_name(snapshot, id);
+        if(memcmp(name, str, length) == 0 && name[length] == '\0') return id;
+    }
+
+    return SNAPSHOT_NONE;
+}
+
+const char *sn_name(Snapshot *snapshot, uint32_t id)
+{
+    return snapshot->names + snapshot->name_starts[id];
+}
+
+uint32_t sn_degree(Snapshot *snapshot, uint32_t id, int direction)
+{
+    uint32_t *start = direction == DIR_HIGHER ? snapshot->higher_start : snapshot->lower_start;
+    return start[id + 1] - start[id];
+}
+
+const uint32_t *sn_relations(Snapshot *snapshot, uint32_t id, int direction)
+{
+    if(direction == DIR_HIGHER) return snapshot->higher + snapshot->higher_start[id];
+    return snapshot->lower + snapshot->lower_start[id];
+}
+
+void sn_close(Snapshot *snapshot)
+{
+    munmap(snapshot->mapping, snapshot->size);
+    if(snapshot->fd != -1) close(snapshot->fd);
+
+    // never committed, so don't leave half a snapshot lying around
+    if(snapshot->temp) unlink(snapshot->temp);
+    free(snapshot->path);
+    free(snapshot->temp);
+    free(snapshot);
+}
@@ -0,0 +1,191 @@
+/* Binary graph snapshots
+ *
+ * A snapshot holds a whole graph in one file laid out so it can be mapped into
+ *   memory and used as it is, with nothing to parse or rebuild:
+ *
+ *   header: Magic, version, byte order, checksum and where each section is
+ *   name_starts: Offset of each value's name in names, length + 1 entries
+ *   hashes: Hash of each name
+ *   higher_start, higher: Higher relations in compressed sparse rows (see Frozen)
+ *   lower_start, lower: Lower relations, as above
+ *   table: Open-addressing table of id + 1 by hash, for finding names
+ *   names: Every name, null-terminated, one after another
+ *
+ * Values are numbered in sorted order, so the order is stored by the ids
+ *   themselves: id a comes before id b exactly when a < b
+ *
+ * Every section starts on an 8-byte boundary. Numbers are stored in the byte
+ *   order of the machine that wrote the file, and files from the other byte
+ *   order are rejected
+ *
+ * Write with g_save and read back into a graph with g_load, or open read-only
+ *   with sn_open. g_snapshot builds the same layout in memory instead, to hand
+ *   to readers on other threads (see publish.h)
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Version written by this code; files with any other version are rejected
+#define SNAPSHOT_VERSION 1
+
+// Returned in place of an id when a name isn't in a snapshot
+#define SNAPSHOT_NONE ((uint32_t)-1)
+
+/* struct: SnapshotHeader
+ *
+ * Start of every snapshot file. Avoid using directly
+ *
+ * magic: "DAGSNAP" and a null byte
+ * version: SNAPSHOT_VERSION
+ * endian: 0x01020304 as written by the machine that made the file
+ * checksum: hash_n of the whole file, with this field as 0
+ * size: Size of the whole file in bytes
+ * length: Number of values
+ * relations: Number of relations
+ * table_size: Number of slots in table, a power of two
+ * reserved: Always 0
+ * names_size: Size of names in bytes
+ * name_starts ... names: Offset of each section from the start of the file
+ */
+typedef struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint64_t checksum;
+    uint64_t size;
+    uint32_t length;
+    uint32_t relations;
+    uint32_t table_size;
+    uint32_t reserved;
+    uint64_t names_size;
+    uint64_t name_starts;
+    uint64_t hashes;
+    uint64_t higher_start;
+    uint64_t higher;
+    uint64_t lower_start;
+    uint64_t lower;
+    uint64_t table;
+    uint64_t names;
+} SnapshotHeader;
+
+/* struct: Snapshot
+ *
+ * Snapshot mapped into memory. Create with sn_open (or sn_create to write one)
+ *   and operate with sn_* functions
+ *
+ * The arrays point straight into the mapping; see the description of each
+ *   section above
+ *
+ * mapping: Mapping of the file
+ * size: Size of the mapping
+ * header: Header at the start of the mapping
+ * length: Number of values
+ * relations: Number of relations
+ * path: Where the file goes once written, NULL when opened for reading or
+ *   built in memory
+ * temp: File being written, renamed to path by sn_commit
+ * fd: temp, kept open for sn_commit to sync, -1 otherwise
+ */
+typedef struct snapshot {
+    void *mapping;
+    size_t size;
+    SnapshotHeader *header;
+    uint32_t length;
+    uint32_t relations;
+    uint64_t *name_starts;
+    uint64_t *hashes;
+    uint32_t *higher_start;
+    uint32_t *higher;
+    uint32_t *lower_start;
+    uint32_t *lower;
+    uint32_t *table;
+    char *names;
+    char *path;
+    char *temp;
+    int fd;
+} Snapshot;
+
+/* function: sn_open(const char *path, int verify)
+ *
+ * Map a snapshot read-only. The header and section bounds are always checked;
+ *   if verify is set the checksum is too, which means reading the whole file
+ *
+ * Without verify, opening only touches the header, and the rest is paged in as
+ *   it's used
+ *
+ * Returns the snapshot, or NULL if it can't be read or isn't a valid snapshot
+ */
+Snapshot *sn_open(const char *path, int verify);
+
+/* function: sn_create(const char *path, uint32_t length, uint32_t relations, uint64_t names_size)
+ *
+ * Start writing a snapshot with room for length values, relations relations and
+ *   names_size bytes of names. The file is written next to path and only
+ *   replaces it when sn_commit succeeds
+ *
+ * If path is NULL the snapshot is built in anonymous memory instead, and gone
+ *   once it's closed
+ *
+ * Fill in every section then call sn_commit, or sn_close to give up
+ *
+ * Returns the snapshot, or NULL if the file can't be made
+ */
+Snapshot *sn_create(const char *path, uint32_t length, uint32_t relations, uint64_t names_size);
+
+/* function: sn_commit(Snapshot *snapshot)
+ *
+ * Finish writing a snapshot: build its table from hashes, checksum it, flush it
+ *   to disk and move it into place, syncing the directory so the rename is on
+ *   disk too before this returns. One built in memory only gets its table, and
+ *   isn't checksummed
+ *
+ * Returns 0 on success or -1 if the file couldn't be written
+ */
+int sn_commit(Snapshot *snapshot);
+
+/* function: sn_find(Snapshot *snapshot, const char *str, size_t length)
+ *
+ * Find the id of a name, given as length bytes of str
+ *
+ * Returns the id or SNAPSHOT_NONE if not found
+ */
+uint32_t sn_find(Snapshot *snapshot, const char *str, size_t length);
+
+/* function: sn_name(Snapshot *snapshot, uint32_t id)
+ *
+ * Get the null-terminated name of a value
+ */
+const char *sn_name(Snapshot *snapshot, uint32_t id);
+
+/* function: sn_degree(Snapshot *snapshot, uint32_t id, int direction)
+ *
+ * Get the number of direct relations of a value in one direction (DIR_HIGHER or DIR_LOWER)
+ */
+uint32_t sn_degree(Snapshot *snapshot, uint32_t id, int direction);
+
+/* function: sn_relations(Snapshot *snapshot, uint32_t id, int direction)
+ *
+ * Get the ids of a value's direct relations in one direction, sn_degree of them
+ */
+const uint32_t *sn_relations(Snapshot *snapshot, uint32_t id, int direction);
+
+/* function: sn_sync_dir(const char *path)
+ *
+ * Sync the directory holding path, so a file just created or renamed there is
+ *   still there after a crash
+ *
+ * Returns 0 on success or -1 if the directory can't be opened or synced
+ */
+int sn_sync_dir(const char *path);
+
+/* function: sn_close(Snapshot *snapshot)
+ *
+ * Unmap a snapshot. If it was being written and not committed, the file is removed
+ */
+void sn_close(Snapshot *snapshot);
+
+#endif
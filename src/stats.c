@@ -0,0 +1,74 @@
+/* Operation counters
+ *
+ * Latencies go in power-of-two buckets, so recording one is a clock read and a
+ *   count of leading zeros
+ */
+
+#include <time.h>
+
+#include "stats.h"
+
+uint64_t st_now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+}
+
+void st_latency(Stats *stats, uint64_t ns)
+{
+    // number of bits in ns, so 2^(n - 1) to 2^n - 1 is bucket n
+    int bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+    if(bucket >= STATS_BUCKETS) bucket = STATS_BUCKETS - 1;
+
+    stats->latency[bucket]++;
+}
+
+uint64_t st_percentile(const Stats *stats, double percentile)
+{
+    unsigned long total = 0;
+    for(int i = 0; i < STATS_BUCKETS; i++) total += stats->latency[i];
+    if(!total) return 0;
+
+    // first bucket that takes the count past the percentile
+    double target = (double)total * percentile / 100.0;
+    unsigned long seen = 0;
+    int bucket = 0;
+    for(; bucket < STATS_BUCKETS - 1; bucket++) {
+        seen += stats->latency[bucket];
+        if((double)seen >= target && seen) break;
+    }
+
+    return bucket ? (UINT64_C(1) << bucket) - 1 : 0;
+}
+
+void st_print(const Stats *stats, FILE *out)
+{
+    if(!stats->enabled) {
+        fprintf(out, "Stats not counted, build with OPTFLAGS=-DGRAPH_STATS\n");
+        return;
+    }
+
+    fprintf(out, "Lookups: %lu finds\n", stats->finds);
+    fprintf(out, "Applies: %lu relations, p50 <= %llu ns, p99 <= %llu ns, p99.9 <= %llu ns\n", stats->applies,
+            (unsigned long long)st_percentile(stats, 50), (unsigned long long)st_percentile(stats, 99),
+            (unsigned long long)st_percentile(stats, 99.9));
+    fprintf(out, "Reorders: %lu, %lu values visited (%.1f each, %lu at most), %lu shifted\n", stats->resolves,
+            stats->visited, stats->resolves ? (double)stats->visited / (double)stats->resolves : 0.0,
+            stats->visited_max, stats->shifted);
+    fprintf(out, "Memory: %lu allocations of %lu bytes in all, %lu bytes reserved\n", stats->allocations,
+            stats->bytes, stats->reserved);
+
+    // only the buckets in use
+    int first = 0;
+    int last = STATS_BUCKETS - 1;
+    while(first < last && !stats->latency[first]) first++;
+    while(last > first && !stats->latency[last]) last--;
+    if(!stats->latency[first]) return;
+
+    fprintf(out, "Apply latency:\n");
+    for(int i = first; i <= last; i++) {
+        unsigned long long upper = i ? (1ULL << i) - 1 : 0;
+        fprintf(out, "  <= %12llu ns: %lu%s\n", upper, stats->latency[i], i == STATS_BUCKETS - 1 ? " or more" : "");
+    }
+}
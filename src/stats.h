@@ -0,0 +1,94 @@
+/* Operation counters
+ *
+ * Counts of what a graph has been doing: lookups, how much each reorder had to
+ *   search and move, allocations, and how long each relation took to apply
+ *
+ * Only counted when built with GRAPH_STATS defined, e.g. make OPTFLAGS=-DGRAPH_STATS.
+ *   Otherwise the STAT_* macros are empty and nothing extra runs on any path;
+ *   the counters are still there so the layout of Graph doesn't change, and
+ *   stay 0
+ *
+ * Get a graph's counters with g_stats and print them with st_print
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Latency buckets, bucket n counts calls taking 2^(n - 1) to 2^n - 1 ns, and
+//   bucket 0 calls under 1ns. The last bucket holds everything slower
+#define STATS_BUCKETS 40
+
+/* struct: Stats
+ *
+ * Counters for one graph since it was made or last reset
+ *
+ * enabled: 1 if counted, 0 if built without GRAPH_STATS
+ * finds: Values looked up by string or id, including by g_apply_relation
+ * applies: Calls to g_apply_relation or g_apply_relation_n
+ * resolves: Relations that went against the order, so needed a reorder
+ * visited: Values visited by reorder searches, both sides
+ * visited_max: Most values visited by one reorder
+ * shifted: Values moved by reorders
+ * allocations: Allocations from the graph's and its pool's arenas, which are
+ *   nearly all of them. Graphs from new_graph_malloc don't have arenas
+ * bytes: Bytes handed out by those allocations
+ * reserved: Bytes the arenas got from malloc to hand out
+ * latency: Histogram of g_apply_relation times in nanoseconds, see STATS_BUCKETS
+ */
+typedef struct stats {
+    int enabled;
+    unsigned long finds;
+    unsigned long applies;
+    unsigned long resolves;
+    unsigned long visited;
+    unsigned long visited_max;
+    unsigned long shifted;
+    unsigned long allocations;
+    unsigned long bytes;
+    unsigned long reserved;
+    unsigned long latency[STATS_BUCKETS];
+} Stats;
+
+#ifdef GRAPH_STATS
+#define STAT_ADD(stats, field, n) ((stats).field += (unsigned long)(n))
+#define STAT_MAX(stats, field, n) \
+    do { if((unsigned long)(n) > (stats).field) (stats).field = (unsigned long)(n); } while(0)
+#else
+// sizeof doesn't evaluate n, it only stops it looking unused
+#define STAT_ADD(stats, field, n) ((void)sizeof(n))
+#define STAT_MAX(stats, field, n) ((void)sizeof(n))
+#endif
+
+/* function: st_now()
+ *
+ * Get a monotonic time in nanoseconds, for timing with st_latency
+ */
+uint64_t st_now(void);
+
+/* function: st_latency(Stats *stats, uint64_t ns)
+ *
+ * Add a time in nanoseconds to the latency histogram
+ */
+void st_latency(Stats *stats, uint64_t ns);
+
+/* function: st_percentile(const Stats *stats, double percentile)
+ *
+ * Estimate a latency percentile, 0 to 100, from the histogram
+ *
+ * Returns the upper bound of the bucket it falls in, in nanoseconds, or 0 if
+ *   nothing's been timed
+ */
+uint64_t st_percentile(const Stats *stats, double percentile);
+
+/* function: st_print(const Stats *stats, FILE *out)
+ *
+ * Print a readable report of the counters
+ *
+ * Output subject to change
+ */
+void st_print(const Stats *stats, FILE *out);
+
+#endif
@@ -0,0 +1,677 @@
+/* Write-ahead log
+ *
+ * The file's only ever appended to between checkpoints, so a crash can only
+ *   leave the last frame short. Replay checks every frame before applying any
+ *   of it, so a frame is either replayed whole or not at all
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "wal.h"
+#include "hash.h"
+#include "pool.h"
+#include "dbg.h"
+
+#define WAL_MAGIC "DAGWAL\0"
+#define WAL_ENDIAN UINT32_C(0x01020304)
+// Length and checksum at the start of every frame
+#define WAL_FRAME 8
+#define WAL_INITIAL_SIZE 65536
+// Longest LEB128 encoding of a 64-bit number
+#define WAL_VARINT 10
+#define WAL_BATCH_INITIAL_SIZE 1024
+
+// One decoded record
+typedef struct record {
+    int type;
+    uint64_t first;
+    uint64_t second;
+    const char *name;
+} Record;
+
+// A relation read from the log, waiting to be applied with the rest at the end
+typedef struct pending {
+    unsigned int greater;
+    unsigned int lesser;
+    // earlier pending relation of greater and of lesser, index + 1 or 0 for none
+    unsigned int next[2];
+    // whether the relation's still to be added, and whether each value still has
+    //   to exist if it isn't
+    unsigned char related;
+    unsigned char exists[2];
+} Pending;
+
+// Relations read from the log, applied together once all of it's been read
+// table: Index + 1 of each pending relation by greater and lesser, 0 for empty
+// last: Index + 1 of the last pending relation of each pool id, 0 for none
+typedef struct replay {
+    Pending *pending;
+    int length;
+    int size;
+    unsigned int *table;
+    unsigned int table_size;
+    unsigned int *last;
+    unsigned int last_size;
+    unsigned int *pool_ids;
+    unsigned int names_size;
+} Replay;
+
+// Write all of data to the log
+static int wl_all(Wal *wal, const unsigned char *data, size_t length)
+{
+    while(length && !wal->failed) {
+        ssize_t written = write(wal->fd, data, length);
+
+        if(written < 0) {
+            if(errno == EINTR) continue;
+
+            log_err("Could not write log");
+            wal->failed = 1;
+            break;
+        }
+
+        data += written;
+        length -= (size_t)written;
+    }
+
+    return wal->failed ? ERR_IO : 0;
+}
+
+// Make room for more bytes in the frame being built
+static int wl_reserve(Wal *wal, size_t more)
+{
+    if(wal->size - wal->length >= more) return 0;
+
+    size_t size = wal->size * 2;
+    while(size - wal->length < more) size *= 2;
+
+    unsigned char *buffer = realloc(wal->buffer, size);
+    if(!buffer) return ERR_OUT_OF_MEMORY;
+
+    wal->buffer = buffer;
+    wal->size = size;
+    return 0;
+}
+
+// Add a number to the frame, room for it already reserved
+static void wl_varint(Wal *wal, uint64_t n)
+{
+    while(n >= 0x80) {
+        wal->buffer[wal->length++] = (unsigned char)(n | 0x80);
+        n >>= 7;
+    }
+    wal->buffer[wal->length++] = (unsigned char)n;
+}
+
+// Make room in ids for a pool id
+static int wl_grow_ids(Wal *wal, unsigned int pool_id)
+{
+    if(pool_id < wal->ids_size) return 0;
+
+    unsigned int size = wal->ids_size ? wal->ids_size : WAL_BATCH_INITIAL_SIZE;
+    while(size <= pool_id) size *= 2;
+
+    unsigned int *ids = realloc(wal->ids, sizeof(unsigned int) * size);
+    if(!ids) return ERR_OUT_OF_MEMORY;
+    memset(ids + wal->ids_size, 0, sizeof(unsigned int) * (size - wal->ids_size));
+
+    wal->ids = ids;
+    wal->ids_size = size;
+    return 0;
+}
+
+// Get the log id of a pool id, writing its name first if it's not in the log yet
+static int wl_id(Wal *wal, unsigned int pool_id, uint64_t *id)
+{
+    if(wl_grow_ids(wal, pool_id)) return ERR_OUT_OF_MEMORY;
+
+    if(!wal->ids[pool_id]) {
+        const char *name = p_string(wal->graph->pool, pool_id);
+        size_t length = strlen(name);
+        if(wl_reserve(wal, 1 + WAL_VARINT + length)) return ERR_OUT_OF_MEMORY;
+
+        wal->buffer[wal->length++] = WAL_NAME;
+        wl_varint(wal, length);
+        memcpy(wal->buffer + wal->length, name, length);
+        wal->length += length;
+        wal->ids[pool_id] = ++wal->names;
+    }
+
+    *id = wal->ids[pool_id] - 1;
+    return 0;
+}
+
+// Add a record of a change to the frame and commit if the group's full
+static int wl_log(Wal *wal, int type, unsigned int first, unsigned int second)
+{
+    uint64_t first_id = 0;
+    uint64_t second_id = 0;
+
+    if(wal->failed) return ERR_IO;
+    check(wl_id(wal, first, &first_id) == 0, "Out of memory logging a change");
+    check(type == WAL_REMOVE_VALUE || wl_id(wal, second, &second_id) == 0, "Out of memory logging a change");
+    check(wl_reserve(wal, 1 + WAL_VARINT * 2) == 0, "Out of memory logging a change");
+
+    wal->buffer[wal->length++] = (unsigned char)type;
+    wl_varint(wal, first_id);
+    if(type != WAL_REMOVE_VALUE) wl_varint(wal, second_id);
+
+    wal->pending++;
+    if(wal->group && wal->pending >= wal->group) return wl_commit(wal);
+    return 0;
+
+error:
+    // the graph has the change but the log doesn't, so anything logged after
+    //   would replay onto the wrong graph
+    wal->failed = 1;
+    return ERR_IO;
+}
+
+int wl_commit(Wal *wal)
+{
+    if(wal->failed) return ERR_IO;
+    if(wal->length == WAL_FRAME) return 0;
+
+    uint32_t header[2] = {
+        (uint32_t)(wal->length - WAL_FRAME),
+        (uint32_t)hash_n((const char *)wal->buffer + WAL_FRAME, wal->length - WAL_FRAME),
+    };
+    memcpy(wal->buffer, header, sizeof(header));
+
+    if(wl_all(wal, wal->buffer, wal->length)) return ERR_IO;
+    if(fdatasync(wal->fd)) {
+        log_err("Could not sync log");
+        wal->failed = 1;
+        return ERR_IO;
+    }
+
+    wal->length = WAL_FRAME;
+    wal->pending = 0;
+    wal->commits++;
+    return 0;
+}
+
+// Read a varint, returns the bytes it took or 0 if it runs off the end
+static size_t wl_read_varint(const unsigned char *data, size_t size, uint64_t *n)
+{
+    *n = 0;
+    for(size_t i = 0; i < size && i < WAL_VARINT; i++) {
+        *n |= (uint64_t)(data[i] & 0x7f) << (7 * i);
+        if(!(data[i] & 0x80)) return i + 1;
+    }
+
+    return 0;
+}
+
+// Read one record, returns the bytes it took or 0 if it isn't whole and valid
+static size_t wl_decode(const unsigned char *data, size_t size, Record *record)
+{
+    if(!size) return 0;
+
+    size_t used = 1;
+    size_t length = 0;
+    record->type = data[0];
+
+    if(!(length = wl_read_varint(data + used, size - used, &record->first))) return 0;
+    used += length;
+
+    switch(record->type) {
+    case WAL_NAME:
+        if(record->first > size - used) return 0;
+        record->name = (const char *)data + used;
+        return used + (size_t)record->first;
+    case WAL_APPLY:
+    case WAL_REMOVE:
+        if(!(length = wl_read_varint(data + used, size - used, &record->second))) return 0;
+        return used + length;
+    case WAL_REMOVE_VALUE:
+        return used;
+    default:
+        return 0;
+    }
+}
+
+// Check every record of a frame is whole and only uses names given before it
+static int wl_valid(const unsigned char *data, size_t size, unsigned int names)
+{
+    Record record;
+    uint64_t defined = names;
+
+    for(size_t used = 0, length = 0; used < size; used += length) {
+        if(!(length = wl_decode(data + used, size - used, &record))) return 0;
+
+        if(record.type == WAL_NAME) defined++;
+        else if(record.first >= defined) return 0;
+        else if(record.type != WAL_REMOVE_VALUE && record.second >= defined) return 0;
+    }
+
+    return 1;
+}
+
+// Slot of the table to start looking for greater > lesser in
+static unsigned int wl_slot(Replay *replay, unsigned int greater, unsigned int lesser)
+{
+    uint64_t key = ((uint64_t)greater << 32 | lesser) * UINT64_C(0x9e3779b97f4a7c15);
+    return (unsigned int)(key >> 32) & (replay->table_size - 1);
+}
+
+// Put a pending relation in the table, which has room for it
+static void wl_table_add(Replay *replay, unsigned int index)
+{
+    unsigned int mask = replay->table_size - 1;
+    unsigned int i = wl_slot(replay, replay->pending[index].greater, replay->pending[index].lesser);
+    while(replay->table[i]) i = (i + 1) & mask;
+    replay->table[i] = index + 1;
+}
+
+// Find greater > lesser if it's still to be added, NULL otherwise
+static Pending *wl_find(Replay *replay, unsigned int greater, unsigned int lesser)
+{
+    if(!replay->table_size) return NULL;
+
+    unsigned int mask = replay->table_size - 1;
+    for(unsigned int i = wl_slot(replay, greater, lesser); replay->table[i]; i = (i + 1) & mask) {
+        Pending *pending = &replay->pending[replay->table[i] - 1];
+        if(pending->related && pending->greater == greater && pending->lesser == lesser) return pending;
+    }
+
+    return NULL;
+}
+
+// Make room for one more pending relation, and in last for a pool id
+static int wl_grow_pending(Replay *replay, unsigned int pool_id)
+{
+    if(replay->length == replay->size) {
+        int size = replay->size ? replay->size * 2 : WAL_BATCH_INITIAL_SIZE;
+        Pending *pending = realloc(replay->pending, sizeof(Pending) * (size_t)size);
+        if(!pending) return ERR_OUT_OF_MEMORY;
+        replay->pending = pending;
+        replay->size = size;
+    }
+
+    // at most half full, only keeping relations still to be added
+    if((unsigned int)(replay->length + 1) * 2 > replay->table_size) {
+        unsigned int size = replay->table_size ? replay->table_size * 2 : WAL_BATCH_INITIAL_SIZE * 2;
+        unsigned int *table = calloc(size, sizeof(unsigned int));
+        if(!table) return ERR_OUT_OF_MEMORY;
+
+        free(replay->table);
+        replay->table = table;
+        replay->table_size = size;
+        for(int i = 0; i < replay->length; i++) {
+            if(replay->pending[i].related) wl_table_add(replay, (unsigned int)i);
+        }
+    }
+
+    if(pool_id < replay->last_size) return 0;
+
+    unsigned int size = replay->last_size ? replay->last_size : WAL_BATCH_INITIAL_SIZE;
+    while(size <= pool_id) size *= 2;
+
+    unsigned int *last = realloc(replay->last, sizeof(unsigned int) * size);
+    if(!last) return ERR_OUT_OF_MEMORY;
+    memset(last + replay->last_size, 0, sizeof(unsigned int) * (size - replay->last_size));
+
+    replay->last = last;
+    replay->last_size = size;
+    return 0;
+}
+
+// Add greater > lesser to the relations waiting to be applied
+static int wl_pend(Replay *replay, unsigned int greater, unsigned int lesser)
+{
+    if(wl_grow_pending(replay, greater > lesser ? greater : lesser)) return ERR_OUT_OF_MEMORY;
+
+    unsigned int index = (unsigned int)replay->length++;
+    Pending *pending = &replay->pending[index];
+    pending->greater = greater;
+    pending->lesser = lesser;
+    pending->next[0] = replay->last[greater];
+    pending->next[1] = replay->last[lesser];
+    pending->related = 1;
+    pending->exists[0] = 1;
+    pending->exists[1] = 1;
+
+    replay->last[greater] = index + 1;
+    replay->last[lesser] = index + 1;
+    wl_table_add(replay, index);
+    return 0;
+}
+
+// Take a removed value out of every pending relation it's in
+static void wl_forget(Replay *replay, unsigned int pool_id)
+{
+    if(pool_id >= replay->last_size) return;
+
+    for(unsigned int i = replay->last[pool_id]; i;) {
+        Pending *pending = &replay->pending[i - 1];
+        int side = pending->greater == pool_id ? 0 : 1;
+
+        pending->related = 0;
+        pending->exists[side] = 0;
+        i = pending->next[side];
+    }
+    replay->last[pool_id] = 0;
+}
+
+// Apply the pending relations in one batch, along with the values of any taken
+//   back out before the end, which stay like they did when the log was written
+static int wl_flush(Wal *wal, Replay *replay)
+{
+    if(!replay->length) return 0;
+
+    size_t size = sizeof(unsigned int) * (size_t)replay->length * 2;
+    unsigned int *greater = malloc(size);
+    unsigned int *lesser = malloc(size);
+    int count = 0;
+    int rc = ERR_OUT_OF_MEMORY;
+    if(!greater || !lesser) goto end;
+
+    for(int i = 0; i < replay->length; i++) {
+        Pending *pending = &replay->pending[i];
+        if(pending->related) {
+            greater[count] = pending->greater;
+            lesser[count++] = pending->lesser;
+            continue;
+        }
+
+        if(pending->exists[0]) {
+            greater[count] = pending->greater;
+            lesser[count++] = POOL_NONE;
+        }
+        if(pending->exists[1]) {
+            greater[count] = pending->lesser;
+            lesser[count++] = POOL_NONE;
+        }
+    }
+
+    rc = g_apply_relations_ids(wal->graph, greater, lesser, count);
+    replay->length = 0;
+
+end:
+    free(greater);
+    free(lesser);
+    return rc;
+}
+
+// Replay one frame, already checked
+static int wl_frame(Wal *wal, Replay *replay, const unsigned char *data, size_t size)
+{
+    Record record;
+    Pool *pool = wal->graph->pool;
+
+    for(size_t used = 0, length = 0; used < size; used += length) {
+        length = wl_decode(data + used, size - used, &record);
+
+        if(record.type == WAL_NAME) {
+            if(wal->names == replay->names_size) {
+                unsigned int names_size = replay->names_size ? replay->names_size * 2 : WAL_BATCH_INITIAL_SIZE;
+                unsigned int *pool_ids = realloc(replay->pool_ids, sizeof(unsigned int) * names_size);
+                if(!pool_ids) return ERR_OUT_OF_MEMORY;
+                replay->pool_ids = pool_ids;
+                replay->names_size = names_size;
+            }
+
+            unsigned int id = p_intern(pool, record.name, (size_t)record.first);
+            if(id == POOL_NONE || wl_grow_ids(wal, id)) return ERR_OUT_OF_MEMORY;
+
+            // both ways, so appending carries on with the same ids
+            replay->pool_ids[wal->names] = id;
+            wal->ids[id] = ++wal->names;
+            continue;
+        }
+
+        unsigned int first = replay->pool_ids[record.first];
+        unsigned int second = record.type == WAL_REMOVE_VALUE ? 0 : replay->pool_ids[record.second];
+
+        if(record.type == WAL_APPLY) {
+            if(wl_pend(replay, first, second)) return ERR_OUT_OF_MEMORY;
+            continue;
+        }
+
+        // taking relations out never breaks the graph's order, so removals go
+        //   straight to the graph, cancelling anything pending they take out
+        int rc = 0;
+        if(record.type == WAL_REMOVE) {
+            Pending *pending = wl_find(replay, first, second);
+            if(pending) pending->related = 0;
+            else rc = g_remove_relation(wal->graph, p_string(pool, first), p_string(pool, second));
+        } else {
+            wl_forget(replay, first);
+            rc = g_remove_value(wal->graph, p_string(pool, first));
+        }
+        if(rc && rc != ERR_NOT_FOUND) return rc;
+    }
+
+    return 0;
+}
+
+// Replay every whole frame after the header, setting good to where the last one ends
+static int wl_replay(Wal *wal, const unsigned char *data, size_t size, size_t *good)
+{
+    Replay replay;
+    memset(&replay, 0, sizeof(replay));
+    size_t used = sizeof(WalHeader);
+    int rc = 0;
+
+    while(!rc && size - used >= WAL_FRAME) {
+        uint32_t header[2];
+        memcpy(header, data + used, sizeof(header));
+
+        const unsigned char *frame = data + used + WAL_FRAME;
+        if(header[0] > size - used - WAL_FRAME) break;
+        if(header[1] != (uint32_t)hash_n((const char *)frame, header[0])) break;
+        if(!wl_valid(frame, header[0], wal->names)) break;
+
+        rc = wl_frame(wal, &replay, frame, header[0]);
+        used += WAL_FRAME + header[0];
+    }
+
+    if(!rc) rc = wl_flush(wal, &replay);
+    *good = used;
+
+    free(replay.pending);
+    free(replay.table);
+    free(replay.last);
+    free(replay.pool_ids);
+    return rc;
+}
+
+// Empty the log and start it again on top of the snapshot with checksum base
+static int wl_reset(Wal *wal, uint64_t base)
+{
+    WalHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, WAL_MAGIC, sizeof(header.magic));
+    header.version = WAL_VERSION;
+    header.endian = WAL_ENDIAN;
+    header.base = base;
+
+    // a crash part way leaves a log too short for a header, which is the same as none
+    if(ftruncate(wal->fd, 0) || lseek(wal->fd, 0, SEEK_SET)) return ERR_IO;
+    if(wl_all(wal, (const unsigned char *)&header, sizeof(header))) return ERR_IO;
+    if(fdatasync(wal->fd)) return ERR_IO;
+
+    if(wal->ids) memset(wal->ids, 0, sizeof(unsigned int) * wal->ids_size);
+    wal->names = 0;
+    wal->length = WAL_FRAME;
+    wal->pending = 0;
+    return 0;
+}
+
+// Start a log that's new or from before the snapshot, syncing its directory as
+//   well so the file itself is still there after a crash
+static int wl_create(Wal *wal, const char *path, uint64_t base)
+{
+    if(wl_reset(wal, base)) return ERR_IO;
+    check(sn_sync_dir(path) == 0, "Could not write the directory of %s", path);
+    return 0;
+
+error:
+    return ERR_IO;
+}
+
+// Open the log file, replaying it if it's for the snapshot with checksum base
+static int wl_start(Wal *wal, const char *path, uint64_t base, int loaded)
+{
+    struct stat info;
+    void *mapping = MAP_FAILED;
+    size_t size = 0;
+    int rc = ERR_IO;
+
+    wal->fd = open(path, O_RDWR | O_CREAT, 0644);
+    check(wal->fd != -1, "Could not open %s", path);
+    check(fstat(wal->fd, &info) == 0, "Could not stat %s", path);
+    size = (size_t)info.st_size;
+
+    if(size < sizeof(WalHeader)) return wl_create(wal, path, base);
+
+    mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, wal->fd, 0);
+    check(mapping != MAP_FAILED, "Could not map %s", path);
+
+    WalHeader *header = mapping;
+    check(memcmp(header->magic, WAL_MAGIC, sizeof(header->magic)) == 0 && header->version == WAL_VERSION &&
+            header->endian == WAL_ENDIAN, "%s is not a valid log", path);
+    check(loaded || !header->base, "%s needs a snapshot that isn't there", path);
+
+    if(header->base != base) {
+        log_warn("Log %s is from before the snapshot, starting it again", path);
+        munmap(mapping, size);
+        return wl_create(wal, path, base);
+    }
+
+    size_t good = 0;
+    rc = wl_replay(wal, mapping, size, &good);
+    check(!rc, "Could not replay %s", path);
+
+    rc = ERR_IO;
+    if(good < size) {
+        log_warn("Log %s ends in a torn frame, cutting off %zu bytes", path, size - good);
+        check(ftruncate(wal->fd, (off_t)good) == 0 && fdatasync(wal->fd) == 0, "Could not cut back %s", path);
+    }
+    check(lseek(wal->fd, 0, SEEK_END) != -1, "Could not seek %s", path);
+
+    munmap(mapping, size);
+    return 0;
+
+error:
+    if(mapping != MAP_FAILED) munmap(mapping, size);
+    return rc ? rc : ERR_IO;
+}
+
+Wal *wl_open(const char *path, const char *snapshot, int group)
+{
+    uint64_t base = 0;
+    int loaded = 0;
+
+    Wal *wal = calloc(1, sizeof(Wal));
+    check_mem(wal);
+    wal->fd = -1;
+    wal->group = group;
+    wal->size = WAL_INITIAL_SIZE;
+    wal->length = WAL_FRAME;
+    wal->buffer = malloc(wal->size);
+    check_mem(wal->buffer);
+
+    if(snapshot) {
+        size_t length = strlen(snapshot) + 1;
+        wal->snapshot = malloc(length);
+        check_mem(wal->snapshot);
+        memcpy(wal->snapshot, snapshot, length);
+    }
+
+    // the snapshot's checksum says which log goes with it
+    if(snapshot && access(snapshot, F_OK) == 0) {
+        Snapshot *saved = sn_open(snapshot, 0);
+        check(saved, "Could not open snapshot %s", snapshot);
+        base = saved->header->checksum;
+        sn_close(saved);
+
+        wal->graph = g_load(snapshot);
+        check(wal->graph, "Could not load snapshot %s", snapshot);
+        loaded = 1;
+    } else {
+        wal->graph = new_graph();
+        check_mem(wal->graph);
+    }
+
+    check(!wl_start(wal, path, base, loaded), "Could not open log %s", path);
+    return wal;
+
+error:
+    if(wal) {
+        if(wal->fd != -1) close(wal->fd);
+        if(wal->graph) g_free(wal->graph);
+        free(wal->snapshot);
+        free(wal->buffer);
+        free(wal->ids);
+        free(wal);
+    }
+    return NULL;
+}
+
+int wl_apply(Wal *wal, char greater[], char lesser[])
+{
+    int rc = g_apply_relation(wal->graph, greater, lesser);
+    if(rc) return rc;
+
+    Pool *pool = wal->graph->pool;
+    return wl_log(wal, WAL_APPLY, p_find(pool, greater, strlen(greater)), p_find(pool, lesser, strlen(lesser)));
+}
+
+int wl_remove(Wal *wal, char greater[], char lesser[])
+{
+    int rc = g_remove_relation(wal->graph, greater, lesser);
+    if(rc) return rc;
+
+    Pool *pool = wal->graph->pool;
+    return wl_log(wal, WAL_REMOVE, p_find(pool, greater, strlen(greater)), p_find(pool, lesser, strlen(lesser)));
+}
+
+int wl_remove_value(Wal *wal, char item[])
+{
+    int rc = g_remove_value(wal->graph, item);
+    if(rc) return rc;
+
+    // the name stays interned after the value's gone
+    return wl_log(wal, WAL_REMOVE_VALUE, p_find(wal->graph->pool, item, strlen(item)), 0);
+}
+
+int wl_checkpoint(Wal *wal)
+{
+    if(!wal->snapshot || wal->failed) return ERR_IO;
+
+    int rc = g_save(wal->graph, wal->snapshot);
+    if(rc) return rc;
+
+    // saved and synced, rename and all, so everything logged is in it
+    Snapshot *saved = sn_open(wal->snapshot, 0);
+    if(!saved) return ERR_IO;
+    uint64_t base = saved->header->checksum;
+    sn_close(saved);
+
+    if(wl_reset(wal, base)) {
+        log_err("Could not start the log again");
+        wal->failed = 1;
+        return ERR_IO;
+    }
+    return 0;
+}
+
+int wl_close(Wal *wal)
+{
+    int rc = wl_commit(wal);
+
+    close(wal->fd);
+    free(wal->snapshot);
+    free(wal->buffer);
+    free(wal->ids);
+    free(wal);
+    return rc;
+}
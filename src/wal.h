@@ -0,0 +1,184 @@
+/* Write-ahead log
+ *
+ * Makes each change to a graph durable without writing the whole graph, by
+ *   appending it to a log that's replayed on top of the last snapshot when the
+ *   graph is loaded again. wl_open loads the snapshot (see g_load) and replays
+ *   the log into it, and to keep the log short wl_checkpoint now and then saves
+ *   a new snapshot and empties the log
+ *
+ * Each log starts with the checksum of the snapshot it goes on top of, 0 for
+ *   none. Saving a snapshot replaces the file in one rename, so that's the
+ *   point a checkpoint happens: a crash after it leaves a log for the snapshot
+ *   before, which wl_open sees and drops, since the snapshot already has
+ *   everything in it
+ *
+ * The log is binary: a header, then frames of records, each frame written with
+ *   one write() and made durable with one fdatasync(). Records name values by
+ *   log ids, given out from 0 in the order names first appear since the log was
+ *   started, with the name itself written only the first time:
+ *
+ *   header: "DAGWAL" and two null bytes, version and 0x01020304 as 32-bit
+ *     numbers as in snapshots, then the 64-bit snapshot checksum
+ *   frame: 32-bit length of the records, 32-bit checksum of them (low half of
+ *     hash_n), then the records
+ *   record: A type byte then numbers as LEB128 varints
+ *     WAL_NAME length bytes: Next log id is this name
+ *     WAL_APPLY greater lesser: Relation greater > lesser applied
+ *     WAL_REMOVE greater lesser: Relation greater > lesser removed
+ *     WAL_REMOVE_VALUE id: Value and all its relations removed
+ *
+ * A frame that's cut short or doesn't match its checksum is where a crash
+ *   stopped a write, so replay stops there and the log is cut back to the last
+ *   whole frame. Nothing after it was committed
+ *
+ * Relations are replayed with g_apply_relations_ids, sorting once at the end
+ *   rather than reordering after each one. Taking relations out never breaks
+ *   the graph's order, so removals go straight to the graph, or cancel the
+ *   relations still waiting that they take out
+ *
+ * Group commit: changes are buffered and only written and synced every group
+ *   changes, or at wl_commit. A change is durable once the commit it's in has
+ *   returned, so a caller that has to acknowledge each change commits before
+ *   acknowledging; one that takes changes from many clients acknowledges them
+ *   all after one commit
+ *
+ * The graph shouldn't be changed other than through the log while it's open,
+ *   and not reset, since the log keeps the pool ids of the names it's written
+ */
+
+#ifndef WAL_H
+#define WAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "graph.h"
+
+// Version written by this code; logs with any other version are rejected
+#define WAL_VERSION 1
+
+// Record types
+enum wl_record {
+    WAL_NAME = 1,
+    WAL_APPLY = 2,
+    WAL_REMOVE = 3,
+    WAL_REMOVE_VALUE = 4,
+};
+
+/* struct: WalHeader
+ *
+ * Start of every log file. Avoid using directly
+ *
+ * magic: "DAGWAL" and two null bytes
+ * version: WAL_VERSION
+ * endian: 0x01020304 as written by the machine that made the file
+ * base: Checksum of the snapshot the log goes on top of, 0 if none
+ */
+typedef struct wal_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint64_t base;
+} WalHeader;
+
+/* struct: Wal
+ *
+ * Open log. Create with wl_open and operate with wl_* functions
+ *
+ * graph: Graph the log is for, made by wl_open. Still the caller's to g_free
+ *   after wl_close
+ * snapshot: Where wl_checkpoint saves the graph, NULL if it's only logged
+ * fd: The log file
+ * buffer: Frame being built, starting with room for its length and checksum
+ * length: Bytes in buffer
+ * size: Bytes buffer has room for
+ * ids: Log id + 1 of each pool id, 0 for names not in the log yet
+ * ids_size: Number of pool ids ids has room for
+ * names: Number of log ids given out
+ * group: Changes per commit, 0 to only commit in wl_commit
+ * pending: Changes in buffer
+ * commits: Number of frames written since opened
+ * failed: Set once a write fails, after which nothing more is written
+ */
+typedef struct wal {
+    Graph *graph;
+    char *snapshot;
+    int fd;
+    unsigned char *buffer;
+    size_t length;
+    size_t size;
+    unsigned int *ids;
+    unsigned int ids_size;
+    unsigned int names;
+    int group;
+    int pending;
+    unsigned long commits;
+    int failed;
+} Wal;
+
+/* function: wl_open(const char *path, const char *snapshot, int group)
+ *
+ * Load the graph from snapshot and open the log at path to append changes to it,
+ *   creating either if it doesn't exist yet. Everything in the log is replayed
+ *   into the graph first, and a torn last frame is cut off. A log from before
+ *   the snapshot was saved is emptied. snapshot can be NULL to only use the log
+ *
+ * Commits every group changes, or only at wl_commit if group is 0
+ *
+ * Returns the log with the graph in wal->graph, or NULL if a file can't be read
+ *   or written or isn't valid, a log needs a snapshot that isn't there, or
+ *   replaying fails, e.g. its relations make a cycle
+ */
+Wal *wl_open(const char *path, const char *snapshot, int group);
+
+/* function: wl_apply(Wal *wal, char greater[], char lesser[])
+ *
+ * Apply a relation with g_apply_relation and log it if it changed the graph
+ *
+ * Returns as g_apply_relation, or ERR_IO if the graph changed but logging it
+ *   failed
+ */
+int wl_apply(Wal *wal, char greater[], char lesser[]);
+
+/* function: wl_remove(Wal *wal, char greater[], char lesser[])
+ *
+ * Remove a relation with g_remove_relation and log it if it was there
+ *
+ * Returns as g_remove_relation, or ERR_IO as wl_apply
+ */
+int wl_remove(Wal *wal, char greater[], char lesser[]);
+
+/* function: wl_remove_value(Wal *wal, char item[])
+ *
+ * Remove a value with g_remove_value and log it if it was there
+ *
+ * Returns as g_remove_value, or ERR_IO as wl_apply
+ */
+int wl_remove_value(Wal *wal, char item[]);
+
+/* function: wl_commit(Wal *wal)
+ *
+ * Write every buffered change and wait for it to reach the disk
+ *
+ * Returns 0 on success or ERR_IO
+ */
+int wl_commit(Wal *wal);
+
+/* function: wl_checkpoint(Wal *wal)
+ *
+ * Save the graph to the snapshot with g_save and start the log again empty
+ *
+ * Returns 0 on success, ERR_IO if there's no snapshot or either file can't be
+ *   written, or ERR_OUT_OF_MEMORY. If saving fails the log is kept
+ */
+int wl_checkpoint(Wal *wal);
+
+/* function: wl_close(Wal *wal)
+ *
+ * Commit anything buffered and close the log. The graph is left for the caller
+ *
+ * Returns 0 on success or ERR_IO if the last commit failed
+ */
+int wl_close(Wal *wal);
+
+#endif
@@ -0,0 +1,103 @@
+/* Buffered output
+ *
+ * write() can take less than it's given, or be interrupted before taking
+ *   anything, so every write loops until it's all gone or there's a real error
+ */
+
+#include <errno.h>
+#include <malloc.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "writer.h"
+#include "dbg.h"
+
+Writer *new_writer(int fd, size_t size)
+{
+    Writer *writer = malloc(sizeof(Writer));
+    if(!writer) return NULL;
+
+    writer->fd = fd;
+    writer->size = size ? size : WRITER_SIZE;
+    writer->length = 0;
+    writer->failed = 0;
+    writer->buffer = malloc(writer->size);
+    if(!writer->buffer) {
+        free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+// Write all of data to the file descriptor
+static int wr_all(Writer *writer, const char *data, size_t length)
+{
+    while(length && !writer->failed) {
+        ssize_t written = write(writer->fd, data, length);
+
+        if(written < 0) {
+            if(errno == EINTR) continue;
+
+            log_err("Could not write output");
+            writer->failed = 1;
+            break;
+        }
+
+        data += written;
+        length -= (size_t)written;
+    }
+
+    return writer->failed ? ERR_IO : 0;
+}
+
+int wr_flush(Writer *writer)
+{
+    int rc = wr_all(writer, writer->buffer, writer->length);
+    writer->length = 0;
+    return rc;
+}
+
+int wr_write(Writer *writer, const char *data, size_t length)
+{
+    if(writer->failed) return ERR_IO;
+
+    if(length > writer->size - writer->length) {
+        if(wr_flush(writer)) return ERR_IO;
+
+        // too big to be worth copying
+        if(length >= writer->size) return wr_all(writer, data, length);
+    }
+
+    memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+    return 0;
+}
+
+int wr_string(Writer *writer, const char *str)
+{
+    return wr_write(writer, str, strlen(str));
+}
+
+int wr_free(Writer *writer)
+{
+    int rc = wr_flush(writer);
+
+    free(writer->buffer);
+    free(writer);
+    return rc;
+}
+
+// walks the graph itself rather than getting g_sorted's array
+int g_write_sorted(Graph *graph, Writer *writer, const char *separator)
+{
+    size_t length = strlen(separator);
+    Iter iter = g_iter_begin(graph);
+    Value *value = NULL;
+
+    while((value = g_iter_next(&iter))) {
+        if(wr_string(writer, value->value) || wr_write(writer, separator, length)) return ERR_IO;
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+/* Buffered output
+ *
+ * Collects output in one large buffer and hands it to write() a buffer at a time,
+ *   so printing millions of short strings takes a few hundred system calls and
+ *   no formatting. Strings bigger than the buffer go straight through
+ *
+ * g_write_sorted streams a graph's order with it, one value at a time from the
+ *   graph, so nothing the size of the graph is allocated
+ */
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+
+#include "graph.h"
+
+// Buffer size used when new_writer is given 0
+#define WRITER_SIZE (1 << 20)
+
+/* struct: Writer
+ *
+ * Create with new_writer and operate with wr_* functions
+ *
+ * fd: File descriptor written to, not owned by the writer
+ * buffer: Output not yet written
+ * length: Bytes in buffer
+ * size: Bytes buffer has room for
+ * failed: Set once a write fails, after which nothing more is written
+ */
+typedef struct writer {
+    int fd;
+    char *buffer;
+    size_t length;
+    size_t size;
+    int failed;
+} Writer;
+
+/* function: new_writer(int fd, size_t size)
+ *
+ * Create a writer to fd with a buffer of size bytes, or WRITER_SIZE if 0
+ *
+ * Returns the writer, or NULL if out of memory
+ */
+Writer *new_writer(int fd, size_t size);
+
+/* function: wr_write(Writer *writer, const char *data, size_t length)
+ *
+ * Add length bytes of data to the output
+ *
+ * Returns 0 on success or ERR_IO if a write has failed
+ */
+int wr_write(Writer *writer, const char *data, size_t length);
+
+/* function: wr_string(Writer *writer, const char *str)
+ *
+ * Add a null-terminated string to the output, without the terminator
+ *
+ * Returns 0 on success or ERR_IO if a write has failed
+ */
+int wr_string(Writer *writer, const char *str);
+
+/* function: wr_flush(Writer *writer)
+ *
+ * Write everything buffered so far
+ *
+ * Returns 0 on success or ERR_IO if a write has failed
+ */
+int wr_flush(Writer *writer);
+
+/* function: wr_free(Writer *writer)
+ *
+ * Flush and free a writer, leaving its file descriptor open
+ *
+ * Returns 0 on success or ERR_IO if a write has failed
+ */
+int wr_free(Writer *writer);
+
+/* function: g_write_sorted(Graph *graph, Writer *writer, const char *separator)
+ *
+ * Write every value in a graph in sorted order, each followed by separator
+ *
+ * Returns 0 on success or ERR_IO if a write has failed. Output is left in the
+ *   buffer, flush or free the writer to finish it
+ */
+int g_write_sorted(Graph *graph, Writer *writer, const char *separator);
+
+#endif
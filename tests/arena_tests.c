@@ -0,0 +1,83 @@
+// Test arena allocator
+
+#include "minunit.h"
+#include "../src/arena.h"
+#include "../src/dbg.h"
+
+mu_suite_start();
+
+static Arena *t_arena = NULL;
+
+static char *test_new(void)
+{
+    t_arena = new_arena();
+
+    mu_assert(t_arena, "Arena not created")
+    mu_assert(t_arena->blocks == NULL, "Block allocated before use")
+    return NULL;
+}
+
+static char *test_alloc(void)
+{
+    char *first = a_alloc(t_arena, 5);
+    char *second = a_alloc(t_arena, 40);
+
+    mu_assert(first && second, "Allocation failed")
+    mu_assert(((size_t)first & 15) == 0, "First allocation not aligned")
+    mu_assert(((size_t)second & 15) == 0, "Second allocation not aligned")
+    mu_assert(second >= first + 5, "Allocations overlap")
+
+    memset(first, 'a', 5);
+    memset(second, 'b', 40);
+    mu_assert(first[4] == 'a', "First allocation overwritten")
+
+    // bigger than a block, and the block it was in has to stay current
+    char *large = a_alloc(t_arena, (size_t)4 << 20);
+    mu_assert(large, "Large allocation failed")
+    memset(large, 'c', (size_t)4 << 20);
+
+    char *third = a_alloc(t_arena, 16);
+    mu_assert(third == second + 48, "Large allocation moved the current block")
+
+    return NULL;
+}
+
+static char *test_slab(void)
+{
+    void *first = a_slab_alloc(t_arena, 64);
+    mu_assert(first, "Slab allocation failed")
+
+    a_slab_free(t_arena, first, 64);
+    void *second = a_slab_alloc(t_arena, 60);
+    mu_assert(second == first, "Freed slab not reused")
+
+    void *third = a_slab_alloc(t_arena, 64);
+    mu_assert(third != second, "Slab handed out twice")
+
+    return NULL;
+}
+
+static char *test_reset(void)
+{
+    a_reset(t_arena);
+    mu_assert(t_arena->blocks && !t_arena->blocks->next, "Reset didn't keep exactly one block")
+
+    char *first = a_alloc(t_arena, 16);
+    mu_assert(first == t_arena->blocks->data, "Kept block not reused")
+
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_new)
+    mu_run_test(test_alloc)
+    mu_run_test(test_slab)
+    mu_run_test(test_reset)
+
+    a_free(t_arena);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
@@ -0,0 +1,187 @@
+// Test transitive closure
+
+#include "minunit.h"
+#include "../src/closure.h"
+#include "../src/dbg.h"
+
+// A few cache lines of bits per row, so threads get different columns
+#define VALUES 1100
+#define RELATIONS_PER_VALUE 2
+// Relations only reach this far ahead, so plenty of pairs aren't related
+#define RELATION_SPAN 60
+
+mu_suite_start();
+
+// Graph of values n0 to n<count - 1>, where each relation goes from a value to
+//   one a little after it
+static Graph *random_graph(int count)
+{
+    Graph *graph = new_graph();
+    char greater[16];
+    char lesser[16];
+
+    srand(1);
+    for(int i = 0; i < count * RELATIONS_PER_VALUE; i++) {
+        int a = rand() % count;
+        int b = a + 1 + rand() % RELATION_SPAN;
+        if(b >= count) continue;
+
+        snprintf(greater, sizeof(greater), "n%i", a);
+        snprintf(lesser, sizeof(lesser), "n%i", b);
+        int rc = g_apply_relation(graph, greater, lesser);
+        if(rc && rc != ERR_DUPLICATE) {
+            g_free(graph);
+            return NULL;
+        }
+
+        // freeze part way through so both frozen and added relations are covered
+        if(i == count) g_freeze(graph);
+    }
+
+    return graph;
+}
+
+// Mark everything below a value the slow way
+static void mark_below(Graph *graph, Value *from, char *below, Vector *stack)
+{
+    memset(below, 0, (size_t)graph->values_size);
+    stack->length = 0;
+
+    v_push(stack, from);
+    Value *value = NULL;
+    while((value = v_pop(stack))) {
+        for(int j = 0; j < g_degree(graph, value, DIR_LOWER); j++) {
+            Value *lower = g_relation(graph, value, DIR_LOWER, j);
+            if(below[lower->index]) continue;
+
+            below[lower->index] = 1;
+            v_push(stack, lower);
+        }
+    }
+}
+
+// Compare every pair, count and set against searching
+static char *check_closure(Graph *graph, Closure *closure)
+{
+    size_t size = (size_t)graph->values_size;
+    char *below = malloc(size * size);
+    Value **values = malloc(sizeof(Value *) * size);
+    Vector *stack = new_vector();
+    mu_assert(below && values && stack, "Out of memory")
+
+    for(Value *value = graph->start; value; value = value->next) {
+        mark_below(graph, value, below + value->index * size, stack);
+    }
+
+    unsigned long related = 0;
+    for(Value *higher = graph->start; higher; higher = higher->next) {
+        char *row = below + higher->index * size;
+        uint32_t expected_below = 0;
+        uint32_t expected_above = 0;
+
+        for(Value *lower = graph->start; lower; lower = lower->next) {
+            int expected = row[lower->index];
+            mu_assert(cl_above(closure, higher, lower) == expected, "%s above %s should be %i",
+                    higher->value, lower->value, expected)
+            expected_below += (uint32_t)expected;
+            expected_above += below[lower->index * size + higher->index] ? 1 : 0;
+        }
+        related += expected_below;
+
+        mu_assert(cl_count(closure, higher, DIR_LOWER) == expected_below, "Wrong count below %s", higher->value)
+        mu_assert(cl_count(closure, higher, DIR_HIGHER) == expected_above, "Wrong count above %s", higher->value)
+
+        // sets come back in order, and hold only what's related
+        uint32_t count = cl_values(closure, higher, DIR_LOWER, values);
+        mu_assert(count == expected_below, "Wrong number of values below %s", higher->value)
+        for(uint32_t i = 0; i < count; i++) {
+            mu_assert(row[values[i]->index], "%s isn't below %s", values[i]->value, higher->value)
+            mu_assert(!i || g_before(values[i - 1], values[i]), "Values below %s out of order", higher->value)
+        }
+
+        count = cl_values(closure, higher, DIR_HIGHER, values);
+        mu_assert(count == expected_above, "Wrong number of values above %s", higher->value)
+        for(uint32_t i = 0; i < count; i++) {
+            mu_assert(below[values[i]->index * size + higher->index], "%s isn't above %s", values[i]->value, higher->value)
+            mu_assert(!i || g_before(values[i - 1], values[i]), "Values above %s out of order", higher->value)
+        }
+    }
+
+    mu_assert(related > (unsigned long)graph->length * 10, "Too few related pairs tested, only %lu", related)
+
+    free(below);
+    free(values);
+    v_free(stack);
+    return NULL;
+}
+
+static char *test_closure(void)
+{
+    Graph *graph = random_graph(VALUES);
+    mu_assert(graph, "Failed to build graph")
+
+    int flags[] = { 0, CLOSURE_ABOVE, CLOSURE_ABOVE | CLOSURE_SCALAR };
+    int threads[] = { 1, 3, 7 };
+    for(size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+        for(size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+            Closure *closure = g_closure(graph, flags[f], threads[t]);
+            mu_assert(closure, "Closure not built with flags %i and %i threads", flags[f], threads[t])
+            mu_assert(!(flags[f] & CLOSURE_ABOVE) == !closure->above, "Rows above built when not asked for, or not when asked")
+            mu_assert(!(flags[f] & CLOSURE_SCALAR) || !closure->vector, "Vector instructions used when told not to")
+
+            char *failed = check_closure(graph, closure);
+            if(failed) return failed;
+            cl_free(closure);
+        }
+    }
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_newer(void)
+{
+    Graph *graph = new_graph();
+    mu_assert(g_apply_relation(graph, "a", "b") == 0, "Failed to relate")
+
+    Closure *closure = g_closure(graph, CLOSURE_ABOVE, 1);
+    mu_assert(closure, "Closure not built")
+
+    // values added since aren't covered
+    mu_assert(g_apply_relation(graph, "b", "c") == 0, "Failed to relate")
+    Value *a = g_lookup(graph, "a");
+    Value *b = g_lookup(graph, "b");
+    Value *c = g_lookup(graph, "c");
+    mu_assert(cl_above(closure, a, b), "a should be above b")
+    mu_assert(!cl_above(closure, b, a), "b shouldn't be above a")
+    mu_assert(!cl_above(closure, a, a), "a shouldn't be above itself")
+    mu_assert(!cl_above(closure, a, c), "c is newer than the closure")
+    mu_assert(cl_count(closure, c, DIR_HIGHER) == 0, "c is newer than the closure")
+
+    cl_free(closure);
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_empty(void)
+{
+    Graph *graph = new_graph();
+    Closure *closure = g_closure(graph, CLOSURE_ABOVE, 0);
+    mu_assert(closure, "Closure not built for an empty graph")
+    mu_assert(closure->count == 0, "Empty graph has rows")
+
+    cl_free(closure);
+    g_free(graph);
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_closure);
+    mu_run_test(test_newer);
+    mu_run_test(test_empty);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
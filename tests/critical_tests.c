@@ -0,0 +1,243 @@
+// Test critical path scheduling
+
+#include "minunit.h"
+#include "../src/critical.h"
+#include "../src/levels.h"
+#include "../src/dbg.h"
+
+#define RANDOM_VALUES 300
+#define RANDOM_RELATIONS 1500
+#define RANDOM_CHANGES 3000
+
+mu_suite_start();
+
+// Check a value's times
+static char *check_times(Graph *graph, Schedule *schedule, char *name, int64_t earliest, int64_t latest)
+{
+    Value *value = g_lookup(graph, name);
+    mu_assert(value, "%s not found", name)
+    mu_assert(schedule->earliest[value->index] == earliest, "%s should start at %lli, got %lli",
+            name, (long long)earliest, (long long)schedule->earliest[value->index])
+    mu_assert(schedule->latest[value->index] == latest, "%s should start by %lli, got %lli",
+            name, (long long)latest, (long long)schedule->latest[value->index])
+
+    return NULL;
+}
+
+// Check the chain is exactly the names given
+static char *check_chain(Schedule *schedule, const char **names, int length)
+{
+    mu_assert(schedule->chain_length == length, "Expected a chain of %i, got %i", length, schedule->chain_length)
+    for(int i = 0; i < length; i++) {
+        mu_assert(strcmp(schedule->chain[i]->value, names[i]) == 0, "Expected %s at %i in the chain, got %s",
+                names[i], i, schedule->chain[i]->value)
+    }
+
+    return NULL;
+}
+
+static char *test_small(void)
+{
+    Graph *graph = new_graph();
+    mu_assert(g_critical_path(graph)->length == 0, "Empty graph should take no time")
+
+    mu_assert(g_apply_relation(graph, "a", "b") == 0, "Failed to apply a > b")
+    mu_assert(g_apply_relation(graph, "a", "c") == 0, "Failed to apply a > c")
+    mu_assert(g_apply_relation(graph, "b", "d") == 0, "Failed to apply b > d")
+    mu_assert(g_apply_relation(graph, "c", "d") == 0, "Failed to apply c > d")
+    mu_assert(g_set_weight(graph, "a", 3) == 0 && g_set_weight(graph, "b", 2) == 0, "Failed to set weights")
+    mu_assert(g_set_weight(graph, "c", 4) == 0 && g_set_weight(graph, "x", 4) == ERR_NOT_FOUND,
+            "Weight of a missing value should be rejected")
+    mu_assert(g_set_relation_weight(graph, "a", "c", 1) == 0, "Failed to set the lag of a > c")
+    mu_assert(g_set_relation_weight(graph, "a", "d", 1) == ERR_NOT_FOUND, "Lag of a missing relation should be rejected")
+
+    // a takes 3, then b 2 or c 4 after a lag of 1, then d 1
+    Schedule *schedule = g_critical_path(graph);
+    mu_assert(schedule && schedule->length == 9, "Expected a length of 9, got %lli", (long long)schedule->length)
+    char *times[] = { "a", "b", "c", "d" };
+    int64_t earliest[] = { 0, 3, 4, 8 };
+    int64_t latest[] = { 0, 6, 4, 8 };
+    for(int i = 0; i < 4; i++) {
+        char *err = check_times(graph, schedule, times[i], earliest[i], latest[i]);
+        if(err) return err;
+    }
+    const char *chain[] = { "a", "c", "d" };
+    char *err = check_chain(schedule, chain, 3);
+    if(err) return err;
+
+    // b gets longer than c, so the chain moves over to it
+    mu_assert(g_set_weight(graph, "b", 6) == 0, "Failed to set the weight of b")
+    schedule = g_critical_path(graph);
+    mu_assert(schedule && schedule->length == 10, "Expected a length of 10, got %lli", (long long)schedule->length)
+    const char *moved[] = { "a", "b", "d" };
+    err = check_chain(schedule, moved, 3);
+    if(err) return err;
+    err = check_times(graph, schedule, "c", 4, 5);
+    if(err) return err;
+
+    // nothing changed, nothing to do
+    schedule = g_critical_path(graph);
+    mu_assert(schedule->recomputed == 0, "Recomputed %lu times without a change", schedule->recomputed)
+
+    // taking b out leaves c critical again
+    mu_assert(g_remove_value(graph, "b") == 0, "Failed to remove b")
+    schedule = g_critical_path(graph);
+    mu_assert(schedule && schedule->length == 9, "Expected a length of 9, got %lli", (long long)schedule->length)
+    err = check_chain(schedule, chain, 3);
+    if(err) return err;
+
+    g_reset(graph);
+    mu_assert(graph->schedule == NULL, "Schedule not reset")
+    g_free(graph);
+    return NULL;
+}
+
+// Without weights set every value takes 1, so each starts at its level
+static char *test_levels(void)
+{
+    Graph *graph = new_graph();
+    char greater[16];
+    char lesser[16];
+
+    srand(2);
+    for(int i = 0; i < RANDOM_RELATIONS; i++) {
+        int a = rand() % RANDOM_VALUES;
+        int b = rand() % RANDOM_VALUES;
+        if(a == b) continue;
+
+        snprintf(greater, sizeof(greater), "n%i", a < b ? a : b);
+        snprintf(lesser, sizeof(lesser), "n%i", a < b ? b : a);
+        g_apply_relation(graph, greater, lesser);
+    }
+
+    Schedule *schedule = g_critical_path(graph);
+    Levels *levels = g_levels(graph, 1);
+    mu_assert(schedule && levels, "Out of memory")
+    mu_assert(schedule->length == levels->count, "Length %lli but %i levels", (long long)schedule->length, levels->count)
+
+    for(Value *value = graph->start; value; value = value->next) {
+        mu_assert(schedule->earliest[value->index] == levels->level[value->index], "%s starts at %lli but is on level %i",
+                value->value, (long long)schedule->earliest[value->index], levels->level[value->index])
+    }
+    mu_assert(schedule->chain_length == levels->count, "Chain of %i through %i levels", schedule->chain_length, levels->count)
+
+    lv_free(levels);
+    g_free(graph);
+    return NULL;
+}
+
+// Every kind of change, checking the incremental schedule against one from scratch
+//   after each
+static char *test_random(void)
+{
+    Graph *graph = new_graph();
+    char greater[16];
+    char lesser[16];
+    int64_t *earliest = malloc(sizeof(int64_t) * RANDOM_VALUES * 2);
+    int64_t *latest = malloc(sizeof(int64_t) * RANDOM_VALUES * 2);
+    unsigned long partial = 0;
+    mu_assert(earliest && latest, "Out of memory")
+
+    srand(3);
+    for(int i = 0; i < RANDOM_RELATIONS; i++) {
+        int a = rand() % RANDOM_VALUES;
+        int b = rand() % RANDOM_VALUES;
+        if(a == b) continue;
+
+        snprintf(greater, sizeof(greater), "n%i", a);
+        snprintf(lesser, sizeof(lesser), "n%i", b);
+        g_apply_relation(graph, greater, lesser);
+    }
+    mu_assert(g_critical_path(graph), "Failed to schedule")
+
+    for(int i = 0; i < RANDOM_CHANGES; i++) {
+        int a = rand() % RANDOM_VALUES;
+        int b = rand() % RANDOM_VALUES;
+        snprintf(greater, sizeof(greater), "n%i", a);
+        snprintf(lesser, sizeof(lesser), "n%i", b);
+
+        switch(rand() % 6) {
+            case 0:
+            case 1:
+                if(a != b) g_apply_relation(graph, greater, lesser);
+                break;
+            case 2:
+                g_remove_relation(graph, greater, lesser);
+                break;
+            case 3:
+                if(rand() % 4 == 0) g_remove_value(graph, greater);
+                break;
+            case 4:
+                g_set_weight(graph, greater, rand() % 10);
+                break;
+            default:
+                g_set_relation_weight(graph, greater, lesser, rand() % 5);
+                break;
+        }
+
+        // now and then through a batch, which sorts the graph again
+        if(i % 100 == 0 && a != b) {
+            char *batch_greater[] = { greater };
+            char *batch_lesser[] = { lesser };
+            g_apply_relations_batch(graph, batch_greater, batch_lesser, 1);
+        }
+
+        Schedule *schedule = g_critical_path(graph);
+        mu_assert(schedule, "Failed to schedule after change %i", i)
+        if(schedule->recomputed < 2 * (unsigned long)graph->length) partial++;
+
+        int64_t length = schedule->length;
+        for(Value *value = graph->start; value; value = value->next) {
+            earliest[value->index] = schedule->earliest[value->index];
+            latest[value->index] = schedule->latest[value->index];
+        }
+
+        schedule->full = 1;
+        schedule = g_critical_path(graph);
+        mu_assert(schedule->length == length, "Length %lli, expected %lli after change %i",
+                (long long)length, (long long)schedule->length, i)
+
+        for(Value *value = graph->start; value; value = value->next) {
+            mu_assert(earliest[value->index] == schedule->earliest[value->index] &&
+                    latest[value->index] == schedule->latest[value->index],
+                    "%s starts at %lli by %lli, expected %lli by %lli after change %i", value->value,
+                    (long long)earliest[value->index], (long long)latest[value->index],
+                    (long long)schedule->earliest[value->index], (long long)schedule->latest[value->index], i)
+        }
+
+        // the chain is a path of values with no slack, from 0 to the length
+        mu_assert(graph->length == 0 || schedule->chain_length > 0, "No chain after change %i", i)
+        for(int j = 0; j < schedule->chain_length; j++) {
+            Value *value = schedule->chain[j];
+            mu_assert(schedule->earliest[value->index] == schedule->latest[value->index],
+                    "%s in the chain has slack after change %i", value->value, i)
+            if(j + 1 < schedule->chain_length) {
+                mu_assert(g_before(value, schedule->chain[j + 1]), "Chain out of order after change %i", i)
+            }
+        }
+        if(schedule->chain_length) {
+            Value *first = schedule->chain[0];
+            Value *last = schedule->chain[schedule->chain_length - 1];
+            mu_assert(schedule->earliest[first->index] == 0, "Chain doesn't start at 0 after change %i", i)
+            mu_assert(schedule->finish[last->index] == schedule->length, "Chain doesn't finish last after change %i", i)
+        }
+    }
+
+    mu_assert(partial > RANDOM_CHANGES / 2, "Only %lu of %i changes recomputed incrementally", partial, RANDOM_CHANGES)
+
+    free(earliest);
+    free(latest);
+    g_free(graph);
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_small)
+    mu_run_test(test_levels)
+    mu_run_test(test_random)
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
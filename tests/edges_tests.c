@@ -0,0 +1,119 @@
+// Test edge set
+
+#include "minunit.h"
+#include "../src/edges.h"
+#include "../src/dbg.h"
+
+mu_suite_start();
+
+#define MANY_EDGES 100000
+
+static Edges *t_edges = NULL;
+
+static char *test_new(void)
+{
+    t_edges = new_edges();
+
+    mu_assert(t_edges, "Edge set not created")
+    mu_assert(t_edges->length == 0, "New edge set not empty")
+    return NULL;
+}
+
+static char *test_add(void)
+{
+    mu_assert(e_add(t_edges, 1, 2) == 0, "Failed to add 1, 2")
+    mu_assert(e_add(t_edges, 1, 2) == 1, "1, 2 added twice")
+    mu_assert(e_add(t_edges, 2, 1) == 0, "Pairs aren't ordered")
+    mu_assert(e_add(t_edges, 0, 0) == 0, "Failed to add 0, 0")
+    mu_assert(t_edges->length == 3, "Edge set length incorrect, got %llu", (unsigned long long)t_edges->length)
+
+    mu_assert(e_has(t_edges, 1, 2) && e_has(t_edges, 2, 1) && e_has(t_edges, 0, 0), "Added pairs not found")
+    mu_assert(!e_has(t_edges, 1, 3), "1, 3 found without being added")
+
+    return NULL;
+}
+
+static char *test_remove(void)
+{
+    mu_assert(e_remove(t_edges, 1, 2) == 0, "Failed to remove 1, 2")
+    mu_assert(e_remove(t_edges, 1, 2) == 1, "1, 2 removed twice")
+    mu_assert(!e_has(t_edges, 1, 2), "1, 2 found after removing")
+    mu_assert(e_has(t_edges, 2, 1), "2, 1 lost removing 1, 2")
+    mu_assert(t_edges->length == 2, "Edge set length incorrect, got %llu", (unsigned long long)t_edges->length)
+
+    return NULL;
+}
+
+// Enough pairs to grow the table many times, then remove every other one so
+//   removals have to shift the rest of their runs back
+static char *test_many(void)
+{
+    e_reset(t_edges);
+
+    for(unsigned int i = 0; i < MANY_EDGES; i++) {
+        mu_assert(e_add(t_edges, i / 100, i % 100) == 0, "Failed to add pair %u", i)
+    }
+    mu_assert(t_edges->table_size >= MANY_EDGES * 2, "Table more than half full")
+
+    for(unsigned int i = 0; i < MANY_EDGES; i += 2) {
+        mu_assert(e_remove(t_edges, i / 100, i % 100) == 0, "Failed to remove pair %u", i)
+    }
+
+    for(unsigned int i = 0; i < MANY_EDGES; i++) {
+        mu_assert(e_has(t_edges, i / 100, i % 100) == (int)(i % 2), "Pair %u wrong after removals", i)
+    }
+    mu_assert(t_edges->length == MANY_EDGES / 2, "Edge set length incorrect, got %llu", (unsigned long long)t_edges->length)
+
+    // reserving ahead means adding doesn't grow the table
+    uint64_t size = t_edges->table_size;
+    mu_assert(e_reserve(t_edges, MANY_EDGES * 4) == 0, "Failed to reserve")
+    mu_assert(t_edges->table_size > size, "Table not grown by reserve")
+    mu_assert(e_has(t_edges, 0, 1) && !e_has(t_edges, 0, 0), "Pairs lost when reserving")
+
+    return NULL;
+}
+
+// Weights have to follow their pairs through growing and removals
+static char *test_weights(void)
+{
+    e_reset(t_edges);
+
+    mu_assert(e_add(t_edges, 1, 2) == 0, "Failed to add 1, 2")
+    mu_assert(e_set_weight(t_edges, 1, 2, 0) == 0 && !t_edges->weights, "Weight of 0 shouldn't need a table")
+    mu_assert(e_set_weight(t_edges, 2, 1, 5) == 1, "Weight set on a missing pair")
+    mu_assert(e_weight(t_edges, 2, 1) == 0, "Missing pair has a weight")
+
+    for(unsigned int i = 0; i < MANY_EDGES; i++) {
+        mu_assert(e_add(t_edges, i / 100 + 10, i % 100) == 0, "Failed to add pair %u", i)
+        mu_assert(e_set_weight(t_edges, i / 100 + 10, i % 100, (int64_t)i - 7) == 0, "Failed to weight pair %u", i)
+    }
+    for(unsigned int i = 0; i < MANY_EDGES; i += 3) e_remove(t_edges, i / 100 + 10, i % 100);
+
+    for(unsigned int i = 0; i < MANY_EDGES; i++) {
+        int64_t expected = i % 3 ? (int64_t)i - 7 : 0;
+        mu_assert(e_weight(t_edges, i / 100 + 10, i % 100) == expected, "Pair %u has the wrong weight", i)
+    }
+
+    // added again it starts from 0
+    mu_assert(e_add(t_edges, 10, 0) == 0 && e_weight(t_edges, 10, 0) == 0, "Weight kept after removing")
+
+    e_reset(t_edges);
+    mu_assert(!t_edges->weights, "Weights not reset")
+
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_new)
+    mu_run_test(test_add)
+    mu_run_test(test_remove)
+    mu_run_test(test_many)
+    mu_run_test(test_weights)
+
+    e_free(t_edges);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
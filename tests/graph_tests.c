@@ -0,0 +1,743 @@
+// Test graph implementation
+
+#include "minunit.h"
+#include "../src/graph.h"
+#include "../src/hash.h"
+#include "../src/dbg.h"
+
+mu_suite_start();
+
+static Graph *t_graph = NULL;
+
+// Check that greater comes before lesser in the sorted graph
+static int before(Graph *graph, char greater[], char lesser[])
+{
+    Value *greater_v = g_lookup(graph, greater);
+    Value *lesser_v = g_lookup(graph, lesser);
+
+    return greater_v && lesser_v && g_before(greater_v, lesser_v);
+}
+
+// Check whether greater > lesser is in the graph
+static int related(Graph *graph, char greater[], char lesser[])
+{
+    Value *value = g_lookup(graph, greater);
+    if(!value) return 0;
+
+    for(int i = 0; i < g_degree(graph, value, DIR_LOWER); i++) {
+        if(strcmp(g_relation(graph, value, DIR_LOWER, i)->value, lesser) == 0) return 1;
+    }
+    return 0;
+}
+
+// Check the conflict from rejecting greater > lesser is a cycle through it,
+//   made of relations in the graph
+static char *check_cycle(Graph *graph, char greater[], char lesser[])
+{
+    Conflict *conflict = g_conflict(graph);
+    mu_assert(conflict && conflict->count == 1, "Expected one cycle for %s > %s", greater, lesser)
+
+    char **names = conflict->names;
+    int length = conflict->starts[1];
+    mu_assert(length >= 2 && strcmp(names[0], greater) == 0 && strcmp(names[1], lesser) == 0,
+            "Cycle for %s > %s doesn't start with it", greater, lesser)
+
+    for(int i = 1; i < length; i++) {
+        char *next = names[(i + 1) % length];
+        mu_assert(related(graph, names[i], next), "%s > %s in cycle for %s > %s isn't a relation",
+                names[i], next, greater, lesser)
+    }
+
+    return NULL;
+}
+
+static char *test_new(void)
+{
+    t_graph = new_graph();
+
+    mu_assert(t_graph, "Graph not created")
+    mu_assert(t_graph->length == 0, "New graph not empty")
+    return NULL;
+}
+
+static char *test_apply(void)
+{
+    mu_assert(g_apply_relation(t_graph, "five", "two") == 0, "Failed to apply five > two")
+    mu_assert(g_apply_relation(t_graph, "five", "zero") == 0, "Failed to apply five > zero")
+    mu_assert(g_apply_relation(t_graph, "two", "three") == 0, "Failed to apply two > three")
+    mu_assert(g_apply_relation(t_graph, "three", "one") == 0, "Failed to apply three > one")
+    mu_assert(g_apply_relation(t_graph, "four", "one") == 0, "Failed to apply four > one")
+    mu_assert(g_apply_relation(t_graph, "four", "zero") == 0, "Failed to apply four > zero")
+    mu_assert(g_apply_relation(t_graph, "four", "five") == 0, "Failed to apply four > five")
+
+    mu_assert(t_graph->length == 6, "Graph length incorrect, got %i", t_graph->length)
+
+    mu_assert(before(t_graph, "five", "two"), "five not before two")
+    mu_assert(before(t_graph, "five", "zero"), "five not before zero")
+    mu_assert(before(t_graph, "two", "three"), "two not before three")
+    mu_assert(before(t_graph, "three", "one"), "three not before one")
+    mu_assert(before(t_graph, "four", "one"), "four not before one")
+    mu_assert(before(t_graph, "four", "zero"), "four not before zero")
+    mu_assert(before(t_graph, "four", "five"), "four not before five")
+
+    return NULL;
+}
+
+static char *test_conflict(void)
+{
+    mu_assert(g_apply_relation(t_graph, "zero", "four") == ERR_RELATIONAL_CONFLICT,
+            "Cyclic relation zero > four not rejected")
+    mu_assert(before(t_graph, "four", "zero"), "four moved after zero by rejected relation")
+
+    // both sides of the search meet in the middle
+    mu_assert(g_apply_relation(t_graph, "one", "five") == ERR_RELATIONAL_CONFLICT,
+            "Cyclic relation one > five not rejected")
+    char *err = check_cycle(t_graph, "one", "five");
+    if(err) return err;
+
+    Conflict *conflict = g_conflict(t_graph);
+    mu_assert(conflict->starts[1] == 4, "Expected one > five > two > three, got %i values", conflict->starts[1])
+
+    return NULL;
+}
+
+static char *test_find(void)
+{
+    int i = 0;
+    Value *value = g_find(t_graph, hash("three"), &i);
+
+    mu_assert(value, "three not found")
+    mu_assert(strcmp(value->value, "three") == 0, "Found wrong value %s", value->value)
+    mu_assert(i >= 0 && i < t_graph->length, "Index %i out of range", i)
+
+    value = g_find(t_graph, hash("six"), &i);
+    mu_assert(!value, "Found value that was never added")
+    mu_assert(i == -1, "Index not reset for missing value")
+
+    mu_assert(g_lookup(t_graph, "zero") != NULL, "Lookup of zero failed")
+    mu_assert(g_lookup(t_graph, "six") == NULL, "Lookup of six succeeded")
+
+    return NULL;
+}
+
+static char *test_order(void)
+{
+    int i = 0;
+    for(Value *value = t_graph->start; value; value = value->next) {
+        int index = 0;
+        mu_assert(g_find(t_graph, value->id, &index) == value, "%s not found", value->value)
+        mu_assert(index == i, "Index of %s is %i, expected %i", value->value, index, i)
+        if(value->next) mu_assert(g_before(value, value->next), "%s not before next value", value->value)
+        i++;
+    }
+
+    return NULL;
+}
+
+static char *test_relabel(void)
+{
+    Graph *graph = new_graph();
+    char name[16];
+
+    // Repeatedly inserting in the same place runs out of gaps and forces relabels
+    snprintf(name, sizeof(name), "pivot");
+    Value *pivot = new_value(name);
+    g_push(graph, pivot);
+
+    for(int i = 0; i < 2000; i++) {
+        snprintf(name, sizeof(name), "v%i", i);
+        Value *value = new_value(name);
+        mu_assert(value, "Failed to make value")
+
+        switch(i % 3) {
+            case 0: g_insert_before(graph, pivot, value); break;
+            case 1: g_insert_after(graph, pivot->prev, value); break;
+            default: g_push(graph, value); break;
+        }
+    }
+
+    mu_assert(graph->length == 2001, "Graph length incorrect, got %i", graph->length)
+    for(Value *value = graph->start; value->next; value = value->next) {
+        mu_assert(g_before(value, value->next), "Labels out of order at %s", value->value)
+    }
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_sorted(void)
+{
+    int size = 0;
+    char **sorted = g_sorted(t_graph, &size);
+
+    mu_assert(sorted, "Sorted list not returned")
+    mu_assert(size == t_graph->length, "Sorted size %i doesn't match length", size)
+    mu_assert(strcmp(sorted[0], t_graph->start->value) == 0, "Sorted list doesn't start with graph start")
+
+    free(sorted);
+    return NULL;
+}
+
+static char *test_iter(void)
+{
+    int size = 0;
+    char **sorted = g_sorted(t_graph, &size);
+    Iter iter = g_iter_begin(t_graph);
+    Value *value = NULL;
+
+    int i = 0;
+    while((value = g_iter_next(&iter))) {
+        mu_assert(i < size, "Iterator gave more values than the graph has")
+        mu_assert(strcmp(value->value, sorted[i]) == 0, "Iterator gave %s at %i, expected %s", value->value, i, sorted[i])
+        i++;
+    }
+    mu_assert(i == size, "Iterator stopped after %i of %i values", i, size)
+    mu_assert(g_iter_next(&iter) == NULL, "Iterator went past the end")
+    free(sorted);
+
+    // the value just given can be removed
+    Graph *graph = new_graph();
+    g_apply_relation(graph, "a", "b");
+    g_apply_relation(graph, "b", "c");
+    iter = g_iter_begin(graph);
+    i = 0;
+    while((value = g_iter_next(&iter))) {
+        mu_assert(g_remove_value(graph, value->value) == 0, "Failed to remove while iterating")
+        i++;
+    }
+    mu_assert(i == 3 && graph->length == 0, "Removing while iterating missed values")
+
+    iter = g_iter_begin(graph);
+    mu_assert(g_iter_next(&iter) == NULL, "Iterator over an empty graph gave a value")
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_large(void)
+{
+    Graph *graph = new_graph();
+    char greater[16];
+    char lesser[16];
+
+    // Long enough chain that recursing over it would exhaust the stack
+    for(int i = 0; i < 300000; i++) {
+        snprintf(greater, sizeof(greater), "c%i", i);
+        snprintf(lesser, sizeof(lesser), "c%i", i + 1);
+        mu_assert(g_apply_relation(graph, greater, lesser) == 0, "Failed to apply %s > %s", greater, lesser)
+    }
+
+    mu_assert(graph->length == 300001, "Graph length incorrect, got %i", graph->length)
+    mu_assert(g_apply_relation(graph, "c300000", "c0") == ERR_RELATIONAL_CONFLICT, "Cycle through chain not rejected")
+    char *err = check_cycle(graph, "c300000", "c0");
+    if(err) return err;
+    mu_assert(g_conflict(graph)->starts[1] == 300001, "Cycle should be the whole chain, got %i values",
+            g_conflict(graph)->starts[1])
+
+    int size = 0;
+    char **sorted = g_sorted(graph, &size);
+    mu_assert(size == 300001, "Sorted size incorrect, got %i", size)
+    mu_assert(strcmp(sorted[size - 1], "c300000") == 0, "Chain not in order, ends with %s", sorted[size - 1])
+
+    free(sorted);
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_batch(void)
+{
+    Graph *graphs[2] = { new_graph(), new_graph_malloc() };
+
+    for(int g = 0; g < 2; g++) {
+        Graph *graph = graphs[g];
+        g_apply_relation(graph, "x", "y");
+        g_apply_relation(graph, "y", "c");
+        mu_assert(g_freeze(graph) == 0, "Failed to freeze")
+
+        char *greater[] = { "a", "b", "c", "x", "e", "e" };
+        char *lesser[] = { "b", "c", "d", "a", "d", "b" };
+        mu_assert(g_apply_relations_batch(graph, greater, lesser, 6) == 0, "Failed to apply batch to graph %i", g)
+        mu_assert(graph->length == 7, "Graph %i length incorrect, got %i", g, graph->length)
+
+        for(int i = 0; i < 6; i++) {
+            mu_assert(before(graph, greater[i], lesser[i]), "%s not before %s in graph %i", greater[i], lesser[i], g)
+        }
+        mu_assert(before(graph, "x", "y") && before(graph, "y", "c"), "Earlier relations lost in graph %i", g)
+
+        // a cycle rejects the whole batch, including new values and relations
+        char *cyclic_greater[] = { "z", "d", "a" };
+        char *cyclic_lesser[] = { "a", "x", "z" };
+        mu_assert(g_apply_relations_batch(graph, cyclic_greater, cyclic_lesser, 3) == ERR_RELATIONAL_CONFLICT,
+                "Cycle not rejected in graph %i", g)
+        mu_assert(graph->length == 7, "Graph %i length changed by rejected batch, got %i", g, graph->length)
+        mu_assert(g_lookup(graph, "z") == NULL, "z added by rejected batch in graph %i", g)
+        mu_assert(g_degree(graph, g_lookup(graph, "d"), DIR_LOWER) == 0, "d kept rejected relation in graph %i", g)
+        mu_assert(g_degree(graph, g_lookup(graph, "a"), DIR_HIGHER) == 1, "a kept rejected relation in graph %i", g)
+
+        Conflict *conflict = g_conflict(graph);
+        mu_assert(conflict && conflict->count == 1 && conflict->starts[1] == 7,
+                "Expected one cycle through 7 values in graph %i", g)
+
+        char *self[] = { "q" };
+        mu_assert(g_apply_relations_batch(graph, self, self, 1) == ERR_RELATIONAL_CONFLICT,
+                "Relation to itself not rejected in graph %i", g)
+        conflict = g_conflict(graph);
+        mu_assert(conflict && conflict->count == 1 && strcmp(conflict->names[0], "q") == 0,
+                "Relation to itself not reported in graph %i", g)
+
+        // relabeled graph can still be updated one relation at a time
+        mu_assert(g_apply_relation(graph, "d", "f") == 0, "Failed to apply after batch")
+        mu_assert(g_apply_relation(graph, "f", "x") == ERR_RELATIONAL_CONFLICT, "Cycle after batch not rejected")
+        mu_assert(before(graph, "d", "f"), "d not before f")
+
+        g_free(graph);
+    }
+
+    // the other way around from test_large, so every value has to move
+    Graph *graph = new_graph();
+    int count = 300000;
+    char **names = malloc(sizeof(char *) * (size_t)(count + 1));
+    mu_assert(names, "Out of memory")
+    for(int i = 0; i <= count; i++) {
+        names[i] = malloc(16);
+        snprintf(names[i], 16, "c%i", count - i);
+    }
+
+    mu_assert(g_apply_relations_batch(graph, names + 1, names, count) == 0, "Failed to apply chain")
+    mu_assert(graph->length == count + 1, "Chain length incorrect, got %i", graph->length)
+    mu_assert(strcmp(graph->start->value, "c0") == 0, "Chain starts with %s", graph->start->value)
+    mu_assert(strcmp(graph->end->value, "c300000") == 0, "Chain ends with %s", graph->end->value)
+    for(Value *value = graph->start; value->next; value = value->next) {
+        mu_assert(g_before(value, value->next), "Labels out of order at %s", value->value)
+    }
+
+    for(int i = 0; i <= count; i++) free(names[i]);
+    free(names);
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_views(void)
+{
+    Graph *graph = new_graph();
+    const char buffer[] = "alphabetagamma";
+    View alpha = { buffer, 5 };
+    View beta = { buffer + 5, 4 };
+    View gamma = { buffer + 9, 5 };
+
+    // views into one buffer, none of them null-terminated
+    mu_assert(g_apply_relation_n(graph, alpha, beta) == 0, "Failed to apply alpha > beta")
+    mu_assert(g_apply_relation_n(graph, beta, gamma) == 0, "Failed to apply beta > gamma")
+    mu_assert(g_apply_relation_n(graph, gamma, alpha) == ERR_RELATIONAL_CONFLICT, "gamma > alpha not rejected")
+    mu_assert(graph->length == 3, "Graph length incorrect, got %i", graph->length)
+    mu_assert(before(graph, "alpha", "beta") && before(graph, "beta", "gamma"), "Views not applied in order")
+
+    View greater[] = { gamma };
+    View lesser[] = { { "delta", 5 } };
+    mu_assert(g_apply_relations_batch_n(graph, greater, lesser, 1) == 0, "Failed to apply batch of views")
+    mu_assert(before(graph, "gamma", "delta"), "gamma not before delta")
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_freeze(void)
+{
+    Graph *graph = new_graph();
+    g_apply_relation(graph, "a", "b");
+    g_apply_relation(graph, "a", "c");
+    g_apply_relation(graph, "b", "c");
+
+    mu_assert(g_freeze(graph) == 0, "Failed to freeze")
+    mu_assert(graph->frozen->length == 3, "Frozen length incorrect, got %u", graph->frozen->length)
+
+    Value *a = g_lookup(graph, "a");
+    Value *b = g_lookup(graph, "b");
+    Value *c = g_lookup(graph, "c");
+    mu_assert(g_degree(graph, a, DIR_LOWER) == 2, "a should have 2 lower values")
+    mu_assert(g_degree(graph, c, DIR_HIGHER) == 2, "c should have 2 higher values")
+    mu_assert(g_relation(graph, a, DIR_LOWER, 0) == b, "b not first lower value of a")
+    mu_assert(g_relation(graph, c, DIR_HIGHER, 1) == b, "b not second higher value of c")
+    mu_assert(a->lower.length == 0, "Vector not cleared after freezing")
+
+    // relations added after freezing come after the frozen ones
+    g_apply_relation(graph, "a", "d");
+    g_apply_relation(graph, "d", "b");
+    Value *d = g_lookup(graph, "d");
+    mu_assert(g_degree(graph, a, DIR_LOWER) == 3, "a should have 3 lower values")
+    mu_assert(g_relation(graph, a, DIR_LOWER, 2) == d, "d not last lower value of a")
+    mu_assert(g_degree(graph, d, DIR_HIGHER) == 1, "d should have 1 higher value")
+    mu_assert(g_before(d, b), "d not before b")
+
+    mu_assert(g_freeze(graph) == 0, "Failed to freeze again")
+    mu_assert(g_degree(graph, a, DIR_LOWER) == 3, "a lost lower values when refrozen")
+    mu_assert(g_relation(graph, b, DIR_HIGHER, 1) == d, "d not second higher value of b")
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_reset(void)
+{
+    Graph *graphs[2] = { new_graph(), new_graph_malloc() };
+
+    for(int i = 0; i < 2; i++) {
+        Graph *graph = graphs[i];
+        mu_assert(graph, "Graph %i not created", i)
+
+        for(int round = 0; round < 3; round++) {
+            g_apply_relation(graph, "a", "b");
+            g_apply_relation(graph, "b", "c");
+            g_apply_relation(graph, "c", "d");
+            g_apply_relation(graph, "a", "d");
+            mu_assert(graph->length == 4, "Graph %i length incorrect, got %i", i, graph->length)
+            mu_assert(g_before(g_lookup(graph, "a"), g_lookup(graph, "d")), "a not before d")
+
+            g_reset(graph);
+            mu_assert(graph->length == 0, "Graph %i not empty after reset", i)
+            mu_assert(g_lookup(graph, "a") == NULL, "a still in graph %i after reset", i)
+        }
+
+        g_free(graph);
+    }
+
+    return NULL;
+}
+
+static char *test_lattice(void)
+{
+    Graph *graph = new_graph();
+    char greater[16];
+    char lesser[16];
+
+    // 2^40 paths from top to bottom, so this only finishes if values are visited once
+    for(int level = 0; level < 40; level++) {
+        for(int i = 0; i < 4; i++) {
+            snprintf(greater, sizeof(greater), "l%i_%i", level, i / 2);
+            snprintf(lesser, sizeof(lesser), "l%i_%i", level + 1, i % 2);
+            mu_assert(g_apply_relation(graph, greater, lesser) == 0, "Failed to apply %s > %s", greater, lesser)
+        }
+    }
+
+    mu_assert(g_apply_relation(graph, "l40_0", "l0_1") == ERR_RELATIONAL_CONFLICT, "Cycle through lattice not rejected")
+
+    g_free(graph);
+    return NULL;
+}
+
+#define RANDOM_VALUES 500
+#define RANDOM_RELATIONS 4000
+
+// Check whether there's a path down from one value to another
+// Values are named n<index>, seen is indexed the same way
+static int reaches(Graph *graph, Value *from, Value *to, int *seen)
+{
+    Vector *stack = new_vector();
+    int found = 0;
+    memset(seen, 0, sizeof(int) * RANDOM_VALUES);
+
+    v_push(stack, from);
+    Value *value = NULL;
+    while(!found && (value = v_pop(stack))) {
+        if(value == to) found = 1;
+
+        int i = atoi(value->value + 1);
+        if(seen[i]) continue;
+        seen[i] = 1;
+
+        for(int j = 0; j < g_degree(graph, value, DIR_LOWER); j++) v_push(stack, g_relation(graph, value, DIR_LOWER, j));
+    }
+
+    v_free(stack);
+    return found;
+}
+
+static char *test_random(void)
+{
+    Graph *graph = new_graph();
+    int seen[RANDOM_VALUES];
+    char greater[16];
+    char lesser[16];
+    int conflicts = 0;
+
+    srand(1);
+    for(int i = 0; i < RANDOM_RELATIONS; i++) {
+        // freeze part way through so both frozen and added relations are searched
+        if(i == RANDOM_RELATIONS / 2) mu_assert(g_freeze(graph) == 0, "Failed to freeze")
+
+        int a = rand() % RANDOM_VALUES;
+        int b = rand() % RANDOM_VALUES;
+        if(a == b) continue;
+
+        snprintf(greater, sizeof(greater), "n%i", a);
+        snprintf(lesser, sizeof(lesser), "n%i", b);
+
+        int rc = g_apply_relation(graph, greater, lesser);
+        if(rc == ERR_DUPLICATE) {
+            mu_assert(before(graph, greater, lesser), "Duplicate %s > %s out of order", greater, lesser)
+        } else if(rc == ERR_RELATIONAL_CONFLICT) {
+            // only allowed if lesser is already above greater
+            conflicts++;
+            mu_assert(reaches(graph, g_lookup(graph, lesser), g_lookup(graph, greater), seen),
+                    "%s > %s rejected without a cycle", greater, lesser)
+            char *err = check_cycle(graph, greater, lesser);
+            if(err) return err;
+        } else {
+            mu_assert(rc == 0, "Failed to apply %s > %s", greater, lesser)
+        }
+    }
+
+    mu_assert(conflicts > 0, "No conflicts tested")
+
+    // every relation kept has to hold in the final order
+    for(Value *value = graph->start; value; value = value->next) {
+        if(value->next) mu_assert(g_before(value, value->next), "Labels out of order at %s", value->value)
+
+        for(int j = 0; j < g_degree(graph, value, DIR_LOWER); j++) {
+            Value *lower = g_relation(graph, value, DIR_LOWER, j);
+            mu_assert(g_before(value, lower), "%s not before %s", value->value, lower->value)
+        }
+    }
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_remove(void)
+{
+    Graph *graphs[2] = { new_graph(), new_graph_malloc() };
+
+    for(int i = 0; i < 2; i++) {
+        Graph *graph = graphs[i];
+        g_apply_relation(graph, "a", "b");
+        g_apply_relation(graph, "b", "c");
+        g_apply_relation(graph, "a", "c");
+        mu_assert(g_freeze(graph) == 0, "Failed to freeze")
+        // one relation that isn't frozen
+        g_apply_relation(graph, "c", "d");
+
+        Value *a = g_lookup(graph, "a");
+        Value *c = g_lookup(graph, "c");
+        mu_assert(g_remove_relation(graph, "a", "c") == 0, "Failed to remove frozen a > c")
+        mu_assert(g_degree(graph, a, DIR_LOWER) == 1, "a should have 1 lower value")
+        mu_assert(g_degree(graph, c, DIR_HIGHER) == 1, "c should have 1 higher value")
+        mu_assert(g_remove_relation(graph, "a", "c") == ERR_NOT_FOUND, "a > c removed twice")
+        mu_assert(g_remove_relation(graph, "c", "d") == 0, "Failed to remove added c > d")
+        mu_assert(g_degree(graph, c, DIR_LOWER) == 0, "c should have no lower values")
+        mu_assert(g_remove_relation(graph, "a", "x") == ERR_NOT_FOUND, "Missing value not reported")
+        mu_assert(graph->length == 4, "Values removed with their relations")
+
+        // d > a is fine now c > d is gone
+        mu_assert(g_apply_relation(graph, "d", "a") == 0, "Failed to apply d > a")
+        mu_assert(before(graph, "d", "a"), "d not before a")
+
+        mu_assert(g_remove_value(graph, "b") == 0, "Failed to remove b")
+        mu_assert(g_lookup(graph, "b") == NULL, "b still found")
+        mu_assert(graph->length == 4 - 1, "Graph length incorrect, got %i", graph->length)
+        mu_assert(g_degree(graph, a, DIR_LOWER) == 0, "a still has b as a lower value")
+        mu_assert(g_degree(graph, c, DIR_HIGHER) == 0, "c still has b as a higher value")
+        mu_assert(g_remove_value(graph, "b") == ERR_NOT_FOUND, "b removed twice")
+
+        // c > a would have been a cycle through b
+        mu_assert(g_apply_relation(graph, "c", "a") == 0, "Failed to apply c > a")
+        mu_assert(g_apply_relation(graph, "b", "c") == 0, "Failed to add b back")
+        mu_assert(before(graph, "b", "c") && before(graph, "c", "a"), "b, c, a not in order")
+        mu_assert(g_freeze(graph) == 0, "Failed to freeze after removing")
+        mu_assert(g_degree(graph, g_lookup(graph, "b"), DIR_LOWER) == 1, "b should have 1 lower value")
+
+        g_free(graph);
+    }
+
+    return NULL;
+}
+
+static char *test_duplicates(void)
+{
+    Graph *graph = new_graph();
+
+    mu_assert(g_apply_relation(graph, "a", "b") == 0, "Failed to apply a > b")
+    mu_assert(g_apply_relation(graph, "a", "b") == ERR_DUPLICATE, "Duplicate a > b not reported")
+    mu_assert(g_degree(graph, g_lookup(graph, "a"), DIR_LOWER) == 1, "Duplicate added to a")
+    mu_assert(g_degree(graph, g_lookup(graph, "b"), DIR_HIGHER) == 1, "Duplicate added to b")
+    mu_assert(graph->duplicates == 1, "Duplicates should be 1, got %lu", graph->duplicates)
+
+    // still caught once the relation is frozen, and gone once it's removed
+    mu_assert(g_freeze(graph) == 0, "Failed to freeze")
+    mu_assert(g_apply_relation(graph, "a", "b") == ERR_DUPLICATE, "Frozen duplicate not reported")
+    mu_assert(g_remove_relation(graph, "a", "b") == 0, "Failed to remove a > b")
+    mu_assert(g_apply_relation(graph, "a", "b") == 0, "Failed to apply a > b after removing")
+
+    // duplicates of the graph and within a batch are both skipped
+    char *greater[] = { "a", "b", "b", "c" };
+    char *lesser[] = { "b", "c", "c", "d" };
+    mu_assert(g_apply_relations_batch(graph, greater, lesser, 4) == 0, "Failed to apply batch")
+    mu_assert(graph->duplicates == 4, "Duplicates should be 4, got %lu", graph->duplicates)
+    mu_assert(g_degree(graph, g_lookup(graph, "b"), DIR_LOWER) == 1, "b should have 1 lower value")
+
+    // a rejected batch doesn't count its duplicates, or leave its relations behind
+    char *cyclic_greater[] = { "c", "c", "d" };
+    char *cyclic_lesser[] = { "d", "e", "a" };
+    mu_assert(g_apply_relations_batch(graph, cyclic_greater, cyclic_lesser, 3) == ERR_RELATIONAL_CONFLICT, "Cycle not found")
+    mu_assert(graph->duplicates == 4, "Rejected batch counted, got %lu", graph->duplicates)
+    mu_assert(g_apply_relation(graph, "c", "d") == ERR_DUPLICATE, "c > d lost with rejected batch")
+    mu_assert(g_degree(graph, g_lookup(graph, "c"), DIR_LOWER) == 1, "c kept relations from rejected batch")
+
+    g_reset(graph);
+    mu_assert(graph->duplicates == 0, "Duplicates not reset")
+    mu_assert(g_apply_relation(graph, "a", "b") == 0, "Failed to apply a > b after reset")
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_cycles(void)
+{
+    Graph *graph = new_graph();
+    mu_assert(g_apply_relation(graph, "top", "a") == 0, "Failed to apply top > a")
+    mu_assert(g_conflict(graph) == NULL, "Conflict without a cycle")
+
+    // two separate cycles, with values hanging off them that aren't on either
+    char *greater[] = { "a", "b", "c", "c", "x", "y", "y", "d" };
+    char *lesser[] = { "b", "c", "a", "d", "y", "x", "e", "e" };
+    mu_assert(g_apply_relations_batch(graph, greater, lesser, 8) == ERR_RELATIONAL_CONFLICT, "Cycles not found")
+
+    Conflict *conflict = g_conflict(graph);
+    mu_assert(conflict && conflict->count == 2, "Expected 2 cycles, got %i", conflict ? conflict->count : 0)
+
+    int found[2] = { 0, 0 };
+    for(int i = 0; i < conflict->count; i++) {
+        int length = conflict->starts[i + 1] - conflict->starts[i];
+        char *first = conflict->names[conflict->starts[i]];
+        int which = strchr("abc", first[0]) ? 0 : 1;
+        mu_assert(length == (which ? 2 : 3), "Cycle through %s has %i values", first, length)
+
+        for(int j = conflict->starts[i]; j < conflict->starts[i + 1]; j++) {
+            char *name = conflict->names[j];
+            mu_assert(strchr(which ? "xy" : "abc", name[0]) && strlen(name) == 1, "%s in the wrong cycle", name)
+        }
+        found[which]++;
+    }
+    mu_assert(found[0] == 1 && found[1] == 1, "Both cycles should be found once")
+
+    // a relation to itself is a cycle of one, whether or not the value's there
+    int length = graph->length;
+    mu_assert(g_apply_relation(graph, "top", "top") == ERR_RELATIONAL_CONFLICT, "top > top not rejected")
+    conflict = g_conflict(graph);
+    mu_assert(conflict && conflict->count == 1 && conflict->starts[1] == 1 && strcmp(conflict->names[0], "top") == 0,
+            "top > top not kept as a conflict")
+    mu_assert(g_degree(graph, g_lookup(graph, "top"), DIR_LOWER) == 1, "top > top added")
+    mu_assert(g_degree(graph, g_lookup(graph, "top"), DIR_HIGHER) == 0, "top > top added")
+
+    mu_assert(g_apply_relation(graph, "self", "self") == ERR_RELATIONAL_CONFLICT, "self > self not rejected")
+    mu_assert(strcmp(g_conflict(graph)->names[0], "self") == 0, "self > self not kept as a conflict")
+    mu_assert(g_lookup(graph, "self") == NULL && graph->length == length, "self > self added a value")
+
+    // and leaves nothing behind to trip up the next batch
+    char *next_greater[] = { "top", "p" };
+    char *next_lesser[] = { "p", "q" };
+    mu_assert(g_apply_relations_batch(graph, next_greater, next_lesser, 2) == 0, "Batch failed after a self relation")
+    conflict = g_conflict(graph);
+
+    // kept until the next conflict, and gone after a reset
+    mu_assert(g_apply_relation(graph, "a", "z") == 0, "Failed to apply a > z")
+    mu_assert(g_conflict(graph) == conflict, "Conflict dropped by a good relation")
+    g_reset(graph);
+    mu_assert(g_conflict(graph) == NULL, "Conflict not reset")
+
+    g_free(graph);
+    return NULL;
+}
+
+// Adds and removes in equal measure, as a graph tracking changing dependencies would
+static char *test_churn(void)
+{
+    Graph *graph = new_graph();
+    char greater[16];
+    char lesser[16];
+    int removed = 0;
+
+    srand(2);
+    for(int i = 0; i < RANDOM_RELATIONS * 4; i++) {
+        // freeze now and then so removals hit frozen rows as well as vectors
+        if(i % (RANDOM_RELATIONS / 2) == 0) mu_assert(g_freeze(graph) == 0, "Failed to freeze")
+
+        int a = rand() % RANDOM_VALUES;
+        int b = rand() % RANDOM_VALUES;
+        if(a == b) continue;
+
+        snprintf(greater, sizeof(greater), "n%i", a);
+        snprintf(lesser, sizeof(lesser), "n%i", b);
+
+        int action = rand() % 16;
+        int rc = 0;
+        if(action == 0) {
+            rc = g_remove_value(graph, greater);
+        } else if(action < 8) {
+            // usually there's no relation, so remove the first lower value instead
+            Value *value = g_lookup(graph, greater);
+            if(value && g_degree(graph, value, DIR_LOWER)) {
+                snprintf(lesser, sizeof(lesser), "%s", g_relation(graph, value, DIR_LOWER, 0)->value);
+            }
+            rc = g_remove_relation(graph, greater, lesser);
+        } else {
+            rc = g_apply_relation(graph, greater, lesser);
+        }
+
+        if(rc == 0 && action < 8) removed++;
+        mu_assert(rc == 0 || rc == ERR_NOT_FOUND || rc == ERR_RELATIONAL_CONFLICT || rc == ERR_DUPLICATE,
+                "Unexpected error %i at step %i", rc, i)
+    }
+
+    mu_assert(removed > RANDOM_RELATIONS, "Too few removals tested, only %i", removed)
+
+    // the order still holds, and both directions agree
+    int length = 0;
+    int lower = 0;
+    int higher = 0;
+    for(Value *value = graph->start; value; value = value->next, length++) {
+        if(value->next) mu_assert(g_before(value, value->next), "Labels out of order at %s", value->value)
+        mu_assert(g_lookup(graph, value->value) == value, "%s not found", value->value)
+
+        lower += g_degree(graph, value, DIR_LOWER);
+        higher += g_degree(graph, value, DIR_HIGHER);
+        for(int j = 0; j < g_degree(graph, value, DIR_LOWER); j++) {
+            Value *related = g_relation(graph, value, DIR_LOWER, j);
+            mu_assert(g_lookup(graph, related->value) == related, "%s has removed lower value", value->value)
+            mu_assert(g_before(value, related), "%s not before %s", value->value, related->value)
+        }
+    }
+    mu_assert(length == graph->length, "Graph length %i but %i values linked", graph->length, length)
+    mu_assert(lower == higher, "%i lower relations but %i higher", lower, higher)
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_new)
+    mu_run_test(test_apply)
+    mu_run_test(test_conflict)
+    mu_run_test(test_find)
+    mu_run_test(test_order)
+    mu_run_test(test_relabel)
+    mu_run_test(test_sorted)
+    mu_run_test(test_iter)
+    mu_run_test(test_large)
+    mu_run_test(test_batch)
+    mu_run_test(test_views)
+    mu_run_test(test_freeze)
+    mu_run_test(test_reset)
+    mu_run_test(test_lattice)
+    mu_run_test(test_random)
+    mu_run_test(test_remove)
+    mu_run_test(test_duplicates)
+    mu_run_test(test_cycles)
+    mu_run_test(test_churn)
+
+    g_free(t_graph);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
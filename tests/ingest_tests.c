@@ -0,0 +1,144 @@
+// Test parallel relation file loader
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "minunit.h"
+#include "../src/ingest.h"
+#include "../src/dbg.h"
+
+#define RELATIONS 20000
+#define VALUES 3000
+
+mu_suite_start();
+
+static char t_path[] = "/tmp/ingest_testsXXXXXX";
+
+// Check that greater comes before lesser in the sorted graph
+static int before(Graph *graph, char greater[], char lesser[])
+{
+    Value *greater_v = g_lookup(graph, greater);
+    Value *lesser_v = g_lookup(graph, lesser);
+
+    return greater_v && lesser_v && g_before(greater_v, lesser_v);
+}
+
+// Write a file to load, replacing the last one
+static int write_file(const char *data)
+{
+    FILE *file = fopen(t_path, "w");
+    if(!file) return 1;
+
+    int rc = fputs(data, file) < 0;
+    return fclose(file) || rc;
+}
+
+static char *test_small(void)
+{
+    int fd = mkstemp(t_path);
+    mu_assert(fd != -1, "Couldn't make a temporary file")
+    close(fd);
+
+    mu_assert(write_file("a > b\nc < b\nnot a relation\n\nb > d\n") == 0, "Couldn't write file")
+
+    // more threads than lines, so some chunks are empty
+    for(int threads = 1; threads <= 8; threads++) {
+        Graph *graph = new_graph();
+        Ingest stats;
+
+        mu_assert(in_load(graph, t_path, threads, &stats) == 0, "Failed to load with %i threads", threads)
+        mu_assert(stats.threads == threads, "Wrong thread count %i", stats.threads)
+        mu_assert(stats.relations == 3, "Should be 3 relations with %i threads, got %i", threads, stats.relations)
+        mu_assert(stats.invalid == 1, "Should be 1 invalid line with %i threads, got %i", threads, stats.invalid)
+        mu_assert(graph->length == 4, "Graph length should be 4 with %i threads, got %i", threads, graph->length)
+        mu_assert(before(graph, "a", "b") && before(graph, "b", "c") && before(graph, "b", "d"),
+                "Relations don't hold with %i threads", threads)
+
+        g_free(graph);
+    }
+
+    return NULL;
+}
+
+static char *test_existing(void)
+{
+    Graph *graph = new_graph();
+    g_apply_relation(graph, "x", "a");
+
+    mu_assert(write_file("a > b\nb > c") == 0, "Couldn't write file")
+    mu_assert(in_load(graph, t_path, 2, NULL) == 0, "Failed to load into existing graph")
+    mu_assert(graph->length == 4, "Graph length should be 4, got %i", graph->length)
+    mu_assert(before(graph, "x", "a") && before(graph, "b", "c"), "Relations don't hold")
+
+    // a cycle rejects the whole file
+    mu_assert(write_file("c > d\nd > x\n") == 0, "Couldn't write file")
+    mu_assert(in_load(graph, t_path, 2, NULL) == ERR_RELATIONAL_CONFLICT, "Cycle not rejected")
+    mu_assert(graph->length == 4, "Graph length changed by rejected file, got %i", graph->length)
+    mu_assert(g_lookup(graph, "d") == NULL, "d added by rejected file")
+
+    mu_assert(in_load(graph, "/tmp/ingest_tests_missing", 2, NULL) == -1, "Missing file loaded")
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_random(void)
+{
+    FILE *file = fopen(t_path, "w");
+    mu_assert(file, "Couldn't write file")
+
+    // relations always point from the lower number to the higher, so no cycles
+    srand(1);
+    for(int i = 0; i < RELATIONS; i++) {
+        int a = rand() % VALUES;
+        int b = rand() % VALUES;
+        if(a == b) continue;
+
+        if(a < b) fprintf(file, "n%i > n%i\n", a, b);
+        else fprintf(file, "n%i < n%i\n", a, b);
+    }
+    fclose(file);
+
+    Graph *single = new_graph();
+    mu_assert(in_load(single, t_path, 1, NULL) == 0, "Failed to load with 1 thread")
+
+    for(int threads = 2; threads <= 16; threads *= 2) {
+        Graph *graph = new_graph();
+        mu_assert(in_load(graph, t_path, threads, NULL) == 0, "Failed to load with %i threads", threads)
+        mu_assert(graph->length == single->length, "Graph length with %i threads %i, expected %i",
+                threads, graph->length, single->length)
+
+        // relations are applied in file order whatever the number of threads, so every
+        //   value has the same relations in the same order as with one thread
+        for(Value *value = graph->start; value; value = value->next) {
+            Value *other = g_lookup(single, value->value);
+            mu_assert(other, "%s missing with 1 thread", value->value)
+            mu_assert(g_degree(graph, value, DIR_LOWER) == g_degree(single, other, DIR_LOWER),
+                    "%s has different relations with %i threads", value->value, threads)
+
+            for(int j = 0; j < g_degree(graph, value, DIR_LOWER); j++) {
+                Value *lower = g_relation(graph, value, DIR_LOWER, j);
+                mu_assert(g_before(value, lower), "%s not before %s", value->value, lower->value)
+                mu_assert(strcmp(lower->value, g_relation(single, other, DIR_LOWER, j)->value) == 0,
+                        "Relations of %s in a different order with %i threads", value->value, threads)
+            }
+        }
+
+        g_free(graph);
+    }
+
+    g_free(single);
+    unlink(t_path);
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_small)
+    mu_run_test(test_existing)
+    mu_run_test(test_random)
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
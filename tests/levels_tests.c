@@ -0,0 +1,128 @@
+// Test level-synchronous sort
+
+#include "minunit.h"
+#include "../src/levels.h"
+#include "../src/dbg.h"
+
+#define RANDOM_VALUES 2000
+#define RANDOM_RELATIONS 20000
+
+mu_suite_start();
+
+// Check levels are consistent with the graph: each value is one level below its
+//   lowest higher value, and the order is grouped by level
+static char *check_levels(Graph *graph, Levels *levels)
+{
+    mu_assert(levels->length == graph->length, "Levels length %i, expected %i", levels->length, graph->length)
+    mu_assert(levels->starts[0] == 0, "First level doesn't start at 0")
+    mu_assert(levels->starts[levels->count] == levels->length, "Levels don't cover every value")
+
+    for(int l = 0; l < levels->count; l++) {
+        mu_assert(levels->starts[l] < levels->starts[l + 1], "Level %i empty", l)
+
+        for(int i = levels->starts[l]; i < levels->starts[l + 1]; i++) {
+            Value *value = levels->order[i];
+            mu_assert(levels->level[value->index] == l, "%s in level %i, expected %i",
+                    value->value, levels->level[value->index], l)
+
+            int deepest = -1;
+            for(int j = 0; j < g_degree(graph, value, DIR_HIGHER); j++) {
+                int higher = levels->level[g_relation(graph, value, DIR_HIGHER, j)->index];
+                if(higher > deepest) deepest = higher;
+            }
+            mu_assert(deepest + 1 == l, "%s in level %i but deepest higher value is in %i", value->value, l, deepest)
+        }
+    }
+
+    return NULL;
+}
+
+static char *test_small(void)
+{
+    Graph *graph = new_graph();
+    g_apply_relation(graph, "a", "b");
+    g_apply_relation(graph, "b", "c");
+    g_apply_relation(graph, "a", "c");
+    g_apply_relation(graph, "d", "c");
+    g_apply_relation(graph, "e", "f");
+
+    Levels *levels = g_levels(graph, 1);
+    mu_assert(levels, "Levels not made")
+    mu_assert(levels->count == 3, "Should be 3 levels, got %i", levels->count)
+    mu_assert(levels->level[g_lookup(graph, "a")->index] == 0, "a not in level 0")
+    mu_assert(levels->level[g_lookup(graph, "f")->index] == 1, "f not in level 1")
+    mu_assert(levels->level[g_lookup(graph, "c")->index] == 2, "c not in level 2")
+
+    char *failed = check_levels(graph, levels);
+    if(failed) return failed;
+
+    lv_free(levels);
+
+    // empty graphs have no levels
+    g_reset(graph);
+    levels = g_levels(graph, 2);
+    mu_assert(levels, "Levels not made for empty graph")
+    mu_assert(levels->count == 0 && levels->length == 0, "Empty graph has levels")
+    lv_free(levels);
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_threads(void)
+{
+    Graph *graph = new_graph();
+    char greater[16];
+    char lesser[16];
+
+    // relations always point from the lower number to the higher, so no cycles
+    srand(1);
+    for(int i = 0; i < RANDOM_RELATIONS; i++) {
+        // freeze part way through so both frozen and added relations are followed
+        if(i == RANDOM_RELATIONS / 2) mu_assert(g_freeze(graph) == 0, "Failed to freeze")
+
+        int a = rand() % RANDOM_VALUES;
+        int b = rand() % RANDOM_VALUES;
+        if(a == b) continue;
+
+        snprintf(greater, sizeof(greater), "n%i", a < b ? a : b);
+        snprintf(lesser, sizeof(lesser), "n%i", a < b ? b : a);
+        int rc = g_apply_relation(graph, greater, lesser);
+        mu_assert(rc == 0 || rc == ERR_DUPLICATE, "Failed to apply %s > %s", greater, lesser)
+    }
+
+    Levels *single = g_levels(graph, 1);
+    mu_assert(single, "Levels not made with 1 thread")
+    char *failed = check_levels(graph, single);
+    if(failed) return failed;
+
+    // more threads than a level has chunks, and more than there are cores
+    for(int threads = 2; threads <= 16; threads *= 2) {
+        Levels *levels = g_levels(graph, threads);
+        mu_assert(levels, "Levels not made with %i threads", threads)
+
+        failed = check_levels(graph, levels);
+        if(failed) return failed;
+
+        mu_assert(levels->count == single->count, "%i levels with %i threads, expected %i",
+                levels->count, threads, single->count)
+        mu_assert(memcmp(levels->level, single->level, sizeof(int) * (size_t)single->size) == 0,
+                "Levels differ with %i threads", threads)
+
+        lv_free(levels);
+    }
+
+    lv_free(single);
+    g_free(graph);
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_small)
+    mu_run_test(test_threads)
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
@@ -85,12 +85,50 @@ static char *test_pop(void)
     return NULL;
 }
 
+static int each_visit(void *value, void *data)
+{
+    int *sum = data;
+    *sum += *(int *)value;
+    return *(int *)value == 2;
+}
+
+static char *test_each(void)
+{
+    int sum = 0;
+
+    mu_assert(l_each(t_list, each_visit, &sum) == 1, "Each didn't stop at 2")
+    mu_assert(sum == 3, "Sum of 1 and 2 incorrect, got %i", sum)
+
+    return NULL;
+}
+
+static char *test_vector(void)
+{
+    Vector *vector = new_vector();
+    mu_assert(vector, "Vector not created")
+
+    for(int i = 0; i < 100; i++) {
+        mu_assert(v_push(vector, &int1) == 0, "Failed to push %i", i)
+    }
+    v_push(vector, &int2);
+    mu_assert(vector->length == 101, "Vector length incorrect, got %i", vector->length)
+
+    mu_assert(v_pop(vector) == &int2, "2 not popped correctly")
+    while(vector->length) mu_assert(v_pop(vector) == &int1, "1 not popped correctly")
+    mu_assert(v_pop(vector) == NULL, "Pop from empty vector not NULL")
+
+    v_free(vector);
+    return NULL;
+}
+
 static char *all_tests(void)
 {
     mu_run_test(test_new)
     mu_run_test(test_push)
     mu_run_test(test_index)
+    mu_run_test(test_each)
     mu_run_test(test_pop)
+    mu_run_test(test_vector)
 
     l_free(t_list);
 
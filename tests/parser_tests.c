@@ -0,0 +1,132 @@
+// Test relation file parser
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "minunit.h"
+#include "../src/parser.h"
+#include "../src/dbg.h"
+
+mu_suite_start();
+
+// Check a view against a string
+static int is(View view, const char *str)
+{
+    return view.length == strlen(str) && memcmp(view.str, str, view.length) == 0;
+}
+
+static char *test_lines(void)
+{
+    const char data[] = "one > two\n"
+        "three < four\r\n"
+        "\n"
+        "   \t\n"
+        "  five\t>  six  \n"
+        "seven>eight\n"
+        "not a relation\n"
+        "nine >\n"
+        "ten < eleven";
+    Parser *parser = new_parser_buffer(data, sizeof(data) - 1);
+    Relation relation;
+
+    mu_assert(parser, "Parser not created")
+
+    mu_assert(pr_next(parser, &relation) == PARSE_RELATION, "First relation not read")
+    mu_assert(is(relation.greater, "one") && is(relation.lesser, "two"), "First relation wrong")
+
+    mu_assert(pr_next(parser, &relation) == PARSE_RELATION, "Second relation not read")
+    mu_assert(is(relation.greater, "four") && is(relation.lesser, "three"), "< not swapped round")
+
+    // blank lines are skipped
+    mu_assert(pr_next(parser, &relation) == PARSE_RELATION, "Third relation not read")
+    mu_assert(is(relation.greater, "five") && is(relation.lesser, "six"), "Whitespace not skipped")
+    mu_assert(parser->line == 5, "Line should be 5, got %i", parser->line)
+
+    mu_assert(pr_next(parser, &relation) == PARSE_RELATION, "Relation without spaces not read")
+    mu_assert(is(relation.greater, "seven") && is(relation.lesser, "eight"), "Relation without spaces wrong")
+
+    mu_assert(pr_next(parser, &relation) == PARSE_INVALID, "Invalid line accepted")
+    mu_assert(is(parser->bad, "not a relation"), "Wrong invalid line")
+    mu_assert(pr_next(parser, &relation) == PARSE_INVALID, "Line without lesser value accepted")
+    mu_assert(parser->line == 8, "Line should be 8, got %i", parser->line)
+
+    // last line has no newline
+    mu_assert(pr_next(parser, &relation) == PARSE_RELATION, "Last relation not read")
+    mu_assert(is(relation.greater, "eleven") && is(relation.lesser, "ten"), "Last relation wrong")
+
+    mu_assert(pr_next(parser, &relation) == PARSE_END, "Parser didn't end")
+    mu_assert(pr_next(parser, &relation) == PARSE_END, "Parser didn't stay at the end")
+
+    pr_free(parser);
+    return NULL;
+}
+
+static char *test_long(void)
+{
+    // far longer than any buffer the old reader used, and not a multiple of 16
+    size_t length = 100003;
+    char *data = malloc(length * 2 + 4);
+    mu_assert(data, "Out of memory")
+
+    memset(data, 'a', length);
+    memcpy(data + length, " < ", 3);
+    memset(data + length + 3, 'b', length);
+    data[length * 2 + 3] = '\n';
+
+    Parser *parser = new_parser_buffer(data, length * 2 + 4);
+    Relation relation;
+    mu_assert(pr_next(parser, &relation) == PARSE_RELATION, "Long relation not read")
+    mu_assert(relation.greater.length == length && relation.greater.str[0] == 'b', "Long greater value wrong")
+    mu_assert(relation.lesser.length == length && relation.lesser.str == data, "Long lesser value wrong")
+    mu_assert(pr_next(parser, &relation) == PARSE_END, "Parser didn't end")
+
+    pr_free(parser);
+    free(data);
+    return NULL;
+}
+
+static char *test_file(void)
+{
+    char path[] = "/tmp/parser_testsXXXXXX";
+    int fd = mkstemp(path);
+    mu_assert(fd != -1, "Couldn't make a temporary file")
+
+    const char data[] = "a > b\nb > c\n";
+    mu_assert(write(fd, data, sizeof(data) - 1) == (ssize_t)sizeof(data) - 1, "Couldn't write temporary file")
+    close(fd);
+
+    Parser *parser = new_parser(path);
+    Relation relation;
+    mu_assert(parser, "File not mapped")
+    mu_assert(parser->mapping, "File not mapped")
+    mu_assert(pr_next(parser, &relation) == PARSE_RELATION, "First relation not read")
+    mu_assert(pr_next(parser, &relation) == PARSE_RELATION, "Second relation not read")
+    mu_assert(is(relation.greater, "b") && is(relation.lesser, "c"), "Second relation wrong")
+    mu_assert(pr_next(parser, &relation) == PARSE_END, "Parser didn't end")
+    pr_free(parser);
+
+    // empty files have nothing to map
+    fd = open(path, O_TRUNC | O_WRONLY);
+    close(fd);
+    parser = new_parser(path);
+    mu_assert(parser, "Empty file not opened")
+    mu_assert(pr_next(parser, &relation) == PARSE_END, "Empty file not empty")
+    pr_free(parser);
+
+    unlink(path);
+    mu_assert(new_parser(path) == NULL, "Missing file opened")
+
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_lines)
+    mu_run_test(test_long)
+    mu_run_test(test_file)
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
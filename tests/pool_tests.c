@@ -0,0 +1,102 @@
+// Test interned string pool
+
+#include "minunit.h"
+#include "../src/pool.h"
+#include "../src/hash.h"
+#include "../src/dbg.h"
+
+mu_suite_start();
+
+static Pool *t_pool = NULL;
+
+static char *test_new(void)
+{
+    t_pool = new_pool();
+
+    mu_assert(t_pool, "Pool not created")
+    mu_assert(t_pool->length == 0, "New pool not empty")
+    return NULL;
+}
+
+static char *test_intern(void)
+{
+    unsigned int first = p_intern(t_pool, "first", 5);
+    unsigned int second = p_intern(t_pool, "second", 6);
+
+    mu_assert(first == 0, "First id should be 0, got %u", first)
+    mu_assert(second == 1, "Second id should be 1, got %u", second)
+    mu_assert(p_intern(t_pool, "first", 5) == first, "first interned twice")
+    mu_assert(strcmp(p_string(t_pool, second), "second") == 0, "Wrong string for second")
+    mu_assert(p_hash(t_pool, first) == hash("first"), "Stored hash doesn't match hash()")
+
+    // strings don't have to be null-terminated, and prefixes are different strings
+    unsigned int prefix = p_intern(t_pool, "secondary", 3);
+    mu_assert(prefix == 2, "Prefix should get a new id, got %u", prefix)
+    mu_assert(strcmp(p_string(t_pool, prefix), "sec") == 0, "Prefix not terminated")
+    mu_assert(p_find(t_pool, "second", 6) == second, "Prefix matched second")
+
+    return NULL;
+}
+
+static char *test_find(void)
+{
+    mu_assert(p_find(t_pool, "first", 5) == 0, "first not found")
+    mu_assert(p_find(t_pool, "third", 5) == POOL_NONE, "Found string never added")
+    mu_assert(p_find_hash(t_pool, hash("second")) == 1, "second not found by hash")
+    mu_assert(p_find_hash(t_pool, hash("third")) == POOL_NONE, "Found hash never added")
+
+    return NULL;
+}
+
+static char *test_grow(void)
+{
+    char name[32];
+
+    // enough to grow the table and ids many times, and fill several blocks
+    for(unsigned int i = 0; i < 100000; i++) {
+        snprintf(name, sizeof(name), "value number %u", i);
+        mu_assert(p_intern(t_pool, name, strlen(name)) == i + 3, "Wrong id for %s", name)
+    }
+
+    for(unsigned int i = 0; i < 100000; i += 997) {
+        snprintf(name, sizeof(name), "value number %u", i);
+        mu_assert(p_find(t_pool, name, strlen(name)) == i + 3, "Lost %s after growing", name)
+        mu_assert(strcmp(p_string(t_pool, i + 3), name) == 0, "String for %s moved", name)
+    }
+
+    // long strings get their own allocation
+    char *long_name = malloc(100000);
+    memset(long_name, 'x', 99999);
+    long_name[99999] = '\0';
+    unsigned int id = p_intern(t_pool, long_name, 99999);
+    mu_assert(strcmp(p_string(t_pool, id), long_name) == 0, "Long string not stored")
+    free(long_name);
+
+    return NULL;
+}
+
+static char *test_reset(void)
+{
+    p_reset(t_pool);
+
+    mu_assert(t_pool->length == 0, "Pool not empty after reset")
+    mu_assert(p_find(t_pool, "first", 5) == POOL_NONE, "first still in pool after reset")
+    mu_assert(p_intern(t_pool, "again", 5) == 0, "Ids don't restart from 0")
+
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_new)
+    mu_run_test(test_intern)
+    mu_run_test(test_find)
+    mu_run_test(test_grow)
+    mu_run_test(test_reset)
+
+    p_free(t_pool);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
@@ -0,0 +1,168 @@
+// Test snapshot publishing
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "minunit.h"
+#include "../src/graph.h"
+#include "../src/publish.h"
+#include "../src/dbg.h"
+
+#define READERS 3
+#define VALUES 2000
+#define BATCHES 50
+#define PER_BATCH 100
+
+mu_suite_start();
+
+// Check a snapshot's names are the ones given, in order
+static char *check_order(Snapshot *snapshot, const char **names, uint32_t length)
+{
+    mu_assert(snapshot->length == length, "Expected %u values, got %u", length, snapshot->length)
+    for(uint32_t id = 0; id < length; id++) {
+        mu_assert(strcmp(sn_name(snapshot, id), names[id]) == 0, "Expected %s at %u, got %s", names[id], id,
+                sn_name(snapshot, id))
+    }
+    return NULL;
+}
+
+static char *test_publish(void)
+{
+    Graph *graph = new_graph();
+    Publisher *publisher = new_publisher(2);
+    mu_assert(graph && publisher, "Failed to create")
+    mu_assert(pb_enter(publisher, 0) == NULL, "Nothing published yet")
+    pb_leave(publisher, 0);
+
+    mu_assert(g_apply_relation(graph, "a", "b") == 0, "Failed to apply a > b")
+    mu_assert(g_apply_relation(graph, "b", "c") == 0, "Failed to apply b > c")
+    mu_assert(pb_publish(publisher, graph) == 0, "Failed to publish")
+
+    const char *first[] = { "a", "b", "c" };
+    Version *held = pb_enter(publisher, 0);
+    mu_assert(held && held->number == 1, "Expected version 1")
+    char *err = check_order(held->snapshot, first, 3);
+    if(err) return err;
+
+    // changed and published again while reader 0 still has the first version
+    mu_assert(g_apply_relation(graph, "d", "a") == 0, "Failed to apply d > a")
+    mu_assert(pb_publish(publisher, graph) == 0, "Failed to publish")
+    mu_assert(pb_reclaim(publisher) == 1, "Version 1 freed while still entered")
+
+    const char *second[] = { "d", "a", "b", "c" };
+    Version *latest = pb_enter(publisher, 1);
+    mu_assert(latest && latest->number == 2, "Expected version 2")
+    err = check_order(latest->snapshot, second, 4);
+    if(err) return err;
+    pb_leave(publisher, 1);
+
+    // still as it was
+    err = check_order(held->snapshot, first, 3);
+    if(err) return err;
+    uint32_t b = sn_find(held->snapshot, "b", 1);
+    mu_assert(b == 1 && sn_degree(held->snapshot, b, DIR_HIGHER) == 1, "Relations of b changed")
+
+    pb_leave(publisher, 0);
+    mu_assert(pb_reclaim(publisher) == 0, "Version 1 not freed once left")
+
+    pb_free(publisher);
+    g_free(graph);
+    return NULL;
+}
+
+// Shared by the writer and reader threads
+typedef struct shared {
+    Publisher *publisher;
+    atomic_int done;
+    int reader;
+    unsigned long reads;
+    int failed;
+} Shared;
+
+// Every relation in a snapshot has to go down the order, so up the ids
+static void *reader(void *data)
+{
+    Shared *shared = data;
+    unsigned long last = 0;
+
+    while(!atomic_load(&shared->done) && !shared->failed) {
+        Version *version = pb_enter(shared->publisher, shared->reader);
+
+        if(version) {
+            Snapshot *snapshot = version->snapshot;
+            if(version->number < last) shared->failed = 1;
+            last = version->number;
+
+            for(uint32_t id = 0; id < snapshot->length; id++) {
+                const uint32_t *lower = sn_relations(snapshot, id, DIR_LOWER);
+                for(uint32_t i = 0; i < sn_degree(snapshot, id, DIR_LOWER); i++) {
+                    if(lower[i] <= id) shared->failed = 1;
+                }
+            }
+            shared->reads++;
+        }
+
+        pb_leave(shared->publisher, shared->reader);
+    }
+
+    return NULL;
+}
+
+static char *test_threads(void)
+{
+    Graph *graph = new_graph();
+    Publisher *publisher = new_publisher(READERS);
+    mu_assert(graph && publisher, "Failed to create")
+
+    Shared shared[READERS];
+    pthread_t threads[READERS];
+    for(int i = 0; i < READERS; i++) {
+        shared[i].publisher = publisher;
+        atomic_init(&shared[i].done, 0);
+        shared[i].reader = i;
+        shared[i].reads = 0;
+        shared[i].failed = 0;
+        mu_assert(pthread_create(&threads[i], NULL, reader, &shared[i]) == 0, "Failed to start reader %i", i)
+    }
+
+    // lower numbers always greater, so it never cycles
+    char greater[16];
+    char lesser[16];
+    srand(1);
+    for(int batch = 0; batch < BATCHES; batch++) {
+        for(int i = 0; i < PER_BATCH; i++) {
+            int a = rand() % (VALUES - 1);
+            int b = a + 1 + rand() % (VALUES - a - 1);
+            snprintf(greater, sizeof(greater), "v%i", a);
+            snprintf(lesser, sizeof(lesser), "v%i", b);
+
+            int rc = g_apply_relation(graph, greater, lesser);
+            mu_assert(!rc || rc == ERR_DUPLICATE, "Failed to apply %s > %s", greater, lesser)
+        }
+        mu_assert(pb_publish(publisher, graph) == 0, "Failed to publish batch %i", batch)
+    }
+
+    for(int i = 0; i < READERS; i++) {
+        atomic_store(&shared[i].done, 1);
+        pthread_join(threads[i], NULL);
+        mu_assert(!shared[i].failed, "Reader %i saw an inconsistent snapshot", i)
+    }
+
+    mu_assert(pb_reclaim(publisher) == 0, "Versions left once every reader's gone")
+    mu_assert(publisher->published == BATCHES, "Expected %i versions, got %lu", BATCHES, publisher->published)
+
+    pb_free(publisher);
+    g_free(graph);
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_publish)
+    mu_run_test(test_threads)
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
@@ -0,0 +1,169 @@
+// Test reachability index
+
+#include "minunit.h"
+#include "../src/reach.h"
+#include "../src/dbg.h"
+
+// Past REACH_CLOSURE_LIMIT, so the labels and searches are used rather than the bit matrix
+#define LARGE_VALUES 6000
+#define SMALL_VALUES 500
+#define RELATIONS_PER_VALUE 2
+// Relations only reach this far ahead, so plenty of pairs aren't related
+#define RELATION_SPAN 40
+#define QUERIES 20000
+
+mu_suite_start();
+
+// Check whether there's a path down from one value to another the slow way
+static int reaches(Graph *graph, Value *from, Value *to, char *seen)
+{
+    Vector *stack = new_vector();
+    int found = 0;
+    memset(seen, 0, (size_t)graph->values_size);
+
+    v_push(stack, from);
+    Value *value = NULL;
+    while(!found && (value = v_pop(stack))) {
+        for(int j = 0; j < g_degree(graph, value, DIR_LOWER); j++) {
+            Value *lower = g_relation(graph, value, DIR_LOWER, j);
+            if(lower == to) found = 1;
+            if(seen[lower->index]) continue;
+
+            seen[lower->index] = 1;
+            v_push(stack, lower);
+        }
+    }
+
+    v_free(stack);
+    return found;
+}
+
+// Graph of values n0 to n<count - 1>, where each relation goes from a value to
+//   one a little after it
+static Graph *random_graph(int count)
+{
+    Graph *graph = new_graph();
+    char greater[16];
+    char lesser[16];
+
+    srand(1);
+    for(int i = 0; i < count * RELATIONS_PER_VALUE; i++) {
+        int a = rand() % count;
+        int b = a + 1 + rand() % RELATION_SPAN;
+        if(b >= count) continue;
+
+        snprintf(greater, sizeof(greater), "n%i", a);
+        snprintf(lesser, sizeof(lesser), "n%i", b);
+        int rc = g_apply_relation(graph, greater, lesser);
+        if(rc && rc != ERR_DUPLICATE) {
+            g_free(graph);
+            return NULL;
+        }
+
+        // freeze part way through so both frozen and added relations are indexed
+        if(i == count) g_freeze(graph);
+    }
+
+    return graph;
+}
+
+// Compare the index against searching for random pairs, including pairs in both
+//   directions and a value with itself
+static char *check_queries(Graph *graph, Reach *reach, int count)
+{
+    char *seen = malloc((size_t)graph->values_size);
+    char name[16];
+    int above = 0;
+    mu_assert(seen, "Out of memory")
+
+    for(int i = 0; i < QUERIES; i++) {
+        int a = rand() % count;
+        // mostly close together, where the answer could go either way
+        int b = i % 4 ? a - RELATION_SPAN * 4 + rand() % (RELATION_SPAN * 8) : rand() % count;
+        if(b < 0 || b >= count) continue;
+
+        snprintf(name, sizeof(name), "n%i", a);
+        Value *higher = g_lookup(graph, name);
+        snprintf(name, sizeof(name), "n%i", b);
+        Value *lower = g_lookup(graph, name);
+        if(!higher || !lower) continue;
+
+        int expected = higher != lower && reaches(graph, higher, lower, seen);
+        mu_assert(ri_above(reach, higher, lower) == expected, "n%i above n%i should be %i", a, b, expected)
+        above += expected;
+    }
+
+    mu_assert(above > QUERIES / 20, "Too few related pairs tested, only %i", above)
+    mu_assert(above < QUERIES / 2, "Too few unrelated pairs tested, %i related", above)
+
+    free(seen);
+    return NULL;
+}
+
+static char *test_large(void)
+{
+    Graph *graph = random_graph(LARGE_VALUES);
+    mu_assert(graph, "Failed to build graph")
+
+    for(int traversals = 1; traversals <= 4; traversals++) {
+        Reach *reach = g_reach(graph, traversals);
+        mu_assert(reach, "Index not built with %i traversals", traversals)
+        mu_assert(reach->closure == NULL, "Large graph got a bit matrix")
+
+        char *failed = check_queries(graph, reach, LARGE_VALUES);
+        if(failed) return failed;
+        mu_assert(reach->searches < reach->queries, "Every query needed a search")
+
+        ri_free(reach);
+    }
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_small(void)
+{
+    Graph *graph = random_graph(SMALL_VALUES);
+    mu_assert(graph, "Failed to build graph")
+
+    Reach *reach = g_reach(graph, 0);
+    mu_assert(reach, "Index not built")
+    mu_assert(reach->closure, "Small graph didn't get a bit matrix")
+    mu_assert(reach->traversals == REACH_TRAVERSALS, "Wrong default traversals, got %i", reach->traversals)
+
+    char *failed = check_queries(graph, reach, SMALL_VALUES);
+    if(failed) return failed;
+    mu_assert(reach->searches == 0, "Bit matrix queries searched")
+
+    // values added since aren't covered
+    mu_assert(g_apply_relation(graph, "n0", "new") == 0, "Failed to apply n0 > new")
+    mu_assert(ri_above(reach, g_lookup(graph, "n0"), g_lookup(graph, "new")) == 0, "New value in index")
+
+    ri_free(reach);
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_empty(void)
+{
+    Graph *graph = new_graph();
+
+    Reach *reach = g_reach(graph, 0);
+    mu_assert(reach, "Index not built for empty graph")
+    mu_assert(reach->length == 0, "Empty index has ids")
+
+    ri_free(reach);
+    g_free(graph);
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_large)
+    mu_run_test(test_small)
+    mu_run_test(test_empty)
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
@@ -0,0 +1,153 @@
+// Test transitive reduction
+
+#include "minunit.h"
+#include "../src/reduce.h"
+#include "../src/dbg.h"
+
+// More than one block, with relations reaching across blocks
+#define RANDOM_VALUES 700
+#define RANDOM_RELATIONS 5000
+#define RELATION_SPAN 100
+
+mu_suite_start();
+
+// Count every relation in a graph
+static int relations(Graph *graph)
+{
+    int count = 0;
+    for(Value *value = graph->start; value; value = value->next) count += g_degree(graph, value, DIR_LOWER);
+
+    return count;
+}
+
+// Mark everything below a value in seen, indexed by id, skipping one relation
+//   from the value itself if skip isn't NULL
+static void below(Graph *graph, Value *from, Value *skip, char *seen)
+{
+    Vector *stack = new_vector();
+    memset(seen, 0, (size_t)graph->values_size);
+
+    v_push(stack, from);
+    Value *value = NULL;
+    while((value = v_pop(stack))) {
+        for(int j = 0; j < g_degree(graph, value, DIR_LOWER); j++) {
+            Value *lower = g_relation(graph, value, DIR_LOWER, j);
+            if(value == from && lower == skip) continue;
+            if(seen[lower->index]) continue;
+
+            seen[lower->index] = 1;
+            v_push(stack, lower);
+        }
+    }
+
+    v_free(stack);
+}
+
+static char *test_triangle(void)
+{
+    Graph *graph = new_graph();
+    g_apply_relation(graph, "a", "b");
+    g_apply_relation(graph, "b", "c");
+    g_apply_relation(graph, "a", "c");
+    // a diamond has no implied relations
+    g_apply_relation(graph, "c", "d");
+    g_apply_relation(graph, "c", "e");
+    g_apply_relation(graph, "d", "f");
+    g_apply_relation(graph, "e", "f");
+    // implied by a path of four
+    g_apply_relation(graph, "a", "f");
+
+    unsigned long removed = 0;
+    mu_assert(g_transitive_reduce(graph, &removed) == 0, "Failed to reduce")
+    mu_assert(removed == 2, "Should remove 2 relations, removed %lu", removed)
+    mu_assert(relations(graph) == 6, "Should be 6 relations left, got %i", relations(graph))
+    mu_assert(g_degree(graph, g_lookup(graph, "a"), DIR_LOWER) == 1, "a should have 1 lower value")
+    mu_assert(g_degree(graph, g_lookup(graph, "f"), DIR_HIGHER) == 2, "f should have 2 higher values")
+    mu_assert(g_apply_relation(graph, "a", "c") == 0, "a > c still in graph")
+
+    // nothing left to remove the second time
+    mu_assert(g_transitive_reduce(graph, &removed) == 0, "Failed to reduce again")
+    mu_assert(removed == 1, "Should remove a > c again, removed %lu", removed)
+    mu_assert(g_transitive_reduce(graph, &removed) == 0 && removed == 0, "Reduced graph changed")
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_random(void)
+{
+    Graph *graph = new_graph();
+    char greater[16];
+    char lesser[16];
+
+    srand(1);
+    for(int i = 0; i < RANDOM_RELATIONS; i++) {
+        // freeze part way through so both frozen and added relations are reduced
+        if(i == RANDOM_RELATIONS / 2) mu_assert(g_freeze(graph) == 0, "Failed to freeze")
+
+        int a = rand() % RANDOM_VALUES;
+        int b = a + 1 + rand() % RELATION_SPAN;
+        if(b >= RANDOM_VALUES) continue;
+
+        snprintf(greater, sizeof(greater), "n%i", a);
+        snprintf(lesser, sizeof(lesser), "n%i", b);
+        int rc = g_apply_relation(graph, greater, lesser);
+        mu_assert(rc == 0 || rc == ERR_DUPLICATE, "Failed to apply %s > %s", greater, lesser)
+    }
+
+    // everything below each value before reducing, by id
+    int size = graph->values_size;
+    char *before = calloc((size_t)size * (size_t)size, 1);
+    char *seen = malloc((size_t)size);
+    mu_assert(before && seen, "Out of memory")
+    for(Value *value = graph->start; value; value = value->next) below(graph, value, NULL, before + value->index * (unsigned int)size);
+
+    int count = relations(graph);
+    unsigned long removed = 0;
+    mu_assert(g_transitive_reduce(graph, &removed) == 0, "Failed to reduce")
+    mu_assert(removed > (unsigned long)count / 2, "Only removed %lu of %i relations", removed, count)
+    mu_assert(relations(graph) == count - (int)removed, "Removed %lu but %i relations left of %i",
+            removed, relations(graph), count)
+
+    for(Value *value = graph->start; value; value = value->next) {
+        // the same values are below
+        below(graph, value, NULL, seen);
+        mu_assert(memcmp(seen, before + value->index * (unsigned int)size, (size_t)size) == 0,
+                "Values below %s changed", value->value)
+
+        // and no relation left is implied by the others
+        for(int j = 0; j < g_degree(graph, value, DIR_LOWER); j++) {
+            Value *lower = g_relation(graph, value, DIR_LOWER, j);
+            below(graph, value, lower, seen);
+            mu_assert(!seen[lower->index], "%s > %s is implied", value->value, lower->value)
+        }
+    }
+
+    free(before);
+    free(seen);
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_empty(void)
+{
+    Graph *graph = new_graph();
+    unsigned long removed = 1;
+
+    mu_assert(g_transitive_reduce(graph, &removed) == 0, "Failed to reduce empty graph")
+    mu_assert(removed == 0, "Removed relations from empty graph")
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_triangle)
+    mu_run_test(test_random)
+    mu_run_test(test_empty)
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
@@ -0,0 +1,191 @@
+// Test graph snapshots
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "minunit.h"
+#include "../src/graph.h"
+#include "../src/snapshot.h"
+#include "../src/dbg.h"
+
+#define RANDOM_VALUES 1000
+#define RANDOM_RELATIONS 5000
+
+mu_suite_start();
+
+static char t_path[] = "/tmp/snapshot_testsXXXXXX";
+static Graph *t_graph = NULL;
+
+// Check two graphs have the same values in the same order, with the same relations
+static char *check_same(Graph *graph, Graph *other)
+{
+    mu_assert(graph->length == other->length, "Lengths differ: %i and %i", graph->length, other->length)
+
+    Value *value = graph->start;
+    Value *copy = other->start;
+    for(; value && copy; value = value->next, copy = copy->next) {
+        mu_assert(strcmp(value->value, copy->value) == 0, "%s in place of %s", copy->value, value->value)
+        if(copy->next) mu_assert(g_before(copy, copy->next), "Labels out of order at %s", copy->value)
+
+        for(int direction = DIR_LOWER; direction <= DIR_HIGHER; direction++) {
+            int degree = g_degree(graph, value, direction);
+            mu_assert(g_degree(other, copy, direction) == degree, "%s has different relations", value->value)
+
+            for(int i = 0; i < degree; i++) {
+                mu_assert(strcmp(g_relation(graph, value, direction, i)->value, g_relation(other, copy, direction, i)->value) == 0,
+                        "Relation %i of %s differs", i, value->value)
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static char *test_save(void)
+{
+    int fd = mkstemp(t_path);
+    mu_assert(fd != -1, "Couldn't make a temporary file")
+    close(fd);
+
+    t_graph = new_graph();
+    char greater[16];
+    char lesser[16];
+
+    srand(1);
+    for(int i = 0; i < RANDOM_RELATIONS; i++) {
+        // freeze part way through so both frozen and added relations are saved
+        if(i == RANDOM_RELATIONS / 2) mu_assert(g_freeze(t_graph) == 0, "Failed to freeze")
+
+        int a = rand() % RANDOM_VALUES;
+        int b = rand() % RANDOM_VALUES;
+        if(a == b) continue;
+
+        snprintf(greater, sizeof(greater), "n%i", a < b ? a : b);
+        snprintf(lesser, sizeof(lesser), "n%i", a < b ? b : a);
+        int rc = g_apply_relation(t_graph, greater, lesser);
+        mu_assert(rc == 0 || rc == ERR_DUPLICATE, "Failed to apply %s > %s", greater, lesser)
+    }
+
+    mu_assert(g_save(t_graph, t_path) == 0, "Failed to save")
+    return NULL;
+}
+
+static char *test_open(void)
+{
+    Snapshot *snapshot = sn_open(t_path, 1);
+    mu_assert(snapshot, "Snapshot not opened")
+    mu_assert(snapshot->length == (uint32_t)t_graph->length, "Snapshot length %u, expected %i",
+            snapshot->length, t_graph->length)
+
+    // ids are the sorted order
+    uint32_t id = 0;
+    for(Value *value = t_graph->start; value; value = value->next, id++) {
+        mu_assert(strcmp(sn_name(snapshot, id), value->value) == 0, "Name %u is %s, expected %s",
+                id, sn_name(snapshot, id), value->value)
+        mu_assert(sn_find(snapshot, value->value, strlen(value->value)) == id, "%s not found", value->value)
+        mu_assert(sn_degree(snapshot, id, DIR_LOWER) == (uint32_t)g_degree(t_graph, value, DIR_LOWER),
+                "%s has different lower relations", value->value)
+
+        const uint32_t *lower = sn_relations(snapshot, id, DIR_LOWER);
+        for(uint32_t i = 0; i < sn_degree(snapshot, id, DIR_LOWER); i++) {
+            mu_assert(lower[i] > id, "%s not before %s", value->value, sn_name(snapshot, lower[i]))
+        }
+    }
+
+    mu_assert(sn_find(snapshot, "missing", 7) == SNAPSHOT_NONE, "Found name never added")
+    mu_assert(sn_find(snapshot, "n1x", 2) == sn_find(snapshot, "n1", 2), "Name given by length not found")
+
+    sn_close(snapshot);
+    return NULL;
+}
+
+static char *test_load(void)
+{
+    Graph *graph = g_load(t_path);
+    mu_assert(graph, "Graph not loaded")
+
+    char *failed = check_same(t_graph, graph);
+    if(failed) return failed;
+
+    // still a normal graph afterwards
+    mu_assert(g_apply_relation(graph, "n1", "new") == 0, "Failed to apply after loading")
+    mu_assert(g_before(g_lookup(graph, "n1"), g_lookup(graph, "new")), "n1 not before new")
+    mu_assert(g_apply_relation(graph, "n1", "new") == ERR_DUPLICATE, "Duplicate not found after loading")
+
+    // relations from the snapshot are duplicates too
+    Value *n1 = g_lookup(graph, "n1");
+    Value *lower = g_relation(graph, n1, DIR_LOWER, 0);
+    mu_assert(g_apply_relation(graph, "n1", lower->value) == ERR_DUPLICATE, "Loaded relation not a duplicate")
+
+    // saving a loaded graph gives the same graph back
+    mu_assert(g_save(graph, t_path) == 0, "Failed to save loaded graph")
+    Graph *again = g_load(t_path);
+    mu_assert(again, "Graph not loaded again")
+    failed = check_same(graph, again);
+    if(failed) return failed;
+
+    g_free(again);
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_empty(void)
+{
+    Graph *graph = new_graph();
+    mu_assert(g_save(graph, t_path) == 0, "Failed to save empty graph")
+    g_free(graph);
+
+    graph = g_load(t_path);
+    mu_assert(graph, "Empty graph not loaded")
+    mu_assert(graph->length == 0, "Empty graph has %i values", graph->length)
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_corrupt(void)
+{
+    mu_assert(g_save(t_graph, t_path) == 0, "Failed to save")
+
+    // flip a byte in the names at the end of the file
+    int fd = open(t_path, O_RDWR);
+    mu_assert(fd != -1, "Couldn't open snapshot")
+    off_t end = lseek(fd, -2, SEEK_END);
+    char byte;
+    mu_assert(pread(fd, &byte, 1, end) == 1, "Couldn't read snapshot")
+    byte ^= 1;
+    mu_assert(pwrite(fd, &byte, 1, end) == 1, "Couldn't write snapshot")
+
+    // the checksum only gets checked when asked for
+    Snapshot *snapshot = sn_open(t_path, 0);
+    mu_assert(snapshot, "Snapshot not opened without verifying")
+    sn_close(snapshot);
+    mu_assert(sn_open(t_path, 1) == NULL, "Corrupt snapshot verified")
+    mu_assert(g_load(t_path) == NULL, "Corrupt snapshot loaded")
+
+    // cut short
+    mu_assert(ftruncate(fd, end) == 0, "Couldn't truncate snapshot")
+    close(fd);
+    mu_assert(sn_open(t_path, 0) == NULL, "Truncated snapshot opened")
+
+    mu_assert(sn_open("/tmp/snapshot_tests_missing", 0) == NULL, "Missing snapshot opened")
+
+    unlink(t_path);
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_save)
+    mu_run_test(test_open)
+    mu_run_test(test_load)
+    mu_run_test(test_empty)
+    mu_run_test(test_corrupt)
+
+    g_free(t_graph);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
@@ -0,0 +1,90 @@
+// Test operation counters
+//
+// Built with the same flags as the library, so the counters are checked when it's
+//   built with GRAPH_STATS and checked to stay 0 otherwise
+
+#include <stdlib.h>
+
+#include "minunit.h"
+#include "../src/graph.h"
+#include "../src/hash.h"
+#include "../src/stats.h"
+
+mu_suite_start();
+
+static char *test_latency(void)
+{
+    Stats stats;
+    memset(&stats, 0, sizeof(Stats));
+    mu_assert(st_percentile(&stats, 50) == 0, "Percentile of nothing should be 0")
+
+    // 90 fast, 10 slow
+    for(int i = 0; i < 90; i++) st_latency(&stats, 100);
+    for(int i = 0; i < 10; i++) st_latency(&stats, 5000);
+    st_latency(&stats, 0);
+    st_latency(&stats, UINT64_MAX);
+
+    mu_assert(stats.latency[0] == 1, "0 ns not in the first bucket")
+    mu_assert(stats.latency[7] == 90, "100 ns should be in bucket 7, 64 to 127")
+    mu_assert(stats.latency[13] == 10, "5000 ns should be in bucket 13, 4096 to 8191")
+    mu_assert(stats.latency[STATS_BUCKETS - 1] == 1, "Slowest not in the last bucket")
+
+    mu_assert(st_percentile(&stats, 50) == 127, "p50 should be 127, got %llu",
+            (unsigned long long)st_percentile(&stats, 50))
+    mu_assert(st_percentile(&stats, 95) == 8191, "p95 should be 8191, got %llu",
+            (unsigned long long)st_percentile(&stats, 95))
+
+    return NULL;
+}
+
+static char *test_counters(void)
+{
+    Graph *graph = new_graph();
+    mu_assert(graph, "Graph not created")
+
+    // a chain, then a pair pushed after it that has to go above it
+    mu_assert(g_apply_relation(graph, "b", "c") == 0, "Failed to apply b > c")
+    mu_assert(g_apply_relation(graph, "a", "b") == 0, "Failed to apply a > b")
+    mu_assert(g_apply_relation(graph, "c", "d") == 0, "Failed to apply c > d")
+    mu_assert(g_apply_relation(graph, "d", "e") == 0, "Failed to apply d > e")
+    mu_assert(g_apply_relation(graph, "x", "y") == 0, "Failed to apply x > y")
+    mu_assert(g_apply_relation(graph, "y", "a") == 0, "Failed to apply y > a")
+    mu_assert(g_find(graph, hash("a"), NULL), "a not found")
+
+    Stats stats = g_stats(graph);
+
+#ifdef GRAPH_STATS
+    mu_assert(stats.enabled, "Stats should be enabled")
+    mu_assert(stats.applies == 6, "Expected 6 applies, got %lu", stats.applies)
+    mu_assert(stats.finds == 13, "Expected 13 finds, got %lu", stats.finds)
+    mu_assert(stats.resolves >= 1, "Reversing relation not counted")
+    mu_assert(stats.visited >= stats.resolves && stats.visited_max <= stats.visited, "Visited counts wrong")
+    mu_assert(stats.shifted >= 2, "Expected x and y moved, got %lu", stats.shifted)
+    mu_assert(stats.allocations && stats.bytes && stats.reserved >= stats.bytes, "Allocations not counted")
+
+    unsigned long timed = 0;
+    for(int i = 0; i < STATS_BUCKETS; i++) timed += stats.latency[i];
+    mu_assert(timed == 6, "Expected 6 applies timed, got %lu", timed)
+#else
+    mu_assert(!stats.enabled, "Stats shouldn't be enabled")
+    mu_assert(!stats.finds && !stats.applies && !stats.resolves && !stats.allocations, "Counted without GRAPH_STATS")
+#endif
+
+    // reset starts again
+    g_reset(graph);
+    stats = g_stats(graph);
+    mu_assert(!stats.finds && !stats.applies && !stats.resolves && !stats.shifted, "Counters not reset")
+
+    g_free(graph);
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_latency)
+    mu_run_test(test_counters)
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
@@ -0,0 +1,346 @@
+// Test the write-ahead log
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "minunit.h"
+#include "../src/graph.h"
+#include "../src/wal.h"
+#include "../src/dbg.h"
+
+#define PATH_SIZE 64
+#define CHURN_VALUES 40
+#define CHURN_CHANGES 3000
+
+mu_suite_start();
+
+static char t_dir[] = "/tmp/wal_testsXXXXXX";
+static char t_log[PATH_SIZE];
+static char t_snapshot[PATH_SIZE];
+
+static off_t size_of(const char *path)
+{
+    struct stat info;
+    return stat(path, &info) ? -1 : info.st_size;
+}
+
+// Check a graph's order is exactly the names given
+static char *check_order(Graph *graph, const char **names, int length)
+{
+    int size = 0;
+    char **sorted = g_sorted(graph, &size);
+    mu_assert(size == length, "Expected %i values, got %i", length, size)
+
+    int wrong = 0;
+    while(wrong < size && strcmp(sorted[wrong], names[wrong]) == 0) wrong++;
+    free(sorted);
+    mu_assert(wrong == size, "Expected %s at %i", names[wrong], wrong)
+
+    return NULL;
+}
+
+// Check whether greater > lesser is in a graph
+static int related(Graph *graph, char *greater, char *lesser)
+{
+    Value *value = g_lookup(graph, greater);
+    if(!value) return 0;
+
+    for(int i = 0; i < g_degree(graph, value, DIR_LOWER); i++) {
+        if(strcmp(g_relation(graph, value, DIR_LOWER, i)->value, lesser) == 0) return 1;
+    }
+    return 0;
+}
+
+static char *test_open(void)
+{
+    mu_assert(mkdtemp(t_dir), "Couldn't make a temporary directory")
+    snprintf(t_log, PATH_SIZE, "%s/log", t_dir);
+    snprintf(t_snapshot, PATH_SIZE, "%s/snapshot", t_dir);
+    return NULL;
+}
+
+static char *test_replay(void)
+{
+    Wal *wal = wl_open(t_log, t_snapshot, 0);
+    mu_assert(wal && wal->graph->length == 0, "New log should give an empty graph")
+
+    mu_assert(wl_apply(wal, "a", "b") == 0, "Failed to apply a > b")
+    mu_assert(wl_apply(wal, "b", "c") == 0, "Failed to apply b > c")
+    mu_assert(wl_apply(wal, "c", "d") == 0, "Failed to apply c > d")
+    mu_assert(wl_apply(wal, "a", "b") == ERR_DUPLICATE, "Duplicate should be reported")
+    mu_assert(wl_remove(wal, "b", "c") == 0, "Failed to remove b > c")
+    mu_assert(wl_remove_value(wal, "d") == 0, "Failed to remove d")
+    mu_assert(wl_apply(wal, "c", "a") == 0, "Failed to apply c > a")
+    mu_assert(wl_remove(wal, "x", "y") == ERR_NOT_FOUND, "Missing relation should be reported")
+    mu_assert(wl_commit(wal) == 0 && wal->commits == 1, "Failed to commit")
+
+    // a value greater than itself is a conflict, and nothing is logged for it
+    off_t before = size_of(t_log);
+    mu_assert(wl_apply(wal, "b", "b") == ERR_RELATIONAL_CONFLICT, "Self relation should be a conflict")
+    mu_assert(!related(wal->graph, "b", "b") && wal->graph->length == 3, "Self relation changed the graph")
+    mu_assert(wl_commit(wal) == 0 && wal->commits == 1 && size_of(t_log) == before, "Self relation was logged")
+
+    // a value that's removed then comes back
+    mu_assert(wl_apply(wal, "b", "d") == 0, "Failed to apply b > d")
+    Graph *graph = wal->graph;
+    mu_assert(wl_close(wal) == 0, "Failed to close")
+
+    const char *order[] = { "c", "a", "b", "d" };
+    char *err = check_order(graph, order, 4);
+    if(err) return err;
+    g_free(graph);
+
+    wal = wl_open(t_log, t_snapshot, 0);
+    mu_assert(wal, "Failed to reopen")
+    err = check_order(wal->graph, order, 4);
+    if(err) return err;
+    mu_assert(!related(wal->graph, "b", "c") && related(wal->graph, "c", "a") && related(wal->graph, "b", "d"),
+            "Relations not replayed")
+    mu_assert(!related(wal->graph, "c", "d"), "d's relations not removed")
+
+    // names already in the log aren't written again
+    off_t size = size_of(t_log);
+    mu_assert(wl_apply(wal, "c", "b") == 0 && wl_commit(wal) == 0, "Failed to apply c > b")
+    mu_assert(size_of(t_log) - size == 8 + 3, "Expected one 3 byte record, grew by %lli",
+            (long long)(size_of(t_log) - size))
+
+    graph = wal->graph;
+    wl_close(wal);
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_torn(void)
+{
+    Wal *wal = wl_open(t_log, t_snapshot, 0);
+    mu_assert(wal, "Failed to reopen")
+    off_t whole = size_of(t_log);
+
+    mu_assert(wl_apply(wal, "d", "e") == 0 && wl_commit(wal) == 0, "Failed to apply d > e")
+    mu_assert(size_of(t_log) > whole, "Nothing written")
+    Graph *graph = wal->graph;
+    wl_close(wal);
+    g_free(graph);
+
+    // lose the end of the last frame, as if the write was cut short
+    mu_assert(truncate(t_log, size_of(t_log) - 2) == 0, "Couldn't cut the log")
+
+    wal = wl_open(t_log, t_snapshot, 0);
+    mu_assert(wal, "Failed to open a torn log")
+    mu_assert(!g_lookup(wal->graph, "e"), "Torn frame replayed")
+    mu_assert(related(wal->graph, "c", "b"), "Whole frames not replayed")
+    mu_assert(size_of(t_log) == whole, "Torn frame not cut off")
+
+    // and it carries on from there
+    mu_assert(wl_apply(wal, "d", "e") == 0, "Failed to apply d > e")
+    graph = wal->graph;
+    wl_close(wal);
+    g_free(graph);
+
+    wal = wl_open(t_log, t_snapshot, 0);
+    mu_assert(wal && related(wal->graph, "d", "e"), "Frame after a cut not replayed")
+    graph = wal->graph;
+    wl_close(wal);
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_checkpoint(void)
+{
+    Wal *wal = wl_open(t_log, t_snapshot, 0);
+    mu_assert(wal, "Failed to reopen")
+
+    mu_assert(wl_apply(wal, "e", "f") == 0, "Failed to apply e > f")
+    mu_assert(wl_checkpoint(wal) == 0, "Failed to checkpoint")
+    mu_assert(size_of(t_log) == sizeof(WalHeader), "Log not emptied")
+    mu_assert(wl_apply(wal, "f", "g") == 0, "Failed to apply f > g")
+
+    // saved again without starting the log again, as if it crashed in between
+    mu_assert(wl_commit(wal) == 0, "Failed to commit")
+    mu_assert(wl_apply(wal, "g", "h") == 0, "Failed to apply g > h")
+    mu_assert(g_save(wal->graph, t_snapshot) == 0, "Failed to save")
+    Graph *graph = wal->graph;
+    wl_close(wal);
+    g_free(graph);
+
+    wal = wl_open(t_log, t_snapshot, 0);
+    mu_assert(wal, "Failed to open with a stale log")
+    mu_assert(related(wal->graph, "e", "f") && related(wal->graph, "f", "g") && related(wal->graph, "g", "h"),
+            "Snapshot not loaded")
+    mu_assert(size_of(t_log) == sizeof(WalHeader), "Stale log not emptied")
+    graph = wal->graph;
+    wl_close(wal);
+    g_free(graph);
+
+    // a log that needs a snapshot that's gone
+    wal = wl_open(t_log, t_snapshot, 0);
+    mu_assert(wal && wl_apply(wal, "h", "i") == 0, "Failed to apply h > i")
+    graph = wal->graph;
+    wl_close(wal);
+    g_free(graph);
+    unlink(t_snapshot);
+    mu_assert(wl_open(t_log, t_snapshot, 0) == NULL, "Log opened without its snapshot")
+
+    return NULL;
+}
+
+static char *test_group(void)
+{
+    unlink(t_log);
+    Wal *wal = wl_open(t_log, NULL, 3);
+    mu_assert(wal, "Failed to open")
+
+    char greater[16];
+    char lesser[16];
+    for(int i = 0; i < 7; i++) {
+        snprintf(greater, sizeof(greater), "g%i", i);
+        snprintf(lesser, sizeof(lesser), "g%i", i + 1);
+        mu_assert(wl_apply(wal, greater, lesser) == 0, "Failed to apply %s > %s", greater, lesser)
+    }
+    mu_assert(wal->commits == 2 && wal->pending == 1, "Expected 2 commits and 1 pending, got %lu and %i",
+            wal->commits, wal->pending)
+    mu_assert(wl_checkpoint(wal) == ERR_IO, "Checkpoint without a snapshot should fail")
+
+    Graph *graph = wal->graph;
+    mu_assert(wl_close(wal) == 0, "Failed to close")
+    g_free(graph);
+
+    wal = wl_open(t_log, NULL, 3);
+    mu_assert(wal && wal->graph->length == 8, "Expected 8 values replayed")
+    graph = wal->graph;
+    wl_close(wal);
+    g_free(graph);
+    return NULL;
+}
+
+// Check two graphs have the same values and relations
+static char *check_same(Graph *graph, Graph *expected)
+{
+    mu_assert(graph->length == expected->length, "Expected %i values, got %i", expected->length, graph->length)
+
+    for(Value *value = expected->start; value; value = value->next) {
+        Value *other = g_lookup(graph, value->value);
+        mu_assert(other, "%s missing", value->value)
+        mu_assert(g_degree(graph, other, DIR_LOWER) == g_degree(expected, value, DIR_LOWER),
+                "%s has %i lower values, expected %i", value->value, g_degree(graph, other, DIR_LOWER),
+                g_degree(expected, value, DIR_LOWER))
+
+        for(int i = 0; i < g_degree(expected, value, DIR_LOWER); i++) {
+            char *lesser = g_relation(expected, value, DIR_LOWER, i)->value;
+            mu_assert(related(graph, value->value, lesser), "%s > %s missing", value->value, lesser)
+        }
+    }
+
+    return NULL;
+}
+
+// Relations and removals mixed, including relations taken out and put back the
+//   other way, replayed to the same graph
+static char *test_churn(void)
+{
+    unlink(t_log);
+    Wal *wal = wl_open(t_log, NULL, 16);
+    mu_assert(wal, "Failed to open")
+
+    // removed before the end, but both values stay
+    mu_assert(wl_apply(wal, "x", "y") == 0 && wl_remove(wal, "x", "y") == 0, "Failed to apply and remove x > y")
+    mu_assert(wl_apply(wal, "y", "x") == 0, "Failed to apply y > x after x > y went")
+    mu_assert(wl_apply(wal, "p", "q") == 0 && wl_remove_value(wal, "p") == 0, "Failed to remove p")
+
+    char greater[16];
+    char lesser[16];
+    srand(4);
+    for(int i = 0; i < CHURN_CHANGES; i++) {
+        int a = rand() % CHURN_VALUES;
+        int b = rand() % CHURN_VALUES;
+        snprintf(greater, sizeof(greater), "c%i", a);
+        snprintf(lesser, sizeof(lesser), "c%i", b);
+
+        switch(rand() % 4) {
+            case 0:
+                if(rand() % 8 == 0) wl_remove_value(wal, greater);
+                break;
+            case 1:
+                wl_remove(wal, greater, lesser);
+                break;
+            default:
+                wl_apply(wal, greater, lesser);
+                break;
+        }
+    }
+    mu_assert(!wal->failed && wl_commit(wal) == 0, "Failed to log")
+
+    Graph *graph = wal->graph;
+    mu_assert(wl_close(wal) == 0, "Failed to close")
+
+    wal = wl_open(t_log, NULL, 0);
+    mu_assert(wal, "Failed to replay")
+    mu_assert(g_lookup(wal->graph, "q") && !g_lookup(wal->graph, "p"), "Values of removals not replayed")
+    char *err = check_same(wal->graph, graph);
+    if(err) return err;
+
+    g_free(graph);
+    graph = wal->graph;
+    wl_close(wal);
+    g_free(graph);
+    return NULL;
+}
+
+// Once a change can't be logged nothing more is, even changes that could be
+static char *test_failed(void)
+{
+    unlink(t_log);
+    Wal *wal = wl_open(t_log, t_snapshot, 1);
+    mu_assert(wal && wl_apply(wal, "a", "b") == 0, "Failed to apply a > b")
+
+    // swap the log for a read-only one so the next write fails
+    int fd = open(t_log, O_RDONLY);
+    mu_assert(fd != -1 && dup2(fd, wal->fd) != -1, "Couldn't make the log read-only")
+    close(fd);
+    off_t size = size_of(t_log);
+
+    mu_assert(wl_apply(wal, "b", "c") == ERR_IO && wal->failed, "Failed write should be reported")
+    mu_assert(related(wal->graph, "b", "c"), "Change should still be in the graph")
+    mu_assert(wl_apply(wal, "c", "d") == ERR_IO, "Nothing should be logged after a failure")
+    mu_assert(wl_remove_value(wal, "a") == ERR_IO, "Nothing should be logged after a failure")
+    mu_assert(wl_commit(wal) == ERR_IO && wl_checkpoint(wal) == ERR_IO, "Nothing should be written after a failure")
+    mu_assert(size_of(t_log) == size, "Log grew after a failure")
+
+    Graph *graph = wal->graph;
+    mu_assert(wl_close(wal) == ERR_IO, "Close should report the failure")
+    g_free(graph);
+
+    // what was logged before is still there, and nothing after
+    wal = wl_open(t_log, t_snapshot, 1);
+    mu_assert(wal && related(wal->graph, "a", "b") && wal->graph->length == 2, "Expected only a > b replayed")
+    graph = wal->graph;
+    wl_close(wal);
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_close(void)
+{
+    unlink(t_log);
+    unlink(t_snapshot);
+    rmdir(t_dir);
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_open)
+    mu_run_test(test_replay)
+    mu_run_test(test_torn)
+    mu_run_test(test_checkpoint)
+    mu_run_test(test_group)
+    mu_run_test(test_churn)
+    mu_run_test(test_failed)
+    mu_run_test(test_close)
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)
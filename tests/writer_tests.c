@@ -0,0 +1,148 @@
+// Test buffered output
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "minunit.h"
+#include "../src/writer.h"
+#include "../src/dbg.h"
+
+#define CHAIN 50000
+// Small enough that the chain fills it many times over
+#define BUFFER 4096
+
+mu_suite_start();
+
+static char t_path[] = "/tmp/writer_testsXXXXXX";
+static int t_fd = -1;
+
+// Read back everything written to the temporary file, then empty it
+static char *contents(size_t *length)
+{
+    off_t size = lseek(t_fd, 0, SEEK_END);
+    char *data = malloc((size_t)size + 1);
+    if(!data) return NULL;
+
+    if(pread(t_fd, data, (size_t)size, 0) != size) {
+        free(data);
+        return NULL;
+    }
+    data[size] = '\0';
+    *length = (size_t)size;
+
+    if(ftruncate(t_fd, 0) || lseek(t_fd, 0, SEEK_SET)) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+static char *test_open(void)
+{
+    t_fd = mkstemp(t_path);
+    mu_assert(t_fd != -1, "Couldn't make a temporary file")
+    return NULL;
+}
+
+static char *test_write(void)
+{
+    Writer *writer = new_writer(t_fd, 16);
+    mu_assert(writer, "Writer not created")
+
+    mu_assert(wr_string(writer, "short ") == 0, "Failed to write")
+    mu_assert(wr_string(writer, "and ") == 0, "Failed to write")
+    size_t length = 0;
+    char *data = NULL;
+
+    // still buffered until it's full
+    mu_assert(lseek(t_fd, 0, SEEK_END) == 0, "Written before the buffer filled")
+
+    // bigger than the whole buffer, so it goes straight through after what's buffered
+    mu_assert(wr_string(writer, "a string longer than the buffer") == 0, "Failed to write")
+    mu_assert(wr_write(writer, "!?", 1) == 0, "Failed to write")
+    mu_assert(wr_free(writer) == 0, "Failed to flush")
+
+    data = contents(&length);
+    mu_assert(data, "Couldn't read output back")
+    mu_assert(strcmp(data, "short and a string longer than the buffer!") == 0, "Wrong output: %s", data)
+    free(data);
+
+    return NULL;
+}
+
+static char *test_sorted(void)
+{
+    Graph *graph = new_graph();
+    char greater[16];
+    char lesser[16];
+
+    for(int i = 0; i < CHAIN; i++) {
+        snprintf(greater, sizeof(greater), "c%i", i);
+        snprintf(lesser, sizeof(lesser), "c%i", i + 1);
+        mu_assert(g_apply_relation(graph, greater, lesser) == 0, "Failed to apply %s > %s", greater, lesser)
+    }
+
+    Writer *writer = new_writer(t_fd, BUFFER);
+    mu_assert(writer, "Writer not created")
+    mu_assert(g_write_sorted(graph, writer, ", ") == 0, "Failed to write graph")
+    mu_assert(wr_free(writer) == 0, "Failed to flush")
+
+    // same as joining g_sorted
+    int size = 0;
+    char **sorted = g_sorted(graph, &size);
+    size_t length = 0;
+    char *data = contents(&length);
+    mu_assert(data && sorted, "Couldn't read output back")
+
+    char *cursor = data;
+    for(int i = 0; i < size; i++) {
+        size_t item = strlen(sorted[i]);
+        mu_assert(strncmp(cursor, sorted[i], item) == 0 && strncmp(cursor + item, ", ", 2) == 0,
+                "Value %i isn't %s", i, sorted[i])
+        cursor += item + 2;
+    }
+    mu_assert(cursor == data + length, "Output has %zu bytes left over", (size_t)(data + length - cursor))
+
+    free(data);
+    free(sorted);
+    g_free(graph);
+    return NULL;
+}
+
+static char *test_failed(void)
+{
+    // reading end of nothing, every write fails
+    int fd = open("/dev/null", O_RDONLY);
+    mu_assert(fd != -1, "Couldn't open /dev/null")
+
+    Writer *writer = new_writer(fd, 16);
+    mu_assert(writer, "Writer not created")
+    mu_assert(wr_string(writer, "buffered") == 0, "Buffering shouldn't write")
+    mu_assert(wr_string(writer, " then written") == ERR_IO, "Failed write not reported")
+    mu_assert(wr_string(writer, "x") == ERR_IO, "Writes after a failure should fail")
+    mu_assert(wr_free(writer) == ERR_IO, "Failure not reported on free")
+
+    close(fd);
+    return NULL;
+}
+
+static char *test_close(void)
+{
+    close(t_fd);
+    unlink(t_path);
+    return NULL;
+}
+
+static char *all_tests(void)
+{
+    mu_run_test(test_open)
+    mu_run_test(test_write)
+    mu_run_test(test_sorted)
+    mu_run_test(test_failed)
+    mu_run_test(test_close)
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests)